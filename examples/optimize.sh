@@ -0,0 +1,31 @@
+#!/bin/sh
+# Checks that the scripts print the same with and without optimizing
+# them, and without compiling the closures called often
+
+srcdir=${srcdir:-.}
+status=0
+
+for script in optimize.gel test2.gel test3.gel test4.gel test5.gel \
+    test6.gel test7.gel test8.gel test9.gel
+do
+    ./test "$srcdir/$script" > optimize-plain.out 2>&1
+    GEL_OPTIMIZE=1 ./test "$srcdir/$script" > optimize-optimized.out 2>&1
+    GEL_JIT=0 ./test "$srcdir/$script" > optimize-interpreted.out 2>&1
+
+    if ! cmp -s optimize-plain.out optimize-optimized.out
+    then
+        echo "$script prints something else when optimized:"
+        diff optimize-plain.out optimize-optimized.out
+        status=1
+    fi
+
+    if ! cmp -s optimize-plain.out optimize-interpreted.out
+    then
+        echo "$script prints something else when interpreted:"
+        diff optimize-interpreted.out optimize-plain.out
+        status=1
+    fi
+done
+
+rm -f optimize-plain.out optimize-optimized.out optimize-interpreted.out
+exit $status
@@ -5,6 +5,10 @@
     It's still work in progress.
 */
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <gmodule.h>
 #include <gel.h>
 
 
@@ -36,24 +40,27 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    GError *error = NULL;
-
-    /* parsing a file returns an array of values, unless an error occurs */
-    GelValueArray *parsed_array = gel_parse_file(argv[1], &error);
-
-    /* if an error occurred when parsing ... */
-    if(error != NULL)
+    /* open the file, which will be read as the values are needed */
+    gint fd = open(argv[1], O_RDONLY);
+    if(fd < 0)
     {
-        /* ... then print information about the error */
-        g_print("There was an error parsing '%s'\n", argv[1]);
-        g_print("%s\n", error->message);
-        g_error_free(error);
+        g_printerr("Cannot open '%s'\n", argv[1]);
         return 1;
     }
 
+    GError *error = NULL;
+
+    /* the parser yields the values of the file one at a time */
+    GelParser *parser = gel_parser_new();
+    gel_parser_input_fd(parser, fd);
+
     /* instantiate a context to evaluate the parsed values */
     GelContext *context = gel_context_new();
 
+    /* optimize the code before evaluating it, if asked to */
+    if(g_getenv("GEL_OPTIMIZE") != NULL)
+        gel_context_set_optimize(context, TRUE);
+
     /* insert a function to make it available from the script */
     gel_context_define_function(context, "make-label", make_label, NULL);
 
@@ -63,19 +70,33 @@ int main(int argc, char *argv[])
     g_value_set_string(title_value, "Hello Gtk from Gel");
     gel_context_define(context, "title", title_value);
 
-    /* for each value obtained during the parsing ... */
-    for(guint i = 0; i < gel_value_array_get_n_values(parsed_array); i++)
-    {
-        GValue *iter_value = gel_value_array_get_values(parsed_array) + i;
+    GValue iter_value = {0};
+    gint status = 0;
 
+    /* a script compiled by gelc is evaluated as a whole */
+    if(g_str_has_suffix(argv[1], "." G_MODULE_SUFFIX))
+    {
+        if(!gel_context_load_module(context, argv[1], &error))
+        {
+            g_print("There was an error loading '%s'\n", argv[1]);
+            g_print("%s\n", error->message);
+            g_error_free(error);
+            error = NULL;
+            status = 1;
+        }
+    }
+    else
+    /* for each value obtained from the parser ... */
+    while(gel_parser_next(parser, &iter_value, &error))
+    {
         /* ... print a representation of the value to be evaluated */
-        gchar *value_repr = gel_value_repr(iter_value);
+        gchar *value_repr = gel_value_repr(&iter_value);
         g_print("\n%s ?\n", value_repr);
         g_free(value_repr);
 
         GValue result_value = {0};
         /* if the evaluation yields a value ... */
-        if(gel_context_eval(context, iter_value, &result_value, &error))
+        if(gel_context_eval(context, &iter_value, &result_value, &error))
         {
             /* ... then print the value obtained from the evaluation */
             gchar *value_string = gel_value_to_string(&result_value);
@@ -83,22 +104,37 @@ int main(int argc, char *argv[])
             g_free(value_string);
             g_value_unset(&result_value);
         }
-        else
-        /* else if an error occurred when evaluating ... */
+
+        /* the value is not needed anymore */
+        g_value_unset(&iter_value);
+
+        /* if an error occurred when evaluating ... */
         if(error != NULL)
         {
             /* ... then print information about the error */
             g_print("There was an error evaluating '%s'\n", argv[1]);
             g_print("%s\n", error->message);
             g_error_free(error);
+            error = NULL;
             break;
         }
     }
 
+    /* if an error occurred when parsing ... */
+    if(error != NULL)
+    {
+        /* ... then print information about the error */
+        g_print("There was an error parsing '%s'\n", argv[1]);
+        g_print("%s\n", error->message);
+        g_error_free(error);
+        status = 1;
+    }
+
     /* free the resources before exit */
-    gel_value_array_free(parsed_array);
+    gel_parser_free(parser);
     gel_context_free(context);
+    close(fd);
 
-    return 0;
+    return status;
 }
 
@@ -12,7 +12,7 @@ int main(string[] args) {
         return 1;
     }
 
-    ValueArray parsed_array;
+    Gel.ValueArray parsed_array;
     try {
         // parsing a file returns an array of values
         parsed_array = Gel.parse_file(args[1]);
@@ -6,6 +6,7 @@
 #include <gelvalue.h>
 #include <gelclosure.h>
 #include <gelarray.h>
+#include <gelmodule.h>
 
 #endif
 
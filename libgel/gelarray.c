@@ -0,0 +1,881 @@
+#include <string.h>
+
+#include <gelarray.h>
+#include <gelarrayprivate.h>
+#include <gelvalue.h>
+#include <gelvalueprivate.h>
+
+
+/*
+ * Arrays start without a storage. The first value appended decides how the
+ * values are kept: integers, doubles and booleans are stored unboxed in a
+ * packed buffer, anything else is stored as GValues.
+ * As soon as a value of a different type is stored in a packed array, or
+ * someone asks for its values as GValues, the array moves to the generic
+ * storage and stays there.
+ *
+ * Arrays of parsed code are views of a list node in a #GelAst, and move to
+ * the generic storage the same way, their lists becoming views themselves.
+ */
+
+
+static
+GelArrayStorage gel_value_array_storage_for(const GValue *value)
+{
+    if(value == NULL || !GEL_IS_VALUE(value))
+        return GEL_ARRAY_STORAGE_GENERIC;
+
+    switch(GEL_VALUE_TYPE(value))
+    {
+        case G_TYPE_INT64:
+            return GEL_ARRAY_STORAGE_INT64;
+        case G_TYPE_DOUBLE:
+            return GEL_ARRAY_STORAGE_DOUBLE;
+        case G_TYPE_BOOLEAN:
+            return GEL_ARRAY_STORAGE_BOOLEAN;
+        default:
+            return GEL_ARRAY_STORAGE_GENERIC;
+    }
+}
+
+
+static
+gsize gel_value_array_buffer_size(GelArrayStorage storage, guint n_values)
+{
+    switch(storage)
+    {
+        case GEL_ARRAY_STORAGE_GENERIC:
+            return sizeof(GValue) * n_values;
+        case GEL_ARRAY_STORAGE_INT64:
+            return sizeof(gint64) * n_values;
+        case GEL_ARRAY_STORAGE_DOUBLE:
+            return sizeof(gdouble) * n_values;
+        case GEL_ARRAY_STORAGE_BOOLEAN:
+            return sizeof(guint32) * ((n_values + 31) / 32);
+        default:
+            return 0;
+    }
+}
+
+
+static
+void gel_value_array_set_boolean(GelValueArray *self, guint index,
+                                 gboolean value)
+{
+    if(value)
+        self->data.bits[index / 32] |= 1U << (index % 32);
+    else
+        self->data.bits[index / 32] &= ~(1U << (index % 32));
+}
+
+
+static
+void gel_value_array_grow(GelValueArray *self, guint n_values)
+{
+    if(n_values <= self->n_prealloced && self->data.data != NULL)
+        return;
+
+    guint n_prealloced = MAX(n_values, self->n_prealloced);
+    if(self->data.data != NULL)
+        n_prealloced = MAX(n_prealloced, self->n_prealloced * 2);
+    n_prealloced = MAX(n_prealloced, 1);
+
+    gsize old_size =
+        self->data.data != NULL
+        ? gel_value_array_buffer_size(self->storage, self->n_prealloced)
+        : 0;
+    gsize new_size = gel_value_array_buffer_size(self->storage, n_prealloced);
+
+    self->data.data = g_realloc(self->data.data, new_size);
+    memset((guint8*)self->data.data + old_size, 0, new_size - old_size);
+    self->n_prealloced = n_prealloced;
+}
+
+
+static
+void gel_value_array_deoptimize(GelValueArray *self)
+{
+    if(self->storage == GEL_ARRAY_STORAGE_GENERIC)
+        return;
+
+    if(self->storage == GEL_ARRAY_STORAGE_AST)
+    {
+        GelAst *ast = self->data.ast;
+        GValue *values = g_new0(GValue, MAX(self->n_values, 1));
+
+        for(guint i = 0; i < self->n_values; i++)
+            gel_ast_get_value(ast,
+                gel_ast_get_child(ast, self->ast_node, i), values + i);
+
+        /* The arena is kept to know where the code came from */
+        self->origin = ast;
+        self->data.values = values;
+        self->n_prealloced = MAX(self->n_values, 1);
+        self->storage = GEL_ARRAY_STORAGE_GENERIC;
+        return;
+    }
+
+    guint n_prealloced = MAX(self->n_prealloced, self->n_values);
+    GValue *values = g_new0(GValue, MAX(n_prealloced, 1));
+
+    for(guint i = 0; i < self->n_values; i++)
+        gel_value_array_get_value(self, i, values + i);
+
+    g_free(self->data.data);
+    self->data.values = values;
+    self->n_prealloced = MAX(n_prealloced, 1);
+    self->storage = GEL_ARRAY_STORAGE_GENERIC;
+}
+
+
+GType gel_value_array_get_type(void)
+{
+    static volatile gsize once = 0;
+    static GType type = G_TYPE_INVALID;
+
+    if(g_once_init_enter(&once))
+    {
+        type = g_boxed_type_register_static("GelValueArray",
+            (GBoxedCopyFunc)gel_value_array_copy,
+            (GBoxedFreeFunc)gel_value_array_free);
+        g_once_init_leave(&once, 1);
+    }
+
+    return type;
+}
+
+
+/**
+ * gel_value_array_new:
+ * @n_prealloced: number of values to preallocate space for
+ *
+ * Creates a new, empty #GelValueArray.
+ * The way values are stored is decided when the first value is appended.
+ *
+ * Returns: a new #GelValueArray
+ */
+GelValueArray* gel_value_array_new(guint n_prealloced)
+{
+    GelValueArray *self = g_slice_new0(GelValueArray);
+    self->n_prealloced = n_prealloced;
+    self->storage = GEL_ARRAY_STORAGE_EMPTY;
+
+    return self;
+}
+
+
+GelValueArray* gel_value_array_new_packed(GelArrayStorage storage,
+                                          guint n_values)
+{
+    GelValueArray *self = gel_value_array_new(n_values);
+    self->storage = storage;
+    gel_value_array_grow(self, n_values);
+    self->n_values = n_values;
+
+    return self;
+}
+
+
+/*
+ * Creates an array with the children of @node, which must be a list of @ast.
+ */
+GelValueArray* gel_value_array_new_ast(GelAst *ast, guint node)
+{
+    GelValueArray *self = g_slice_new0(GelValueArray);
+    self->n_values = gel_ast_get_n_children(ast, node);
+    self->storage = GEL_ARRAY_STORAGE_AST;
+    self->ast_node = node;
+    self->data.ast = gel_ast_ref(ast);
+
+    return self;
+}
+
+
+/*
+ * Gets the #GelAst @self is a view of, and the list node it shows in @node,
+ * or NULL if @self is not a view.
+ */
+GelAst* gel_value_array_peek_ast(const GelValueArray *self, guint *node)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+
+    if(self->storage != GEL_ARRAY_STORAGE_AST)
+        return NULL;
+
+    *node = self->ast_node;
+    return self->data.ast;
+}
+
+
+/*
+ * Gets the #GelAst the code in @self was parsed into, and its list node
+ * in @node, or NULL if @self does not come from parsed code.
+ * Unlike gel_value_array_peek_ast(), arrays that are no longer views
+ * still give the code they were made from.
+ */
+GelAst* gel_value_array_peek_origin(const GelValueArray *self, guint *node)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+
+    *node = self->ast_node;
+    if(self->storage == GEL_ARRAY_STORAGE_AST)
+        return self->data.ast;
+
+    return self->origin;
+}
+
+
+/*
+ * Gets how the values of @self are stored.
+ * Views of parsed code are converted to GValues first,
+ * since callers use this to decide how to read them.
+ */
+GelArrayStorage gel_value_array_get_storage(const GelValueArray *self)
+{
+    g_return_val_if_fail(self != NULL, GEL_ARRAY_STORAGE_GENERIC);
+
+    if(self->storage == GEL_ARRAY_STORAGE_AST)
+        gel_value_array_deoptimize((GelValueArray*)self);
+
+    return self->storage;
+}
+
+
+/**
+ * gel_value_array_copy:
+ * @self: a #GelValueArray
+ *
+ * Creates a copy of @self, copying each of its values.
+ *
+ * Returns: a new #GelValueArray
+ */
+GelValueArray* gel_value_array_copy(const GelValueArray *self)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+
+    if(self->storage == GEL_ARRAY_STORAGE_AST)
+        return gel_value_array_new_ast(self->data.ast, self->ast_node);
+
+    GelValueArray *copy = gel_value_array_new(self->n_values);
+    copy->storage = self->storage;
+
+    if(self->origin != NULL)
+    {
+        copy->origin = gel_ast_ref(self->origin);
+        copy->ast_node = self->ast_node;
+    }
+
+    if(self->storage == GEL_ARRAY_STORAGE_EMPTY || self->n_values == 0)
+        return copy;
+
+    gel_value_array_grow(copy, self->n_values);
+    copy->n_values = self->n_values;
+
+    if(self->storage == GEL_ARRAY_STORAGE_GENERIC)
+        for(guint i = 0; i < self->n_values; i++)
+        {
+            if(GEL_IS_VALUE(self->data.values + i))
+                gel_value_copy(self->data.values + i, copy->data.values + i);
+        }
+    else
+        memcpy(copy->data.data, self->data.data,
+            gel_value_array_buffer_size(self->storage, self->n_values));
+
+    return copy;
+}
+
+
+/**
+ * gel_value_array_free:
+ * @self: a #GelValueArray
+ *
+ * Frees @self and all of its values.
+ */
+void gel_value_array_free(GelValueArray *self)
+{
+    g_return_if_fail(self != NULL);
+
+    if(self->storage == GEL_ARRAY_STORAGE_GENERIC)
+        for(guint i = 0; i < self->n_values; i++)
+            if(GEL_IS_VALUE(self->data.values + i))
+                g_value_unset(self->data.values + i);
+
+    if(self->storage == GEL_ARRAY_STORAGE_AST)
+        gel_ast_unref(self->data.ast);
+    else
+        g_free(self->data.data);
+
+    if(self->origin != NULL)
+        gel_ast_unref(self->origin);
+    g_slice_free(GelValueArray, self);
+}
+
+
+/**
+ * gel_value_array_get_location:
+ * @self: a #GelValueArray
+ * @file: return location for the file @self was read from, or NULL.
+ * It is set to NULL when @self was not read from a file.
+ * @line: return location for the line, or NULL
+ * @column: return location for the column, or NULL
+ *
+ * Gets where @self was opened in the code it was parsed from.
+ * The location is only looked up when asked for.
+ *
+ * Returns: %TRUE if @self was parsed and its location is known,
+ * %FALSE otherwise.
+ */
+gboolean gel_value_array_get_location(const GelValueArray *self,
+                                      const gchar **file,
+                                      guint *line, guint *column)
+{
+    g_return_val_if_fail(self != NULL, FALSE);
+
+    const GelAst *ast = self->storage == GEL_ARRAY_STORAGE_AST
+        ? self->data.ast : self->origin;
+
+    if(ast == NULL)
+        return FALSE;
+
+    return gel_ast_get_span(ast, self->ast_node, file, line, column);
+}
+
+
+/**
+ * gel_value_array_get_n_values:
+ * @self: a #GelValueArray
+ *
+ * Returns: the number of values in @self
+ */
+guint gel_value_array_get_n_values(const GelValueArray *self)
+{
+    g_return_val_if_fail(self != NULL, 0);
+
+    return self->n_values;
+}
+
+
+/**
+ * gel_value_array_set_n_values:
+ * @self: a #GelValueArray
+ * @n_values: the new number of values
+ *
+ * Changes the number of values in @self.
+ * New values are left unset, values beyond @n_values are unset.
+ */
+void gel_value_array_set_n_values(GelValueArray *self, guint n_values)
+{
+    g_return_if_fail(self != NULL);
+
+    gel_value_array_deoptimize(self);
+    gel_value_array_grow(self, n_values);
+
+    for(guint i = n_values; i < self->n_values; i++)
+        if(GEL_IS_VALUE(self->data.values + i))
+            g_value_unset(self->data.values + i);
+
+    self->n_values = n_values;
+}
+
+
+/**
+ * gel_value_array_get_values:
+ * @self: a #GelValueArray
+ *
+ * Gets the values of @self as a C array of #GValue.
+ * Arrays holding unboxed values are converted to hold #GValue
+ * the first time this is called on them.
+ *
+ * Returns: the values of @self
+ */
+GValue* gel_value_array_get_values(const GelValueArray *self)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+
+    gel_value_array_deoptimize((GelValueArray*)self);
+    return self->data.values;
+}
+
+
+/*
+ * Copies the value at @index to @dest_value, which must be unset.
+ * Unlike gel_value_array_get_values(), it does not change the storage.
+ */
+void gel_value_array_get_value(const GelValueArray *self, guint index,
+                               GValue *dest_value)
+{
+    g_return_if_fail(self != NULL);
+    g_return_if_fail(index < self->n_values);
+
+    switch(self->storage)
+    {
+        case GEL_ARRAY_STORAGE_INT64:
+            g_value_init(dest_value, G_TYPE_INT64);
+            gel_value_set_int64(dest_value, self->data.ints[index]);
+            break;
+        case GEL_ARRAY_STORAGE_DOUBLE:
+            g_value_init(dest_value, G_TYPE_DOUBLE);
+            gel_value_set_double(dest_value, self->data.doubles[index]);
+            break;
+        case GEL_ARRAY_STORAGE_BOOLEAN:
+            g_value_init(dest_value, G_TYPE_BOOLEAN);
+            gel_value_set_boolean(dest_value,
+                gel_value_array_peek_boolean(self, index));
+            break;
+        case GEL_ARRAY_STORAGE_AST:
+            gel_ast_get_value(self->data.ast,
+                gel_ast_get_child(self->data.ast, self->ast_node, index),
+                dest_value);
+            break;
+        default:
+            if(GEL_IS_VALUE(self->data.values + index))
+                gel_value_copy(self->data.values + index, dest_value);
+    }
+}
+
+
+/*
+ * Stores @value at @index the same way gel_value_copy() would store it
+ * in the existing value, moving to the generic storage only if the
+ * resulting value can not be kept unboxed.
+ */
+void gel_value_array_set_value(GelValueArray *self, guint index,
+                               const GValue *value)
+{
+    g_return_if_fail(self != NULL);
+    g_return_if_fail(index < self->n_values);
+    g_return_if_fail(value != NULL);
+
+    if(self->storage == GEL_ARRAY_STORAGE_AST)
+        gel_value_array_deoptimize(self);
+
+    if(self->storage != GEL_ARRAY_STORAGE_GENERIC)
+    {
+        GValue tmp_value = {0};
+        gel_value_array_get_value(self, index, &tmp_value);
+        gel_value_copy(value, &tmp_value);
+
+        if(gel_value_array_storage_for(&tmp_value) == self->storage)
+        {
+            switch(self->storage)
+            {
+                case GEL_ARRAY_STORAGE_INT64:
+                    self->data.ints[index] = gel_value_get_int64(&tmp_value);
+                    break;
+                case GEL_ARRAY_STORAGE_DOUBLE:
+                    self->data.doubles[index] =
+                        gel_value_get_double(&tmp_value);
+                    break;
+                default:
+                    gel_value_array_set_boolean(self, index,
+                        gel_value_get_boolean(&tmp_value));
+            }
+            g_value_unset(&tmp_value);
+            return;
+        }
+
+        gel_value_array_deoptimize(self);
+        g_value_unset(self->data.values + index);
+        *(self->data.values + index) = tmp_value;
+        return;
+    }
+
+    gel_value_copy(value, self->data.values + index);
+}
+
+
+/**
+ * gel_value_array_append:
+ * @self: a #GelValueArray
+ * @value: a #GValue to append, or %NULL to append an unset value
+ *
+ * Appends a copy of @value to @self.
+ *
+ * Returns: @self
+ */
+GelValueArray* gel_value_array_append(GelValueArray *self,
+                                      const GValue *value)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+
+    GelArrayStorage storage = gel_value_array_storage_for(value);
+    if(self->storage == GEL_ARRAY_STORAGE_EMPTY)
+        self->storage = storage;
+    else
+    if(self->storage != storage)
+        gel_value_array_deoptimize(self);
+
+    gel_value_array_grow(self, self->n_values + 1);
+    guint index = self->n_values++;
+
+    switch(self->storage)
+    {
+        case GEL_ARRAY_STORAGE_INT64:
+            self->data.ints[index] = gel_value_get_int64(value);
+            break;
+        case GEL_ARRAY_STORAGE_DOUBLE:
+            self->data.doubles[index] = gel_value_get_double(value);
+            break;
+        case GEL_ARRAY_STORAGE_BOOLEAN:
+            gel_value_array_set_boolean(self, index,
+                gel_value_get_boolean(value));
+            break;
+        default:
+            if(value != NULL && GEL_IS_VALUE(value))
+                gel_value_copy(value, self->data.values + index);
+    }
+
+    return self;
+}
+
+
+/*
+ * Appends @value to @self, without going through a #GValue
+ * when @self is empty or already packs integers.
+ */
+GelValueArray* gel_value_array_append_int64(GelValueArray *self, gint64 value)
+{
+    if(self->storage != GEL_ARRAY_STORAGE_EMPTY
+        && self->storage != GEL_ARRAY_STORAGE_INT64)
+    {
+        GValue tmp_value = {0};
+        g_value_init(&tmp_value, G_TYPE_INT64);
+        gel_value_set_int64(&tmp_value, value);
+        return gel_value_array_take(self, &tmp_value);
+    }
+
+    self->storage = GEL_ARRAY_STORAGE_INT64;
+    gel_value_array_grow(self, self->n_values + 1);
+    self->data.ints[self->n_values++] = value;
+
+    return self;
+}
+
+
+/*
+ * Appends @value to @self, without going through a #GValue
+ * when @self is empty or already packs doubles.
+ */
+GelValueArray* gel_value_array_append_double(GelValueArray *self,
+                                             gdouble value)
+{
+    if(self->storage != GEL_ARRAY_STORAGE_EMPTY
+        && self->storage != GEL_ARRAY_STORAGE_DOUBLE)
+    {
+        GValue tmp_value = {0};
+        g_value_init(&tmp_value, G_TYPE_DOUBLE);
+        gel_value_set_double(&tmp_value, value);
+        return gel_value_array_take(self, &tmp_value);
+    }
+
+    self->storage = GEL_ARRAY_STORAGE_DOUBLE;
+    gel_value_array_grow(self, self->n_values + 1);
+    self->data.doubles[self->n_values++] = value;
+
+    return self;
+}
+
+
+/*
+ * Appends @value to @self as #gel_value_array_append does, but moving it
+ * instead of copying it. @value is left unset.
+ */
+GelValueArray* gel_value_array_take(GelValueArray *self, GValue *value)
+{
+    if(gel_value_array_storage_for(value) != GEL_ARRAY_STORAGE_GENERIC)
+    {
+        gel_value_array_append(self, value);
+        g_value_unset(value);
+        return self;
+    }
+
+    if(self->storage == GEL_ARRAY_STORAGE_EMPTY)
+        self->storage = GEL_ARRAY_STORAGE_GENERIC;
+    else
+    if(self->storage != GEL_ARRAY_STORAGE_GENERIC)
+        gel_value_array_deoptimize(self);
+
+    gel_value_array_grow(self, self->n_values + 1);
+    self->data.values[self->n_values++] = *value;
+    memset(value, 0, sizeof(GValue));
+
+    return self;
+}
+
+
+/**
+ * gel_value_array_remove:
+ * @self: a #GelValueArray
+ * @index: the position of the value to remove
+ *
+ * Removes the value at @index from @self.
+ *
+ * Returns: @self
+ */
+GelValueArray* gel_value_array_remove(GelValueArray *self, guint index)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+    g_return_val_if_fail(index < self->n_values, self);
+
+    if(self->storage == GEL_ARRAY_STORAGE_AST)
+        gel_value_array_deoptimize(self);
+
+    switch(self->storage)
+    {
+        case GEL_ARRAY_STORAGE_BOOLEAN:
+            for(guint i = index + 1; i < self->n_values; i++)
+                gel_value_array_set_boolean(self, i - 1,
+                    gel_value_array_peek_boolean(self, i));
+            break;
+        case GEL_ARRAY_STORAGE_GENERIC:
+            if(GEL_IS_VALUE(self->data.values + index))
+                g_value_unset(self->data.values + index);
+            memmove(self->data.values + index, self->data.values + index + 1,
+                sizeof(GValue) * (self->n_values - index - 1));
+            memset(self->data.values + self->n_values - 1, 0, sizeof(GValue));
+            break;
+        default:
+        {
+            /* gint64 and gdouble have the same size */
+            gint64 *ints = self->data.ints;
+            memmove(ints + index, ints + index + 1,
+                sizeof(gint64) * (self->n_values - index - 1));
+        }
+    }
+
+    self->n_values--;
+    return self;
+}
+
+
+static
+gint gel_value_array_compare(gconstpointer a, gconstpointer b,
+                             gpointer user_data)
+{
+    return ((GCompareFunc)user_data)(a, b);
+}
+
+
+/**
+ * gel_value_array_sort:
+ * @self: a #GelValueArray
+ * @compare_func: a function comparing two #GValue
+ *
+ * Sorts @self using @compare_func.
+ *
+ * Returns: @self
+ */
+GelValueArray* gel_value_array_sort(GelValueArray *self,
+                                    GCompareFunc compare_func)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+    g_return_val_if_fail(compare_func != NULL, self);
+
+    if(self->n_values > 0)
+        g_qsort_with_data(gel_value_array_get_values(self),
+            self->n_values, sizeof(GValue),
+            gel_value_array_compare, compare_func);
+
+    return self;
+}
+
+
+static
+gint gel_value_array_compare_int64s(gconstpointer a, gconstpointer b,
+                                    gpointer user_data)
+{
+    gint64 i1 = *(const gint64*)a;
+    gint64 i2 = *(const gint64*)b;
+    gint result = i1 < i2 ? -1 : i1 > i2 ? 1 : 0;
+
+    return GPOINTER_TO_INT(user_data) ? -result : result;
+}
+
+
+static
+gint gel_value_array_compare_doubles(gconstpointer a, gconstpointer b,
+                                     gpointer user_data)
+{
+    gdouble d1 = *(const gdouble*)a;
+    gdouble d2 = *(const gdouble*)b;
+    gint result = d1 < d2 ? -1 : d1 > d2 ? 1 : 0;
+
+    return GPOINTER_TO_INT(user_data) ? -result : result;
+}
+
+
+/*
+ * Sorts the unboxed values of @self in ascending order, or descending
+ * if @reverse is %TRUE, without going through GValues.
+ * Returns %FALSE without touching @self if it does not hold numbers.
+ */
+gboolean gel_value_array_sort_packed(GelValueArray *self, gboolean reverse)
+{
+    g_return_val_if_fail(self != NULL, FALSE);
+
+    switch(self->storage)
+    {
+        case GEL_ARRAY_STORAGE_INT64:
+            g_qsort_with_data(self->data.ints, self->n_values,
+                sizeof(gint64), gel_value_array_compare_int64s,
+                GINT_TO_POINTER(reverse));
+            return TRUE;
+        case GEL_ARRAY_STORAGE_DOUBLE:
+            g_qsort_with_data(self->data.doubles, self->n_values,
+                sizeof(gdouble), gel_value_array_compare_doubles,
+                GINT_TO_POINTER(reverse));
+            return TRUE;
+        case GEL_ARRAY_STORAGE_EMPTY:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+
+/*
+ * Creates a new array with the values of @a1 followed by those of @a2,
+ * keeping them unboxed when both arrays use the same packed storage.
+ */
+GelValueArray* gel_value_array_concat(const GelValueArray *a1,
+                                      const GelValueArray *a2)
+{
+    g_return_val_if_fail(a1 != NULL, NULL);
+    g_return_val_if_fail(a2 != NULL, NULL);
+
+    guint n1_values = a1->n_values;
+    guint n2_values = a2->n_values;
+
+    if(a1->storage == a2->storage
+        && (a1->storage == GEL_ARRAY_STORAGE_INT64
+            || a1->storage == GEL_ARRAY_STORAGE_DOUBLE))
+    {
+        GelValueArray *self =
+            gel_value_array_new_packed(a1->storage, n1_values + n2_values);
+        memcpy(self->data.ints, a1->data.ints, sizeof(gint64) * n1_values);
+        memcpy(self->data.ints + n1_values, a2->data.ints,
+            sizeof(gint64) * n2_values);
+        return self;
+    }
+
+    GelValueArray *self = gel_value_array_new(n1_values + n2_values);
+    GValue tmp_value = {0};
+
+    for(guint i = 0; i < n1_values; i++)
+    {
+        gel_value_array_get_value(a1, i, &tmp_value);
+        gel_value_array_append(self, &tmp_value);
+        if(GEL_IS_VALUE(&tmp_value))
+            g_value_unset(&tmp_value);
+    }
+
+    for(guint i = 0; i < n2_values; i++)
+    {
+        gel_value_array_get_value(a2, i, &tmp_value);
+        gel_value_array_append(self, &tmp_value);
+        if(GEL_IS_VALUE(&tmp_value))
+            g_value_unset(&tmp_value);
+    }
+
+    return self;
+}
+
+
+/*
+ * Gets the packed storage that can hold every value of @self as a number:
+ * %GEL_ARRAY_STORAGE_INT64 if they are all integers (or there are none),
+ * %GEL_ARRAY_STORAGE_DOUBLE if they are integers and doubles, or
+ * %GEL_ARRAY_STORAGE_GENERIC if some of them are not numbers.
+ */
+GelArrayStorage gel_value_array_get_numeric_storage(const GelValueArray *self)
+{
+    g_return_val_if_fail(self != NULL, GEL_ARRAY_STORAGE_GENERIC);
+
+    switch(gel_value_array_get_storage(self))
+    {
+        case GEL_ARRAY_STORAGE_EMPTY:
+        case GEL_ARRAY_STORAGE_INT64:
+            return GEL_ARRAY_STORAGE_INT64;
+        case GEL_ARRAY_STORAGE_DOUBLE:
+            return GEL_ARRAY_STORAGE_DOUBLE;
+        case GEL_ARRAY_STORAGE_BOOLEAN:
+            return GEL_ARRAY_STORAGE_GENERIC;
+        default:
+            break;
+    }
+
+    GelArrayStorage storage = GEL_ARRAY_STORAGE_INT64;
+    for(guint i = 0; i < self->n_values; i++)
+        switch(gel_value_array_storage_for(self->data.values + i))
+        {
+            case GEL_ARRAY_STORAGE_INT64:
+                break;
+            case GEL_ARRAY_STORAGE_DOUBLE:
+                storage = GEL_ARRAY_STORAGE_DOUBLE;
+                break;
+            default:
+                return GEL_ARRAY_STORAGE_GENERIC;
+        }
+
+    return storage;
+}
+
+
+/*
+ * Creates a copy of @self packed as @storage, which must be
+ * %GEL_ARRAY_STORAGE_INT64 or %GEL_ARRAY_STORAGE_DOUBLE and be able
+ * to hold every value, as told by gel_value_array_get_numeric_storage().
+ */
+GelValueArray* gel_value_array_to_numeric(const GelValueArray *self,
+                                          GelArrayStorage storage)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+    g_return_val_if_fail(storage == GEL_ARRAY_STORAGE_INT64
+        || storage == GEL_ARRAY_STORAGE_DOUBLE, NULL);
+
+    if(self->storage == GEL_ARRAY_STORAGE_AST)
+        gel_value_array_deoptimize((GelValueArray*)self);
+
+    GelValueArray *array = gel_value_array_new_packed(storage, self->n_values);
+    gint64 *ints = array->data.ints;
+    gdouble *doubles = array->data.doubles;
+
+    for(guint i = 0; i < self->n_values; i++)
+    {
+        gint64 int_value = 0;
+        gdouble double_value = 0;
+
+        switch(self->storage)
+        {
+            case GEL_ARRAY_STORAGE_INT64:
+                int_value = self->data.ints[i];
+                double_value = int_value;
+                break;
+            case GEL_ARRAY_STORAGE_DOUBLE:
+                double_value = self->data.doubles[i];
+                int_value = double_value;
+                break;
+            default:
+            {
+                const GValue *value = self->data.values + i;
+                if(GEL_VALUE_TYPE(value) == G_TYPE_INT64)
+                {
+                    int_value = gel_value_get_int64(value);
+                    double_value = int_value;
+                }
+                else
+                {
+                    double_value = gel_value_get_double(value);
+                    int_value = double_value;
+                }
+            }
+        }
+
+        if(storage == GEL_ARRAY_STORAGE_INT64)
+            ints[i] = int_value;
+        else
+            doubles[i] = double_value;
+    }
+
+    return array;
+}
@@ -1,17 +1,28 @@
 #ifndef __GEL_ARRAY_H__
 #define __GEL_ARRAY_H__
 
-typedef GValueArray GelValueArray;
+#include <glib-object.h>
 
-#define GEL_TYPE_VALUE_ARRAY G_TYPE_VALUE_ARRAY
-#define gel_value_array_new g_value_array_new
-#define gel_value_array_copy g_value_array_copy
-#define gel_value_array_free g_value_array_free
-#define gel_value_array_get_n_values(array) ((array)->n_values)
-#define gel_value_array_set_n_values(array, n) ((array)->n_values = (n))
-#define gel_value_array_get_values(array) ((array)->values)
-#define gel_value_array_append g_value_array_append
-#define gel_value_array_remove g_value_array_remove
-#define gel_value_array_sort g_value_array_sort
+typedef struct _GelValueArray GelValueArray;
+
+#define GEL_TYPE_VALUE_ARRAY (gel_value_array_get_type())
+GType gel_value_array_get_type(void) G_GNUC_CONST;
+
+GelValueArray* gel_value_array_new(guint n_prealloced);
+GelValueArray* gel_value_array_copy(const GelValueArray *self);
+void gel_value_array_free(GelValueArray *self);
+
+guint gel_value_array_get_n_values(const GelValueArray *self);
+void gel_value_array_set_n_values(GelValueArray *self, guint n_values);
+GValue* gel_value_array_get_values(const GelValueArray *self);
+gboolean gel_value_array_get_location(const GelValueArray *self,
+                                      const gchar **file,
+                                      guint *line, guint *column);
+
+GelValueArray* gel_value_array_append(GelValueArray *self,
+                                      const GValue *value);
+GelValueArray* gel_value_array_remove(GelValueArray *self, guint index);
+GelValueArray* gel_value_array_sort(GelValueArray *self,
+                                    GCompareFunc compare_func);
 
 #endif
@@ -0,0 +1,68 @@
+#ifndef __GEL_ARRAY_PRIVATE_H__
+#define __GEL_ARRAY_PRIVATE_H__
+
+#include <glib-object.h>
+
+#include <gelarray.h>
+#include <gelast.h>
+
+typedef enum _GelArrayStorage
+{
+    GEL_ARRAY_STORAGE_EMPTY,
+    GEL_ARRAY_STORAGE_GENERIC,
+    GEL_ARRAY_STORAGE_INT64,
+    GEL_ARRAY_STORAGE_DOUBLE,
+    GEL_ARRAY_STORAGE_BOOLEAN,
+    GEL_ARRAY_STORAGE_AST
+} GelArrayStorage;
+
+struct _GelValueArray
+{
+    guint n_values;
+    guint n_prealloced;
+    GelArrayStorage storage;
+    guint ast_node;
+    GelAst *origin;
+    union
+    {
+        GValue *values;
+        gint64 *ints;
+        gdouble *doubles;
+        guint32 *bits;
+        gpointer data;
+        GelAst *ast;
+    } data;
+};
+
+#define gel_value_array_peek_data(array) ((array)->data.data)
+#define gel_value_array_peek_int64s(array) ((array)->data.ints)
+#define gel_value_array_peek_doubles(array) ((array)->data.doubles)
+#define gel_value_array_peek_boolean(array, i) \
+    ((((array)->data.bits[(i) / 32]) >> ((i) % 32)) & 1)
+
+GelValueArray* gel_value_array_new_packed(GelArrayStorage storage,
+                                          guint n_values);
+GelValueArray* gel_value_array_new_ast(GelAst *ast, guint node);
+GelAst* gel_value_array_peek_ast(const GelValueArray *self, guint *node);
+GelAst* gel_value_array_peek_origin(const GelValueArray *self, guint *node);
+
+GelArrayStorage gel_value_array_get_storage(const GelValueArray *self);
+
+void gel_value_array_get_value(const GelValueArray *self, guint index,
+                               GValue *dest_value);
+void gel_value_array_set_value(GelValueArray *self, guint index,
+                               const GValue *value);
+GelValueArray* gel_value_array_take(GelValueArray *self, GValue *value);
+GelValueArray* gel_value_array_append_int64(GelValueArray *self, gint64 value);
+GelValueArray* gel_value_array_append_double(GelValueArray *self,
+                                             gdouble value);
+
+GelValueArray* gel_value_array_concat(const GelValueArray *a1,
+                                      const GelValueArray *a2);
+gboolean gel_value_array_sort_packed(GelValueArray *self, gboolean reverse);
+
+GelArrayStorage gel_value_array_get_numeric_storage(const GelValueArray *self);
+GelValueArray* gel_value_array_to_numeric(const GelValueArray *self,
+                                          GelArrayStorage storage);
+
+#endif
@@ -0,0 +1,901 @@
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <gelast.h>
+#include <gelarrayprivate.h>
+#include <gelsymbol.h>
+#include <gelvalue.h>
+#include <gelvalueprivate.h>
+
+#ifndef GEL_AST_N_PREALLOCATED
+#define GEL_AST_N_PREALLOCATED 256
+#endif
+
+#define GEL_AST_FILE_MAGIC "GELC"
+#define GEL_AST_FILE_VERSION 3
+#define GEL_AST_FILE_BYTE_ORDER 0x01020304
+
+
+/*
+ * Parsed code is kept in an arena of compact nodes instead of a tree of
+ * GValues. Every node takes 16 bytes: literals hold their value, symbols
+ * and strings hold the offset of a name interned in the arena, and lists
+ * hold the offset of their children in a shared table of node indices.
+ *
+ * Nodes are only appended, never modified, so the index of a node stays
+ * valid while the arena lives. Arrays of code are created as views of a
+ * list node (see gel_value_array_new_ast()) which turn into GValues only
+ * when someone asks for them, so code that is never evaluated nor
+ * inspected never leaves the arena. The arena is released in one go when
+ * the parser and the last of its views are gone.
+ *
+ * Since nodes hold no pointers, an arena can be saved as is and mapped
+ * back from the file, see gel_ast_save() and gel_ast_load().
+ *
+ * Where lists were read is kept aside in a table of spans sorted by node,
+ * so nodes do not grow and only whoever asks for a location pays for it.
+ */
+
+typedef struct _GelAstNode GelAstNode;
+
+struct _GelAstNode
+{
+    GelAstKind kind;
+    guint n_children;
+    union
+    {
+        gint64 v_int64;
+        gdouble v_double;
+        guint v_name;
+        guint v_value;
+        guint v_children;
+    } data;
+};
+
+typedef struct _GelAstSpan GelAstSpan;
+
+struct _GelAstSpan
+{
+    guint node;
+    guint line;
+    guint column;
+};
+
+/*
+ * A saved arena is this header followed by the nodes,
+ * the table of children, the spans and the names.
+ */
+typedef struct _GelAstFileHeader GelAstFileHeader;
+
+struct _GelAstFileHeader
+{
+    gchar magic[4];
+    guint32 version;
+    guint32 byte_order;
+    guint32 root;
+    GelAstStamp stamp;
+    guint32 n_nodes;
+    guint32 n_children;
+    guint32 n_spans;
+    guint32 names_size;
+};
+
+struct _GelAst
+{
+    volatile gint ref_count;
+
+    GelAstNode *nodes;
+    guint n_nodes;
+    guint n_nodes_prealloced;
+
+    guint *children;
+    guint n_children;
+    guint n_children_prealloced;
+
+    GelAstSpan *spans;
+    guint n_spans;
+    guint n_spans_prealloced;
+    gchar *file;
+
+    gchar *names;
+    gsize names_size;
+    gsize names_prealloced;
+    GHashTable *names_hash;
+
+    GPtrArray *values;
+    GMappedFile *mapped_file;
+
+    /* Symbols found under the lists asked about, see gel_ast_get_symbols() */
+    GHashTable *symbols;
+};
+
+
+GelAst* gel_ast_new(void)
+{
+    GelAst *self = g_slice_new0(GelAst);
+
+    self->ref_count = 1;
+    self->names_hash =
+        g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    self->values = g_ptr_array_new_with_free_func(
+        (GDestroyNotify)gel_value_free);
+
+    return self;
+}
+
+
+GelAst* gel_ast_ref(GelAst *self)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+
+    g_atomic_int_inc(&self->ref_count);
+    return self;
+}
+
+
+void gel_ast_unref(GelAst *self)
+{
+    g_return_if_fail(self != NULL);
+
+    if(g_atomic_int_dec_and_test(&self->ref_count))
+    {
+        if(self->mapped_file != NULL)
+            g_mapped_file_unref(self->mapped_file);
+        else
+        {
+            g_free(self->nodes);
+            g_free(self->children);
+            g_free(self->spans);
+            g_free(self->names);
+            g_hash_table_unref(self->names_hash);
+            g_ptr_array_unref(self->values);
+        }
+        if(self->symbols != NULL)
+            g_hash_table_unref(self->symbols);
+        g_free(self->file);
+        g_slice_free(GelAst, self);
+    }
+}
+
+
+/*
+ * Drops every node of @self when nobody else holds a reference to it,
+ * so the memory can be used again for the next code parsed.
+ */
+void gel_ast_recycle(GelAst *self)
+{
+    g_return_if_fail(self != NULL);
+
+    if(g_atomic_int_get(&self->ref_count) != 1 || self->mapped_file != NULL)
+        return;
+
+    self->n_nodes = 0;
+    self->n_children = 0;
+    self->n_spans = 0;
+    self->names_size = 0;
+    g_hash_table_remove_all(self->names_hash);
+    g_ptr_array_set_size(self->values, 0);
+    if(self->symbols != NULL)
+        g_hash_table_remove_all(self->symbols);
+}
+
+
+/*
+ * Sets the file the code of @self was read from.
+ */
+void gel_ast_set_file(GelAst *self, const gchar *file)
+{
+    g_return_if_fail(self != NULL);
+
+    g_free(self->file);
+    self->file = g_strdup(file);
+}
+
+
+/*
+ * Records that the list @node was opened at @line and @column.
+ * Spans must be added in the order their nodes were appended.
+ */
+void gel_ast_add_span(GelAst *self, guint node, guint line, guint column)
+{
+    g_return_if_fail(self->mapped_file == NULL);
+    g_return_if_fail(self->n_spans == 0
+        || self->spans[self->n_spans - 1].node < node);
+
+    if(self->n_spans == self->n_spans_prealloced)
+    {
+        self->n_spans_prealloced =
+            MAX(self->n_spans_prealloced * 2, GEL_AST_N_PREALLOCATED);
+        self->spans =
+            g_renew(GelAstSpan, self->spans, self->n_spans_prealloced);
+    }
+
+    GelAstSpan *span = self->spans + self->n_spans++;
+    span->node = node;
+    span->line = line;
+    span->column = column;
+}
+
+
+/*
+ * Gets where @node was read, if it is a list with a span.
+ * @file is set to NULL when the code was not read from a file.
+ */
+gboolean gel_ast_get_span(const GelAst *self, guint node,
+                          const gchar **file, guint *line, guint *column)
+{
+    g_return_val_if_fail(self != NULL, FALSE);
+
+    guint low = 0;
+    guint high = self->n_spans;
+
+    while(low < high)
+    {
+        guint middle = low + (high - low) / 2;
+        const GelAstSpan *span = self->spans + middle;
+
+        if(span->node < node)
+            low = middle + 1;
+        else
+        if(span->node > node)
+            high = middle;
+        else
+        {
+            if(file != NULL)
+                *file = self->file;
+            if(line != NULL)
+                *line = span->line;
+            if(column != NULL)
+                *column = span->column;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+
+/*
+ * Interns @name in the names of @self, returning its offset.
+ */
+static
+guint gel_ast_add_name(GelAst *self, const gchar *name)
+{
+    gpointer offset = NULL;
+    if(g_hash_table_lookup_extended(self->names_hash, name, NULL, &offset))
+        return GPOINTER_TO_UINT(offset);
+
+    gsize size = strlen(name) + 1;
+    if(self->names_size + size > self->names_prealloced)
+    {
+        self->names_prealloced = MAX(self->names_size + size,
+            MAX(self->names_prealloced * 2, GEL_AST_N_PREALLOCATED * 8));
+        self->names = g_realloc(self->names, self->names_prealloced);
+    }
+
+    guint name_offset = self->names_size;
+    memcpy(self->names + name_offset, name, size);
+    self->names_size += size;
+
+    g_hash_table_insert(self->names_hash,
+        g_strdup(name), GUINT_TO_POINTER(name_offset));
+    return name_offset;
+}
+
+
+static
+GelAstNode* gel_ast_new_node(GelAst *self, GelAstKind kind, guint *index)
+{
+    g_return_val_if_fail(self->mapped_file == NULL, NULL);
+
+    if(self->n_nodes == self->n_nodes_prealloced)
+    {
+        self->n_nodes_prealloced =
+            MAX(self->n_nodes_prealloced * 2, GEL_AST_N_PREALLOCATED);
+        self->nodes =
+            g_renew(GelAstNode, self->nodes, self->n_nodes_prealloced);
+    }
+
+    *index = self->n_nodes++;
+
+    GelAstNode *node = self->nodes + *index;
+    node->kind = kind;
+    node->n_children = 0;
+
+    return node;
+}
+
+
+guint gel_ast_append_int64(GelAst *self, gint64 value)
+{
+    guint index = 0;
+    gel_ast_new_node(self, GEL_AST_INT64, &index)->data.v_int64 = value;
+
+    return index;
+}
+
+
+guint gel_ast_append_double(GelAst *self, gdouble value)
+{
+    guint index = 0;
+    gel_ast_new_node(self, GEL_AST_DOUBLE, &index)->data.v_double = value;
+
+    return index;
+}
+
+
+guint gel_ast_append_string(GelAst *self, const gchar *string)
+{
+    guint index = 0;
+    guint offset = gel_ast_add_name(self, string);
+    gel_ast_new_node(self, GEL_AST_STRING, &index)->data.v_name = offset;
+
+    return index;
+}
+
+
+guint gel_ast_append_symbol(GelAst *self, const gchar *name)
+{
+    guint index = 0;
+    guint offset = gel_ast_add_name(self, name);
+    gel_ast_new_node(self, GEL_AST_SYMBOL, &index)->data.v_name = offset;
+
+    return index;
+}
+
+
+/*
+ * Appends a node holding the predefined value called @name.
+ */
+guint gel_ast_append_predefined(GelAst *self, const gchar *name)
+{
+    guint index = 0;
+    guint offset = gel_ast_add_name(self, name);
+    gel_ast_new_node(self, GEL_AST_PREDEFINED, &index)->data.v_name = offset;
+
+    return index;
+}
+
+
+guint gel_ast_append_list(GelAst *self,
+                          guint n_children, const guint *children)
+{
+    g_return_val_if_fail(self->mapped_file == NULL, 0);
+
+    guint n_needed = self->n_children + n_children;
+    if(n_needed > self->n_children_prealloced)
+    {
+        self->n_children_prealloced = MAX(n_needed,
+            MAX(self->n_children_prealloced * 2, GEL_AST_N_PREALLOCATED));
+        self->children =
+            g_renew(guint, self->children, self->n_children_prealloced);
+    }
+
+    if(n_children > 0)
+        memcpy(self->children + self->n_children,
+            children, sizeof(guint) * n_children);
+
+    guint index = 0;
+    GelAstNode *node = gel_ast_new_node(self, GEL_AST_LIST, &index);
+    node->n_children = n_children;
+    node->data.v_children = self->n_children;
+    self->n_children = n_needed;
+
+    return index;
+}
+
+
+/*
+ * Appends the nodes needed to hold @value, as code produced by a macro.
+ * Views of lists of @self are not copied, their node is used instead.
+ */
+guint gel_ast_append_value(GelAst *self, const GValue *value)
+{
+    GType type = GEL_VALUE_TYPE(value);
+
+    if(type == G_TYPE_INT64)
+        return gel_ast_append_int64(self, gel_value_get_int64(value));
+
+    if(type == G_TYPE_DOUBLE)
+        return gel_ast_append_double(self, gel_value_get_double(value));
+
+    if(type == GEL_TYPE_SYMBOL)
+        return gel_ast_append_symbol(self,
+            gel_symbol_get_name(gel_value_get_boxed(value)));
+
+    if(type == GEL_TYPE_STRING)
+    {
+        const gchar *string = gel_value_get_string(value);
+        if(gel_string_get_length(string) == strlen(string))
+            return gel_ast_append_string(self, string);
+    }
+    else
+    if(type == GEL_TYPE_VALUE_ARRAY)
+    {
+        GelValueArray *array = gel_value_get_boxed(value);
+        guint node = 0;
+
+        if(gel_value_array_peek_ast(array, &node) == self)
+            return node;
+
+        guint n_values = gel_value_array_get_n_values(array);
+        guint *children = g_new(guint, MAX(n_values, 1));
+
+        for(guint i = 0; i < n_values; i++)
+        {
+            GValue tmp_value = {0};
+            gel_value_array_get_value(array, i, &tmp_value);
+            children[i] = gel_ast_append_value(self, &tmp_value);
+            if(GEL_IS_VALUE(&tmp_value))
+                g_value_unset(&tmp_value);
+        }
+
+        node = gel_ast_append_list(self, n_values, children);
+        g_free(children);
+
+        return node;
+    }
+
+    guint index = 0;
+    gel_ast_new_node(self, GEL_AST_VALUE, &index)->data.v_value =
+        self->values->len;
+    g_ptr_array_add(self->values, gel_value_dup(value));
+
+    return index;
+}
+
+
+/*
+ * Appends a copy of @node of @ast, with its children if it is a list.
+ */
+guint gel_ast_append_copy(GelAst *self, const GelAst *ast, guint node)
+{
+    const GelAstNode *ast_node = ast->nodes + node;
+    guint index = 0;
+
+    switch(ast_node->kind)
+    {
+        case GEL_AST_STRING:
+            return gel_ast_append_string(self,
+                ast->names + ast_node->data.v_name);
+        case GEL_AST_SYMBOL:
+            return gel_ast_append_symbol(self,
+                ast->names + ast_node->data.v_name);
+        case GEL_AST_PREDEFINED:
+            return gel_ast_append_predefined(self,
+                ast->names + ast_node->data.v_name);
+        case GEL_AST_VALUE:
+            return gel_ast_append_value(self,
+                g_ptr_array_index(ast->values, ast_node->data.v_value));
+        case GEL_AST_LIST:
+        {
+            guint n_children = ast_node->n_children;
+            guint *children = g_new(guint, MAX(n_children, 1));
+
+            for(guint i = 0; i < n_children; i++)
+                children[i] = gel_ast_append_copy(self, ast,
+                    ast->children[ast_node->data.v_children + i]);
+
+            index = gel_ast_append_list(self, n_children, children);
+            g_free(children);
+            return index;
+        }
+        default:
+            *gel_ast_new_node(self, ast_node->kind, &index) = *ast_node;
+            return index;
+    }
+}
+
+
+GelAstKind gel_ast_get_kind(const GelAst *self, guint node)
+{
+    return self->nodes[node].kind;
+}
+
+
+/*
+ * Gets the name of a symbol node, or NULL for any other node.
+ */
+const gchar* gel_ast_get_name(const GelAst *self, guint node)
+{
+    const GelAstNode *ast_node = self->nodes + node;
+
+    return ast_node->kind == GEL_AST_SYMBOL
+        ? self->names + ast_node->data.v_name : NULL;
+}
+
+
+guint gel_ast_get_n_children(const GelAst *self, guint node)
+{
+    return self->nodes[node].n_children;
+}
+
+
+guint gel_ast_get_child(const GelAst *self, guint node, guint index)
+{
+    const GelAstNode *ast_node = self->nodes + node;
+    g_return_val_if_fail(index < ast_node->n_children, 0);
+
+    return self->children[ast_node->data.v_children + index];
+}
+
+
+static
+guint64 gel_ast_hash_bytes(guint64 hash, gconstpointer data, gsize size)
+{
+    const guint8 *bytes = data;
+
+    /* FNV-1a */
+    for(gsize i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * G_GUINT64_CONSTANT(0x100000001b3);
+
+    return hash;
+}
+
+
+static
+guint64 gel_ast_hash_node(const GelAst *self, guint node, guint64 hash)
+{
+    const GelAstNode *ast_node = self->nodes + node;
+    hash = gel_ast_hash_bytes(hash, &ast_node->kind, sizeof(GelAstKind));
+
+    switch(ast_node->kind)
+    {
+        case GEL_AST_INT64:
+            return gel_ast_hash_bytes(hash,
+                &ast_node->data.v_int64, sizeof(gint64));
+        case GEL_AST_DOUBLE:
+            return gel_ast_hash_bytes(hash,
+                &ast_node->data.v_double, sizeof(gdouble));
+        case GEL_AST_STRING:
+        case GEL_AST_SYMBOL:
+        case GEL_AST_PREDEFINED:
+        {
+            const gchar *name = self->names + ast_node->data.v_name;
+            return gel_ast_hash_bytes(hash, name, strlen(name) + 1);
+        }
+        case GEL_AST_VALUE:
+        {
+            /* Values have no source, they only match themselves */
+            const GValue *value =
+                g_ptr_array_index(self->values, ast_node->data.v_value);
+            return gel_ast_hash_bytes(hash, &value, sizeof(gpointer));
+        }
+        case GEL_AST_LIST:
+            hash = gel_ast_hash_bytes(hash,
+                &ast_node->n_children, sizeof(guint));
+            for(guint i = 0; i < ast_node->n_children; i++)
+                hash = gel_ast_hash_node(self,
+                    self->children[ast_node->data.v_children + i], hash);
+            return hash;
+    }
+
+    return hash;
+}
+
+
+/*
+ * Gets a fingerprint of the code in @node, which only changes when
+ * the code does, no matter where it is in the arena or how it was
+ * formatted in its source.
+ */
+guint64 gel_ast_hash(const GelAst *self, guint node)
+{
+    return gel_ast_hash_node(self, node,
+        G_GUINT64_CONSTANT(0xcbf29ce484222325));
+}
+
+
+static
+void gel_ast_collect_symbols(const GelAst *self, guint node,
+                             GHashTable *names, GArray *symbols)
+{
+    const GelAstNode *ast_node = self->nodes + node;
+
+    if(ast_node->kind == GEL_AST_SYMBOL)
+    {
+        gpointer name = GUINT_TO_POINTER(ast_node->data.v_name + 1);
+        if(g_hash_table_lookup(names, name) == NULL)
+        {
+            g_hash_table_insert(names, name, name);
+            g_array_append_val(symbols, node);
+        }
+    }
+    else
+    if(ast_node->kind == GEL_AST_LIST)
+        for(guint i = 0; i < ast_node->n_children; i++)
+            gel_ast_collect_symbols(self,
+                self->children[ast_node->data.v_children + i], names, symbols);
+}
+
+
+/*
+ * Stores in @symbols a symbol node for each name used under @node,
+ * and returns how many there are. They are looked for the first time
+ * they are asked for and kept until the nodes of @self are dropped.
+ */
+guint gel_ast_get_symbols(GelAst *self, guint node, const guint **symbols)
+{
+    g_return_val_if_fail(self != NULL, 0);
+    g_return_val_if_fail(node < self->n_nodes, 0);
+
+    if(self->symbols == NULL)
+        self->symbols = g_hash_table_new_full(
+            g_direct_hash, g_direct_equal, NULL, g_free);
+
+    /* The first element is the number of symbols */
+    guint *result = g_hash_table_lookup(self->symbols, GUINT_TO_POINTER(node));
+    if(result == NULL)
+    {
+        GHashTable *names = g_hash_table_new(g_direct_hash, g_direct_equal);
+        GArray *array = g_array_new(FALSE, FALSE, sizeof(guint));
+
+        g_array_append_val(array, node);
+        gel_ast_collect_symbols(self, node, names, array);
+        g_array_index(array, guint, 0) = array->len - 1;
+
+        result = (guint*)g_array_free(array, FALSE);
+        g_hash_table_insert(self->symbols, GUINT_TO_POINTER(node), result);
+        g_hash_table_unref(names);
+    }
+
+    *symbols = result + 1;
+    return result[0];
+}
+
+
+/*
+ * Stores the value of @node in @dest_value, which must be unset.
+ * Lists are stored as views of @self.
+ */
+void gel_ast_get_value(GelAst *self, guint node, GValue *dest_value)
+{
+    const GelAstNode *ast_node = self->nodes + node;
+
+    switch(ast_node->kind)
+    {
+        case GEL_AST_INT64:
+            g_value_init(dest_value, G_TYPE_INT64);
+            gel_value_set_int64(dest_value, ast_node->data.v_int64);
+            break;
+        case GEL_AST_DOUBLE:
+            g_value_init(dest_value, G_TYPE_DOUBLE);
+            gel_value_set_double(dest_value, ast_node->data.v_double);
+            break;
+        case GEL_AST_STRING:
+            g_value_init(dest_value, GEL_TYPE_STRING);
+            gel_value_take_boxed(dest_value,
+                gel_string_new(self->names + ast_node->data.v_name));
+            break;
+        case GEL_AST_SYMBOL:
+        {
+            const gchar *name = self->names + ast_node->data.v_name;
+            GelVariable *variable = gel_variable_lookup_predefined(name);
+            g_value_init(dest_value, GEL_TYPE_SYMBOL);
+            gel_value_take_boxed(dest_value, gel_symbol_new(name, variable));
+            break;
+        }
+        case GEL_AST_LIST:
+            g_value_init(dest_value, GEL_TYPE_VALUE_ARRAY);
+            gel_value_take_boxed(dest_value,
+                gel_value_array_new_ast(self, node));
+            break;
+        case GEL_AST_PREDEFINED:
+        {
+            const GValue *value = gel_value_lookup_predefined(
+                self->names + ast_node->data.v_name);
+            if(value != NULL)
+                gel_value_copy(value, dest_value);
+            break;
+        }
+        case GEL_AST_VALUE:
+            gel_value_copy(
+                g_ptr_array_index(self->values, ast_node->data.v_value),
+                dest_value);
+            break;
+    }
+}
+
+
+static
+gboolean gel_ast_write(gint fd, gconstpointer data, gsize size)
+{
+    const gchar *bytes = data;
+    while(size > 0)
+    {
+        gssize written = write(fd, bytes, size);
+        if(written < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return FALSE;
+        }
+        bytes += written;
+        size -= written;
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * Saves @self to @file, with @root as the node to return when loaded.
+ * @stamp describes the source of @self, and gel_ast_load()
+ * only accepts the file if it still matches.
+ * Arenas holding values that are not code can not be saved.
+ */
+gboolean gel_ast_save(const GelAst *self, guint root, const gchar *file,
+                      const GelAstStamp *stamp, GError **error)
+{
+    g_return_val_if_fail(self != NULL, FALSE);
+    g_return_val_if_fail(root < self->n_nodes, FALSE);
+    g_return_val_if_fail(stamp != NULL, FALSE);
+
+    if(self->mapped_file == NULL && self->values->len > 0)
+    {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+            "Code holding values can not be saved");
+        return FALSE;
+    }
+
+    GelAstFileHeader header = {{0}};
+    memcpy(header.magic, GEL_AST_FILE_MAGIC, sizeof(header.magic));
+    header.version = GEL_AST_FILE_VERSION;
+    header.byte_order = GEL_AST_FILE_BYTE_ORDER;
+    header.root = root;
+    header.stamp = *stamp;
+    header.n_nodes = self->n_nodes;
+    header.n_children = self->n_children;
+    header.n_spans = self->n_spans;
+    header.names_size = self->names_size;
+
+    /* Written aside and renamed, so readers never see half a file */
+    gchar *tmp_file = g_strconcat(file, ".XXXXXX", NULL);
+    gint fd = g_mkstemp(tmp_file);
+    gboolean written = fd >= 0
+        && gel_ast_write(fd, &header, sizeof(header))
+        && gel_ast_write(fd, self->nodes, sizeof(GelAstNode) * self->n_nodes)
+        && gel_ast_write(fd, self->children, sizeof(guint) * self->n_children)
+        && gel_ast_write(fd, self->spans, sizeof(GelAstSpan) * self->n_spans)
+        && gel_ast_write(fd, self->names, self->names_size);
+    gint saved_errno = errno;
+
+    if(fd >= 0 && close(fd) != 0 && written)
+    {
+        written = FALSE;
+        saved_errno = errno;
+    }
+
+    if(written && rename(tmp_file, file) != 0)
+    {
+        written = FALSE;
+        saved_errno = errno;
+    }
+
+    if(!written)
+    {
+        if(fd >= 0)
+            unlink(tmp_file);
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+            "Failed to save '%s': %s", file, g_strerror(saved_errno));
+    }
+
+    g_free(tmp_file);
+    return written;
+}
+
+
+/*
+ * Checks that every offset and index in a mapped arena is in range,
+ * so a corrupted file can not make views read outside of it.
+ * Lists are appended after their children, which keeps them acyclic.
+ */
+static
+gboolean gel_ast_is_valid(const GelAst *self)
+{
+    if(self->names_size > 0 && self->names[self->names_size - 1] != '\0')
+        return FALSE;
+
+    for(guint i = 0; i < self->n_nodes; i++)
+    {
+        const GelAstNode *node = self->nodes + i;
+        switch(node->kind)
+        {
+            case GEL_AST_INT64:
+            case GEL_AST_DOUBLE:
+                break;
+            case GEL_AST_STRING:
+            case GEL_AST_SYMBOL:
+            case GEL_AST_PREDEFINED:
+                if(node->data.v_name >= self->names_size)
+                    return FALSE;
+                break;
+            case GEL_AST_LIST:
+                if(node->data.v_children > self->n_children
+                    || node->n_children
+                        > self->n_children - node->data.v_children)
+                    return FALSE;
+                for(guint j = 0; j < node->n_children; j++)
+                    if(self->children[node->data.v_children + j] >= i)
+                        return FALSE;
+                break;
+            default:
+                return FALSE;
+        }
+    }
+
+    for(guint i = 0; i < self->n_spans; i++)
+        if(self->spans[i].node >= self->n_nodes
+            || (i > 0 && self->spans[i].node <= self->spans[i - 1].node))
+            return FALSE;
+
+    return TRUE;
+}
+
+
+/*
+ * Maps an arena saved by gel_ast_save() from @file, storing its root in
+ * @root. Returns NULL if it can not be read, was saved by another
+ * version or on another architecture, or if @stamp does not match
+ * the one it was saved with.
+ * The nodes are used in place, so the arena can not be appended to.
+ */
+GelAst* gel_ast_load(const gchar *file, const GelAstStamp *stamp,
+                     guint *root)
+{
+    g_return_val_if_fail(file != NULL, NULL);
+    g_return_val_if_fail(stamp != NULL, NULL);
+    g_return_val_if_fail(root != NULL, NULL);
+
+    GMappedFile *mapped_file = g_mapped_file_new(file, FALSE, NULL);
+    if(mapped_file == NULL)
+        return NULL;
+
+    const gchar *contents = g_mapped_file_get_contents(mapped_file);
+    gsize length = g_mapped_file_get_length(mapped_file);
+    const GelAstFileHeader *header = (const GelAstFileHeader*)contents;
+
+    if(length < sizeof(GelAstFileHeader)
+        || memcmp(header->magic, GEL_AST_FILE_MAGIC, sizeof(header->magic))
+        || header->version != GEL_AST_FILE_VERSION
+        || header->byte_order != GEL_AST_FILE_BYTE_ORDER
+        || header->stamp.size != stamp->size
+        || header->stamp.mtime != stamp->mtime
+        || header->stamp.ctime != stamp->ctime
+        || header->stamp.inode != stamp->inode
+        || header->stamp.device != stamp->device
+        || header->root >= header->n_nodes
+        || length != sizeof(GelAstFileHeader)
+            + sizeof(GelAstNode) * (guint64)header->n_nodes
+            + sizeof(guint) * (guint64)header->n_children
+            + sizeof(GelAstSpan) * (guint64)header->n_spans
+            + header->names_size)
+    {
+        g_mapped_file_unref(mapped_file);
+        return NULL;
+    }
+
+    GelAst *self = g_slice_new0(GelAst);
+    self->ref_count = 1;
+    self->mapped_file = mapped_file;
+
+    self->nodes = (GelAstNode*)(contents + sizeof(GelAstFileHeader));
+    self->n_nodes = header->n_nodes;
+    self->children = (guint*)(self->nodes + self->n_nodes);
+    self->n_children = header->n_children;
+    self->spans = (GelAstSpan*)(self->children + self->n_children);
+    self->n_spans = header->n_spans;
+    self->names = (gchar*)(self->spans + self->n_spans);
+    self->names_size = header->names_size;
+
+    if(!gel_ast_is_valid(self))
+    {
+        gel_ast_unref(self);
+        return NULL;
+    }
+
+    *root = header->root;
+    return self;
+}
@@ -0,0 +1,66 @@
+#ifndef __GEL_AST_H__
+#define __GEL_AST_H__
+
+#include <glib-object.h>
+
+typedef enum _GelAstKind
+{
+    GEL_AST_INT64,
+    GEL_AST_DOUBLE,
+    GEL_AST_STRING,
+    GEL_AST_SYMBOL,
+    GEL_AST_LIST,
+    GEL_AST_PREDEFINED,
+    GEL_AST_VALUE
+} GelAstKind;
+
+typedef struct _GelAst GelAst;
+
+/*
+ * What identifies the version of a source file an arena was parsed from,
+ * times are in nanoseconds, as edits can happen within the same second.
+ */
+typedef struct _GelAstStamp
+{
+    guint64 size;
+    gint64 mtime;
+    gint64 ctime;
+    guint64 inode;
+    guint64 device;
+} GelAstStamp;
+
+GelAst* gel_ast_new(void);
+GelAst* gel_ast_ref(GelAst *self);
+void gel_ast_unref(GelAst *self);
+void gel_ast_recycle(GelAst *self);
+
+void gel_ast_set_file(GelAst *self, const gchar *file);
+void gel_ast_add_span(GelAst *self, guint node, guint line, guint column);
+gboolean gel_ast_get_span(const GelAst *self, guint node,
+                          const gchar **file, guint *line, guint *column);
+
+guint gel_ast_append_int64(GelAst *self, gint64 value);
+guint gel_ast_append_double(GelAst *self, gdouble value);
+guint gel_ast_append_string(GelAst *self, const gchar *string);
+guint gel_ast_append_symbol(GelAst *self, const gchar *name);
+guint gel_ast_append_predefined(GelAst *self, const gchar *name);
+guint gel_ast_append_list(GelAst *self,
+                          guint n_children, const guint *children);
+guint gel_ast_append_value(GelAst *self, const GValue *value);
+guint gel_ast_append_copy(GelAst *self, const GelAst *ast, guint node);
+
+GelAstKind gel_ast_get_kind(const GelAst *self, guint node);
+const gchar* gel_ast_get_name(const GelAst *self, guint node);
+guint gel_ast_get_n_children(const GelAst *self, guint node);
+guint gel_ast_get_child(const GelAst *self, guint node, guint index);
+guint64 gel_ast_hash(const GelAst *self, guint node);
+guint gel_ast_get_symbols(GelAst *self, guint node, const guint **symbols);
+
+void gel_ast_get_value(GelAst *self, guint node, GValue *dest_value);
+
+gboolean gel_ast_save(const GelAst *self, guint root, const gchar *file,
+                      const GelAstStamp *stamp, GError **error);
+GelAst* gel_ast_load(const gchar *file, const GelAstStamp *stamp,
+                     guint *root);
+
+#endif
@@ -1,5 +1,7 @@
 #include <config.h>
 
+#include <string.h>
+
 #include <gelclosure.h>
 #include <gelclosureprivate.h>
 #include <gelcontext.h>
@@ -8,6 +10,9 @@
 #include <gelvalueprivate.h>
 #include <gelsymbol.h>
 #include <gelerrors.h>
+#include <gelarrayprivate.h>
+#include <gelnative.h>
+#include <geljit.h>
 
 #ifdef HAVE_GOBJECT_INTROSPECTION
 #include <geltypeinfo.h>
@@ -40,6 +45,23 @@ struct _GelClosure
     gchar *variadic_arg;
     GHashTable *args_hash;
     GelValueArray *code;
+
+    /* Captured names that also have a predefined value */
+    GList *shadowed;
+
+    /* Code compiled ahead of time by a module, if any,
+       and the instructions it was compiled from */
+    GelModuleFunc native;
+    GelNative *native_code;
+
+    /* Invocations running, that share a reference to the closure */
+    guint n_running;
+
+#ifdef GEL_JIT
+    /* Calls made so far, up to GEL_JIT_THRESHOLD, and the compiled code */
+    guint n_calls;
+    GelJit *jit;
+#endif
 };
 
 
@@ -57,40 +79,71 @@ void gel_closure_marshal(GelClosure *self, GValue *return_value,
     {
         if(n_values < n_args)
         {
-            gchar *message = g_strdup_printf(
-                "at least %u arguments, got %u", n_args, n_values);
-            gel_error_expected(invocation_context, self->name, message);
-            g_free(message);
+            gel_error_expected_at_least_n_arguments(invocation_context,
+                self->name, n_args, n_values);
             return;
         }
     }
     else
     if(n_values != n_args)
     {
-        gchar *message = g_strdup_printf(
-            "%u arguments, got %u", n_args, n_values);
-        gel_error_expected(invocation_context, self->name, message);
-        g_free(message);
+        gel_error_expected_n_arguments(invocation_context,
+            self->name, n_args, n_values);
         return;
     }
 
-    GelContext *context = gel_context_new_with_outer(self->context);
+    GValue *args_values = g_newa(GValue, n_args);
+    memset(args_values, 0, n_args * sizeof(GValue));
 
     guint i = 0;
-    for(GList *iter = self->args; iter != NULL; iter = iter->next, i++)
+    for(; i < n_args; i++)
     {
-        const gchar *arg_name = iter->data;
-        GValue *value = gel_value_new();
-
-        gel_context_eval_value(invocation_context, values + i, value);
+        gel_context_eval_value(invocation_context, values + i, args_values + i);
 
         if(gel_context_error(invocation_context))
         {
-            g_free(value);
-            goto end;
+            for(guint j = 0; j <= i; j++)
+                if(GEL_IS_VALUE(args_values + j))
+                    g_value_unset(args_values + j);
+            return;
         }
-        else
-            gel_context_define(context, arg_name, value);
+    }
+
+    if(self->native != NULL && gel_native_call(self->native_code,
+            self->native, args_values, return_value, invocation_context))
+    {
+        for(guint j = 0; j < n_args; j++)
+            g_value_unset(args_values + j);
+        return;
+    }
+
+#ifdef GEL_JIT
+    if(!is_variadic && self->n_calls < GEL_JIT_THRESHOLD
+        && ++self->n_calls == GEL_JIT_THRESHOLD)
+        self->jit = gel_jit_compile(self->args, self->code, self->context);
+
+    if(self->jit != NULL && gel_jit_call(self->jit,
+            args_values, return_value, invocation_context))
+    {
+        for(guint j = 0; j < n_args; j++)
+            g_value_unset(args_values + j);
+        return;
+    }
+#endif
+
+    GelContext *context = gel_context_new_with_outer(self->context);
+
+    /* Symbols look at their predefined value before the outer contexts */
+    for(GList *iter = self->shadowed; iter != NULL; iter = iter->next)
+        gel_context_define_variable(context, iter->data,
+            gel_context_get_variable(self->context, iter->data));
+
+    i = 0;
+    for(GList *iter = self->args; iter != NULL; iter = iter->next, i++)
+    {
+        GValue *value = gel_value_new();
+        *value = args_values[i];
+        gel_context_define(context, iter->data, value);
     }
 
     if(is_variadic)
@@ -143,8 +196,18 @@ void gel_closure_marshal(GelClosure *self, GValue *return_value,
     end:
 
     if(gel_context_error(context))
-        gel_context_transfer_error(context, invocation_context);
-    gel_context_free(context);  
+    {
+        GelContextExit exit = gel_context_get_exit(context);
+        if(exit == GEL_CONTEXT_EXIT_RETURN)
+            gel_context_clear_exit(context, return_value);
+        else
+        {
+            if(exit != GEL_CONTEXT_EXIT_ERROR)
+                gel_context_fail_exit(context);
+            gel_context_transfer_error(context, invocation_context);
+        }
+    }
+    gel_context_free(context);
 }
 
 
@@ -159,50 +222,94 @@ void gel_closure_finalize(void *data, GelClosure *self)
         g_free(self->variadic_arg);
 
     g_hash_table_unref(self->args_hash);
+    g_list_foreach(self->shadowed, (GFunc)g_free, NULL);
+    g_list_free(self->shadowed);
     gel_value_array_free(self->code);
     gel_context_free(self->context);
+
+    if(self->native_code != NULL)
+        gel_native_free(self->native_code);
+
+#ifdef GEL_JIT
+    if(self->jit != NULL)
+        gel_jit_free(self->jit);
+#endif
 }
 
 
+/*
+ * Shares with the context of @self the variable called @name
+ * the code of @self would find, unless it is an argument.
+ */
 static
-void gel_closure_bind_symbols_of_array(GelClosure *self, GelValueArray *array)
+void gel_closure_capture(GelClosure *self, const gchar *name)
 {
-    guint array_n_values = gel_value_array_get_n_values(array);
-    GValue *array_values = gel_value_array_get_values(array);
+    if(g_hash_table_lookup(self->args_hash, name) != NULL
+        || gel_context_get_variable(self->context, name) != NULL)
+        return;
+
+    GelVariable *variable = gel_context_lookup_variable(self->context, name);
+    if(variable == NULL)
+        return;
+
+    gel_context_define_variable(self->context, name, variable);
+
+    if(gel_variable_lookup_predefined(name) != NULL)
+        self->shadowed = g_list_prepend(self->shadowed, g_strdup(name));
+}
 
-    for(guint i = 0; i < array_n_values; i++)
+
+static
+void gel_closure_capture_value(GelClosure *self, const GValue *value)
+{
+    GType type = GEL_VALUE_TYPE(value);
+
+    if(type == GEL_TYPE_SYMBOL)
+        gel_closure_capture(self,
+            gel_symbol_get_name(gel_value_get_boxed(value)));
+    else
+    if(type == GEL_TYPE_VALUE_ARRAY)
     {
-        const GValue *value = array_values + i;
-        GType type = GEL_VALUE_TYPE(value);
+        GelValueArray *array = gel_value_get_boxed(value);
+        guint node = 0;
+        GelAst *ast = gel_value_array_peek_origin(array, &node);
 
-        if(type == GEL_TYPE_VALUE_ARRAY)
+        if(ast != NULL)
         {
-            GelValueArray *array = gel_value_get_boxed(value);
-            gel_closure_bind_symbols_of_array(self, array);
+            /* Parsed code knows its symbols */
+            const guint *symbols = NULL;
+            guint n_symbols = gel_ast_get_symbols(ast, node, &symbols);
+
+            for(guint i = 0; i < n_symbols; i++)
+                gel_closure_capture(self, gel_ast_get_name(ast, symbols[i]));
         }
         else
-        if(type == GEL_TYPE_SYMBOL)
+        if(gel_value_array_get_storage(array) == GEL_ARRAY_STORAGE_GENERIC)
         {
-            GelSymbol *symbol = gel_value_get_boxed(value);
-            const gchar *name = gel_symbol_get_name(symbol);
-            const GelContext *context = self->context;
+            const GValue *values = gel_value_array_peek_data(array);
+            guint n_values = gel_value_array_get_n_values(array);
 
-            if(g_hash_table_lookup(self->args_hash, name) == NULL)
-            {
-                GelVariable *variable =
-                    gel_context_lookup_variable(context, name);
-                if(variable != NULL)
-                    gel_symbol_set_variable(symbol, variable);
-            }
+            for(guint i = 0; i < n_values; i++)
+                gel_closure_capture_value(self, values + i);
         }
     }
 }
 
 
+/*
+ * Captures the variables used by the code of @closure that are visible
+ * where it was created. Only those are kept by the closure, any other
+ * name is looked up in the outer contexts when the closure is invoked.
+ */
 void gel_closure_close_over(GClosure *closure)
 {
     GelClosure *self = (GelClosure *)closure;
-    gel_closure_bind_symbols_of_array(self, self->code);
+
+    guint code_n_values = gel_value_array_get_n_values(self->code);
+    const GValue *code_values = gel_value_array_get_values(self->code);
+
+    for(guint i = 0; i < code_n_values; i++)
+        gel_closure_capture_value(self, code_values + i);
 }
 
 
@@ -247,8 +354,7 @@ GClosure* gel_closure_new(const gchar *name, GList *args, gchar *variadic,
     if(variadic != NULL)
         g_hash_table_insert(args_hash, (void *)variadic, (void *)variadic);
 
-    GelContext *closure_context = gel_context_dup(context);
-    gel_context_set_outer(closure_context, context);
+    GelContext *closure_context = gel_context_new_with_outer(context);
 
     static guint counter = 0;
 
@@ -270,6 +376,7 @@ struct _GelNativeClosure
     GClosure closure;
     gchar *name;
     GClosureMarshal native_marshal;
+    guint n_running;
 };
 
 
@@ -366,6 +473,111 @@ void* gel_introspection_closure_get_instance(GelIntrospectionClosure *self)
 #endif
 
 
+/*
+ * Checks whether @closure was created by gel_closure_new_native()
+ * to call @marshal.
+ */
+gboolean gel_closure_is_native(const GClosure *closure,
+                               GClosureMarshal marshal)
+{
+    g_return_val_if_fail(closure != NULL, FALSE);
+
+    return closure->marshal == (GClosureMarshal)gel_native_closure_marshal
+        && ((const GelNativeClosure*)closure)->native_marshal == marshal;
+}
+
+
+/*
+ * Invokes @closure as #g_closure_invoke does, but when it is predefined
+ * or written in gel, nested invocations share a single reference to it,
+ * so recursion is not limited by how many references a GClosure counts.
+ */
+void gel_closure_invoke(GClosure *closure, GValue *return_value,
+                        guint n_values, const GValue *values,
+                        GelContext *context)
+{
+    guint *n_running = NULL;
+
+    if(closure->marshal == (GClosureMarshal)gel_closure_marshal)
+        n_running = &((GelClosure*)closure)->n_running;
+    else
+    if(closure->marshal == (GClosureMarshal)gel_native_closure_marshal)
+        n_running = &((GelNativeClosure*)closure)->n_running;
+
+    if(n_running == NULL || closure->is_invalid)
+    {
+        g_closure_invoke(closure, return_value, n_values, values, context);
+        return;
+    }
+
+    if((*n_running)++ == 0)
+        g_closure_ref(closure);
+
+    closure->marshal(closure,
+        return_value, n_values, values, context, closure->data);
+
+    if(--(*n_running) == 0)
+        g_closure_unref(closure);
+}
+
+
+/*
+ * Gets the names of the arguments and the code of @closure,
+ * if it is written in gel and takes a fixed number of arguments.
+ */
+gboolean gel_closure_peek_code(const GClosure *closure,
+                               const GList **args, GelValueArray **code)
+{
+    g_return_val_if_fail(closure != NULL, FALSE);
+
+    if(closure->marshal != (GClosureMarshal)gel_closure_marshal)
+        return FALSE;
+
+    const GelClosure *self = (const GelClosure*)closure;
+    if(self->variadic_arg != NULL)
+        return FALSE;
+
+    *args = self->args;
+    *code = self->code;
+    return TRUE;
+}
+
+
+/*
+ * Makes @closure call @func before evaluating its code, if @closure
+ * is written in gel and its code translates to the instructions whose
+ * checksum is @checksum, which @func was compiled from.
+ */
+gboolean gel_closure_set_native(GClosure *closure, guint checksum,
+                                GelModuleFunc func)
+{
+    g_return_val_if_fail(closure != NULL, FALSE);
+    g_return_val_if_fail(func != NULL, FALSE);
+
+    const GList *args = NULL;
+    GelValueArray *code = NULL;
+
+    if(!gel_closure_peek_code(closure, &args, &code))
+        return FALSE;
+
+    GelClosure *self = (GelClosure*)closure;
+    GelNative *native = gel_native_new(args, code, self->context);
+    if(native == NULL || gel_native_get_checksum(native) != checksum)
+    {
+        if(native != NULL)
+            gel_native_free(native);
+        return FALSE;
+    }
+
+    if(self->native_code != NULL)
+        gel_native_free(self->native_code);
+
+    self->native = func;
+    self->native_code = native;
+    return TRUE;
+}
+
+
 /**
  * gel_closure_get_name:
  * @closure: a #GClosure whose name will be retrieved
@@ -2,10 +2,21 @@
 #define __GEL_CLOSURE_PRIVATE_H__
 
 #include <gelcontext.h>
+#include <gelarray.h>
+#include <gelmodule.h>
 
 typedef struct _GelClosure GelClosure;
 
 void gel_closure_close_over(GClosure *closure);
+void gel_closure_invoke(GClosure *closure, GValue *return_value,
+                        guint n_values, const GValue *values,
+                        GelContext *context);
+gboolean gel_closure_is_native(const GClosure *closure,
+                               GClosureMarshal marshal);
+gboolean gel_closure_peek_code(const GClosure *closure,
+                               const GList **args, GelValueArray **code);
+gboolean gel_closure_set_native(GClosure *closure, guint checksum,
+                                GelModuleFunc func);
 
 #ifdef HAVE_GOBJECT_INTROSPECTION
 #include <geltypeinfo.h>
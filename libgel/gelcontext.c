@@ -1,3 +1,12 @@
+#include <config.h>
+
+#include <string.h>
+#include <gmodule.h>
+
+#ifdef HAVE_UCONTEXT_H
+#include <ucontext.h>
+#endif
+
 #include <gelcontext.h>
 #include <gelcontextprivate.h>
 #include <gelerrors.h>
@@ -6,11 +15,48 @@
 #include <gelsymbol.h>
 #include <gelvariable.h>
 #include <gelclosure.h>
+#include <gelclosureprivate.h>
+#include <gelmodule.h>
+#include <gelparser.h>
+#include <gelast.h>
+#include <gelarrayprivate.h>
+#include <geloptimize.h>
 
 #ifndef GEL_CONTEXT_USE_POOL
 #define GEL_CONTEXT_USE_POOL 1
 #endif
 
+/* Calls that can be nested, unless GEL_MAX_DEPTH is set */
+#ifndef GEL_CONTEXT_MAX_DEPTH
+#define GEL_CONTEXT_MAX_DEPTH 100000
+#endif
+
+/*
+ * References a closure can have when it is called, as GClosure can not
+ * count more than 32767. Closures passed around through deep recursion
+ * can get close to it, even if their calls only take one reference.
+ */
+#ifndef GEL_CONTEXT_MAX_CLOSURE_REFS
+#define GEL_CONTEXT_MAX_CLOSURE_REFS 32000
+#endif
+
+/* Stack used by the calls made by the host before they use a segment */
+#ifndef GEL_CONTEXT_STACK_SIZE
+#define GEL_CONTEXT_STACK_SIZE (512 * 1024)
+#endif
+
+/*
+ * Size of the segments of stack, and what calls leave free at their end
+ * for the code they run, which can recurse too, as when copying values
+ */
+#ifndef GEL_CONTEXT_SEGMENT_SIZE
+#define GEL_CONTEXT_SEGMENT_SIZE (8 * 1024 * 1024)
+#endif
+
+#ifndef GEL_CONTEXT_SEGMENT_MARGIN
+#define GEL_CONTEXT_SEGMENT_MARGIN (6 * 1024 * 1024)
+#endif
+
 /**
  * SECTION:gelcontext
  * @short_description: Class used to keep symbols and evaluate values.
@@ -26,7 +72,13 @@ struct _GelContext
     GHashTable *variables;
     GelContext *outer;
     GHashTable *inner;
-    GError *error;
+    GelContextExit exit;
+    gboolean error_located;
+    gboolean optimize;
+
+    /* Fingerprints of the forms of each file loaded with
+       gel_context_reload_file() */
+    GHashTable *scripts;
 };
 
 
@@ -60,6 +112,61 @@ static GList *contexts_POOL;
 
 static GelContext *context_SOLITON;
 
+/*
+ * Errors and non-local exits are pending in the context they happen in,
+ * so they unwind through the checks for errors that every evaluation step
+ * already does, until the loop or closure they exit, or the host.
+ * What they carry, the operands of the error or the value of a return,
+ * is kept aside, as only one of them is pending at a time in a thread.
+ */
+typedef struct _GelContextThread
+{
+    GValue exit_value;
+
+    /*
+     * Calls being evaluated, how many can be, and the lowest address of
+     * the stack they can use before going on in a segment of stack of
+     * their own. Stacks are assumed to grow down, as they do everywhere
+     * ucontext is.
+     */
+    guint depth;
+    guint max_depth;
+    guintptr limit;
+
+    /* The segment being started, and one kept for the next to use */
+    struct _GelContextSegment *segment;
+    gchar *spare_stack;
+} GelContextThread;
+
+static void gel_context_thread_free(GelContextThread *self);
+
+static GPrivate context_THREAD =
+    G_PRIVATE_INIT((GDestroyNotify)gel_context_thread_free);
+
+
+static
+GelContextThread* gel_context_thread(void)
+{
+    GelContextThread *self = g_private_get(&context_THREAD);
+    if(self == NULL)
+    {
+        self = g_new0(GelContextThread, 1);
+        g_private_set(&context_THREAD, self);
+    }
+
+    return self;
+}
+
+
+static
+void gel_context_thread_free(GelContextThread *self)
+{
+    if(GEL_IS_VALUE(&self->exit_value))
+        g_value_unset(&self->exit_value);
+    g_free(self->spare_stack);
+    g_free(self);
+}
+
 
 static
 GelContext* gel_context_alloc(void)
@@ -79,6 +186,8 @@ void gel_context_dispose(GelContext *self)
 {
     g_hash_table_unref(self->variables);
     g_hash_table_unref(self->inner);
+    if(self->scripts != NULL)
+        g_hash_table_unref(self->scripts);
     g_slice_free(GelContext, self);
 }
 
@@ -161,6 +270,7 @@ GelContext* gel_context_dup(const GelContext *self)
     while(g_hash_table_iter_next(&iter, (void **)&name, (void **)&variable))
         gel_context_define_variable(context, name, variable);
 
+    context->optimize = self->optimize;
     return context;
 }
 
@@ -175,27 +285,36 @@ void gel_context_free(GelContext *self)
 {
     g_return_if_fail(self != NULL);
 
-    GList *inner_list = g_hash_table_get_keys(self->inner);
-    for(GList *iter = inner_list; iter != NULL; iter = iter->next)
+    if(g_hash_table_size(self->inner) > 0)
     {
-        GelContext *inner = iter->data;
-        gel_context_set_outer(inner, self->outer);
+        GList *inner_list = g_hash_table_get_keys(self->inner);
+        for(GList *iter = inner_list; iter != NULL; iter = iter->next)
+        {
+            GelContext *inner = iter->data;
+            gel_context_set_outer(inner, self->outer);
+        }
+        g_list_free(inner_list);
     }
-    g_list_free(inner_list);
 
-    if(self->error != NULL)
+    if(self->exit != GEL_CONTEXT_EXIT_NONE)
     {
         if(self->outer != NULL)
-            gel_context_set_error(self->outer, self->error);
+            gel_context_transfer_error(self, self->outer);
         else
-            g_error_free(self->error);
+            gel_context_clear_error(self);
     }
 
 #if GEL_CONTEXT_USE_POOL
     g_hash_table_remove_all(self->variables);
     g_hash_table_remove_all(self->inner);
+    self->optimize = FALSE;
+    if(self->scripts != NULL)
+    {
+        g_hash_table_unref(self->scripts);
+        self->scripts = NULL;
+    }
 
-    contexts_POOL = g_list_append(contexts_POOL, self);
+    contexts_POOL = g_list_prepend(contexts_POOL, self);
     if(--contexts_COUNT == 0)
     {
         g_list_foreach(contexts_POOL, (GFunc)gel_context_dispose, NULL);
@@ -217,6 +336,7 @@ void gel_context_free(GelContext *self)
  * @error: return location for a #GError, or NULL
  *
  * Evaluates @value, stores the result in @dest
+ * Strings are stored as gchararray values.
  *
  * Returns: #TRUE if @dest was written, #FALSE otherwise.
  */
@@ -227,19 +347,286 @@ gboolean gel_context_eval(GelContext *self,
     g_return_val_if_fail(value != NULL, FALSE);
     g_return_val_if_fail(dest != NULL, FALSE);
 
+    /* The code of the host is optimized in a copy of its own */
+    GValue optimized = {0};
+    if(self->optimize)
+    {
+        gel_value_copy(value, &optimized);
+        gel_optimize_code(self, &optimized);
+        value = &optimized;
+    }
+
     gboolean result = gel_context_eval_value(self, value, dest);
 
-    if(self->error != NULL)
+    if(GEL_IS_VALUE(&optimized))
+        g_value_unset(&optimized);
+
+    if(self->exit != GEL_CONTEXT_EXIT_NONE)
     {
-        g_propagate_error(error, self->error);
-        self->error = NULL;
+        if(self->exit != GEL_CONTEXT_EXIT_ERROR)
+            gel_context_fail_exit(self);
+
+        g_propagate_error(error, gel_context_steal_error(self));
         result = FALSE;
     }
+    else
+    if(result)
+        gel_value_to_host(dest);
 
     return result;
 }
 
 
+/*
+ * Gets the name defined by the form @node of @ast, if it is
+ * a call to define or to function with a name, or NULL otherwise.
+ */
+static
+const gchar* gel_context_form_defines(const GelAst *ast, guint node)
+{
+    if(gel_ast_get_kind(ast, node) != GEL_AST_LIST
+        || gel_ast_get_n_children(ast, node) < 2)
+        return NULL;
+
+    const gchar *name = gel_ast_get_name(ast, gel_ast_get_child(ast, node, 0));
+    if(g_strcmp0(name, "define") != 0 && g_strcmp0(name, "function") != 0)
+        return NULL;
+
+    return gel_ast_get_name(ast, gel_ast_get_child(ast, node, 1));
+}
+
+
+static
+gint64* gel_context_fingerprint_new(gint64 fingerprint)
+{
+    gint64 *self = g_new(gint64, 1);
+    *self = fingerprint;
+    return self;
+}
+
+
+/**
+ * gel_context_reload_file:
+ * @self: #GelContext where to evaluate the content of @file
+ * @file: path to a file
+ * @error: return location for a #GError, or NULL
+ *
+ * Parses @file and evaluates its top-level forms in @self. The first
+ * time @file is loaded in @self every form is evaluated. From then on,
+ * only the calls to define and function whose code changed since the
+ * last successful load are evaluated again, replacing the previous
+ * definition of their name. Any other form is skipped, so the state
+ * of @self is kept across reloads.
+ *
+ * Forms are compared by a fingerprint of their parsed code, so changes
+ * in whitespace or comments do not count as changes.
+ *
+ * Returns: #TRUE if @file was parsed and its forms were evaluated
+ * without errors, #FALSE otherwise.
+ */
+gboolean gel_context_reload_file(GelContext *self, const gchar *file,
+                                 GError **error)
+{
+    g_return_val_if_fail(self != NULL, FALSE);
+    g_return_val_if_fail(file != NULL, FALSE);
+
+    GelValueArray *array = gel_parse_file(file, error);
+    if(array == NULL)
+        return FALSE;
+
+    guint root = 0;
+    GelAst *ast = gel_value_array_peek_ast(array, &root);
+    g_return_val_if_fail(ast != NULL, FALSE);
+
+    if(self->scripts == NULL)
+        self->scripts = g_hash_table_new_full(g_str_hash, g_str_equal,
+            (GDestroyNotify)g_free, (GDestroyNotify)g_hash_table_unref);
+
+    GHashTable *old_forms = g_hash_table_lookup(self->scripts, file);
+    GHashTable *forms = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+        (GDestroyNotify)g_free, NULL);
+
+    guint n_forms = gel_ast_get_n_children(ast, root);
+    gboolean failed = FALSE;
+
+    for(guint i = 0; i < n_forms && !failed; i++)
+    {
+        guint node = gel_ast_get_child(ast, root, i);
+        gint64 fingerprint = (gint64)gel_ast_hash(ast, node);
+
+        g_hash_table_replace(forms,
+            gel_context_fingerprint_new(fingerprint), NULL);
+
+        if(old_forms != NULL)
+        {
+            if(g_hash_table_lookup_extended(old_forms,
+                    &fingerprint, NULL, NULL))
+                continue;
+
+            const gchar *name = gel_context_form_defines(ast, node);
+            if(name == NULL)
+                continue;
+
+            gel_context_remove(self, name);
+        }
+
+        GValue value = {0};
+        GValue result = {0};
+        GError *eval_error = NULL;
+        gel_ast_get_value(ast, node, &value);
+
+        gel_context_eval(self, &value, &result, &eval_error);
+        if(eval_error != NULL)
+        {
+            g_propagate_error(error, eval_error);
+            failed = TRUE;
+        }
+
+        if(GEL_IS_VALUE(&result))
+            g_value_unset(&result);
+        g_value_unset(&value);
+    }
+
+    /* Forms that failed are evaluated again in the next reload */
+    if(!failed)
+        g_hash_table_replace(self->scripts, g_strdup(file), forms);
+    else
+        g_hash_table_unref(forms);
+
+    gel_value_array_free(array);
+    return !failed;
+}
+
+
+/**
+ * gel_context_load_module:
+ * @self: #GelContext where to evaluate the script of @file
+ * @file: path to a module made by the gelc tool
+ * @error: return location for a #GError, or NULL
+ *
+ * Loads the script compiled to the shared object @file and evaluates
+ * its top-level forms in @self, as if the script was evaluated.
+ * Each function that gelc compiled to native code is then run natively
+ * whenever its arguments are the ones it was compiled for, falling back
+ * to its code otherwise, so the semantics of the script are kept.
+ *
+ * A function is always interpreted if its code does not translate to
+ * the instructions gelc compiled, as happens when the names of the
+ * predefined functions it calls were given other values in @self,
+ * or when the optimizer of @self folded part of its code.
+ *
+ * Returns: #TRUE if @file was loaded and its forms were evaluated
+ * without errors, #FALSE otherwise.
+ */
+gboolean gel_context_load_module(GelContext *self, const gchar *file,
+                                 GError **error)
+{
+    g_return_val_if_fail(self != NULL, FALSE);
+    g_return_val_if_fail(file != NULL, FALSE);
+
+    GModule *module = g_module_open(file, G_MODULE_BIND_LOCAL);
+    if(module == NULL)
+    {
+        g_set_error(error, GEL_CONTEXT_ERROR, GEL_CONTEXT_ERROR_MODULE,
+            "%s", g_module_error());
+        return FALSE;
+    }
+
+    gpointer symbol = NULL;
+    const GelModule *info = NULL;
+
+    if(g_module_symbol(module, GEL_MODULE_SYMBOL, &symbol))
+        info = symbol;
+
+    if(info == NULL || info->version != GEL_MODULE_VERSION)
+    {
+        g_set_error(error, GEL_CONTEXT_ERROR, GEL_CONTEXT_ERROR_MODULE,
+            "%s is not a gel module of version %d",
+            file, GEL_MODULE_VERSION);
+        g_module_close(module);
+        return FALSE;
+    }
+
+    GelValueArray *array =
+        gel_parse_text(info->source, strlen(info->source), error);
+    if(array == NULL)
+    {
+        g_module_close(module);
+        return FALSE;
+    }
+
+    /* The compiled functions are kept by the closures of @self */
+    g_module_make_resident(module);
+
+    guint root = 0;
+    GelAst *ast = gel_value_array_peek_ast(array, &root);
+    if(ast != NULL)
+        gel_ast_set_file(ast, info->file);
+
+    guint n_forms = gel_value_array_get_n_values(array);
+    const GValue *forms = gel_value_array_get_values(array);
+    const GelModuleFunction *function = info->functions;
+    const GelModuleFunction *last = info->functions + info->n_functions;
+    gboolean failed = FALSE;
+
+    for(guint i = 0; i < n_forms && !failed; i++)
+    {
+        GValue result = {0};
+        GError *eval_error = NULL;
+
+        gel_context_eval(self, forms + i, &result, &eval_error);
+        if(eval_error != NULL)
+        {
+            g_propagate_error(error, eval_error);
+            failed = TRUE;
+        }
+
+        if(GEL_IS_VALUE(&result))
+            g_value_unset(&result);
+
+        /* The name refers to the closure just made by the form */
+        for(; !failed && function < last && function->form == i; function++)
+        {
+            GValue *value = gel_context_lookup_value(self, function->name);
+            if(value != NULL && GEL_VALUE_HOLDS(value, G_TYPE_CLOSURE))
+                gel_closure_set_native(gel_value_get_boxed(value),
+                    function->checksum, function->func);
+        }
+    }
+
+    gel_value_array_free(array);
+    return !failed;
+}
+
+
+/**
+ * gel_context_set_optimize:
+ * @self: a #GelContext
+ * @optimize: whether to optimize the code evaluated in @self
+ *
+ * Sets whether #gel_context_eval optimizes the code it is given before
+ * evaluating it. Calls to predefined functions without side effects whose
+ * arguments are literals are replaced by their result, arrays of literals
+ * are built only once, branches of if and cond that can never be taken
+ * are removed, and calls to small functions are replaced by their code
+ * for as long as their name refers to them. Arithmetic, comparisons and
+ * indexing whose operands are inferred to be numbers are evaluated
+ * without looking up how to operate on them when they are int64 or double,
+ * loops whose code neither defines names nor keeps references to them
+ * run without a context of their own, and case and cond comparing a key
+ * to int64 or string literals find the branch to take in a hash table.
+ *
+ * The code is changed in place, so later evaluations of it do not
+ * need to optimize it again.
+ */
+void gel_context_set_optimize(GelContext *self, gboolean optimize)
+{
+    g_return_if_fail(self != NULL);
+
+    self->optimize = optimize;
+}
+
+
 gboolean gel_context_eval_value(GelContext *self,
                                 const GValue *value, GValue *dest)
 {
@@ -283,6 +670,182 @@ const GValue* gel_context_eval_param_into_value(GelContext *self,
 }
 
 
+/*
+ * Records where @array was read as where the error of @self happened,
+ * if it is known. The first array found with a location,
+ * the innermost one, is the one reported.
+ */
+void gel_context_locate_error(GelContext *self, const GelValueArray *array)
+{
+    const gchar *file = NULL;
+    guint line = 0;
+    guint column = 0;
+
+    if(self->error_located
+        || !gel_value_array_get_location(array, &file, &line, &column))
+        return;
+
+    gel_error_locate(file, line, column);
+    self->error_located = TRUE;
+}
+
+
+static
+guint gel_context_max_depth(void)
+{
+    static volatile gsize once = 0;
+    static guint max_depth = GEL_CONTEXT_MAX_DEPTH;
+
+    if(g_once_init_enter(&once))
+    {
+        const gchar *depth = g_getenv("GEL_MAX_DEPTH");
+        if(depth != NULL && g_ascii_strtoull(depth, NULL, 10) > 0)
+            max_depth = MIN(g_ascii_strtoull(depth, NULL, 10), G_MAXUINT);
+        g_once_init_leave(&once, 1);
+    }
+
+    return max_depth;
+}
+
+
+static
+const GValue* gel_context_eval_call(GelContext *self, GelValueArray *array,
+                                    GValue *out_value);
+
+#ifdef HAVE_UCONTEXT_H
+typedef struct _GelContextSegment
+{
+    ucontext_t caller;
+    ucontext_t callee;
+    GelContext *context;
+    GelValueArray *array;
+    GValue *out_value;
+    const GValue *result;
+
+    /* Kept here, as locals could be clobbered across getcontext */
+    gchar *stack;
+    guintptr limit;
+} GelContextSegment;
+
+
+static
+void gel_context_segment_main(void)
+{
+    GelContextSegment *segment = gel_context_thread()->segment;
+    segment->result = gel_context_eval_call(
+        segment->context, segment->array, segment->out_value);
+}
+
+
+/*
+ * Evaluates the call in @array on a segment of stack allocated for it,
+ * so nested calls are only limited by the depth allowed.
+ * Errors and exits leave it as from any other call.
+ */
+static
+const GValue* gel_context_eval_segment(GelContext *self,
+                                       GelContextThread *thread,
+                                       GelValueArray *array,
+                                       GValue *out_value)
+{
+    GelContextSegment segment;
+    segment.context = self;
+    segment.array = array;
+    segment.out_value = out_value;
+    segment.result = NULL;
+    segment.limit = thread->limit;
+
+    segment.stack = thread->spare_stack;
+    thread->spare_stack = NULL;
+    if(segment.stack == NULL)
+        segment.stack = g_malloc(GEL_CONTEXT_SEGMENT_SIZE);
+
+    getcontext(&segment.callee);
+    segment.callee.uc_stack.ss_sp = segment.stack;
+    segment.callee.uc_stack.ss_size = GEL_CONTEXT_SEGMENT_SIZE;
+    segment.callee.uc_link = &segment.caller;
+    makecontext(&segment.callee, gel_context_segment_main, 0);
+
+    thread->limit = (guintptr)segment.stack + GEL_CONTEXT_SEGMENT_MARGIN;
+    thread->segment = &segment;
+    swapcontext(&segment.caller, &segment.callee);
+    thread->limit = segment.limit;
+
+    if(thread->spare_stack == NULL)
+        thread->spare_stack = segment.stack;
+    else
+        g_free(segment.stack);
+
+    return segment.result;
+}
+#endif
+
+
+/*
+ * Evaluates the call in @array, that is not empty.
+ */
+static
+const GValue* gel_context_eval_call(GelContext *self, GelValueArray *array,
+                                    GValue *out_value)
+{
+    GelContextThread *thread = gel_context_thread();
+    const GValue *result = NULL;
+    GValue tmp_value = {0};
+
+    if(thread->depth == 0)
+    {
+        thread->max_depth = gel_context_max_depth();
+        thread->limit = (guintptr)&tmp_value - GEL_CONTEXT_STACK_SIZE;
+    }
+#ifdef HAVE_UCONTEXT_H
+    else
+    if((guintptr)&tmp_value < thread->limit)
+        return gel_context_eval_segment(self, thread, array, out_value);
+#endif
+
+    if(thread->depth < thread->max_depth)
+    {
+        const GValue *array_values = gel_value_array_get_values(array);
+        const guint array_n_values = gel_value_array_get_n_values(array);
+
+        thread->depth++;
+
+        const GValue *first_value =
+            gel_context_eval_into_value(self, array_values + 0, &tmp_value);
+
+        if(!gel_context_error(self))
+            if(GEL_VALUE_HOLDS(first_value, G_TYPE_CLOSURE))
+            {
+                GClosure *closure = gel_value_get_boxed(first_value);
+                if(closure->ref_count < GEL_CONTEXT_MAX_CLOSURE_REFS)
+                {
+                    gel_closure_invoke(closure, out_value,
+                        array_n_values - 1 , array_values + 1, self);
+                    result = out_value;
+                }
+                else
+                {
+                    const gchar *name = gel_closure_get_name(closure);
+                    gel_error_too_many_references(self, __FUNCTION__,
+                        name != NULL ? name : "closure");
+                }
+            }
+
+        if(GEL_IS_VALUE(&tmp_value))
+            g_value_unset(&tmp_value);
+
+        thread->depth--;
+    }
+    else
+        gel_error_too_deep(self, __FUNCTION__, thread->depth);
+
+    if(self->exit != GEL_CONTEXT_EXIT_NONE)
+        gel_context_locate_error(self, array);
+
+    return result;
+}
+
+
 const GValue* gel_context_eval_into_value(GelContext *self,
                                           const GValue *value,
                                           GValue *out_value)
@@ -304,7 +867,7 @@ const GValue* gel_context_eval_into_value(GelContext *self,
             gel_variable_get_value(variable) : gel_symbol_get_value(symbol);
 
         if(result == NULL)
-            result = gel_context_lookup(self, name);
+            result = gel_context_lookup_value(self, name);
 
         if(result == NULL)
             gel_error_unknown_symbol(self, __FUNCTION__, name);
@@ -313,28 +876,8 @@ const GValue* gel_context_eval_into_value(GelContext *self,
     if(type == GEL_TYPE_VALUE_ARRAY)
     {
         GelValueArray *array = gel_value_get_boxed(value);
-        const guint array_n_values = gel_value_array_get_n_values(array);
-        if(array_n_values > 0)
-        {
-            const GValue *array_values = gel_value_array_get_values(array);
-
-            GValue tmp_value = {0};
-            const GValue *first_value =
-                gel_context_eval_into_value(self, array_values + 0, &tmp_value);
-
-
-            if(!gel_context_error(self))
-                if(GEL_VALUE_HOLDS(first_value, G_TYPE_CLOSURE))
-                {
-                    GClosure *closure = gel_value_get_boxed(first_value);
-                    g_closure_invoke(closure,
-                        out_value, array_n_values - 1 , array_values + 1, self);
-                    result = out_value;
-                }
-
-            if(GEL_IS_VALUE(&tmp_value))
-                g_value_unset(&tmp_value);
-        }
+        if(gel_value_array_get_n_values(array) > 0)
+            result = gel_context_eval_call(self, array, out_value);
     }
 
     if(result == NULL)
@@ -356,17 +899,19 @@ gboolean gel_context_error(const GelContext* self)
 {
     g_return_val_if_fail(self != NULL, FALSE);
 
-    return self->error != NULL;
+    return self->exit != GEL_CONTEXT_EXIT_NONE;
 }
 
 
-void gel_context_set_error(GelContext* self, GError *error)
+/*
+ * Makes the error recorded by the gel_error_* functions the error of @self
+ */
+void gel_context_set_error(GelContext* self)
 {
-    g_warn_if_fail(self->error == NULL);
+    g_warn_if_fail(self->exit == GEL_CONTEXT_EXIT_NONE);
 
-    if(self->error != NULL)
-        g_error_free(self->error);
-    self->error = error;
+    self->exit = GEL_CONTEXT_EXIT_ERROR;
+    self->error_located = FALSE;
 }
 
 
@@ -376,8 +921,11 @@ void gel_context_transfer_error(GelContext *self, GelContext *context)
 
     if(self != context)
     {
-        gel_context_set_error(context, self->error);
-        self->error = NULL;
+        g_warn_if_fail(context->exit == GEL_CONTEXT_EXIT_NONE);
+
+        context->exit = self->exit;
+        context->error_located = self->error_located;
+        self->exit = GEL_CONTEXT_EXIT_NONE;
     }
 }
 
@@ -392,7 +940,129 @@ void gel_context_clear_error(GelContext* self)
 {
     g_return_if_fail(self != NULL);
 
-    g_clear_error(&self->error);
+    if(self->exit == GEL_CONTEXT_EXIT_ERROR)
+    {
+        gel_error_clear();
+        self->exit = GEL_CONTEXT_EXIT_NONE;
+    }
+    else
+    if(self->exit != GEL_CONTEXT_EXIT_NONE)
+        gel_context_clear_exit(self, NULL);
+}
+
+
+/*
+ * Takes the error of @self, which has to be an error
+ * and not a non-local exit, leaving @self without it.
+ * Its message is only formatted here.
+ */
+GError* gel_context_steal_error(GelContext *self)
+{
+    g_return_val_if_fail(self->exit == GEL_CONTEXT_EXIT_ERROR, NULL);
+
+    self->exit = GEL_CONTEXT_EXIT_NONE;
+    return gel_error_take();
+}
+
+
+/*
+ * Makes @exit pending in @self, taking @value as the value it returns,
+ * if it is not NULL and holds a value. Every evaluation step in @self
+ * fails from then on, until the exit is taken by the loop or the closure
+ * it exits.
+ */
+void gel_context_exit(GelContext *self, GelContextExit exit, GValue *value)
+{
+    g_return_if_fail(exit != GEL_CONTEXT_EXIT_NONE
+        && exit != GEL_CONTEXT_EXIT_ERROR);
+    g_warn_if_fail(self->exit == GEL_CONTEXT_EXIT_NONE);
+
+    self->exit = exit;
+    self->error_located = TRUE;
+
+    if(value != NULL && GEL_IS_VALUE(value))
+    {
+        gel_context_thread()->exit_value = *value;
+        memset(value, 0, sizeof(GValue));
+    }
+}
+
+
+GelContextExit gel_context_get_exit(const GelContext *self)
+{
+    return self->exit;
+}
+
+
+/*
+ * Takes the exit pending in @self, moving the value it returns, if any,
+ * to @value, which can be NULL to drop it.
+ */
+void gel_context_clear_exit(GelContext *self, GValue *value)
+{
+    g_warn_if_fail(self->exit != GEL_CONTEXT_EXIT_NONE
+        && self->exit != GEL_CONTEXT_EXIT_ERROR);
+
+    self->exit = GEL_CONTEXT_EXIT_NONE;
+
+    GValue *exit_value = &gel_context_thread()->exit_value;
+    if(GEL_IS_VALUE(exit_value))
+    {
+        if(value != NULL)
+        {
+            if(GEL_IS_VALUE(value))
+                g_value_unset(value);
+            *value = *exit_value;
+        }
+        else
+            g_value_unset(exit_value);
+        memset(exit_value, 0, sizeof(GValue));
+    }
+}
+
+
+/*
+ * Replaces the exit pending in @self, that reached
+ * somewhere it can not be taken, by an error.
+ */
+void gel_context_fail_exit(GelContext *self)
+{
+    GelContextExit exit = self->exit;
+    g_return_if_fail(exit != GEL_CONTEXT_EXIT_NONE);
+
+    gel_context_clear_exit(self, NULL);
+
+    switch(exit)
+    {
+        case GEL_CONTEXT_EXIT_BREAK:
+            gel_error_not_inside(self, "break", "loop");
+            break;
+        case GEL_CONTEXT_EXIT_CONTINUE:
+            gel_error_not_inside(self, "continue", "loop");
+            break;
+        case GEL_CONTEXT_EXIT_RETURN:
+            gel_error_not_inside(self, "return", "function");
+            break;
+        default:
+            break;
+    }
+}
+
+
+/*
+ * Takes the break or continue pending in @self, if any, as a loop
+ * evaluating its code in @self does once an iteration fails.
+ *
+ * Returns: #TRUE if the loop goes on, #FALSE otherwise.
+ */
+gboolean gel_context_loop_exit(GelContext *self)
+{
+    GelContextExit exit = gel_context_get_exit(self);
+
+    if(exit == GEL_CONTEXT_EXIT_BREAK || exit == GEL_CONTEXT_EXIT_CONTINUE)
+        gel_context_clear_exit(self, NULL);
+
+    return exit == GEL_CONTEXT_EXIT_CONTINUE;
 }
 
 
@@ -422,6 +1092,18 @@ GelVariable* gel_context_lookup_variable(const GelContext *self,
 }
 
 
+GValue* gel_context_lookup_value(const GelContext *self, const gchar *name)
+{
+    GelVariable *variable = gel_context_lookup_variable(self, name);
+    GValue *result = NULL;
+
+    if(variable != NULL)
+        result = gel_variable_get_value(variable);
+
+    return result;
+}
+
+
 /**
  * gel_context_lookup:
  * @self: #GelContext where to look for the symbol named @name
@@ -430,6 +1112,7 @@ GelVariable* gel_context_lookup_variable(const GelContext *self,
  * If @context has a definition for @name, then returns its value.
  * If not, then it queries the outer context.
  * The returned value is owned by the context so it should not be freed.
+ * Strings are returned as gchararray values.
  *
  * Returns: The value corresponding to @name, or #NULL if could not find it.
  */
@@ -438,11 +1121,9 @@ GValue* gel_context_lookup(const GelContext *self, const gchar *name)
     g_return_val_if_fail(self != NULL, NULL);
     g_return_val_if_fail(name != NULL, NULL);
 
-    GelVariable *variable = gel_context_lookup_variable(self, name);
-    GValue *result = NULL;
-
-    if(variable != NULL)
-        result = gel_variable_get_value(variable);
+    GValue *result = gel_context_lookup_value(self, name);
+    if(result != NULL)
+        gel_value_to_host(result);
 
     return result;
 }
@@ -468,6 +1149,7 @@ void gel_context_define_variable(GelContext *self,
  *
  * Inserts a new symbol to @self with the name given by @name.
  * @self takes ownership of @value so it should not be freed or unset.
+ * A gchararray @value is turned into a string of the script.
  */
 void gel_context_define(GelContext *self,
                         const gchar *name, GValue *value)
@@ -476,6 +1158,7 @@ void gel_context_define(GelContext *self,
     g_return_if_fail(name != NULL);
     g_return_if_fail(value != NULL);
 
+    gel_value_from_host(value);
     g_hash_table_insert(self->variables,
         g_strdup(name), gel_variable_new(value, TRUE));
 }
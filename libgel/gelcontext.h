@@ -26,6 +26,9 @@ GQuark gel_context_error_quark(void);
  * @GEL_CONTEXT_ERROR_PROPERTY: wrong property
  * @GEL_CONTEXT_ERROR_INDEX: invalid index
  * @GEL_CONTEXT_ERROR_KEY: invalid key
+ * @GEL_CONTEXT_ERROR_MODULE: module that can not be loaded
+ * @GEL_CONTEXT_ERROR_EXIT: break, continue or return out of place
+ * @GEL_CONTEXT_ERROR_DEPTH: calls nested too deep
  *
  * Error codes reported by #gel_context_eval
  */
@@ -38,7 +41,10 @@ typedef enum _GelContextError
    GEL_CONTEXT_ERROR_TYPE,
    GEL_CONTEXT_ERROR_PROPERTY,
    GEL_CONTEXT_ERROR_INDEX,
-   GEL_CONTEXT_ERROR_KEY
+   GEL_CONTEXT_ERROR_KEY,
+   GEL_CONTEXT_ERROR_MODULE,
+   GEL_CONTEXT_ERROR_EXIT,
+   GEL_CONTEXT_ERROR_DEPTH
 } GelContextError;
 
 typedef struct _GelContext GelContext;
@@ -78,6 +84,11 @@ gboolean gel_context_remove(GelContext *self, const gchar *name);
 
 gboolean gel_context_eval(GelContext *self, const GValue *value, GValue *dest,
                           GError **error);
+gboolean gel_context_reload_file(GelContext *self, const gchar *file,
+                                 GError **error);
+gboolean gel_context_load_module(GelContext *self, const gchar *file,
+                                 GError **error);
+void gel_context_set_optimize(GelContext *self, gboolean optimize);
 
 gboolean gel_context_error(const GelContext* self);
 void gel_context_clear_error(GelContext* self);
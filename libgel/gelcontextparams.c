@@ -147,7 +147,7 @@ gboolean gel_context_eval_param(GelContext *self, const gchar *func,
             if(gel_context_error(self))
                 parsed = FALSE;
             else
-            if(GEL_VALUE_HOLDS(result, G_TYPE_STRING))
+            if(GEL_VALUE_HOLDS_STRING(result))
                 gel_args_pop(args, const gchar *) = gel_value_get_string(result);
             else
             {
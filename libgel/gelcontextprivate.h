@@ -5,11 +5,21 @@
 #include <gelvariable.h>
 #include <gelclosure.h>
 
+typedef enum _GelContextExit
+{
+    GEL_CONTEXT_EXIT_NONE,
+    GEL_CONTEXT_EXIT_BREAK,
+    GEL_CONTEXT_EXIT_CONTINUE,
+    GEL_CONTEXT_EXIT_RETURN,
+    GEL_CONTEXT_EXIT_ERROR
+} GelContextExit;
+
 void gel_context_define_variable(GelContext *self,
                                  const gchar *name, GelVariable *variable);
 
 GelVariable* gel_context_lookup_variable(const GelContext *self,
                                          const gchar *name);
+GValue* gel_context_lookup_value(const GelContext *self, const gchar *name);
 
 gboolean gel_context_eval_value(GelContext *self,
                                 const GValue *value, GValue *dest);
@@ -27,8 +37,16 @@ GelVariable* gel_context_get_variable(const GelContext *self,
                                       const gchar *name);
 
 void gel_context_set_outer(GelContext *self, GelContext *context);
-void gel_context_set_error(GelContext* self, GError *error);
+void gel_context_set_error(GelContext* self);
 void gel_context_transfer_error(GelContext *self, GelContext *context);
+void gel_context_locate_error(GelContext *self, const GelValueArray *array);
+GError* gel_context_steal_error(GelContext *self);
+
+void gel_context_exit(GelContext *self, GelContextExit exit, GValue *value);
+GelContextExit gel_context_get_exit(const GelContext *self);
+void gel_context_clear_exit(GelContext *self, GValue *value);
+void gel_context_fail_exit(GelContext *self);
+gboolean gel_context_loop_exit(GelContext *self);
 
 GelContext* gel_context_validate(GelContext *context);
 
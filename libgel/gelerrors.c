@@ -1,9 +1,90 @@
+#include <string.h>
+
 #include <gelerrors.h>
 #include <gelvalue.h>
 #include <gelvalueprivate.h>
 #include <gelcontextprivate.h>
 
 
+/*
+ * Errors are recorded as what happened and its operands, and their
+ * message is only formatted when gel_context_eval() hands them to the
+ * host, or a catch takes them. Code using errors to find out whether
+ * something can be done does not pay for the message.
+ *
+ * Only one error is pending at a time in a thread, so each thread has
+ * one record of it. The strings it needs are copied one after the other
+ * into a buffer that is kept from one error to the next.
+ */
+
+typedef enum _GelErrorKind
+{
+    GEL_ERROR_NEEDS_AT_LEAST_N_ARGUMENTS,
+    GEL_ERROR_NEEDS_N_ARGUMENTS,
+    GEL_ERROR_EXPECTED_AT_LEAST_N_ARGUMENTS,
+    GEL_ERROR_EXPECTED_N_ARGUMENTS,
+    GEL_ERROR_NO_SUCH_PROPERTY,
+    GEL_ERROR_VALUE_NOT_OF_TYPE,
+    GEL_ERROR_UNKNOWN_SYMBOL,
+    GEL_ERROR_TYPE_NOT_INSTANTIATABLE,
+    GEL_ERROR_INVALID_VALUE_FOR_PROPERTY,
+    GEL_ERROR_TYPE_NAME_INVALID,
+    GEL_ERROR_INVALID_ARGUMENT_NAME,
+    GEL_ERROR_INDEX_OUT_OF_BOUNDS,
+    GEL_ERROR_INVALID_KEY,
+    GEL_ERROR_NO_SUCH_FIELD,
+    GEL_ERROR_SYMBOL_EXISTS,
+    GEL_ERROR_EXPECTED,
+    GEL_ERROR_NOT_INSIDE,
+    GEL_ERROR_TOO_DEEP,
+    GEL_ERROR_TOO_MANY_REFERENCES,
+    GEL_ERROR_INCOMPATIBLE
+} GelErrorKind;
+
+typedef struct _GelError
+{
+    GelErrorKind kind;
+
+    /* Offsets in strings of the name of the function and of a string */
+    GString *strings;
+    gsize f;
+    gsize s;
+
+    guint n;
+    guint m;
+    gint index;
+    GType type;
+    GParamSpec *pspec;
+    GValue values[2];
+
+    /* Where it happened, if known */
+    gboolean located;
+    gsize file;
+    guint line;
+    guint column;
+} GelError;
+
+static void gel_error_free(GelError *self);
+
+static GPrivate error_PENDING =
+    G_PRIVATE_INIT((GDestroyNotify)gel_error_free);
+
+
+static
+GelError* gel_error_pending(void)
+{
+    GelError *self = g_private_get(&error_PENDING);
+    if(self == NULL)
+    {
+        self = g_new0(GelError, 1);
+        self->strings = g_string_sized_new(128);
+        g_private_set(&error_PENDING, self);
+    }
+
+    return self;
+}
+
+
 static
 const gchar* plural(guint n)
 {
@@ -11,62 +92,309 @@ const gchar* plural(guint n)
 }
 
 
+static
+gsize gel_error_keep(const gchar *string)
+{
+    GString *strings = gel_error_pending()->strings;
+    gsize offset = strings->len;
+
+    if(string == NULL)
+        string = "(null)";
+    g_string_append_len(strings, string, strlen(string) + 1);
+
+    return offset;
+}
+
+
+static
+const gchar* gel_error_string(gsize offset)
+{
+    return gel_error_pending()->strings->str + offset;
+}
+
+
+static
+void gel_error_keep_value(guint i, const GValue *value)
+{
+    if(value != NULL && GEL_IS_VALUE(value))
+        gel_value_copy(value, gel_error_pending()->values + i);
+}
+
+
+static
+gchar* gel_error_repr(guint i)
+{
+    const GValue *value = gel_error_pending()->values + i;
+    return GEL_IS_VALUE(value) ? gel_value_repr(value) : g_strdup("(null)");
+}
+
+
+static
+void gel_error_reset(GelError *self)
+{
+    for(guint i = 0; i < G_N_ELEMENTS(self->values); i++)
+        if(GEL_IS_VALUE(self->values + i))
+            g_value_unset(self->values + i);
+
+    if(self->pspec != NULL)
+    {
+        g_param_spec_unref(self->pspec);
+        self->pspec = NULL;
+    }
+
+    g_string_truncate(self->strings, 0);
+    self->located = FALSE;
+}
+
+
+static
+void gel_error_free(GelError *self)
+{
+    gel_error_reset(self);
+    g_string_free(self->strings, TRUE);
+    g_free(self);
+}
+
+
+/*
+ * Starts recording an error of @kind in @f as the error of @context,
+ * returning the record to store its operands.
+ */
+static
+GelError* gel_error_set(GelContext *context, GelErrorKind kind,
+                        const gchar *f)
+{
+    GelError *e = gel_error_pending();
+    gel_error_reset(e);
+
+    e->kind = kind;
+    e->f = gel_error_keep(f);
+
+    gel_context_set_error(context);
+    return e;
+}
+
+
+/*
+ * Records where the pending error happened,
+ * in @file, or in the text parsed if it is NULL.
+ */
+void gel_error_locate(const gchar *file, guint line, guint column)
+{
+    GelError *e = gel_error_pending();
+    e->located = TRUE;
+    e->file = (file != NULL) ? gel_error_keep(file) : G_MAXSIZE;
+    e->line = line;
+    e->column = column;
+}
+
+
+/*
+ * Drops the pending error, releasing its operands.
+ */
+void gel_error_clear(void)
+{
+    gel_error_reset(gel_error_pending());
+}
+
+
+/*
+ * Formats the pending error into a #GError, and drops it.
+ */
+GError* gel_error_take(void)
+{
+    const GelError *e = gel_error_pending();
+    const gchar *f = gel_error_string(e->f);
+    GelContextError code = GEL_CONTEXT_ERROR_ARGUMENTS;
+    gchar *message = NULL;
+    gchar *s1 = NULL;
+    gchar *s2 = NULL;
+
+    switch(e->kind)
+    {
+        case GEL_ERROR_NEEDS_AT_LEAST_N_ARGUMENTS:
+            message = g_strdup_printf("%s: Needs at least %u argument%s",
+                f, e->n, plural(e->n));
+            break;
+        case GEL_ERROR_NEEDS_N_ARGUMENTS:
+            message = g_strdup_printf("%s: Needs %u argument%s",
+                f, e->n, plural(e->n));
+            break;
+        case GEL_ERROR_EXPECTED_AT_LEAST_N_ARGUMENTS:
+            message = g_strdup_printf(
+                "%s: Expected at least %u arguments, got %u", f, e->n, e->m);
+            break;
+        case GEL_ERROR_EXPECTED_N_ARGUMENTS:
+            message = g_strdup_printf(
+                "%s: Expected %u arguments, got %u", f, e->n, e->m);
+            break;
+        case GEL_ERROR_NO_SUCH_PROPERTY:
+            code = GEL_CONTEXT_ERROR_PROPERTY;
+            message = g_strdup_printf("%s: No such property '%s'",
+                f, gel_error_string(e->s));
+            break;
+        case GEL_ERROR_VALUE_NOT_OF_TYPE:
+            code = GEL_CONTEXT_ERROR_TYPE;
+            s1 = gel_error_repr(0);
+            message = g_strdup_printf("%s: '%s' is not of type '%s'",
+                f, s1, g_type_name(e->type));
+            break;
+        case GEL_ERROR_UNKNOWN_SYMBOL:
+            code = GEL_CONTEXT_ERROR_UNKNOWN_SYMBOL;
+            message = g_strdup_printf("%s: Unknown symbol '%s'",
+                f, gel_error_string(e->s));
+            break;
+        case GEL_ERROR_TYPE_NOT_INSTANTIATABLE:
+            code = GEL_CONTEXT_ERROR_TYPE;
+            message = g_strdup_printf("%s: Type %s is not instantiatable",
+                f, g_type_name(e->type));
+            break;
+        case GEL_ERROR_INVALID_VALUE_FOR_PROPERTY:
+            code = GEL_CONTEXT_ERROR_PROPERTY;
+            s1 = gel_error_repr(0);
+            message = g_strdup_printf("%s: '%s' of type '%s' is invalid "
+                "for property '%s' of type '%s'", f, s1, GEL_VALUE_TYPE_NAME(e->values + 0),
+                e->pspec->name, g_type_name(e->pspec->value_type));
+            break;
+        case GEL_ERROR_TYPE_NAME_INVALID:
+            code = GEL_CONTEXT_ERROR_TYPE;
+            message = g_strdup_printf("%s: '%s' is not a registered type",
+                f, gel_error_string(e->s));
+            break;
+        case GEL_ERROR_INVALID_ARGUMENT_NAME:
+            message = g_strdup_printf("%s: '%s' is an invalid argument name",
+                f, gel_error_string(e->s));
+            break;
+        case GEL_ERROR_INDEX_OUT_OF_BOUNDS:
+            code = GEL_CONTEXT_ERROR_INDEX;
+            message = g_strdup_printf("%s: Index %d out of bounds",
+                f, e->index);
+            break;
+        case GEL_ERROR_INVALID_KEY:
+            code = GEL_CONTEXT_ERROR_KEY;
+            s1 = gel_error_repr(0);
+            message = g_strdup_printf("%s: Invalid key %s", f, s1);
+            break;
+        case GEL_ERROR_NO_SUCH_FIELD:
+            code = GEL_CONTEXT_ERROR_KEY;
+            message = g_strdup_printf("%s: No such field '%s'",
+                f, gel_error_string(e->s));
+            break;
+        case GEL_ERROR_SYMBOL_EXISTS:
+            code = GEL_CONTEXT_ERROR_SYMBOL_EXISTS;
+            message = g_strdup_printf("%s: Symbol '%s' already exists",
+                f, gel_error_string(e->s));
+            break;
+        case GEL_ERROR_EXPECTED:
+            message = g_strdup_printf("%s: Expected %s",
+                f, gel_error_string(e->s));
+            break;
+        case GEL_ERROR_NOT_INSIDE:
+            code = GEL_CONTEXT_ERROR_EXIT;
+            message = g_strdup_printf("%s: Not inside a %s",
+                f, gel_error_string(e->s));
+            break;
+        case GEL_ERROR_TOO_DEEP:
+            code = GEL_CONTEXT_ERROR_DEPTH;
+            message = g_strdup_printf("%s: Maximum depth of %u calls reached",
+                f, e->n);
+            break;
+        case GEL_ERROR_TOO_MANY_REFERENCES:
+            code = GEL_CONTEXT_ERROR_DEPTH;
+            message = g_strdup_printf("%s: Too many references to %s",
+                f, gel_error_string(e->s));
+            break;
+        case GEL_ERROR_INCOMPATIBLE:
+            s1 = gel_error_repr(0);
+            s2 = gel_error_repr(1);
+            message = g_strdup_printf("%s: Incompatible values: %s and %s",
+                f, s1, s2);
+            break;
+    }
+
+    GError *error = NULL;
+    if(!e->located)
+        error = g_error_new(GEL_CONTEXT_ERROR, code, "%s", message);
+    else
+    if(e->file != G_MAXSIZE)
+        error = g_error_new(GEL_CONTEXT_ERROR, code, "%s:%u:%u: %s",
+            gel_error_string(e->file), e->line, e->column, message);
+    else
+        error = g_error_new(GEL_CONTEXT_ERROR, code, "line %u, char %u: %s",
+            e->line, e->column, message);
+
+    g_free(message);
+    g_free(s1);
+    g_free(s2);
+    gel_error_clear();
+
+    return error;
+}
+
+
 void gel_error_needs_at_least_n_arguments(GelContext *context,const gchar *f,
                                           guint n)
 {
-    gel_context_set_error(context, g_error_new(
-        GEL_CONTEXT_ERROR, GEL_CONTEXT_ERROR_ARGUMENTS,
-        "%s: Needs at least %u argument%s", f, n, plural(n)));
+    gel_error_set(context, GEL_ERROR_NEEDS_AT_LEAST_N_ARGUMENTS, f)->n = n;
 }
 
 
 void gel_error_needs_n_arguments(GelContext *context, const gchar *f,
                                  guint n)
 {
-    gel_context_set_error(context, g_error_new(
-        GEL_CONTEXT_ERROR, GEL_CONTEXT_ERROR_ARGUMENTS,
-        "%s: Needs %u argument%s", f, n, plural(n)));
+    gel_error_set(context, GEL_ERROR_NEEDS_N_ARGUMENTS, f)->n = n;
+}
+
+
+void gel_error_expected_at_least_n_arguments(GelContext *context,
+                                             const gchar *f,
+                                             guint n, guint got)
+{
+    GelError *e =
+        gel_error_set(context, GEL_ERROR_EXPECTED_AT_LEAST_N_ARGUMENTS, f);
+    e->n = n;
+    e->m = got;
+}
+
+
+void gel_error_expected_n_arguments(GelContext *context, const gchar *f,
+                                    guint n, guint got)
+{
+    GelError *e = gel_error_set(context, GEL_ERROR_EXPECTED_N_ARGUMENTS, f);
+    e->n = n;
+    e->m = got;
 }
 
 
 void gel_error_no_such_property(GelContext *context, const gchar *f,
                                 const gchar *prop_name)
 {
-    gel_context_set_error(context, g_error_new(
-        GEL_CONTEXT_ERROR, GEL_CONTEXT_ERROR_PROPERTY,
-        "%s: No such property '%s'", f, prop_name));
+    GelError *e = gel_error_set(context, GEL_ERROR_NO_SUCH_PROPERTY, f);
+    e->s = gel_error_keep(prop_name);
 }
 
 
 void gel_error_value_not_of_type(GelContext *context, const gchar *f,
                                  const GValue *value, GType type)
 {
-    gchar *value_string = gel_value_repr(value);
-
-    gel_context_set_error(context, g_error_new(
-        GEL_CONTEXT_ERROR, GEL_CONTEXT_ERROR_TYPE,
-        "%s: '%s' is not of type '%s'", f,
-        value_string, g_type_name(type)));
-
-    g_free(value_string);
+    GelError *e = gel_error_set(context, GEL_ERROR_VALUE_NOT_OF_TYPE, f);
+    gel_error_keep_value(0, value);
+    e->type = type;
 }
 
 
 void gel_error_unknown_symbol(GelContext *context, const gchar *f,
                               const gchar *symbol)
 {
-    gel_context_set_error(context, g_error_new(
-        GEL_CONTEXT_ERROR, GEL_CONTEXT_ERROR_UNKNOWN_SYMBOL,
-        "%s: Unknown symbol '%s'", f, symbol));
+    GelError *e = gel_error_set(context, GEL_ERROR_UNKNOWN_SYMBOL, f);
+    e->s = gel_error_keep(symbol);
 }
 
 
 void gel_error_type_not_instantiatable(GelContext *context, const gchar *f,
                                        GType type)
 {
-    gel_context_set_error(context, g_error_new(
-        GEL_CONTEXT_ERROR, GEL_CONTEXT_ERROR_TYPE,
-        "%s: Type %s is not instantiatable", f, g_type_name(type)));
+    gel_error_set(context, GEL_ERROR_TYPE_NOT_INSTANTIATABLE, f)->type = type;
 }
 
 
@@ -74,87 +402,94 @@ void gel_error_invalid_value_for_property(GelContext *context, const gchar *f,
                                           const GValue *value,
                                           const GParamSpec *pspec)
 {
-    gchar *value_string = gel_value_repr(value);
-
-    gel_context_set_error(context, g_error_new(
-        GEL_CONTEXT_ERROR, GEL_CONTEXT_ERROR_PROPERTY,
-        "%s: '%s' of type '%s' is invalid for property '%s' of type '%s'",
-        f, value_string, GEL_VALUE_TYPE_NAME(value),
-        pspec->name, g_type_name(pspec->value_type)));
-
-    g_free(value_string);
+    GelError *e =
+        gel_error_set(context, GEL_ERROR_INVALID_VALUE_FOR_PROPERTY, f);
+    gel_error_keep_value(0, value);
+    e->pspec = g_param_spec_ref((GParamSpec *)pspec);
 }
 
 
 void gel_error_type_name_invalid(GelContext *context, const gchar *f,
                                    const gchar *name)
 {
-
-    gel_context_set_error(context, g_error_new(
-        GEL_CONTEXT_ERROR, GEL_CONTEXT_ERROR_TYPE,
-        "%s: '%s' is not a registered type", f, name));
+    GelError *e = gel_error_set(context, GEL_ERROR_TYPE_NAME_INVALID, f);
+    e->s = gel_error_keep(name);
 }
 
 
 void gel_error_invalid_argument_name(GelContext *context, const gchar *f,
                                        const gchar *name)
 {
-    gel_context_set_error(context, g_error_new(
-        GEL_CONTEXT_ERROR, GEL_CONTEXT_ERROR_ARGUMENTS,
-        "%s: '%s' is an invalid argument name", f, name));
+    GelError *e = gel_error_set(context, GEL_ERROR_INVALID_ARGUMENT_NAME, f);
+    e->s = gel_error_keep(name);
 }
 
 
 void gel_error_index_out_of_bounds(GelContext *context, const gchar *f,
                                      gint index)
 {
-    gel_context_set_error(context, g_error_new(
-        GEL_CONTEXT_ERROR, GEL_CONTEXT_ERROR_INDEX,
-        "%s: Index %d out of bounds", f, index));
+    gel_error_set(context, GEL_ERROR_INDEX_OUT_OF_BOUNDS, f)->index = index;
 }
 
 
 void gel_error_invalid_key(GelContext *context, const gchar *f,
                              GValue *key)
 {
-    gchar *value_string = gel_value_repr(key);
+    gel_error_set(context, GEL_ERROR_INVALID_KEY, f);
+    gel_error_keep_value(0, key);
+}
 
-    gel_context_set_error(context, g_error_new(
-        GEL_CONTEXT_ERROR, GEL_CONTEXT_ERROR_KEY,
-        "%s: Invalid key %s", f, value_string));
 
-    g_free(value_string);
+void gel_error_no_such_field(GelContext *context, const gchar *f,
+                             const gchar *name)
+{
+    GelError *e = gel_error_set(context, GEL_ERROR_NO_SUCH_FIELD, f);
+    e->s = gel_error_keep(name);
 }
 
 
 void gel_error_symbol_exists(GelContext *context, const gchar *f,
                                const gchar *name)
 {
-    gel_context_set_error(context, g_error_new(
-        GEL_CONTEXT_ERROR, GEL_CONTEXT_ERROR_SYMBOL_EXISTS,
-        "%s: Symbol '%s' already exists", f, name));
+    GelError *e = gel_error_set(context, GEL_ERROR_SYMBOL_EXISTS, f);
+    e->s = gel_error_keep(name);
 }
 
 
 void gel_error_expected(GelContext *context, const gchar *f,
                           const gchar *s)
 {
-    gel_context_set_error(context, g_error_new(
-        GEL_CONTEXT_ERROR, GEL_CONTEXT_ERROR_ARGUMENTS,
-        "%s: Expected %s", f, s));
+    GelError *e = gel_error_set(context, GEL_ERROR_EXPECTED, f);
+    e->s = gel_error_keep(s);
 }
 
 
-void gel_error_incompatible(GelContext *context, const gchar *f,
-                              const GValue *v1, const GValue *v2)
+void gel_error_not_inside(GelContext *context, const gchar *f,
+                          const gchar *s)
 {
-    gchar *s1 = gel_value_repr(v1);
-    gchar *s2 = gel_value_repr(v2);
+    GelError *e = gel_error_set(context, GEL_ERROR_NOT_INSIDE, f);
+    e->s = gel_error_keep(s);
+}
 
-    gel_context_set_error(context, g_error_new(
-        GEL_CONTEXT_ERROR, GEL_CONTEXT_ERROR_ARGUMENTS,
-        "%s: Incompatible values: %s and %s", f, s1, s2));
 
-    g_free(s1);
-    g_free(s2);
+void gel_error_too_deep(GelContext *context, const gchar *f, guint depth)
+{
+    gel_error_set(context, GEL_ERROR_TOO_DEEP, f)->n = depth;
+}
+
+
+void gel_error_too_many_references(GelContext *context, const gchar *f,
+                                   const gchar *s)
+{
+    GelError *e = gel_error_set(context, GEL_ERROR_TOO_MANY_REFERENCES, f);
+    e->s = gel_error_keep(s);
+}
+
+
+void gel_error_incompatible(GelContext *context, const gchar *f,
+                              const GValue *v1, const GValue *v2)
+{
+    gel_error_set(context, GEL_ERROR_INCOMPATIBLE, f);
+    gel_error_keep_value(0, v1);
+    gel_error_keep_value(1, v2);
 }
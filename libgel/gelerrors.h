@@ -11,6 +11,13 @@ void gel_error_needs_at_least_n_arguments(GelContext *context,
 void gel_error_needs_n_arguments(GelContext *context,
                                  const gchar *func, guint n);
 
+void gel_error_expected_at_least_n_arguments(GelContext *context,
+                                             const gchar *func,
+                                             guint n, guint got);
+
+void gel_error_expected_n_arguments(GelContext *context,
+                                    const gchar *func, guint n, guint got);
+
 void gel_error_no_such_property(GelContext *context,
                                 const gchar *func, const gchar *prop_name);
 
@@ -40,14 +47,29 @@ void gel_error_index_out_of_bounds(GelContext *context,
 void gel_error_invalid_key(GelContext *context,
                            const gchar *func, GValue *key);
 
+void gel_error_no_such_field(GelContext *context,
+                             const gchar *func, const gchar *name);
+
 void gel_error_symbol_exists(GelContext *context,
                              const gchar *func, const gchar *name);
 
 void gel_error_expected(GelContext *context,
                         const gchar *func, const gchar *s);
 
+void gel_error_not_inside(GelContext *context,
+                          const gchar *f, const gchar *s);
+
+void gel_error_too_deep(GelContext *context, const gchar *f, guint depth);
+
+void gel_error_too_many_references(GelContext *context, const gchar *f,
+                                   const gchar *s);
+
 void gel_error_incompatible(GelContext *context, const gchar *f,
                             const GValue *v1, const GValue *v2);
 
+void gel_error_locate(const gchar *file, guint line, guint column);
+void gel_error_clear(void);
+GError* gel_error_take(void);
+
 #endif
 
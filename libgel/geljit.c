@@ -0,0 +1,408 @@
+#include <config.h>
+
+#include <geljit.h>
+
+#ifdef GEL_JIT
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include <gelnative.h>
+
+
+/*
+ * Compiles closures written in gel to x86-64 code, one template of
+ * machine code for each of the instructions their code is translated
+ * to by gelnative.c, once they are called often enough.
+ *
+ * The variables live in an array of int64 pointed by rbx, the
+ * accumulator is rax, and rcx holds the right operands.
+ * r12 points to where the result goes, r13 is the context of the call
+ * and r14 keeps the stack pointer while calling closures.
+ * The environment variable GEL_JIT can be set to "0" to interpret
+ * every closure.
+ */
+
+typedef struct _GelJitCompiler GelJitCompiler;
+
+struct _GelJit
+{
+    guint8 *code;
+    gsize size;
+    GelModuleFunc function;
+    GelNative *native;
+};
+
+struct _GelJitCompiler
+{
+    GByteArray *code;
+    const GelNative *native;
+
+    /* Offset of each label, and the offsets of the jumps to them */
+    guint *labels;
+    GArray *jumps;
+
+    /* Offsets of the jumps to where the compiled code returns
+       what the closures it calls do, when they are not done */
+    GArray *exits;
+};
+
+/* A jump to be patched once its label is known */
+typedef struct _GelJitJump
+{
+    guint offset;
+    guint label;
+} GelJitJump;
+
+#define GEL_JIT_EMIT(c, ...) \
+    G_STMT_START { \
+        static const guint8 bytes[] = {__VA_ARGS__}; \
+        g_byte_array_append((c)->code, bytes, sizeof(bytes)); \
+    } G_STMT_END
+
+
+static
+gboolean gel_jit_enabled(void)
+{
+    static volatile gsize once = 0;
+    static gboolean enabled = TRUE;
+
+    if(g_once_init_enter(&once))
+    {
+        enabled = (g_strcmp0(g_getenv("GEL_JIT"), "0") != 0);
+        g_once_init_leave(&once, 1);
+    }
+
+    return enabled;
+}
+
+
+static
+void gel_jit_emit_int32(GelJitCompiler *c, gint32 value)
+{
+    g_byte_array_append(c->code, (const guint8*)&value, sizeof(value));
+}
+
+
+static
+void gel_jit_emit_int64(GelJitCompiler *c, gint64 value)
+{
+    g_byte_array_append(c->code, (const guint8*)&value, sizeof(value));
+}
+
+
+/* Emits a jump with the opcode @op, returning where its offset goes */
+static
+guint gel_jit_emit_jump(GelJitCompiler *c, const guint8 *op, guint n_op)
+{
+    g_byte_array_append(c->code, op, n_op);
+    guint offset = c->code->len;
+    gel_jit_emit_int32(c, 0);
+    return offset;
+}
+
+
+static
+guint gel_jit_emit_jmp(GelJitCompiler *c)
+{
+    static const guint8 jmp[] = {0xE9};
+    return gel_jit_emit_jump(c, jmp, sizeof(jmp));
+}
+
+
+/* Jumps if rax is 0 */
+static
+guint gel_jit_emit_jz(GelJitCompiler *c)
+{
+    static const guint8 jz[] = {0x0F, 0x84};
+    GEL_JIT_EMIT(c, 0x48, 0x85, 0xC0);
+    return gel_jit_emit_jump(c, jz, sizeof(jz));
+}
+
+
+/* Makes the jump whose offset is at @offset go to @target */
+static
+void gel_jit_patch(GelJitCompiler *c, guint offset, guint target)
+{
+    gint32 relative = (gint32)target - (gint32)(offset + sizeof(gint32));
+    memcpy(c->code->data + offset, &relative, sizeof(relative));
+}
+
+
+static
+void gel_jit_emit_slot(GelJitCompiler *c, const guint8 *op, guint slot)
+{
+    g_byte_array_append(c->code, op, 3);
+    gel_jit_emit_int32(c, slot * sizeof(gint64));
+}
+
+
+
+
+/* Makes the jump whose offset is at @offset go to @label, once known */
+static
+void gel_jit_jump_to(GelJitCompiler *c, guint offset, guint label)
+{
+    GelJitJump jump = {offset, label};
+    g_array_append_val(c->jumps, jump);
+}
+
+
+/*
+ * Makes @call, returning what it does unless it is done,
+ * and leaves its result in rax if it has one.
+ */
+static
+void gel_jit_emit_call(GelJitCompiler *c, const GelModuleCall *call)
+{
+    /* mov r14, rsp; and rsp, -16; mov rdi, call */
+    GEL_JIT_EMIT(c, 0x49, 0x89, 0xE6, 0x48, 0x83, 0xE4, 0xF0, 0x48, 0xBF);
+    gel_jit_emit_int64(c, (gint64)(gintptr)call);
+
+    /* mov rsi, rbx; mov rdx, r13; mov rax, invoke; call rax; mov rsp, r14 */
+    GEL_JIT_EMIT(c, 0x48, 0x89, 0xDE, 0x4C, 0x89, 0xEA, 0x48, 0xB8);
+    gel_jit_emit_int64(c, (gint64)(gintptr)gel_module_call);
+    GEL_JIT_EMIT(c, 0xFF, 0xD0, 0x4C, 0x89, 0xF4);
+
+    /* cmp eax, GEL_MODULE_DONE; jne end */
+    static const guint8 jne[] = {0x0F, 0x85};
+    GEL_JIT_EMIT(c, 0x83, 0xF8, GEL_MODULE_DONE);
+    guint exit = gel_jit_emit_jump(c, jne, sizeof(jne));
+    g_array_append_val(c->exits, exit);
+
+    if(call->result != 0)
+    {
+        static const guint8 load[] = {0x48, 0x8B, 0x83};
+        gel_jit_emit_slot(c, load, call->result - 1);
+    }
+}
+
+
+/* Divides rax by rcx, calling @division instead of dividing by 0 */
+static
+void gel_jit_emit_division(GelJitCompiler *c, GelNativeOpCode code,
+                           const GelModuleCall *division)
+{
+    static const guint8 jnz[] = {0x0F, 0x85};
+    static const guint8 store[] = {0x48, 0x89, 0x83};
+    static const guint8 store_rcx[] = {0x48, 0x89, 0x8B};
+
+    guint end = 0;
+    if(division != NULL)
+    {
+        GEL_JIT_EMIT(c, 0x48, 0x85, 0xC9);
+        guint divide = gel_jit_emit_jump(c, jnz, sizeof(jnz));
+
+        gel_jit_emit_slot(c, store, division->slots[0] - 1);
+        gel_jit_emit_slot(c, store_rcx, division->slots[1] - 1);
+        gel_jit_emit_call(c, division);
+        end = gel_jit_emit_jmp(c);
+
+        gel_jit_patch(c, divide, c->code->len);
+    }
+
+    /* cqo; idiv rcx; mov rax, rdx for the remainder */
+    GEL_JIT_EMIT(c, 0x48, 0x99, 0x48, 0xF7, 0xF9);
+    if(code == GEL_NATIVE_MODULO)
+        GEL_JIT_EMIT(c, 0x48, 0x89, 0xD0);
+
+    if(division != NULL)
+        gel_jit_patch(c, end, c->code->len);
+}
+
+
+/* Compares rax to rcx, leaving 1 in rax if they are as @code says */
+static
+void gel_jit_emit_comparison(GelJitCompiler *c, GelNativeOpCode code)
+{
+    static const guint8 setcc[] =
+    {
+        0x9F, /* GEL_NATIVE_GREATER */
+        0x9D, /* GEL_NATIVE_GREATER_EQUAL */
+        0x94, /* GEL_NATIVE_EQUAL */
+        0x9E, /* GEL_NATIVE_LESS_EQUAL */
+        0x9C, /* GEL_NATIVE_LESS */
+        0x95  /* GEL_NATIVE_NOT_EQUAL */
+    };
+
+    /* cmp rax, rcx; setcc al; movzx eax, al */
+    GEL_JIT_EMIT(c, 0x48, 0x39, 0xC8);
+    guint8 set[] =
+        {0x0F, setcc[code - GEL_NATIVE_GREATER], 0xC0, 0x0F, 0xB6, 0xC0};
+    g_byte_array_append(c->code, set, sizeof(set));
+}
+
+
+static
+void gel_jit_emit_op(GelJitCompiler *c, const GelNativeOp *op)
+{
+    static const guint8 load[] = {0x48, 0x8B, 0x83};
+    static const guint8 store[] = {0x48, 0x89, 0x83};
+
+    switch(op->code)
+    {
+        case GEL_NATIVE_CONSTANT:
+            GEL_JIT_EMIT(c, 0x48, 0xB8);
+            gel_jit_emit_int64(c, op->operand);
+            break;
+        case GEL_NATIVE_LOAD:
+            gel_jit_emit_slot(c, load, op->operand);
+            break;
+        case GEL_NATIVE_STORE:
+            gel_jit_emit_slot(c, store, op->operand);
+            break;
+        case GEL_NATIVE_PUSH:
+            GEL_JIT_EMIT(c, 0x50);
+            break;
+        case GEL_NATIVE_OPERAND:
+            /* mov rcx, rax; pop rax */
+            GEL_JIT_EMIT(c, 0x48, 0x89, 0xC1, 0x58);
+            break;
+        case GEL_NATIVE_ADD:
+            GEL_JIT_EMIT(c, 0x48, 0x01, 0xC8);
+            break;
+        case GEL_NATIVE_SUBTRACT:
+            GEL_JIT_EMIT(c, 0x48, 0x29, 0xC8);
+            break;
+        case GEL_NATIVE_MULTIPLY:
+            GEL_JIT_EMIT(c, 0x48, 0x0F, 0xAF, 0xC1);
+            break;
+        case GEL_NATIVE_DIVIDE:
+        case GEL_NATIVE_MODULO:
+            gel_jit_emit_division(c, op->code, (op->operand != 0)
+                ? g_ptr_array_index(c->native->calls, op->operand - 1)
+                : NULL);
+            break;
+        case GEL_NATIVE_GREATER:
+        case GEL_NATIVE_GREATER_EQUAL:
+        case GEL_NATIVE_EQUAL:
+        case GEL_NATIVE_LESS_EQUAL:
+        case GEL_NATIVE_LESS:
+        case GEL_NATIVE_NOT_EQUAL:
+            gel_jit_emit_comparison(c, op->code);
+            break;
+        case GEL_NATIVE_LABEL:
+            c->labels[op->operand] = c->code->len;
+            break;
+        case GEL_NATIVE_JUMP:
+            gel_jit_jump_to(c, gel_jit_emit_jmp(c), op->operand);
+            break;
+        case GEL_NATIVE_JUMP_IF_FALSE:
+            gel_jit_jump_to(c, gel_jit_emit_jz(c), op->operand);
+            break;
+        case GEL_NATIVE_CALL:
+            gel_jit_emit_call(c,
+                g_ptr_array_index(c->native->calls, op->operand));
+            break;
+    }
+}
+
+
+/*
+ * Compiles @code, the code of a closure taking @args and
+ * defined in @context, or returns NULL if it can not be compiled.
+ */
+GelJit* gel_jit_compile(const GList *args, GelValueArray *code,
+                        GelContext *context)
+{
+    g_return_val_if_fail(code != NULL, NULL);
+    g_return_val_if_fail(context != NULL, NULL);
+
+    if(!gel_jit_enabled())
+        return NULL;
+
+    GelNative *native = gel_native_new(args, code, context);
+    if(native == NULL)
+        return NULL;
+
+    GelJitCompiler c = {0};
+    c.code = g_byte_array_new();
+    c.native = native;
+    c.labels = g_new0(guint, native->n_labels);
+    c.jumps = g_array_new(FALSE, FALSE, sizeof(GelJitJump));
+    c.exits = g_array_new(FALSE, FALSE, sizeof(guint));
+
+    /* push rbp; mov rbp, rsp; push rbx; push r12; push r13; push r14 */
+    GEL_JIT_EMIT(&c, 0x55, 0x48, 0x89, 0xE5, 0x53, 0x41, 0x54,
+        0x41, 0x55, 0x41, 0x56);
+
+    /* mov rbx, rdi; mov r12, rsi; mov r13, rdx */
+    GEL_JIT_EMIT(&c, 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4, 0x49, 0x89, 0xD5);
+
+    for(guint i = 0; i < native->ops->len; i++)
+        gel_jit_emit_op(&c, &g_array_index(native->ops, GelNativeOp, i));
+
+    /* mov [r12], rax; mov eax, GEL_MODULE_DONE */
+    GEL_JIT_EMIT(&c, 0x49, 0x89, 0x04, 0x24, 0xB8, GEL_MODULE_DONE, 0, 0, 0);
+
+    /* lea rsp, [rbp - 32]; pop r14; pop r13; pop r12; pop rbx; pop rbp; ret */
+    guint end = c.code->len;
+    GEL_JIT_EMIT(&c, 0x48, 0x8D, 0x65, 0xE0, 0x41, 0x5E, 0x41, 0x5D,
+        0x41, 0x5C, 0x5B, 0x5D, 0xC3);
+
+    for(guint i = 0; i < c.jumps->len; i++)
+    {
+        const GelJitJump *jump = &g_array_index(c.jumps, GelJitJump, i);
+        gel_jit_patch(&c, jump->offset, c.labels[jump->label]);
+    }
+
+    for(guint i = 0; i < c.exits->len; i++)
+        gel_jit_patch(&c, g_array_index(c.exits, guint, i), end);
+
+    GelJit *self = NULL;
+    guint8 *pages = mmap(NULL, c.code->len, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(pages != MAP_FAILED)
+    {
+        memcpy(pages, c.code->data, c.code->len);
+        if(mprotect(pages, c.code->len, PROT_READ | PROT_EXEC) == 0)
+        {
+            self = g_slice_new0(GelJit);
+            self->code = pages;
+            self->size = c.code->len;
+            self->function = (GelModuleFunc)pages;
+            self->native = native;
+        }
+        else
+            munmap(pages, c.code->len);
+    }
+
+    if(self == NULL)
+        gel_native_free(native);
+    g_array_free(c.exits, TRUE);
+    g_array_free(c.jumps, TRUE);
+    g_free(c.labels);
+    g_byte_array_free(c.code, TRUE);
+
+    return self;
+}
+
+
+/*
+ * Calls the code compiled in @self with the arguments @values, from
+ * @context, storing its result in @return_value, if not NULL.
+ * Returns FALSE, leaving @return_value untouched, if the arguments are
+ * not int64 or the code gave up, so the call has to be interpreted.
+ * Errors raised by the code are left in @context.
+ */
+gboolean gel_jit_call(const GelJit *self, const GValue *values,
+                      GValue *return_value, GelContext *context)
+{
+    g_return_val_if_fail(self != NULL, FALSE);
+
+    return gel_native_call(self->native, self->function,
+        values, return_value, context);
+}
+
+
+void gel_jit_free(GelJit *self)
+{
+    g_return_if_fail(self != NULL);
+
+    munmap(self->code, self->size);
+    gel_native_free(self->native);
+    g_slice_free(GelJit, self);
+}
+
+#endif
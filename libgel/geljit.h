@@ -0,0 +1,27 @@
+#ifndef __GEL_JIT_H__
+#define __GEL_JIT_H__
+
+#include <glib-object.h>
+#include <gelcontext.h>
+#include <gelarray.h>
+
+#if defined(ENABLE_JIT) && defined(__GNUC__) && defined(__x86_64__) \
+    && defined(__linux__)
+#define GEL_JIT 1
+#endif
+
+/* Calls to a closure before it is compiled */
+#ifndef GEL_JIT_THRESHOLD
+#define GEL_JIT_THRESHOLD 64
+#endif
+
+typedef struct _GelJit GelJit;
+
+GelJit* gel_jit_compile(const GList *args, GelValueArray *code,
+                        GelContext *context);
+gboolean gel_jit_call(const GelJit *self, const GValue *values,
+                      GValue *return_value, GelContext *context);
+void gel_jit_free(GelJit *self);
+
+#endif
+
@@ -0,0 +1,797 @@
+#include <config.h>
+
+#include <gelkernels.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+    && defined(HAVE_IMMINTRIN_H)
+#define GEL_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+
+/*
+ * Numeric kernels working on the packed buffers of arrays.
+ * There is a plain C version of each kernel and, on x86, versions using
+ * SSE2 and AVX2. The best set supported by the CPU is chosen the first
+ * time the kernels are requested; the environment variable GEL_KERNELS
+ * can be set to "scalar", "sse2" or "avx2" to pick a lower one.
+ *
+ * Vectorized reductions add the values in a different order than the
+ * plain C loops, so results on doubles may differ in the last bits.
+ */
+
+
+/* Loops shared by every version, also used for the remaining elements */
+
+#define GEL_KERNEL_SCALAR_MAP(A, B) \
+    switch(op) \
+    { \
+        case GEL_KERNEL_ADD: \
+            for(; i < n; i++) dest[i] = (A) + (B); \
+            break; \
+        case GEL_KERNEL_SUB: \
+            for(; i < n; i++) dest[i] = (A) - (B); \
+            break; \
+        case GEL_KERNEL_MUL: \
+            for(; i < n; i++) dest[i] = (A) * (B); \
+            break; \
+        case GEL_KERNEL_DIV: \
+            for(; i < n; i++) dest[i] = (A) / (B); \
+            break; \
+        case GEL_KERNEL_RSUB: \
+            for(; i < n; i++) dest[i] = (B) - (A); \
+            break; \
+        case GEL_KERNEL_RDIV: \
+            for(; i < n; i++) dest[i] = (B) / (A); \
+            break; \
+    }
+
+
+static
+gdouble scalar_sum_doubles(const gdouble *a, guint n)
+{
+    gdouble result = 0;
+    for(guint i = 0; i < n; i++)
+        result += a[i];
+    return result;
+}
+
+
+static
+gint64 scalar_sum_int64s(const gint64 *a, guint n)
+{
+    gint64 result = 0;
+    for(guint i = 0; i < n; i++)
+        result += a[i];
+    return result;
+}
+
+
+static
+gdouble scalar_min_doubles(const gdouble *a, guint n)
+{
+    gdouble result = a[0];
+    for(guint i = 1; i < n; i++)
+        if(a[i] < result)
+            result = a[i];
+    return result;
+}
+
+
+static
+gdouble scalar_max_doubles(const gdouble *a, guint n)
+{
+    gdouble result = a[0];
+    for(guint i = 1; i < n; i++)
+        if(a[i] > result)
+            result = a[i];
+    return result;
+}
+
+
+static
+gint64 scalar_min_int64s(const gint64 *a, guint n)
+{
+    gint64 result = a[0];
+    for(guint i = 1; i < n; i++)
+        if(a[i] < result)
+            result = a[i];
+    return result;
+}
+
+
+static
+gint64 scalar_max_int64s(const gint64 *a, guint n)
+{
+    gint64 result = a[0];
+    for(guint i = 1; i < n; i++)
+        if(a[i] > result)
+            result = a[i];
+    return result;
+}
+
+
+static
+gdouble scalar_dot_doubles(const gdouble *a, const gdouble *b, guint n)
+{
+    gdouble result = 0;
+    for(guint i = 0; i < n; i++)
+        result += a[i] * b[i];
+    return result;
+}
+
+
+static
+gint64 scalar_dot_int64s(const gint64 *a, const gint64 *b, guint n)
+{
+    gint64 result = 0;
+    for(guint i = 0; i < n; i++)
+        result += a[i] * b[i];
+    return result;
+}
+
+
+static
+void scalar_map_doubles(GelKernelOp op, const gdouble *a, const gdouble *b,
+                        gdouble *dest, guint n)
+{
+    guint i = 0;
+    GEL_KERNEL_SCALAR_MAP(a[i], b[i]);
+}
+
+
+static
+void scalar_map_doubles_scalar(GelKernelOp op, const gdouble *a, gdouble b,
+                               gdouble *dest, guint n)
+{
+    guint i = 0;
+    GEL_KERNEL_SCALAR_MAP(a[i], b);
+}
+
+
+static
+void scalar_map_int64s(GelKernelOp op, const gint64 *a, const gint64 *b,
+                       gint64 *dest, guint n)
+{
+    guint i = 0;
+    GEL_KERNEL_SCALAR_MAP(a[i], b[i]);
+}
+
+
+static
+void scalar_map_int64s_scalar(GelKernelOp op, const gint64 *a, gint64 b,
+                              gint64 *dest, guint n)
+{
+    guint i = 0;
+    GEL_KERNEL_SCALAR_MAP(a[i], b);
+}
+
+
+static
+void scalar_cumsum_doubles(const gdouble *a, gdouble *dest, guint n)
+{
+    gdouble sum = 0;
+    for(guint i = 0; i < n; i++)
+        dest[i] = (sum += a[i]);
+}
+
+
+static
+void scalar_cumsum_int64s(const gint64 *a, gint64 *dest, guint n)
+{
+    gint64 sum = 0;
+    for(guint i = 0; i < n; i++)
+        dest[i] = (sum += a[i]);
+}
+
+
+static const GelKernels scalar_KERNELS =
+{
+    "scalar",
+    scalar_sum_doubles,
+    scalar_sum_int64s,
+    scalar_min_doubles,
+    scalar_max_doubles,
+    scalar_min_int64s,
+    scalar_max_int64s,
+    scalar_dot_doubles,
+    scalar_dot_int64s,
+    scalar_map_doubles,
+    scalar_map_doubles_scalar,
+    scalar_map_int64s,
+    scalar_map_int64s_scalar,
+    scalar_cumsum_doubles,
+    scalar_cumsum_int64s
+};
+
+
+#ifdef GEL_KERNELS_X86
+
+/* Vector loops, B is either a vector loaded from b + i or a broadcast */
+
+#define GEL_KERNEL_VECTOR_MAP(W, LOAD, STORE, ADD, SUB, MUL, DIV, B) \
+    switch(op) \
+    { \
+        case GEL_KERNEL_ADD: \
+            for(; i + W <= n; i += W) \
+                STORE(dest + i, ADD(LOAD(a + i), B)); \
+            break; \
+        case GEL_KERNEL_SUB: \
+            for(; i + W <= n; i += W) \
+                STORE(dest + i, SUB(LOAD(a + i), B)); \
+            break; \
+        case GEL_KERNEL_MUL: \
+            for(; i + W <= n; i += W) \
+                STORE(dest + i, MUL(LOAD(a + i), B)); \
+            break; \
+        case GEL_KERNEL_DIV: \
+            for(; i + W <= n; i += W) \
+                STORE(dest + i, DIV(LOAD(a + i), B)); \
+            break; \
+        case GEL_KERNEL_RSUB: \
+            for(; i + W <= n; i += W) \
+                STORE(dest + i, SUB(B, LOAD(a + i))); \
+            break; \
+        case GEL_KERNEL_RDIV: \
+            for(; i + W <= n; i += W) \
+                STORE(dest + i, DIV(B, LOAD(a + i))); \
+            break; \
+    }
+
+/* There are no 64 bits integer multiplications nor divisions */
+#define GEL_KERNEL_VECTOR_MAP_INT(W, LOAD, STORE, ADD, SUB, B) \
+    switch(op) \
+    { \
+        case GEL_KERNEL_ADD: \
+            for(; i + W <= n; i += W) \
+                STORE(dest + i, ADD(LOAD(a + i), B)); \
+            break; \
+        case GEL_KERNEL_SUB: \
+            for(; i + W <= n; i += W) \
+                STORE(dest + i, SUB(LOAD(a + i), B)); \
+            break; \
+        case GEL_KERNEL_RSUB: \
+            for(; i + W <= n; i += W) \
+                STORE(dest + i, SUB(B, LOAD(a + i))); \
+            break; \
+        default: \
+            break; \
+    }
+
+#define sse2_load_epi64(p) _mm_loadu_si128((const __m128i*)(p))
+#define sse2_store_epi64(p, v) _mm_storeu_si128((__m128i*)(p), (v))
+#define avx2_load_epi64(p) _mm256_loadu_si256((const __m256i*)(p))
+#define avx2_store_epi64(p, v) _mm256_storeu_si256((__m256i*)(p), (v))
+
+
+static __attribute__((target("sse2")))
+gdouble sse2_sum_doubles(const gdouble *a, guint n)
+{
+    __m128d s0 = _mm_setzero_pd();
+    __m128d s1 = _mm_setzero_pd();
+    guint i = 0;
+
+    for(; i + 4 <= n; i += 4)
+    {
+        s0 = _mm_add_pd(s0, _mm_loadu_pd(a + i));
+        s1 = _mm_add_pd(s1, _mm_loadu_pd(a + i + 2));
+    }
+
+    gdouble lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(s0, s1));
+
+    gdouble result = lanes[0] + lanes[1];
+    for(; i < n; i++)
+        result += a[i];
+    return result;
+}
+
+
+static __attribute__((target("sse2")))
+gint64 sse2_sum_int64s(const gint64 *a, guint n)
+{
+    __m128i s = _mm_setzero_si128();
+    guint i = 0;
+
+    for(; i + 2 <= n; i += 2)
+        s = _mm_add_epi64(s, sse2_load_epi64(a + i));
+
+    gint64 lanes[2];
+    sse2_store_epi64(lanes, s);
+
+    gint64 result = lanes[0] + lanes[1];
+    for(; i < n; i++)
+        result += a[i];
+    return result;
+}
+
+
+static __attribute__((target("sse2")))
+gdouble sse2_min_doubles(const gdouble *a, guint n)
+{
+    __m128d m = _mm_set1_pd(a[0]);
+    guint i = 0;
+
+    for(; i + 2 <= n; i += 2)
+        m = _mm_min_pd(m, _mm_loadu_pd(a + i));
+
+    gdouble lanes[2];
+    _mm_storeu_pd(lanes, m);
+
+    gdouble result = MIN(lanes[0], lanes[1]);
+    for(; i < n; i++)
+        if(a[i] < result)
+            result = a[i];
+    return result;
+}
+
+
+static __attribute__((target("sse2")))
+gdouble sse2_max_doubles(const gdouble *a, guint n)
+{
+    __m128d m = _mm_set1_pd(a[0]);
+    guint i = 0;
+
+    for(; i + 2 <= n; i += 2)
+        m = _mm_max_pd(m, _mm_loadu_pd(a + i));
+
+    gdouble lanes[2];
+    _mm_storeu_pd(lanes, m);
+
+    gdouble result = MAX(lanes[0], lanes[1]);
+    for(; i < n; i++)
+        if(a[i] > result)
+            result = a[i];
+    return result;
+}
+
+
+static __attribute__((target("sse2")))
+gdouble sse2_dot_doubles(const gdouble *a, const gdouble *b, guint n)
+{
+    __m128d s0 = _mm_setzero_pd();
+    __m128d s1 = _mm_setzero_pd();
+    guint i = 0;
+
+    for(; i + 4 <= n; i += 4)
+    {
+        s0 = _mm_add_pd(s0,
+            _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        s1 = _mm_add_pd(s1,
+            _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+
+    gdouble lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(s0, s1));
+
+    gdouble result = lanes[0] + lanes[1];
+    for(; i < n; i++)
+        result += a[i] * b[i];
+    return result;
+}
+
+
+static __attribute__((target("sse2")))
+void sse2_map_doubles(GelKernelOp op, const gdouble *a, const gdouble *b,
+                      gdouble *dest, guint n)
+{
+    guint i = 0;
+    GEL_KERNEL_VECTOR_MAP(2, _mm_loadu_pd, _mm_storeu_pd,
+        _mm_add_pd, _mm_sub_pd, _mm_mul_pd, _mm_div_pd, _mm_loadu_pd(b + i));
+    GEL_KERNEL_SCALAR_MAP(a[i], b[i]);
+}
+
+
+static __attribute__((target("sse2")))
+void sse2_map_doubles_scalar(GelKernelOp op, const gdouble *a, gdouble b,
+                             gdouble *dest, guint n)
+{
+    __m128d vb = _mm_set1_pd(b);
+    guint i = 0;
+    GEL_KERNEL_VECTOR_MAP(2, _mm_loadu_pd, _mm_storeu_pd,
+        _mm_add_pd, _mm_sub_pd, _mm_mul_pd, _mm_div_pd, vb);
+    GEL_KERNEL_SCALAR_MAP(a[i], b);
+}
+
+
+static __attribute__((target("sse2")))
+void sse2_map_int64s(GelKernelOp op, const gint64 *a, const gint64 *b,
+                     gint64 *dest, guint n)
+{
+    guint i = 0;
+    GEL_KERNEL_VECTOR_MAP_INT(2, sse2_load_epi64, sse2_store_epi64,
+        _mm_add_epi64, _mm_sub_epi64, sse2_load_epi64(b + i));
+    GEL_KERNEL_SCALAR_MAP(a[i], b[i]);
+}
+
+
+static __attribute__((target("sse2")))
+void sse2_map_int64s_scalar(GelKernelOp op, const gint64 *a, gint64 b,
+                            gint64 *dest, guint n)
+{
+    __m128i vb = _mm_set1_epi64x(b);
+    guint i = 0;
+    GEL_KERNEL_VECTOR_MAP_INT(2, sse2_load_epi64, sse2_store_epi64,
+        _mm_add_epi64, _mm_sub_epi64, vb);
+    GEL_KERNEL_SCALAR_MAP(a[i], b);
+}
+
+
+static __attribute__((target("sse2")))
+void sse2_cumsum_doubles(const gdouble *a, gdouble *dest, guint n)
+{
+    __m128d carry = _mm_setzero_pd();
+    guint i = 0;
+
+    for(; i + 2 <= n; i += 2)
+    {
+        /* [a0, a1] + [0, a0] + carry */
+        __m128d x = _mm_loadu_pd(a + i);
+        x = _mm_add_pd(x, _mm_unpacklo_pd(_mm_setzero_pd(), x));
+        x = _mm_add_pd(x, carry);
+        _mm_storeu_pd(dest + i, x);
+        carry = _mm_unpackhi_pd(x, x);
+    }
+
+    gdouble sum = _mm_cvtsd_f64(carry);
+    for(; i < n; i++)
+        dest[i] = (sum += a[i]);
+}
+
+
+static __attribute__((target("sse2")))
+void sse2_cumsum_int64s(const gint64 *a, gint64 *dest, guint n)
+{
+    __m128i carry = _mm_setzero_si128();
+    guint i = 0;
+
+    for(; i + 2 <= n; i += 2)
+    {
+        __m128i x = sse2_load_epi64(a + i);
+        x = _mm_add_epi64(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi64(x, carry);
+        sse2_store_epi64(dest + i, x);
+        carry = _mm_unpackhi_epi64(x, x);
+    }
+
+    gint64 lanes[2];
+    sse2_store_epi64(lanes, carry);
+
+    gint64 sum = lanes[0];
+    for(; i < n; i++)
+        dest[i] = (sum += a[i]);
+}
+
+
+static const GelKernels sse2_KERNELS =
+{
+    "sse2",
+    sse2_sum_doubles,
+    sse2_sum_int64s,
+    sse2_min_doubles,
+    sse2_max_doubles,
+    scalar_min_int64s,
+    scalar_max_int64s,
+    sse2_dot_doubles,
+    scalar_dot_int64s,
+    sse2_map_doubles,
+    sse2_map_doubles_scalar,
+    sse2_map_int64s,
+    sse2_map_int64s_scalar,
+    sse2_cumsum_doubles,
+    sse2_cumsum_int64s
+};
+
+
+static __attribute__((target("avx2")))
+gdouble avx2_sum_doubles(const gdouble *a, guint n)
+{
+    __m256d s0 = _mm256_setzero_pd();
+    __m256d s1 = _mm256_setzero_pd();
+    guint i = 0;
+
+    for(; i + 8 <= n; i += 8)
+    {
+        s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a + i));
+        s1 = _mm256_add_pd(s1, _mm256_loadu_pd(a + i + 4));
+    }
+
+    gdouble lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(s0, s1));
+
+    gdouble result = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for(; i < n; i++)
+        result += a[i];
+    return result;
+}
+
+
+static __attribute__((target("avx2")))
+gint64 avx2_sum_int64s(const gint64 *a, guint n)
+{
+    __m256i s = _mm256_setzero_si256();
+    guint i = 0;
+
+    for(; i + 4 <= n; i += 4)
+        s = _mm256_add_epi64(s, avx2_load_epi64(a + i));
+
+    gint64 lanes[4];
+    avx2_store_epi64(lanes, s);
+
+    gint64 result = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    for(; i < n; i++)
+        result += a[i];
+    return result;
+}
+
+
+static __attribute__((target("avx2")))
+gdouble avx2_min_doubles(const gdouble *a, guint n)
+{
+    __m256d m = _mm256_set1_pd(a[0]);
+    guint i = 0;
+
+    for(; i + 4 <= n; i += 4)
+        m = _mm256_min_pd(m, _mm256_loadu_pd(a + i));
+
+    gdouble lanes[4];
+    _mm256_storeu_pd(lanes, m);
+
+    gdouble result = MIN(MIN(lanes[0], lanes[1]), MIN(lanes[2], lanes[3]));
+    for(; i < n; i++)
+        if(a[i] < result)
+            result = a[i];
+    return result;
+}
+
+
+static __attribute__((target("avx2")))
+gdouble avx2_max_doubles(const gdouble *a, guint n)
+{
+    __m256d m = _mm256_set1_pd(a[0]);
+    guint i = 0;
+
+    for(; i + 4 <= n; i += 4)
+        m = _mm256_max_pd(m, _mm256_loadu_pd(a + i));
+
+    gdouble lanes[4];
+    _mm256_storeu_pd(lanes, m);
+
+    gdouble result = MAX(MAX(lanes[0], lanes[1]), MAX(lanes[2], lanes[3]));
+    for(; i < n; i++)
+        if(a[i] > result)
+            result = a[i];
+    return result;
+}
+
+
+static __attribute__((target("avx2")))
+gint64 avx2_min_int64s(const gint64 *a, guint n)
+{
+    __m256i m = _mm256_set1_epi64x(a[0]);
+    guint i = 0;
+
+    for(; i + 4 <= n; i += 4)
+    {
+        __m256i x = avx2_load_epi64(a + i);
+        m = _mm256_blendv_epi8(m, x, _mm256_cmpgt_epi64(m, x));
+    }
+
+    gint64 lanes[4];
+    avx2_store_epi64(lanes, m);
+
+    gint64 result = MIN(MIN(lanes[0], lanes[1]), MIN(lanes[2], lanes[3]));
+    for(; i < n; i++)
+        if(a[i] < result)
+            result = a[i];
+    return result;
+}
+
+
+static __attribute__((target("avx2")))
+gint64 avx2_max_int64s(const gint64 *a, guint n)
+{
+    __m256i m = _mm256_set1_epi64x(a[0]);
+    guint i = 0;
+
+    for(; i + 4 <= n; i += 4)
+    {
+        __m256i x = avx2_load_epi64(a + i);
+        m = _mm256_blendv_epi8(m, x, _mm256_cmpgt_epi64(x, m));
+    }
+
+    gint64 lanes[4];
+    avx2_store_epi64(lanes, m);
+
+    gint64 result = MAX(MAX(lanes[0], lanes[1]), MAX(lanes[2], lanes[3]));
+    for(; i < n; i++)
+        if(a[i] > result)
+            result = a[i];
+    return result;
+}
+
+
+static __attribute__((target("avx2")))
+gdouble avx2_dot_doubles(const gdouble *a, const gdouble *b, guint n)
+{
+    __m256d s0 = _mm256_setzero_pd();
+    __m256d s1 = _mm256_setzero_pd();
+    guint i = 0;
+
+    for(; i + 8 <= n; i += 8)
+    {
+        s0 = _mm256_add_pd(s0,
+            _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        s1 = _mm256_add_pd(s1,
+            _mm256_mul_pd(_mm256_loadu_pd(a + i + 4),
+                _mm256_loadu_pd(b + i + 4)));
+    }
+
+    gdouble lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(s0, s1));
+
+    gdouble result = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for(; i < n; i++)
+        result += a[i] * b[i];
+    return result;
+}
+
+
+static __attribute__((target("avx2")))
+void avx2_map_doubles(GelKernelOp op, const gdouble *a, const gdouble *b,
+                      gdouble *dest, guint n)
+{
+    guint i = 0;
+    GEL_KERNEL_VECTOR_MAP(4, _mm256_loadu_pd, _mm256_storeu_pd,
+        _mm256_add_pd, _mm256_sub_pd, _mm256_mul_pd, _mm256_div_pd,
+        _mm256_loadu_pd(b + i));
+    GEL_KERNEL_SCALAR_MAP(a[i], b[i]);
+}
+
+
+static __attribute__((target("avx2")))
+void avx2_map_doubles_scalar(GelKernelOp op, const gdouble *a, gdouble b,
+                             gdouble *dest, guint n)
+{
+    __m256d vb = _mm256_set1_pd(b);
+    guint i = 0;
+    GEL_KERNEL_VECTOR_MAP(4, _mm256_loadu_pd, _mm256_storeu_pd,
+        _mm256_add_pd, _mm256_sub_pd, _mm256_mul_pd, _mm256_div_pd, vb);
+    GEL_KERNEL_SCALAR_MAP(a[i], b);
+}
+
+
+static __attribute__((target("avx2")))
+void avx2_map_int64s(GelKernelOp op, const gint64 *a, const gint64 *b,
+                     gint64 *dest, guint n)
+{
+    guint i = 0;
+    GEL_KERNEL_VECTOR_MAP_INT(4, avx2_load_epi64, avx2_store_epi64,
+        _mm256_add_epi64, _mm256_sub_epi64, avx2_load_epi64(b + i));
+    GEL_KERNEL_SCALAR_MAP(a[i], b[i]);
+}
+
+
+static __attribute__((target("avx2")))
+void avx2_map_int64s_scalar(GelKernelOp op, const gint64 *a, gint64 b,
+                            gint64 *dest, guint n)
+{
+    __m256i vb = _mm256_set1_epi64x(b);
+    guint i = 0;
+    GEL_KERNEL_VECTOR_MAP_INT(4, avx2_load_epi64, avx2_store_epi64,
+        _mm256_add_epi64, _mm256_sub_epi64, vb);
+    GEL_KERNEL_SCALAR_MAP(a[i], b);
+}
+
+
+static __attribute__((target("avx2")))
+void avx2_cumsum_doubles(const gdouble *a, gdouble *dest, guint n)
+{
+    const __m256d zero = _mm256_setzero_pd();
+    __m256d carry = zero;
+    guint i = 0;
+
+    for(; i + 4 <= n; i += 4)
+    {
+        /* Add the values shifted one lane, then shifted two lanes */
+        __m256d x = _mm256_loadu_pd(a + i);
+        x = _mm256_add_pd(x, _mm256_blend_pd(
+            _mm256_permute4x64_pd(x, _MM_SHUFFLE(2, 1, 0, 0)), zero, 0x1));
+        x = _mm256_add_pd(x, _mm256_blend_pd(
+            _mm256_permute4x64_pd(x, _MM_SHUFFLE(1, 0, 0, 0)), zero, 0x3));
+        x = _mm256_add_pd(x, carry);
+        _mm256_storeu_pd(dest + i, x);
+        carry = _mm256_permute4x64_pd(x, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+
+    gdouble sum = _mm_cvtsd_f64(_mm256_castpd256_pd128(carry));
+    for(; i < n; i++)
+        dest[i] = (sum += a[i]);
+}
+
+
+static __attribute__((target("avx2")))
+void avx2_cumsum_int64s(const gint64 *a, gint64 *dest, guint n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i carry = zero;
+    guint i = 0;
+
+    for(; i + 4 <= n; i += 4)
+    {
+        __m256i x = avx2_load_epi64(a + i);
+        x = _mm256_add_epi64(x, _mm256_blend_epi32(
+            _mm256_permute4x64_epi64(x, _MM_SHUFFLE(2, 1, 0, 0)),
+            zero, 0x03));
+        x = _mm256_add_epi64(x, _mm256_blend_epi32(
+            _mm256_permute4x64_epi64(x, _MM_SHUFFLE(1, 0, 0, 0)),
+            zero, 0x0F));
+        x = _mm256_add_epi64(x, carry);
+        avx2_store_epi64(dest + i, x);
+        carry = _mm256_permute4x64_epi64(x, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+
+    gint64 lanes[4];
+    avx2_store_epi64(lanes, carry);
+
+    gint64 sum = lanes[0];
+    for(; i < n; i++)
+        dest[i] = (sum += a[i]);
+}
+
+
+static const GelKernels avx2_KERNELS =
+{
+    "avx2",
+    avx2_sum_doubles,
+    avx2_sum_int64s,
+    avx2_min_doubles,
+    avx2_max_doubles,
+    avx2_min_int64s,
+    avx2_max_int64s,
+    avx2_dot_doubles,
+    scalar_dot_int64s,
+    avx2_map_doubles,
+    avx2_map_doubles_scalar,
+    avx2_map_int64s,
+    avx2_map_int64s_scalar,
+    avx2_cumsum_doubles,
+    avx2_cumsum_int64s
+};
+
+#endif
+
+
+const GelKernels* gel_kernels_get(void)
+{
+    static const GelKernels *kernels = NULL;
+    static volatile gsize once = 0;
+
+    if(g_once_init_enter(&once))
+    {
+        /* Supported kernels, the best first */
+        const GelKernels *supported[3];
+        guint n_supported = 0;
+
+#ifdef GEL_KERNELS_X86
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2"))
+            supported[n_supported++] = &avx2_KERNELS;
+        if(__builtin_cpu_supports("sse2"))
+            supported[n_supported++] = &sse2_KERNELS;
+#endif
+        supported[n_supported++] = &scalar_KERNELS;
+
+        kernels = supported[0];
+
+        const gchar *name = g_getenv("GEL_KERNELS");
+        if(name != NULL)
+            for(guint i = 0; i < n_supported; i++)
+                if(g_strcmp0(supported[i]->name, name) == 0)
+                    kernels = supported[i];
+
+        g_once_init_leave(&once, 1);
+    }
+
+    return kernels;
+}
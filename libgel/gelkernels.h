@@ -0,0 +1,56 @@
+#ifndef __GEL_KERNELS_H__
+#define __GEL_KERNELS_H__
+
+#include <glib.h>
+
+typedef enum _GelKernelOp
+{
+    GEL_KERNEL_ADD,
+    GEL_KERNEL_SUB,
+    GEL_KERNEL_MUL,
+    GEL_KERNEL_DIV,
+    GEL_KERNEL_RSUB,
+    GEL_KERNEL_RDIV
+} GelKernelOp;
+
+typedef enum _GelKernelReduce
+{
+    GEL_KERNEL_SUM,
+    GEL_KERNEL_MIN,
+    GEL_KERNEL_MAX,
+    GEL_KERNEL_MEAN
+} GelKernelReduce;
+
+typedef struct _GelKernels GelKernels;
+
+struct _GelKernels
+{
+    const gchar *name;
+
+    gdouble (*sum_doubles)(const gdouble *a, guint n);
+    gint64 (*sum_int64s)(const gint64 *a, guint n);
+
+    gdouble (*min_doubles)(const gdouble *a, guint n);
+    gdouble (*max_doubles)(const gdouble *a, guint n);
+    gint64 (*min_int64s)(const gint64 *a, guint n);
+    gint64 (*max_int64s)(const gint64 *a, guint n);
+
+    gdouble (*dot_doubles)(const gdouble *a, const gdouble *b, guint n);
+    gint64 (*dot_int64s)(const gint64 *a, const gint64 *b, guint n);
+
+    void (*map_doubles)(GelKernelOp op, const gdouble *a, const gdouble *b,
+                        gdouble *dest, guint n);
+    void (*map_doubles_scalar)(GelKernelOp op, const gdouble *a, gdouble b,
+                               gdouble *dest, guint n);
+    void (*map_int64s)(GelKernelOp op, const gint64 *a, const gint64 *b,
+                       gint64 *dest, guint n);
+    void (*map_int64s_scalar)(GelKernelOp op, const gint64 *a, gint64 b,
+                              gint64 *dest, guint n);
+
+    void (*cumsum_doubles)(const gdouble *a, gdouble *dest, guint n);
+    void (*cumsum_int64s)(const gint64 *a, gint64 *dest, guint n);
+};
+
+const GelKernels* gel_kernels_get(void);
+
+#endif
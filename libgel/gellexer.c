@@ -0,0 +1,672 @@
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <gellexer.h>
+#include <gelparser.h>
+
+
+/*
+ * A lexer for the syntax of gel, producing the same tokens the parser used
+ * to get from a #GScanner configured for it, but working directly over a
+ * buffer: the text given, a regular file mapped in memory or the chunks
+ * read from any other file descriptor.
+ *
+ * Tokens that cross the end of a chunk are scanned again once the next
+ * chunk is read, so the scanning functions never wait for input.
+ */
+
+#ifndef GEL_LEXER_CHUNK_SIZE
+#define GEL_LEXER_CHUNK_SIZE 65536
+#endif
+
+/* Returned by the scanning functions when the buffer ends in a token */
+#define GEL_LEXER_MORE G_TOKEN_NONE
+
+#define LEXER_SKIP 1
+#define LEXER_FIRST 2
+#define LEXER_NTH 4
+#define LEXER_DIGIT 8
+#define LEXER_ALNUM 16
+
+/*
+ * Character classes: LEXER_SKIP (blanks), LEXER_FIRST (first character
+ * of an identifier), LEXER_NTH (the rest), LEXER_DIGIT and LEXER_ALNUM
+ * (characters that can continue a number).
+ */
+static const guint8 lexer_CLASSES[256] = {
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  1,  0,  0,  1,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     1,  6,  0,  0,  0,  6,  6,  0,  0,  0,  6,  6,  0,  6,  6,  6,
+    28, 28, 28, 28, 28, 28, 28, 28, 28, 28,  0,  0,  6,  6,  6,  4,
+     0, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+    22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,  0,  0,  0,  0,  6,
+     0, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+    22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,  0,  0,  0,  0,  0
+};
+
+#define lexer_is(c, class) (lexer_CLASSES[(guchar)(c)] & (class))
+
+
+GelLexer* gel_lexer_new(void)
+{
+    GelLexer *self = g_slice_new0(GelLexer);
+    self->input_fd = -1;
+    self->text_line = 1;
+    self->next_token = G_TOKEN_NONE;
+    self->identifier = g_string_sized_new(64);
+    self->string = g_string_sized_new(64);
+    self->number = g_string_sized_new(32);
+
+    return self;
+}
+
+
+void gel_lexer_free(GelLexer *self)
+{
+    g_return_if_fail(self != NULL);
+
+    if(self->mapped_file != NULL)
+        g_mapped_file_unref(self->mapped_file);
+    g_free(self->buffer);
+    g_string_free(self->identifier, TRUE);
+    g_string_free(self->string, TRUE);
+    g_string_free(self->number, TRUE);
+    g_slice_free(GelLexer, self);
+}
+
+
+void gel_lexer_input_text(GelLexer *self, const gchar *text, gsize text_len)
+{
+    g_return_if_fail(self != NULL);
+    g_return_if_fail(text != NULL || text_len == 0);
+
+    self->text = text;
+    self->text_end = text + text_len;
+    self->input_fd = -1;
+}
+
+
+/*
+ * Regular files are mapped from the current offset of @fd,
+ * anything else is read in chunks as the tokens are needed.
+ */
+void gel_lexer_input_fd(GelLexer *self, gint fd)
+{
+    g_return_if_fail(self != NULL);
+    g_return_if_fail(fd >= 0);
+
+    struct stat info;
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+
+    if(offset >= 0 && fstat(fd, &info) == 0
+        && S_ISREG(info.st_mode) && info.st_size > offset)
+    {
+        self->mapped_file = g_mapped_file_new_from_fd(fd, FALSE, NULL);
+        if(self->mapped_file != NULL)
+        {
+            const gchar *contents =
+                g_mapped_file_get_contents(self->mapped_file);
+            gsize length = g_mapped_file_get_length(self->mapped_file);
+
+            gel_lexer_input_text(self,
+                contents + offset, length - MIN(length, (gsize)offset));
+            return;
+        }
+    }
+
+    self->buffer_size = GEL_LEXER_CHUNK_SIZE;
+    self->buffer = g_malloc(self->buffer_size);
+    self->text = self->text_end = self->buffer;
+    self->input_fd = fd;
+}
+
+
+/*
+ * Reads the next chunk of the input after the bytes from @keep on,
+ * which are moved to the beginning of the buffer.
+ * Returns %FALSE when the input is over.
+ */
+static
+gboolean gel_lexer_refill(GelLexer *self, const gchar *keep)
+{
+    if(self->input_fd < 0)
+        return FALSE;
+
+    gsize kept = self->text_end - keep;
+    memmove(self->buffer, keep, kept);
+
+    if(kept == self->buffer_size)
+    {
+        self->buffer_size *= 2;
+        self->buffer = g_realloc(self->buffer, self->buffer_size);
+    }
+
+    gssize n_read;
+    do
+        n_read = read(self->input_fd,
+            self->buffer + kept, self->buffer_size - kept);
+    while(n_read < 0 && errno == EINTR);
+
+    self->text = self->buffer;
+    self->text_end = self->buffer + kept;
+
+    if(n_read <= 0)
+    {
+        self->input_fd = -1;
+        return FALSE;
+    }
+
+    self->text_end += n_read;
+    return TRUE;
+}
+
+
+/*
+ * Finds the first quote, backslash, new line or nul character.
+ */
+static
+const gchar* gel_lexer_find_special(const gchar *p, const gchar *end)
+{
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i nul = _mm_setzero_si128();
+
+    for(; end - p >= 16; p += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+        __m128i found = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                         _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, newline),
+                         _mm_cmpeq_epi8(chunk, nul)));
+        gint mask = _mm_movemask_epi8(found);
+        if(mask != 0)
+            return p + __builtin_ctz(mask);
+    }
+#endif
+
+    for(; p < end; p++)
+        if(*p == '"' || *p == '\\' || *p == '\n' || *p == 0)
+            return p;
+
+    return end;
+}
+
+
+/*
+ * Scans a number starting at @p, the way #GScanner does. A leading dot
+ * is only accepted when @dotted, as a #GScanner without the dot
+ * in its identifiers would do.
+ */
+static
+GTokenType gel_lexer_scan_number(GelLexer *self,
+                                 const gchar *p, const gchar *end,
+                                 gboolean final, gboolean dotted,
+                                 GTokenValue *value, const gchar **stop,
+                                 guint *position)
+{
+    GString *number = self->number;
+    GTokenType token = G_TOKEN_INT;
+    gchar ch = *p++;
+    (*position)++;
+
+    g_string_truncate(number, 0);
+
+    if(ch == '.' && dotted)
+    {
+        token = G_TOKEN_FLOAT;
+        g_string_append(number, "0.");
+        if(p == end && !final)
+            return GEL_LEXER_MORE;
+        ch = p < end ? *p++ : 0;
+        if(ch != 0)
+            (*position)++;
+    }
+    else
+    if(ch == '0')
+    {
+        token = G_TOKEN_OCTAL;
+        if(p == end && !final)
+            return GEL_LEXER_MORE;
+
+        if(p < end && (*p == 'x' || *p == 'X'))
+        {
+            token = G_TOKEN_HEX;
+            p++;
+            (*position)++;
+
+            if(p == end)
+            {
+                if(!final)
+                    return GEL_LEXER_MORE;
+                (*position)++;
+                value->v_error = GEL_PARSE_ERROR_UNEXP_EOF;
+                *stop = p;
+                return G_TOKEN_ERROR;
+            }
+
+            ch = *p++;
+            (*position)++;
+            if(!g_ascii_isxdigit(ch))
+            {
+                value->v_error = GEL_PARSE_ERROR_DIGIT_RADIX;
+                *stop = p;
+                return G_TOKEN_ERROR;
+            }
+        }
+    }
+
+    if(ch != 0)
+        g_string_append_c(number, ch);
+
+    while(TRUE)
+    {
+        gboolean is_e = token == G_TOKEN_FLOAT && (ch == 'e' || ch == 'E');
+
+        if(p == end)
+        {
+            if(!final)
+                return GEL_LEXER_MORE;
+            break;
+        }
+
+        if(!lexer_is(*p, LEXER_ALNUM) && *p != '.'
+            && !(is_e && (*p == '+' || *p == '-')))
+            break;
+
+        ch = *p++;
+        (*position)++;
+
+        if(ch == '.')
+        {
+            if(token != G_TOKEN_INT && token != G_TOKEN_OCTAL)
+            {
+                value->v_error = GEL_PARSE_ERROR_UNKNOWN;
+                *stop = p;
+                return G_TOKEN_ERROR;
+            }
+            token = G_TOKEN_FLOAT;
+        }
+        else
+        if(ch == 'e' || ch == 'E')
+        {
+            if(token != G_TOKEN_HEX)
+                token = G_TOKEN_FLOAT;
+        }
+        else
+        if(!lexer_is(ch, LEXER_DIGIT) && ch != '+' && ch != '-'
+            && token != G_TOKEN_HEX)
+        {
+            value->v_error = GEL_PARSE_ERROR_UNKNOWN;
+            *stop = p;
+            return G_TOKEN_ERROR;
+        }
+
+        g_string_append_c(number, ch);
+    }
+
+    gchar *endptr = NULL;
+    switch(token)
+    {
+        case G_TOKEN_OCTAL:
+            value->v_int64 = g_ascii_strtoull(number->str, &endptr, 8);
+            break;
+        case G_TOKEN_HEX:
+            value->v_int64 = g_ascii_strtoull(number->str, &endptr, 16);
+            break;
+        case G_TOKEN_FLOAT:
+            value->v_float = g_ascii_strtod(number->str, &endptr);
+            break;
+        default:
+            value->v_int64 = g_ascii_strtoull(number->str, &endptr, 10);
+            break;
+    }
+
+    *stop = p;
+    if(endptr != NULL && *endptr != 0)
+    {
+        value->v_error = *endptr == 'e' || *endptr == 'E'
+            ? GEL_PARSE_ERROR_NON_DIGIT_IN_CONST : GEL_PARSE_ERROR_DIGIT_RADIX;
+        return G_TOKEN_ERROR;
+    }
+
+    return token == G_TOKEN_FLOAT ? G_TOKEN_FLOAT : G_TOKEN_INT;
+}
+
+
+static
+GTokenType gel_lexer_scan_string(GelLexer *self,
+                                 const gchar *p, const gchar *end,
+                                 gboolean final, GTokenValue *value,
+                                 const gchar **stop,
+                                 guint *line, guint *position)
+{
+    GString *string = self->string;
+    g_string_truncate(string, 0);
+
+    p++;
+    (*position)++;
+
+    while(TRUE)
+    {
+        const gchar *special = gel_lexer_find_special(p, end);
+        g_string_append_len(string, p, special - p);
+        *position += special - p;
+        p = special;
+
+        if(p == end || *p == 0)
+        {
+            if(!final && p == end)
+                return GEL_LEXER_MORE;
+            (*position)++;
+            value->v_error = GEL_PARSE_ERROR_UNEXP_EOF_IN_STRING;
+            *stop = p;
+            return G_TOKEN_ERROR;
+        }
+
+        gchar ch = *p++;
+        if(ch == '"')
+        {
+            (*position)++;
+            break;
+        }
+        else
+        if(ch == '\n')
+        {
+            g_string_append_c(string, ch);
+            (*line)++;
+            *position = 0;
+            continue;
+        }
+
+        /* An escape, which needs up to three more characters */
+        (*position)++;
+        if(end - p < 3 && !final)
+            return GEL_LEXER_MORE;
+        if(p == end)
+            continue;
+
+        ch = *p++;
+        if(ch == '\n')
+        {
+            (*line)++;
+            *position = 0;
+        }
+        else
+        if(ch != 0)
+            (*position)++;
+
+        switch(ch)
+        {
+            case 0:
+                p--;
+                break;
+            case 'n':
+                g_string_append_c(string, '\n');
+                break;
+            case 't':
+                g_string_append_c(string, '\t');
+                break;
+            case 'r':
+                g_string_append_c(string, '\r');
+                break;
+            case 'b':
+                g_string_append_c(string, '\b');
+                break;
+            case 'f':
+                g_string_append_c(string, '\f');
+                break;
+            case '0': case '1': case '2': case '3':
+            case '4': case '5': case '6': case '7':
+            {
+                guint i = ch - '0';
+                for(guint n = 0; n < 2 && p < end && *p >= '0' && *p <= '7';
+                        n++, p++, (*position)++)
+                    i = i * 8 + *p - '0';
+                g_string_append_c(string, i);
+                break;
+            }
+            default:
+                g_string_append_c(string, ch);
+                break;
+        }
+    }
+
+    *stop = p;
+    value->v_string = string->str;
+    return G_TOKEN_STRING;
+}
+
+
+static
+GTokenType gel_lexer_scan_single_quoted(GelLexer *self,
+                                        const gchar *p, const gchar *end,
+                                        gboolean final, GTokenValue *value,
+                                        const gchar **stop,
+                                        guint *line, guint *position)
+{
+    GString *string = self->string;
+    g_string_truncate(string, 0);
+
+    p++;
+    (*position)++;
+
+    for(; p < end && *p != '\'' && *p != 0; p++)
+    {
+        g_string_append_c(string, *p);
+        if(*p == '\n')
+        {
+            (*line)++;
+            *position = 0;
+        }
+        else
+            (*position)++;
+    }
+
+    if(p == end && !final)
+        return GEL_LEXER_MORE;
+
+    *stop = p + 1;
+    (*position)++;
+
+    if(p == end || *p == 0)
+    {
+        value->v_error = GEL_PARSE_ERROR_UNEXP_EOF_IN_STRING;
+        return G_TOKEN_ERROR;
+    }
+
+    value->v_string = string->str;
+    return G_TOKEN_STRING;
+}
+
+
+static
+GTokenType gel_lexer_scan_identifier(GelLexer *self,
+                                     const gchar *p, const gchar *end,
+                                     gboolean final, GTokenValue *value,
+                                     const gchar **stop, guint *position)
+{
+    const gchar *start = p;
+    for(p++; p < end && lexer_is(*p, LEXER_NTH); p++);
+
+    if(p == end && !final)
+        return GEL_LEXER_MORE;
+
+    gsize len = p - start;
+    *position += len;
+    *stop = p;
+
+    /* A minus sign followed by a whole number is a negative number */
+    if(start[0] == '-' && len > 1
+        && (lexer_is(start[1], LEXER_DIGIT) || start[1] == '.'))
+    {
+        const gchar *number_stop = NULL;
+        guint number_position = 0;
+        GTokenType token = gel_lexer_scan_number(self, start + 1, p,
+            TRUE, TRUE, value, &number_stop, &number_position);
+
+        if(number_stop == p && token == G_TOKEN_INT)
+        {
+            value->v_int64 = -(gint64)value->v_int64;
+            return token;
+        }
+        else
+        if(number_stop == p && token == G_TOKEN_FLOAT)
+        {
+            value->v_float = -value->v_float;
+            return token;
+        }
+    }
+
+    g_string_truncate(self->identifier, 0);
+    g_string_append_len(self->identifier, start, len);
+    value->v_identifier = self->identifier->str;
+
+    return G_TOKEN_IDENTIFIER;
+}
+
+
+/*
+ * Skips blanks and comments, reading more input when needed.
+ */
+static
+void gel_lexer_skip(GelLexer *self)
+{
+    while(TRUE)
+    {
+        if(self->text == self->text_end && !gel_lexer_refill(self,
+                self->text_end))
+            return;
+
+        const gchar *p = self->text;
+        const gchar *end = self->text_end;
+
+        if(self->in_comment)
+        {
+            const gchar *newline = memchr(p, '\n', end - p);
+            if(newline == NULL)
+            {
+                self->text_position += end - p;
+                self->text = end;
+                continue;
+            }
+
+            self->text_position = 0;
+            self->text_line++;
+            self->text = newline + 1;
+            self->in_comment = FALSE;
+            continue;
+        }
+
+        for(; p < end && lexer_is(*p, LEXER_SKIP); p++)
+            if(*p == '\n')
+            {
+                self->text_line++;
+                self->text_position = 0;
+            }
+            else
+                self->text_position++;
+
+        self->text = p;
+        if(p == end)
+            continue;
+
+        if(*p != '#')
+            return;
+
+        self->in_comment = TRUE;
+        self->text_position++;
+        self->text++;
+    }
+}
+
+
+static
+GTokenType gel_lexer_scan(GelLexer *self, GTokenValue *value,
+                          guint *line, guint *position)
+{
+    gel_lexer_skip(self);
+
+    while(TRUE)
+    {
+        const gchar *p = self->text;
+        const gchar *end = self->text_end;
+        const gchar *stop = p + 1;
+        gboolean final = self->input_fd < 0;
+        GTokenType token;
+
+        *line = self->text_line;
+        *position = self->text_position;
+
+        if(p == end)
+            return G_TOKEN_EOF;
+
+        if(lexer_is(*p, LEXER_FIRST))
+            token = gel_lexer_scan_identifier(self,
+                p, end, final, value, &stop, position);
+        else
+        if(lexer_is(*p, LEXER_DIGIT))
+            token = gel_lexer_scan_number(self,
+                p, end, final, FALSE, value, &stop, position);
+        else
+        if(*p == '"')
+            token = gel_lexer_scan_string(self,
+                p, end, final, value, &stop, line, position);
+        else
+        if(*p == '\'')
+            token = gel_lexer_scan_single_quoted(self,
+                p, end, final, value, &stop, line, position);
+        else
+        {
+            token = (guchar)*p;
+            value->v_char = *p;
+            (*position)++;
+        }
+
+        if(token != GEL_LEXER_MORE)
+        {
+            self->text = MIN(stop, end);
+            self->text_line = *line;
+            self->text_position = *position;
+            return token;
+        }
+
+        gel_lexer_refill(self, p);
+    }
+}
+
+
+GTokenType gel_lexer_peek_next_token(GelLexer *self)
+{
+    g_return_val_if_fail(self != NULL, G_TOKEN_EOF);
+
+    if(self->next_token == G_TOKEN_NONE)
+        self->next_token = gel_lexer_scan(self,
+            &self->next_value, &self->next_line, &self->next_position);
+
+    return self->next_token;
+}
+
+
+GTokenType gel_lexer_get_next_token(GelLexer *self)
+{
+    g_return_val_if_fail(self != NULL, G_TOKEN_EOF);
+
+    gel_lexer_peek_next_token(self);
+
+    self->token = self->next_token;
+    self->value = self->next_value;
+    self->line = self->next_line;
+    self->position = self->next_position;
+    self->next_token = G_TOKEN_NONE;
+
+    return self->token;
+}
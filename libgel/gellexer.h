@@ -0,0 +1,49 @@
+#ifndef __GEL_LEXER_H__
+#define __GEL_LEXER_H__
+
+#include <glib.h>
+
+typedef struct _GelLexer GelLexer;
+
+/*
+ * Tokens, values and positions follow the conventions of #GScanner,
+ * so the parser can read them the same way.
+ */
+struct _GelLexer
+{
+    GTokenType token;
+    GTokenValue value;
+    guint line;
+    guint position;
+
+    GTokenType next_token;
+    GTokenValue next_value;
+    guint next_line;
+    guint next_position;
+
+    const gchar *text;
+    const gchar *text_end;
+    guint text_line;
+    guint text_position;
+    gboolean in_comment;
+
+    gint input_fd;
+    gchar *buffer;
+    gsize buffer_size;
+    GMappedFile *mapped_file;
+
+    GString *identifier;
+    GString *string;
+    GString *number;
+};
+
+GelLexer* gel_lexer_new(void);
+void gel_lexer_free(GelLexer *self);
+
+void gel_lexer_input_text(GelLexer *self, const gchar *text, gsize text_len);
+void gel_lexer_input_fd(GelLexer *self, gint fd);
+
+GTokenType gel_lexer_peek_next_token(GelLexer *self);
+GTokenType gel_lexer_get_next_token(GelLexer *self);
+
+#endif
@@ -1,265 +1,362 @@
 #include <gelmacro.h>
 #include <gelvalueprivate.h>
-#include <gelsymbol.h>
-#include <gelparser.h>
+#include <gelarrayprivate.h>
 
 
+/*
+ * Macros are compiled when they are defined into a template: a list of
+ * operations that rebuild their code in post-order, with the parameters
+ * already resolved to the position of the argument that replaces them.
+ * Expanding a macro is then a single pass over its template, appending
+ * nodes to the arena being parsed. Arguments are not copied, the nodes
+ * parsed for them are used as they are.
+ */
+
+typedef enum _GelMacroOpKind
+{
+    GEL_MACRO_OP_LITERAL,
+    GEL_MACRO_OP_ARG,
+    GEL_MACRO_OP_VARIADIC,
+    GEL_MACRO_OP_BEGIN,
+    GEL_MACRO_OP_END
+} GelMacroOpKind;
+
+typedef struct _GelMacroOp GelMacroOp;
+
+struct _GelMacroOp
+{
+    GelMacroOpKind kind;
+    guint operand;
+};
+
 struct _GelMacro
 {
     gchar *name;
-    GList *args;
-    gchar *variadic;
-    GelValueArray *code;
+    guint n_args;
+    gboolean is_variadic;
+    guint depth;
+
+    GelMacroOp *ops;
+    guint n_ops;
+    GelAst *literals;
+};
+
+
+/* The macros defined by the code read by one or more parsers */
+struct _GelMacros
+{
+    volatile gint ref_count;
+    GHashTable *hash;
 };
 
 
-static GHashTable *macros_HASH = NULL;
+static
+void gel_macro_free(GelMacro *self)
+{
+    g_free(self->name);
+    g_free(self->ops);
+    gel_ast_unref(self->literals);
+    g_slice_free(GelMacro, self);
+}
 
 
-GelMacro* gel_macro_new(const gchar *name,
-                        GList *args, gchar *variadic, GelValueArray *code)
+/**
+ * gel_macros_new:
+ *
+ * Creates an empty set of macros, that can be shared by several
+ * #GelParser so the macros defined in an input can be used in others.
+ *
+ * Returns: A new #GelMacros
+ */
+GelMacros* gel_macros_new(void)
 {
-    GelMacro *self = g_slice_new0(GelMacro);
+    GelMacros *self = g_slice_new0(GelMacros);
 
-    self->name = g_strdup(name);
-    self->args = args;
-    self->variadic = variadic;
-    self->code = code;
+    self->ref_count = 1;
+    self->hash = g_hash_table_new_full(
+        g_str_hash, g_str_equal,
+        NULL, (GDestroyNotify)gel_macro_free);
 
     return self;
 }
 
 
-void gel_macro_free(GelMacro *self)
+/**
+ * gel_macros_ref:
+ * @self: a #GelMacros
+ *
+ * Increases the reference count of @self.
+ *
+ * Returns: @self
+ */
+GelMacros* gel_macros_ref(GelMacros *self)
 {
-    g_free(self->name);
-    g_list_foreach(self->args, (GFunc)g_free, NULL);
-    g_list_free(self->args);
-    g_free(self->variadic);
-    gel_value_array_free(self->code);
-    g_slice_free(GelMacro, self);
+    g_return_val_if_fail(self != NULL, NULL);
+
+    g_atomic_int_inc(&self->ref_count);
+    return self;
 }
 
 
-void gel_macros_new(void)
+/**
+ * gel_macros_unref:
+ * @self: a #GelMacros
+ *
+ * Decreases the reference count of @self,
+ * releasing it and its macros when it drops to 0.
+ */
+void gel_macros_unref(GelMacros *self)
 {
-    g_return_if_fail(macros_HASH == NULL);
+    g_return_if_fail(self != NULL);
 
-    macros_HASH = g_hash_table_new_full(
-        g_str_hash, g_str_equal,
-        g_free, (GDestroyNotify)gel_macro_free);
+    if(g_atomic_int_dec_and_test(&self->ref_count))
+    {
+        g_hash_table_unref(self->hash);
+        g_slice_free(GelMacros, self);
+    }
 }
 
 
-void gel_macros_free(void)
+GelMacro* gel_macros_lookup(GelMacros *self, const gchar *name)
 {
-    g_return_if_fail(macros_HASH != NULL);
+    g_return_val_if_fail(self != NULL, NULL);
 
-    g_hash_table_unref(macros_HASH);
-    macros_HASH = NULL;
+    return g_hash_table_lookup(self->hash, name);
 }
 
 
 static
-void gel_macros_insert(const gchar *name, GList *args, gchar *variadic,
-                       GelValueArray *code)
+void gel_macro_add_op(GArray *ops, GelMacroOpKind kind, guint operand)
 {
-    g_return_if_fail(macros_HASH != NULL);
-
-    g_hash_table_insert(macros_HASH,
-        g_strdup(name), gel_macro_new(name, args, variadic, code));
+    GelMacroOp op = {kind, operand};
+    g_array_append_val(ops, op);
 }
 
 
-GelMacro* gel_macros_lookup(const gchar *name)
+/*
+ * Appends to @ops the operations that rebuild @node of @ast,
+ * replacing the symbols found in @params by their argument.
+ */
+static
+void gel_macro_compile(GelMacro *self, GelAst *ast, guint node,
+                       GHashTable *params, const gchar *variadic,
+                       guint depth, GArray *ops)
 {
-    g_return_val_if_fail(macros_HASH != NULL, NULL);
+    if(gel_ast_get_kind(ast, node) == GEL_AST_LIST)
+    {
+        self->depth = MAX(self->depth, depth + 1);
+        gel_macro_add_op(ops, GEL_MACRO_OP_BEGIN, 0);
+
+        guint n_children = gel_ast_get_n_children(ast, node);
+        for(guint i = 0; i < n_children; i++)
+            gel_macro_compile(self, ast, gel_ast_get_child(ast, node, i),
+                params, variadic, depth + 1, ops);
 
-    return g_hash_table_lookup(macros_HASH, name);
+        gel_macro_add_op(ops, GEL_MACRO_OP_END, 0);
+        return;
+    }
+
+    const gchar *name = gel_ast_get_name(ast, node);
+    gpointer position = NULL;
+
+    if(name != NULL && g_strcmp0(name, variadic) == 0)
+        gel_macro_add_op(ops, GEL_MACRO_OP_VARIADIC, 0);
+    else
+    if(name != NULL
+        && g_hash_table_lookup_extended(params, name, NULL, &position))
+        gel_macro_add_op(ops, GEL_MACRO_OP_ARG, GPOINTER_TO_UINT(position));
+    else
+        gel_macro_add_op(ops, GEL_MACRO_OP_LITERAL,
+            gel_ast_append_copy(self->literals, ast, node));
 }
 
 
+/*
+ * Creates a macro called @name from the arguments and code
+ * of the children of @node starting at @first.
+ */
 static
-GelValueArray* gel_macro_map_code(const GelMacro *self,
-                                 GHashTable *hash, GelValueArray *array,
-                                 GError **error)
+GelMacro* gel_macro_new(const gchar *name, GelAst *ast, guint node,
+                        guint first, GError **error)
 {
-    GValue *values = gel_value_array_get_values(array);
-    guint n_values = gel_value_array_get_n_values(array);
-    GelValueArray *code = gel_value_array_new(n_values);
+    GValue vars_value = {0};
+    gel_ast_get_value(ast, gel_ast_get_child(ast, node, first), &vars_value);
 
-    for(guint i = 0; i < n_values; i++)
+    if(!GEL_VALUE_HOLDS(&vars_value, GEL_TYPE_VALUE_ARRAY))
     {
-        GType type = GEL_VALUE_TYPE(values + i);
-        if(type == GEL_TYPE_SYMBOL)
-        {
-            GelSymbol *symbol = gel_value_get_boxed(values + i);
-            const gchar *name = gel_symbol_get_name(symbol);
-            GValue *value = g_hash_table_lookup(hash, name);
+        g_propagate_error(error, g_error_new(
+            GEL_PARSE_ERROR, GEL_PARSE_ERROR_MACRO_MALFORMED,
+            "Macro %s: expected an array of arguments", name));
+        g_value_unset(&vars_value);
+        return NULL;
+    }
 
-            if(g_strcmp0(name, self->variadic) != 0)
-            {
-                if(value != NULL)
-                    gel_value_array_append(code, value);
-                else
-                    gel_value_array_append(code, values + i);
-            }
-            else
-            if(GEL_VALUE_HOLDS(value, GEL_TYPE_VALUE_ARRAY))
-            {
-                GelValueArray *var_array = gel_value_get_boxed(value);
-                guint var_n_values = gel_value_array_get_n_values(var_array);
-                GValue *var_values = gel_value_array_get_values(var_array);
+    gchar *variadic = NULL;
+    gchar *invalid = NULL;
+    GList *args = gel_args_from_array(
+        gel_value_get_boxed(&vars_value), &variadic, &invalid);
+    g_value_unset(&vars_value);
 
-                for(guint i = 0; i < var_n_values; i++)
-                    gel_value_array_append(code, var_values + i);
-            }
-        }
-        else
-        if(type == GEL_TYPE_VALUE_ARRAY)
-        {
-            GelValueArray *array = gel_value_get_boxed(values + i);
-            GelValueArray *new_array =
-                gel_macro_map_code(self, hash, array, error);
+    if(invalid != NULL)
+    {
+        g_propagate_error(error, g_error_new(
+            GEL_PARSE_ERROR, GEL_PARSE_ERROR_MACRO_MALFORMED,
+            "Macro: '%s' is an invalid argument name", invalid));
+        g_free(invalid);
+        return NULL;
+    }
 
-            GValue tmp_value = {0};
-            g_value_init(&tmp_value, GEL_TYPE_VALUE_ARRAY);
+    GelMacro *self = g_slice_new0(GelMacro);
+    self->name = g_strdup(name);
+    self->is_variadic = (variadic != NULL);
+    self->literals = gel_ast_new();
 
-            gel_value_take_boxed(&tmp_value, new_array);
-            gel_value_array_append(code, &tmp_value);
+    GHashTable *params = g_hash_table_new(g_str_hash, g_str_equal);
+    for(GList *iter = args; iter != NULL; iter = iter->next)
+        g_hash_table_insert(params,
+            iter->data, GUINT_TO_POINTER(self->n_args++));
 
-            g_value_unset(&tmp_value);
-        }
-        else
-            gel_value_array_append(code, values + i);
-    }
+    GArray *ops = g_array_new(FALSE, FALSE, sizeof(GelMacroOp));
+    guint n_children = gel_ast_get_n_children(ast, node);
+
+    for(guint i = first + 1; i < n_children; i++)
+        gel_macro_compile(self, ast, gel_ast_get_child(ast, node, i),
+            params, variadic, 0, ops);
+
+    self->n_ops = ops->len;
+    self->ops = (GelMacroOp*)g_array_free(ops, FALSE);
 
-    return code;
+    g_hash_table_unref(params);
+    g_list_foreach(args, (GFunc)g_free, NULL);
+    g_list_free(args);
+    g_free(variadic);
+
+    return self;
 }
 
 
+/*
+ * Appends to @nodes the code of @self, with the arguments
+ * given in the children of @node after its first one.
+ */
 static
-GelValueArray* gel_macro_invoke(const GelMacro *self,
-                              guint n_values, const GValue *values,
-                              GError **error)
+gboolean gel_macro_invoke(const GelMacro *self, GelAst *ast, guint node,
+                          GArray *nodes, GError **error)
 {
-    guint n_args = g_list_length(self->args);
-    gboolean is_variadic = (self->variadic != NULL);
+    guint n_values = gel_ast_get_n_children(ast, node) - 1;
 
-    if(is_variadic)
+    if(self->is_variadic)
     {
-        if(n_values < n_args)
+        if(n_values < self->n_args)
         {
             g_propagate_error(error, g_error_new(
                 GEL_PARSE_ERROR, GEL_PARSE_ERROR_MACRO_ARGUMENTS,
                 "Macro %s: requires at least %u arguments, got %u",
-                self->name, n_args, n_values));
-            return NULL;
+                self->name, self->n_args, n_values));
+            return FALSE;
         }
     }
     else
-    if(n_values != n_args)
+    if(n_values != self->n_args)
     {
         g_propagate_error(error, g_error_new(
             GEL_PARSE_ERROR, GEL_PARSE_ERROR_MACRO_ARGUMENTS,
             "Macro %s: requires %u arguments, got %u",
-            self->name, n_args, n_values));
-        return NULL;
+            self->name, self->n_args, n_values));
+        return FALSE;
     }
 
-    GHashTable *mappings = g_hash_table_new(g_str_hash, g_str_equal);
+    guint *marks = g_newa(guint, self->depth + 1);
+    guint depth = 0;
 
-    guint i = 0;
-    for(GList *iter = self->args; iter != NULL; iter = iter->next, i++)
+    for(guint i = 0; i < self->n_ops; i++)
     {
-        const gchar *arg = iter->data;
-        const GValue *value = values + i;
-        g_hash_table_insert(mappings, (void* )arg, (void *)value);
-    }
-
-    if(is_variadic)
-    {
-        guint array_n_values = n_values - i;
-        GelValueArray *array = gel_value_array_new(array_n_values);
+        const GelMacroOp *op = self->ops + i;
+        guint value = 0;
 
-        for(guint j = 0; i < n_values; i++, j++)
-            gel_value_array_append(array, values + i);
-
-        GValue *value = gel_value_new_from_boxed(GEL_TYPE_VALUE_ARRAY, array);
-        g_hash_table_insert(mappings, self->variadic, value);
+        switch(op->kind)
+        {
+            case GEL_MACRO_OP_LITERAL:
+                value = gel_ast_append_copy(ast, self->literals, op->operand);
+                g_array_append_val(nodes, value);
+                break;
+            case GEL_MACRO_OP_ARG:
+                value = gel_ast_get_child(ast, node, op->operand + 1);
+                g_array_append_val(nodes, value);
+                break;
+            case GEL_MACRO_OP_VARIADIC:
+                for(guint j = self->n_args; j < n_values; j++)
+                {
+                    value = gel_ast_get_child(ast, node, j + 1);
+                    g_array_append_val(nodes, value);
+                }
+                break;
+            case GEL_MACRO_OP_BEGIN:
+                marks[depth++] = nodes->len;
+                break;
+            case GEL_MACRO_OP_END:
+            {
+                guint start = marks[--depth];
+                value = gel_ast_append_list(ast, nodes->len - start,
+                    &g_array_index(nodes, guint, start));
+                g_array_set_size(nodes, start);
+                g_array_append_val(nodes, value);
+                break;
+            }
+        }
     }
 
-    GelValueArray *code =
-        gel_macro_map_code(self, mappings, self->code, error);
-    g_hash_table_unref(mappings);
-
-    return code;
+    return TRUE;
 }
 
 
-GelValueArray* gel_macro_code_from_value(GValue *pre_value, GError **error)
+/*
+ * Appends to @nodes the code @node of @ast expands to, if it is
+ * a list that defines or invokes a macro of @self, and returns %TRUE.
+ * Definitions expand to no code. Returns %FALSE, leaving @nodes as it
+ * was, if @node has nothing to do with macros or if an error occurred.
+ */
+gboolean gel_macros_expand(GelMacros *self, GelAst *ast, guint node,
+                           GArray *nodes, GError **error)
 {
-    if(GEL_VALUE_TYPE(pre_value) == GEL_TYPE_VALUE_ARRAY)
-    {
-        GelValueArray *array = gel_value_get_boxed(pre_value);
-        GValue *values = gel_value_array_get_values(array);
-        guint n_values = gel_value_array_get_n_values(array);
-
-        GType type = GEL_VALUE_TYPE(values + 0);
-        if(type != GEL_TYPE_SYMBOL)
-            return NULL;
+    g_return_val_if_fail(self != NULL, FALSE);
 
-        GelSymbol *symbol = gel_value_get_boxed(values + 0);
-        const gchar *name = gel_symbol_get_name(symbol);
-
-        n_values--;
-        values++;
-
-        if(g_strcmp0(name, "macro") == 0)
-        {
-            if(n_values < 2)
-            {
-                g_propagate_error(error, g_error_new(
-                    GEL_PARSE_ERROR, GEL_PARSE_ERROR_MACRO_MALFORMED,
-                    "Macro: expected arguments and code"));
-                return NULL;
-            }
+    if(gel_ast_get_kind(ast, node) != GEL_AST_LIST)
+        return FALSE;
 
-            symbol = gel_value_get_boxed(values + 0);
-            name = gel_symbol_get_name(symbol);
+    guint n_children = gel_ast_get_n_children(ast, node);
+    if(n_children == 0)
+        return FALSE;
 
-            GelValueArray *vars = gel_value_get_boxed(values + 1);
-            gchar *variadic = NULL;
-            gchar *invalid = NULL;
-            GList* args = gel_args_from_array(vars, &variadic, &invalid);
+    const gchar *name = gel_ast_get_name(ast, gel_ast_get_child(ast, node, 0));
+    if(name == NULL)
+        return FALSE;
 
-            if(invalid != NULL)
-            {
-                g_propagate_error(error, g_error_new(
-                    GEL_PARSE_ERROR, GEL_PARSE_ERROR_MACRO_MALFORMED,
-                    "Macro: '%s' is an invalid argument name", invalid));
-                g_free(invalid);
-                return NULL;
-            }
-
-            n_values -= 2;
-            values += 2;
-
-            GelValueArray *code = gel_value_array_new(n_values);
-            for(guint i = 0; i < n_values; i++)
-                gel_value_array_append(code, values + i);
+    if(g_strcmp0(name, "macro") == 0)
+    {
+        const gchar *macro_name = n_children < 3 ? NULL
+            : gel_ast_get_name(ast, gel_ast_get_child(ast, node, 1));
 
-            gel_macros_insert(name, args, variadic, code);
-            return gel_value_array_new(0);
-        }
-        else
+        if(macro_name == NULL)
         {
-            GelMacro *macro = gel_macros_lookup(name);
-            if(macro != NULL)
-                return gel_macro_invoke(macro, n_values, values, error);
+            g_propagate_error(error, g_error_new(
+                GEL_PARSE_ERROR, GEL_PARSE_ERROR_MACRO_MALFORMED,
+                "Macro: expected arguments and code"));
+            return FALSE;
         }
+
+        GelMacro *macro = gel_macro_new(macro_name, ast, node, 2, error);
+        if(macro == NULL)
+            return FALSE;
+
+        g_hash_table_replace(self->hash, macro->name, macro);
+        return TRUE;
     }
 
-    return NULL;
+    GelMacro *macro = g_hash_table_lookup(self->hash, name);
+    if(macro == NULL)
+        return FALSE;
+
+    return gel_macro_invoke(macro, ast, node, nodes, error);
 }
 
@@ -1,21 +1,16 @@
 #ifndef __GEL_MACRO_H__
+#define __GEL_MACRO_H__
 
 #include <glib-object.h>
-#include <gelarray.h>
+#include <gelparser.h>
+#include <gelast.h>
 
 typedef struct _GelMacro GelMacro;
 
-void gel_macros_new(void);
+GelMacro* gel_macros_lookup(GelMacros *self, const gchar *name);
 
-void gel_macros_free(void);
-
-GelMacro* gel_macro_new(const gchar *name,
-                        GList *args, gchar *variadic, GelValueArray *code);
-
-void gel_macro_free(GelMacro *self);
-
-GelMacro* gel_macro_lookup(const gchar *name);
-
-GelValueArray* gel_macro_code_from_value(GValue *pre_value, GError **error);
+gboolean gel_macros_expand(GelMacros *self, GelAst *ast, guint node,
+                           GArray *nodes, GError **error);
 
 #endif
+
@@ -0,0 +1,106 @@
+#ifndef __GEL_MODULE_H__
+#define __GEL_MODULE_H__
+
+#include <glib-object.h>
+#include <gelcontext.h>
+
+/**
+ * GEL_MODULE_VERSION:
+ *
+ * Version of the layout of #GelModule, a module is only loaded
+ * by #gel_context_load_module if it was built with the same version.
+ */
+#define GEL_MODULE_VERSION 2
+
+/**
+ * GEL_MODULE_SYMBOL:
+ *
+ * Name of the #GelModule exported by a module.
+ */
+#define GEL_MODULE_SYMBOL "gel_module"
+
+/**
+ * GelModuleStatus:
+ * @GEL_MODULE_GIVE_UP: the call has to be interpreted from its beginning
+ * @GEL_MODULE_DONE: the call was done
+ * @GEL_MODULE_ERROR: the call raised an error, which is left in its context
+ *
+ * What the native code of a function and the calls it makes return.
+ */
+typedef enum _GelModuleStatus
+{
+    GEL_MODULE_GIVE_UP,
+    GEL_MODULE_DONE,
+    GEL_MODULE_ERROR
+} GelModuleStatus;
+
+/**
+ * GelModuleCall:
+ *
+ * A call to a predefined closure made by the native code of a function,
+ * made with #gel_module_call.
+ */
+typedef struct _GelModuleCall GelModuleCall;
+
+/**
+ * GelModuleFunc:
+ * @slots: array with the int64 and boolean variables of the function,
+ * starting with its arguments
+ * @result: return location for the result of the function
+ * @context: #GelContext of the call
+ * @calls: the calls to predefined closures the function makes
+ *
+ * Native code of a function of a module. Booleans are stored as 0 or 1.
+ * It has to return #GEL_MODULE_GIVE_UP without having changed anything
+ * when it does not handle the call, so it is evaluated by the
+ * interpreter instead.
+ *
+ * Returns: a #GelModuleStatus
+ */
+typedef GelModuleStatus (*GelModuleFunc)(gint64 *slots, gint64 *result,
+                                         GelContext *context,
+                                         GelModuleCall * const *calls);
+
+/**
+ * GelModuleFunction:
+ * @form: index of the top-level form that defines the function
+ * @name: name of the function
+ * @checksum: checksum of the instructions @func was made from
+ * @func: the native code of the function
+ *
+ * A function of a module compiled to native code. @func is only used
+ * if the code of the function gives the same instructions when the
+ * module is loaded, which it does not if the names of the predefined
+ * closures it calls were given other values.
+ */
+typedef struct _GelModuleFunction
+{
+    guint form;
+    const gchar *name;
+    guint checksum;
+    GelModuleFunc func;
+} GelModuleFunction;
+
+/**
+ * GelModule:
+ * @version: #GEL_MODULE_VERSION when the module was built
+ * @file: name of the script the module was made from
+ * @source: text of the script
+ * @n_functions: number of elements of @functions
+ * @functions: the functions of the script compiled to native code
+ *
+ * A script compiled to a shared object, as made by the gelc tool.
+ */
+typedef struct _GelModule
+{
+    guint version;
+    const gchar *file;
+    const gchar *source;
+    guint n_functions;
+    const GelModuleFunction *functions;
+} GelModule;
+
+GelModuleStatus gel_module_call(const GelModuleCall *call, gint64 *slots,
+                                GelContext *context);
+
+#endif
@@ -0,0 +1,943 @@
+#include <config.h>
+
+#include <string.h>
+
+#include <gelnative.h>
+#include <gelcontextprivate.h>
+#include <gelvalue.h>
+#include <gelvalueprivate.h>
+#include <gelarrayprivate.h>
+#include <gelsymbol.h>
+#include <gelclosure.h>
+#include <gelclosureprivate.h>
+
+
+/*
+ * Translates the code of closures written in gel to instructions,
+ * which the JIT compiles to machine code and gelc to C.
+ *
+ * The code of closures made of int64 and boolean literals, their
+ * arguments, names they define at the top of their code, and calls
+ * to the predefined arithmetic, comparisons, if, do, set and while is
+ * translated to instructions. Their arguments have to be int64 when
+ * they are called.
+ *
+ * Calls to other predefined closures are translated to calls to them,
+ * given the values of their arguments, as long as these are literals,
+ * predefined values, int64 and boolean code that can not fail, or calls
+ * to such closures, made when the closure they are given to evaluates
+ * them. Closures taking code instead of values, such as define or let,
+ * are never called this way. Errors they raise are reported from the call,
+ * and so are divisions by 0, by calling the predefined division.
+ * Closures using anything else are always interpreted.
+ *
+ * Only calls to closures known not to change anything can give their
+ * result to the compiled code, which has to be an int64. When it is not,
+ * the compiled code gives up and the call is interpreted from its
+ * beginning, so code giving up this way can not call closures that
+ * change anything.
+ */
+
+typedef struct _GelNativeCompiler GelNativeCompiler;
+
+struct _GelNativeCompiler
+{
+    GelNative *native;
+    GelContext *context;
+
+    /* Index + 1 of the slot of each variable, and its type */
+    GHashTable *slots;
+    GArray *types;
+
+    /* Whether the code calls closures changing something,
+       or closures whose result may make it give up */
+    gboolean changes;
+    gboolean checks;
+
+    gboolean failed;
+};
+
+/* A call given as an argument, to be made by the closure it is given to */
+typedef struct _GelNativeArgument
+{
+    const GelModuleCall *call;
+    gint64 *slots;
+} GelNativeArgument;
+
+
+static
+void gel_native_emit(GelNativeCompiler *c, GelNativeOpCode code,
+                     gint64 operand)
+{
+    GelNativeOp op = {code, operand};
+    g_array_append_val(c->native->ops, op);
+}
+
+
+static
+guint gel_native_new_label(GelNativeCompiler *c)
+{
+    return c->native->n_labels++;
+}
+
+
+static
+guint gel_native_lookup_slot(GelNativeCompiler *c, const gchar *name)
+{
+    return GPOINTER_TO_UINT(g_hash_table_lookup(c->slots, name));
+}
+
+
+/* Adds a slot for values of @type, returning its index + 1 */
+static
+guint gel_native_new_slot(GelNativeCompiler *c, GelNativeType type)
+{
+    g_array_append_val(c->types, type);
+    return c->types->len;
+}
+
+
+static
+void gel_native_add_slot(GelNativeCompiler *c, const gchar *name,
+                         GelNativeType type)
+{
+    g_hash_table_insert(c->slots, (gpointer)name,
+        GUINT_TO_POINTER(gel_native_new_slot(c, type)));
+}
+
+
+static
+GelNativeType gel_native_fail(GelNativeCompiler *c)
+{
+    c->failed = TRUE;
+    return GEL_NATIVE_NONE;
+}
+
+
+static
+const gchar* gel_native_symbol_name(const GValue *value)
+{
+    if(!GEL_VALUE_HOLDS(value, GEL_TYPE_SYMBOL))
+        return NULL;
+
+    return gel_symbol_get_name(gel_value_get_boxed(value));
+}
+
+
+/*
+ * Gets the predefined value the symbol @name always refers to in the
+ * code being translated, or NULL if it may refer to something else.
+ */
+static
+const GValue* gel_native_lookup_predefined(GelNativeCompiler *c,
+                                           const gchar *name)
+{
+    if(gel_native_lookup_slot(c, name) != 0
+        || gel_context_get_variable(c->context, name) != NULL)
+        return NULL;
+
+    return gel_value_lookup_predefined(name);
+}
+
+
+/*
+ * Gets the name of the predefined closure @value calls, or NULL if
+ * it may call something else. Versions of predefined closures made
+ * by the optimizer are native closures with the same name.
+ */
+static
+const gchar* gel_native_closure_name(GelNativeCompiler *c,
+                                     const GValue *value)
+{
+    const gchar *name = gel_native_symbol_name(value);
+    if(name != NULL)
+        value = gel_native_lookup_predefined(c, name);
+
+    if(value == NULL || !GEL_VALUE_HOLDS(value, G_TYPE_CLOSURE))
+        return NULL;
+
+    GClosure *closure = gel_value_get_boxed(value);
+    name = gel_closure_get_name(closure);
+
+    const GValue *predefined = gel_value_lookup_predefined(name);
+    if(predefined == NULL || !GEL_VALUE_HOLDS(predefined, G_TYPE_CLOSURE)
+        || ((GClosure*)gel_value_get_boxed(predefined))->marshal
+            != closure->marshal)
+        return NULL;
+
+    return name;
+}
+
+
+/* Gets the instruction applying the operator @name, if it is one */
+static
+gboolean gel_native_operator(const gchar *name, GelNativeOpCode *code)
+{
+    static const struct
+    {
+        const gchar *name;
+        GelNativeOpCode code;
+    } operators[] =
+    {
+        {"+", GEL_NATIVE_ADD}, {"-", GEL_NATIVE_SUBTRACT},
+        {"*", GEL_NATIVE_MULTIPLY}, {"/", GEL_NATIVE_DIVIDE},
+        {"%", GEL_NATIVE_MODULO}, {">", GEL_NATIVE_GREATER},
+        {">=", GEL_NATIVE_GREATER_EQUAL}, {"=", GEL_NATIVE_EQUAL},
+        {"<=", GEL_NATIVE_LESS_EQUAL}, {"<", GEL_NATIVE_LESS},
+        {"!=", GEL_NATIVE_NOT_EQUAL}
+    };
+
+    for(guint i = 0; i < G_N_ELEMENTS(operators); i++)
+        if(strcmp(name, operators[i].name) == 0)
+        {
+            *code = operators[i].code;
+            return TRUE;
+        }
+
+    return FALSE;
+}
+
+
+/* Checks whether calls to the predefined closure @name are translated */
+static
+gboolean gel_native_is_native(const gchar *name)
+{
+    GelNativeOpCode code;
+    return gel_native_operator(name, &code)
+        || strcmp(name, "if") == 0 || strcmp(name, "do") == 0;
+}
+
+
+/* Checks whether compiled code can call the predefined closure @name */
+static
+gboolean gel_native_is_callable(const gchar *name)
+{
+    /* These take code or names, not the values of their arguments */
+    static const gchar *unevaluated[] =
+    {
+        "define", "function", "do", "let", "eval", "var", "name", "set",
+        "record", "if", "cond", "case", "while", "for", "and", "or",
+        "break", "continue", "return", "try", "require", ".",
+        NULL
+    };
+
+    for(const gchar **iter = unevaluated; *iter != NULL; iter++)
+        if(strcmp(name, *iter) == 0)
+            return FALSE;
+
+    return TRUE;
+}
+
+
+/* Checks whether calling the predefined closure @name changes nothing */
+static
+gboolean gel_native_is_pure(const gchar *name)
+{
+    static const gchar *pure[] =
+    {
+        "str", "type", "size", "get", "find", "keys", "compare",
+        "array", "range", "min", "max", "sum",
+        NULL
+    };
+
+    for(const gchar **iter = pure; *iter != NULL; iter++)
+        if(strcmp(name, *iter) == 0)
+            return TRUE;
+
+    return FALSE;
+}
+
+
+static
+void gel_native_call_free(GelModuleCall *self)
+{
+    for(guint i = 0; i < self->n_values; i++)
+        if(GEL_IS_VALUE(self->values + i))
+            g_value_unset(self->values + i);
+    g_free(self->values);
+    g_free(self->slots);
+    g_free(self->calls);
+    g_closure_unref(self->closure);
+    g_slice_free(GelModuleCall, self);
+}
+
+
+/*
+ * Adds a call to the closure @value refers to, made in @array,
+ * with @n_values arguments to be set by the caller.
+ */
+static
+GelModuleCall* gel_native_call_new(GelNativeCompiler *c, const GValue *value,
+                                   const GelValueArray *array, guint n_values)
+{
+    const gchar *name = gel_native_symbol_name(value);
+    if(name != NULL)
+        value = gel_native_lookup_predefined(c, name);
+
+    GelModuleCall *self = g_slice_new0(GelModuleCall);
+    self->closure = g_closure_ref(gel_value_get_boxed(value));
+    self->array = array;
+    self->n_values = n_values;
+    self->values = g_new0(GValue, n_values);
+    self->slots = g_new0(guint, n_values);
+    self->calls = g_new0(GelModuleCall*, n_values);
+
+    g_ptr_array_add(c->native->calls, self);
+    return self;
+}
+
+
+static
+gboolean gel_native_call_eval(const GelModuleCall *self, gint64 *slots,
+                              GelContext *context, GValue *return_value);
+
+
+static
+void gel_native_argument_(GClosure *self, GValue *return_value,
+                          guint n_values, const GValue *values,
+                          GelContext *context, GelNativeArgument *argument)
+{
+    gel_native_call_eval(argument->call, argument->slots,
+        context, return_value);
+}
+
+
+/*
+ * Calls the closure of @self in @context with the arguments the
+ * compiled code left in @slots, returning FALSE if it raised an error.
+ */
+static
+gboolean gel_native_call_eval(const GelModuleCall *self, gint64 *slots,
+                              GelContext *context, GValue *return_value)
+{
+    /* The literals are lent to the closure, which does not change them */
+    GValue *values = g_newa(GValue, self->n_values);
+    memcpy(values, self->values, self->n_values * sizeof(GValue));
+    GelNativeArgument *arguments = g_newa(GelNativeArgument, self->n_values);
+
+    for(guint i = 0; i < self->n_values; i++)
+        if(self->slots[i] != 0)
+        {
+            gint64 slot = slots[self->slots[i] - 1];
+            if(GEL_VALUE_HOLDS(values + i, G_TYPE_INT64))
+                gel_value_set_int64(values + i, slot);
+            else
+                gel_value_set_boolean(values + i, slot != 0);
+        }
+        else
+        if(self->calls[i] != NULL)
+        {
+            /* The call is made when the closure evaluates its argument */
+            arguments[i].call = self->calls[i];
+            arguments[i].slots = slots;
+
+            GClosure *closure = gel_closure_new_native("argument",
+                (GClosureMarshal)gel_native_argument_);
+            closure->data = arguments + i;
+            g_closure_ref(closure);
+            g_closure_sink(closure);
+
+            GValue closure_value = {0};
+            g_value_init(&closure_value, G_TYPE_CLOSURE);
+            gel_value_take_boxed(&closure_value, closure);
+
+            GelValueArray *code = gel_value_array_new(1);
+            gel_value_array_take(code, &closure_value);
+
+            g_value_init(values + i, GEL_TYPE_VALUE_ARRAY);
+            gel_value_take_boxed(values + i, code);
+        }
+
+    gel_closure_invoke(self->closure, return_value,
+        self->n_values, values, context);
+
+    for(guint i = 0; i < self->n_values; i++)
+        if(self->calls[i] != NULL)
+            g_value_unset(values + i);
+
+    if(!gel_context_error(context))
+        return TRUE;
+
+    gel_context_locate_error(context, self->array);
+    return FALSE;
+}
+
+
+/**
+ * gel_module_call:
+ * @call: a #GelModuleCall
+ * @slots: the variables of the native code making @call
+ * @context: #GelContext of the native code
+ *
+ * Makes @call with the arguments the native code left in @slots,
+ * storing its result in its slot, if it has one.
+ *
+ * Returns: #GEL_MODULE_DONE if the call was done, #GEL_MODULE_ERROR if
+ * it raised an error and #GEL_MODULE_GIVE_UP if its result is not an int64.
+ */
+GelModuleStatus gel_module_call(const GelModuleCall *call, gint64 *slots,
+                                GelContext *context)
+{
+    g_return_val_if_fail(call != NULL, GEL_MODULE_GIVE_UP);
+    g_return_val_if_fail(context != NULL, GEL_MODULE_GIVE_UP);
+
+    GValue result = {0};
+    GelModuleStatus status = GEL_MODULE_DONE;
+
+    if(!gel_native_call_eval(call, slots, context, &result))
+        status = GEL_MODULE_ERROR;
+    else
+    if(call->result != 0)
+    {
+        if(GEL_VALUE_HOLDS(&result, G_TYPE_INT64))
+            slots[call->result - 1] = gel_value_get_int64(&result);
+        else
+            status = GEL_MODULE_GIVE_UP;
+    }
+
+    if(GEL_IS_VALUE(&result))
+        g_value_unset(&result);
+
+    return status;
+}
+
+
+static
+GelNativeType gel_native_value(GelNativeCompiler *c, const GValue *value);
+
+static
+void gel_native_statement(GelNativeCompiler *c, const GValue *value);
+
+
+/*
+ * Gets the call to the predefined closure @name in @value, translating the
+ * code computing its arguments, or returns NULL if it can not be called.
+ * The arguments are computed before the call, so they have to be code
+ * that can not fail, unless they are calls to closures themselves.
+ */
+static
+GelModuleCall* gel_native_call_compile(GelNativeCompiler *c,
+                                       const gchar *name, const GValue *value)
+{
+    if(!gel_native_is_callable(name))
+    {
+        gel_native_fail(c);
+        return NULL;
+    }
+
+    c->changes = c->changes || !gel_native_is_pure(name);
+
+    GelValueArray *array = gel_value_get_boxed(value);
+    const GValue *values = gel_value_array_get_values(array);
+    guint n_values = gel_value_array_get_n_values(array);
+
+    GelModuleCall *call =
+        gel_native_call_new(c, values + 0, array, n_values - 1);
+
+    for(guint i = 1; i < n_values && !c->failed; i++)
+    {
+        const GValue *arg = values + i;
+        GValue *dest = call->values + i - 1;
+
+        const gchar *arg_name = gel_native_symbol_name(arg);
+        if(arg_name != NULL && gel_native_lookup_slot(c, arg_name) == 0)
+        {
+            arg = gel_native_lookup_predefined(c, arg_name);
+            if(arg == NULL || GEL_VALUE_HOLDS(arg, GEL_TYPE_VALUE_ARRAY))
+                gel_native_fail(c);
+            else
+                gel_value_copy(arg, dest);
+            continue;
+        }
+
+        GelValueArray *arg_array = GEL_VALUE_HOLDS(arg, GEL_TYPE_VALUE_ARRAY)
+            ? gel_value_get_boxed(arg) : NULL;
+        const gchar *arg_callee = (arg_array != NULL
+                && gel_value_array_get_n_values(arg_array) > 0)
+            ? gel_native_closure_name(c,
+                gel_value_array_get_values(arg_array))
+            : NULL;
+
+        if(arg_callee != NULL && !gel_native_is_native(arg_callee))
+        {
+            call->calls[i - 1] = gel_native_call_compile(c, arg_callee, arg);
+            continue;
+        }
+
+        if(arg_name != NULL || arg_array != NULL
+            || GEL_VALUE_HOLDS(arg, G_TYPE_INT64)
+            || GEL_VALUE_HOLDS(arg, G_TYPE_BOOLEAN))
+        {
+            guint n_calls = c->native->calls->len;
+            GelNativeType type = gel_native_value(c, arg);
+            if(type == GEL_NATIVE_NONE || c->native->calls->len != n_calls)
+            {
+                gel_native_fail(c);
+                continue;
+            }
+
+            call->slots[i - 1] = gel_native_new_slot(c, type);
+            g_value_init(dest,
+                (type == GEL_NATIVE_INT64) ? G_TYPE_INT64 : G_TYPE_BOOLEAN);
+            gel_native_emit(c, GEL_NATIVE_STORE, call->slots[i - 1] - 1);
+            continue;
+        }
+
+        gel_value_copy(arg, dest);
+    }
+
+    return c->failed ? NULL : call;
+}
+
+
+/*
+ * Translates a call to the predefined closure @name in @value,
+ * leaving its result in the accumulator if @is_value is TRUE.
+ */
+static
+GelNativeType gel_native_builtin(GelNativeCompiler *c, const gchar *name,
+                                 const GValue *value, gboolean is_value)
+{
+    if(is_value && !gel_native_is_pure(name))
+        return gel_native_fail(c);
+
+    guint index = c->native->calls->len;
+    GelModuleCall *call = gel_native_call_compile(c, name, value);
+    if(call == NULL)
+        return GEL_NATIVE_NONE;
+
+    if(is_value)
+    {
+        c->checks = TRUE;
+        call->result = gel_native_new_slot(c, GEL_NATIVE_INT64);
+    }
+
+    gel_native_emit(c, GEL_NATIVE_CALL, index);
+    return is_value ? GEL_NATIVE_INT64 : GEL_NATIVE_NONE;
+}
+
+
+/*
+ * Translates the operands of the call in @array, moving the right one
+ * to the right operand before applying the operator @code to them.
+ */
+static
+GelNativeType gel_native_binary(GelNativeCompiler *c, GelNativeOpCode code,
+                                const GelValueArray *array)
+{
+    const GValue *values = gel_value_array_get_values(array);
+    guint n_values = gel_value_array_get_n_values(array);
+    gboolean is_comparison = (code >= GEL_NATIVE_GREATER);
+
+    if(n_values < 3 || (is_comparison && n_values != 3))
+        return gel_native_fail(c);
+
+    GelNativeType type = gel_native_value(c, values + 1);
+    if(!is_comparison && type != GEL_NATIVE_INT64)
+        return gel_native_fail(c);
+
+    for(guint i = 2; i < n_values; i++)
+    {
+        gel_native_emit(c, GEL_NATIVE_PUSH, 0);
+        if(gel_native_value(c, values + i) != type)
+            return gel_native_fail(c);
+        gel_native_emit(c, GEL_NATIVE_OPERAND, 0);
+
+        /* Only divisors that are not literals can be 0,
+           dividing by them raises the error of the predefined division */
+        guint division = 0;
+        if((code == GEL_NATIVE_DIVIDE || code == GEL_NATIVE_MODULO)
+            && (!GEL_VALUE_HOLDS(values + i, G_TYPE_INT64)
+                || gel_value_get_int64(values + i) == 0))
+        {
+            GelModuleCall *call = gel_native_call_new(c, values + 0, array, 2);
+            for(guint j = 0; j < 2; j++)
+            {
+                call->slots[j] = gel_native_new_slot(c, GEL_NATIVE_INT64);
+                g_value_init(call->values + j, G_TYPE_INT64);
+            }
+            call->result = gel_native_new_slot(c, GEL_NATIVE_INT64);
+            division = c->native->calls->len;
+        }
+
+        gel_native_emit(c, code, division);
+    }
+
+    return is_comparison ? GEL_NATIVE_BOOLEAN : GEL_NATIVE_INT64;
+}
+
+
+/* Translates an if whose branches are values when @is_value is TRUE */
+static
+GelNativeType gel_native_if(GelNativeCompiler *c, guint n_values,
+                            const GValue *values, gboolean is_value)
+{
+    if(n_values != 4 && (is_value || n_values != 3))
+        return gel_native_fail(c);
+
+    if(gel_native_value(c, values + 1) == GEL_NATIVE_NONE)
+        return GEL_NATIVE_NONE;
+
+    guint else_label = gel_native_new_label(c);
+    gel_native_emit(c, GEL_NATIVE_JUMP_IF_FALSE, else_label);
+    GelNativeType type = GEL_NATIVE_NONE;
+
+    if(is_value)
+        type = gel_native_value(c, values + 2);
+    else
+        gel_native_statement(c, values + 2);
+
+    if(n_values == 4)
+    {
+        guint end_label = gel_native_new_label(c);
+        gel_native_emit(c, GEL_NATIVE_JUMP, end_label);
+        gel_native_emit(c, GEL_NATIVE_LABEL, else_label);
+
+        if(is_value)
+        {
+            if(gel_native_value(c, values + 3) != type)
+                return gel_native_fail(c);
+        }
+        else
+            gel_native_statement(c, values + 3);
+
+        gel_native_emit(c, GEL_NATIVE_LABEL, end_label);
+    }
+    else
+        gel_native_emit(c, GEL_NATIVE_LABEL, else_label);
+
+    return type;
+}
+
+
+/* Translates @value so its value is left in the accumulator */
+static
+GelNativeType gel_native_value(GelNativeCompiler *c, const GValue *value)
+{
+    if(c->failed)
+        return GEL_NATIVE_NONE;
+
+    const gchar *name = gel_native_symbol_name(value);
+    if(name != NULL)
+    {
+        guint slot = gel_native_lookup_slot(c, name);
+        if(slot != 0)
+        {
+            gel_native_emit(c, GEL_NATIVE_LOAD, slot - 1);
+            return g_array_index(c->types, GelNativeType, slot - 1);
+        }
+
+        value = gel_native_lookup_predefined(c, name);
+        if(value == NULL)
+            return gel_native_fail(c);
+    }
+
+    GType type = GEL_VALUE_TYPE(value);
+    if(type == G_TYPE_INT64)
+    {
+        gel_native_emit(c, GEL_NATIVE_CONSTANT, gel_value_get_int64(value));
+        return GEL_NATIVE_INT64;
+    }
+
+    if(type == G_TYPE_BOOLEAN)
+    {
+        gel_native_emit(c, GEL_NATIVE_CONSTANT,
+            gel_value_get_boolean(value) ? 1 : 0);
+        return GEL_NATIVE_BOOLEAN;
+    }
+
+    if(type != GEL_TYPE_VALUE_ARRAY)
+        return gel_native_fail(c);
+
+    GelValueArray *array = gel_value_get_boxed(value);
+    const GValue *values = gel_value_array_get_values(array);
+    guint n_values = gel_value_array_get_n_values(array);
+
+    name = (n_values > 0) ? gel_native_closure_name(c, values + 0) : NULL;
+    if(name == NULL)
+        return gel_native_fail(c);
+
+    GelNativeOpCode code;
+    if(gel_native_operator(name, &code))
+        return gel_native_binary(c, code, array);
+
+    if(strcmp(name, "if") == 0)
+        return gel_native_if(c, n_values, values, TRUE);
+
+    if(strcmp(name, "do") == 0 && n_values > 1)
+    {
+        for(guint i = 1; i < n_values - 1; i++)
+            gel_native_statement(c, values + i);
+        return gel_native_value(c, values + n_values - 1);
+    }
+
+    return gel_native_builtin(c, name, value, TRUE);
+}
+
+
+/* Translates @value, whose value is not used */
+static
+void gel_native_statement(GelNativeCompiler *c, const GValue *value)
+{
+    if(c->failed)
+        return;
+
+    GelValueArray *array = GEL_VALUE_HOLDS(value, GEL_TYPE_VALUE_ARRAY) ?
+        gel_value_get_boxed(value) : NULL;
+    guint n_values = (array != NULL) ? gel_value_array_get_n_values(array) : 0;
+    const GValue *values =
+        (array != NULL) ? gel_value_array_get_values(array) : NULL;
+    const gchar *name =
+        (n_values > 0) ? gel_native_closure_name(c, values + 0) : NULL;
+
+    if(g_strcmp0(name, "set") == 0)
+    {
+        const gchar *set_name =
+            (n_values == 3) ? gel_native_symbol_name(values + 1) : NULL;
+        guint slot =
+            (set_name != NULL) ? gel_native_lookup_slot(c, set_name) : 0;
+
+        if(slot == 0 || gel_native_value(c, values + 2)
+                != g_array_index(c->types, GelNativeType, slot - 1))
+        {
+            gel_native_fail(c);
+            return;
+        }
+
+        gel_native_emit(c, GEL_NATIVE_STORE, slot - 1);
+    }
+    else
+    if(g_strcmp0(name, "while") == 0)
+    {
+        if(n_values < 3)
+        {
+            gel_native_fail(c);
+            return;
+        }
+
+        guint start_label = gel_native_new_label(c);
+        guint end_label = gel_native_new_label(c);
+
+        gel_native_emit(c, GEL_NATIVE_LABEL, start_label);
+        if(gel_native_value(c, values + 1) == GEL_NATIVE_NONE)
+            return;
+
+        gel_native_emit(c, GEL_NATIVE_JUMP_IF_FALSE, end_label);
+        for(guint i = 2; i < n_values; i++)
+            gel_native_statement(c, values + i);
+
+        gel_native_emit(c, GEL_NATIVE_JUMP, start_label);
+        gel_native_emit(c, GEL_NATIVE_LABEL, end_label);
+    }
+    else
+    if(g_strcmp0(name, "if") == 0)
+        gel_native_if(c, n_values, values, FALSE);
+    else
+    if(g_strcmp0(name, "do") == 0)
+    {
+        for(guint i = 1; i < n_values; i++)
+            gel_native_statement(c, values + i);
+    }
+    else
+    if(name != NULL && !gel_native_is_native(name))
+        gel_native_builtin(c, name, value, FALSE);
+    else
+        gel_native_value(c, value);
+}
+
+
+/*
+ * Translates the define in @value, if it is one, returning FALSE otherwise.
+ * Names are defined once, before they are used, in the context of the
+ * call, so they are only handled at the top of the code.
+ */
+static
+gboolean gel_native_define(GelNativeCompiler *c, const GValue *value)
+{
+    if(!GEL_VALUE_HOLDS(value, GEL_TYPE_VALUE_ARRAY))
+        return FALSE;
+
+    GelValueArray *array = gel_value_get_boxed(value);
+    const GValue *values = gel_value_array_get_values(array);
+    guint n_values = gel_value_array_get_n_values(array);
+
+    if(n_values == 0
+        || g_strcmp0(gel_native_closure_name(c, values + 0), "define") != 0)
+        return FALSE;
+
+    const gchar *name =
+        (n_values == 3) ? gel_native_symbol_name(values + 1) : NULL;
+    if(name == NULL || gel_native_lookup_slot(c, name) != 0
+        || gel_context_get_variable(c->context, name) != NULL)
+    {
+        gel_native_fail(c);
+        return TRUE;
+    }
+
+    GelNativeType type = gel_native_value(c, values + 2);
+    if(type == GEL_NATIVE_NONE)
+        return TRUE;
+
+    gel_native_add_slot(c, name, type);
+    gel_native_emit(c, GEL_NATIVE_STORE, c->types->len - 1);
+
+    return TRUE;
+}
+
+
+void gel_native_free(GelNative *self)
+{
+    g_return_if_fail(self != NULL);
+
+    g_ptr_array_unref(self->calls);
+    g_array_free(self->ops, TRUE);
+    g_slice_free(GelNative, self);
+}
+
+
+/*
+ * Translates @code, the code of a closure taking @args and
+ * defined in @context, or returns NULL if it can not be translated.
+ * Its result is left in the accumulator.
+ */
+GelNative* gel_native_new(const GList *args, const GelValueArray *code,
+                          GelContext *context)
+{
+    g_return_val_if_fail(code != NULL, NULL);
+    g_return_val_if_fail(context != NULL, NULL);
+
+    guint n_values = gel_value_array_get_n_values(code);
+    if(n_values == 0)
+        return NULL;
+
+    GelNative *self = g_slice_new0(GelNative);
+    self->ops = g_array_new(FALSE, FALSE, sizeof(GelNativeOp));
+    self->calls = g_ptr_array_new_with_free_func(
+        (GDestroyNotify)gel_native_call_free);
+
+    GelNativeCompiler c = {0};
+    c.native = self;
+    c.context = context;
+    c.slots = g_hash_table_new(g_str_hash, g_str_equal);
+    c.types = g_array_new(FALSE, FALSE, sizeof(GelNativeType));
+
+    for(const GList *iter = args; iter != NULL; iter = iter->next)
+        if(gel_native_lookup_slot(&c, iter->data) == 0)
+            gel_native_add_slot(&c, iter->data, GEL_NATIVE_INT64);
+        else
+            c.failed = TRUE;
+    self->n_args = c.types->len;
+
+    const GValue *values = gel_value_array_get_values(code);
+    for(guint i = 0; i < n_values - 1; i++)
+        if(!gel_native_define(&c, values + i))
+            gel_native_statement(&c, values + i);
+
+    self->type = gel_native_value(&c, values + n_values - 1);
+    self->n_slots = c.types->len;
+
+    g_array_free(c.types, TRUE);
+    g_hash_table_unref(c.slots);
+
+    /* Giving up after changing something would change it twice */
+    if(c.failed || self->type == GEL_NATIVE_NONE || (c.changes && c.checks))
+    {
+        gel_native_free(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+
+static
+guint gel_native_hash(guint hash, gconstpointer data, gsize size)
+{
+    const guint8 *bytes = data;
+
+    /* FNV-1a */
+    for(gsize i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 16777619;
+
+    return hash;
+}
+
+
+/*
+ * Gets a checksum of the instructions of @self and of the slots they
+ * use, which code compiled from them relies on.
+ */
+guint gel_native_get_checksum(const GelNative *self)
+{
+    g_return_val_if_fail(self != NULL, 0);
+
+    guint hash = 2166136261U;
+    hash = gel_native_hash(hash, &self->n_args, sizeof(guint));
+    hash = gel_native_hash(hash, &self->n_slots, sizeof(guint));
+    hash = gel_native_hash(hash, &self->type, sizeof(GelNativeType));
+
+    for(guint i = 0; i < self->ops->len; i++)
+    {
+        const GelNativeOp *op = &g_array_index(self->ops, GelNativeOp, i);
+        hash = gel_native_hash(hash, &op->code, sizeof(GelNativeOpCode));
+        hash = gel_native_hash(hash, &op->operand, sizeof(gint64));
+    }
+
+    for(guint i = 0; i < self->calls->len; i++)
+    {
+        const GelModuleCall *call = g_ptr_array_index(self->calls, i);
+        hash = gel_native_hash(hash, &call->n_values, sizeof(guint));
+        hash = gel_native_hash(hash,
+            call->slots, call->n_values * sizeof(guint));
+        hash = gel_native_hash(hash, &call->result, sizeof(guint));
+    }
+
+    return hash;
+}
+
+
+/*
+ * Calls @func, compiled from @self, with the arguments @values, from
+ * @context, storing its result in @return_value, if not NULL.
+ * Returns FALSE, leaving @return_value untouched, if the arguments are
+ * not int64 or the code gave up, so the call has to be interpreted.
+ * Errors raised by the code are left in @context.
+ */
+gboolean gel_native_call(const GelNative *self, GelModuleFunc func,
+                         const GValue *values, GValue *return_value,
+                         GelContext *context)
+{
+    g_return_val_if_fail(self != NULL, FALSE);
+    g_return_val_if_fail(func != NULL, FALSE);
+    g_return_val_if_fail(context != NULL, FALSE);
+
+    gint64 *slots = g_newa(gint64, self->n_slots);
+    for(guint i = 0; i < self->n_args; i++)
+    {
+        if(GEL_VALUE_TYPE(values + i) != G_TYPE_INT64)
+            return FALSE;
+        slots[i] = gel_value_get_int64(values + i);
+    }
+
+    gint64 result = 0;
+    GelModuleStatus status = func(slots, &result, context,
+        (GelModuleCall * const *)self->calls->pdata);
+    if(status == GEL_MODULE_GIVE_UP)
+        return FALSE;
+
+    if(status == GEL_MODULE_DONE && return_value != NULL)
+    {
+        if(self->type == GEL_NATIVE_INT64)
+        {
+            g_value_init(return_value, G_TYPE_INT64);
+            gel_value_set_int64(return_value, result);
+        }
+        else
+        {
+            g_value_init(return_value, G_TYPE_BOOLEAN);
+            gel_value_set_boolean(return_value, result != 0);
+        }
+    }
+
+    return TRUE;
+}
@@ -0,0 +1,104 @@
+#ifndef __GEL_NATIVE_H__
+#define __GEL_NATIVE_H__
+
+#include <glib-object.h>
+#include <gelcontext.h>
+#include <gelarray.h>
+#include <gelmodule.h>
+
+typedef enum _GelNativeType
+{
+    GEL_NATIVE_NONE,
+    GEL_NATIVE_INT64,
+    GEL_NATIVE_BOOLEAN
+} GelNativeType;
+
+/*
+ * Instructions working on an accumulator, the right operand of
+ * arithmetic and comparisons, a stack and the slots of the variables.
+ */
+typedef enum _GelNativeOpCode
+{
+    /* The accumulator gets the operand, or the value of its slot */
+    GEL_NATIVE_CONSTANT,
+    GEL_NATIVE_LOAD,
+    GEL_NATIVE_STORE,
+
+    /* Pushes the accumulator, or moves it to the right operand
+       and pops the accumulator */
+    GEL_NATIVE_PUSH,
+    GEL_NATIVE_OPERAND,
+
+    /* Apply an operator to the accumulator and the right operand,
+       divisions by 0 make the call whose index + 1 is the operand,
+       when it is not 0, instead of dividing */
+    GEL_NATIVE_ADD,
+    GEL_NATIVE_SUBTRACT,
+    GEL_NATIVE_MULTIPLY,
+    GEL_NATIVE_DIVIDE,
+    GEL_NATIVE_MODULO,
+
+    GEL_NATIVE_GREATER,
+    GEL_NATIVE_GREATER_EQUAL,
+    GEL_NATIVE_EQUAL,
+    GEL_NATIVE_LESS_EQUAL,
+    GEL_NATIVE_LESS,
+    GEL_NATIVE_NOT_EQUAL,
+
+    /* The operand is the label, jumps only if the accumulator is 0 */
+    GEL_NATIVE_LABEL,
+    GEL_NATIVE_JUMP,
+    GEL_NATIVE_JUMP_IF_FALSE,
+
+    /* The operand is the index of the call, whose result is left
+       in the accumulator if it has one */
+    GEL_NATIVE_CALL
+} GelNativeOpCode;
+
+typedef struct _GelNativeOp
+{
+    GelNativeOpCode code;
+    gint64 operand;
+} GelNativeOp;
+
+/* A call to a predefined closure made by compiled code */
+struct _GelModuleCall
+{
+    GClosure *closure;
+
+    /* The call, where its errors are reported */
+    const GelValueArray *array;
+
+    /* The arguments, those computed by the compiled code
+       taken from the index + 1 of the slot they are left in,
+       and those that are calls made when the closure evaluates them */
+    guint n_values;
+    GValue *values;
+    guint *slots;
+    GelModuleCall **calls;
+
+    /* The index + 1 of the slot its result goes to, if it is used */
+    guint result;
+};
+
+/* The code of a closure translated to instructions */
+typedef struct _GelNative
+{
+    guint n_args;
+    guint n_slots;
+    guint n_labels;
+    GelNativeType type;
+
+    GArray *ops;
+    GPtrArray *calls;
+} GelNative;
+
+GelNative* gel_native_new(const GList *args, const GelValueArray *code,
+                          GelContext *context);
+guint gel_native_get_checksum(const GelNative *self);
+gboolean gel_native_call(const GelNative *self, GelModuleFunc func,
+                         const GValue *values, GValue *return_value,
+                         GelContext *context);
+void gel_native_free(GelNative *self);
+
+#endif
@@ -0,0 +1,917 @@
+#include <string.h>
+
+#include <gelndarray.h>
+#include <gelvalue.h>
+#include <gelvalueprivate.h>
+
+
+/*
+ * An ndarray is a view over a buffer of numbers: a shape, the distance
+ * (in elements) between consecutive elements along each dimension and
+ * the position of the first element. Transposing, slicing and most
+ * reshapes just create a new view sharing the buffer with the original,
+ * so writing through a view changes every array sharing the buffer.
+ */
+
+typedef struct _GelNdarrayBuffer GelNdarrayBuffer;
+
+struct _GelNdarrayBuffer
+{
+    volatile gint ref_count;
+    gpointer data;
+};
+
+
+struct _GelNdarray
+{
+    volatile gint ref_count;
+    GelNdarrayBuffer *buffer;
+    GelNdarrayType type;
+    guint n_dims;
+    gsize *shape;
+    gssize *strides;
+    gssize offset;
+};
+
+
+#ifndef GEL_NDARRAY_BLOCK
+#define GEL_NDARRAY_BLOCK 64
+#endif
+
+/* Products smaller than this (in multiply-adds) are not worth a thread */
+#ifndef GEL_NDARRAY_PARALLEL_THRESHOLD
+#define GEL_NDARRAY_PARALLEL_THRESHOLD (1 << 21)
+#endif
+
+
+static
+gsize gel_ndarray_element_size(GelNdarrayType type)
+{
+    return type == GEL_NDARRAY_FLOAT32 ? sizeof(gfloat) : sizeof(gint64);
+}
+
+
+static
+GelNdarrayBuffer* gel_ndarray_buffer_new(gsize size)
+{
+    GelNdarrayBuffer *self = g_slice_new(GelNdarrayBuffer);
+    self->ref_count = 1;
+    self->data = g_malloc0(MAX(size, 1));
+
+    return self;
+}
+
+
+static
+GelNdarrayBuffer* gel_ndarray_buffer_ref(GelNdarrayBuffer *self)
+{
+    g_atomic_int_inc(&self->ref_count);
+    return self;
+}
+
+
+static
+void gel_ndarray_buffer_unref(GelNdarrayBuffer *self)
+{
+    if(g_atomic_int_dec_and_test(&self->ref_count))
+    {
+        g_free(self->data);
+        g_slice_free(GelNdarrayBuffer, self);
+    }
+}
+
+
+static
+GelNdarray* gel_ndarray_new_view(GelNdarray *base, guint n_dims)
+{
+    GelNdarray *self = g_slice_new0(GelNdarray);
+    self->ref_count = 1;
+    self->buffer = gel_ndarray_buffer_ref(base->buffer);
+    self->type = base->type;
+    self->n_dims = n_dims;
+    self->shape = g_new(gsize, n_dims);
+    self->strides = g_new(gssize, n_dims);
+    self->offset = base->offset;
+
+    return self;
+}
+
+
+static
+gdouble gel_ndarray_read_double(const GelNdarray *self, gssize pos)
+{
+    switch(self->type)
+    {
+        case GEL_NDARRAY_INT64:
+            return ((const gint64*)self->buffer->data)[pos];
+        case GEL_NDARRAY_DOUBLE:
+            return ((const gdouble*)self->buffer->data)[pos];
+        default:
+            return ((const gfloat*)self->buffer->data)[pos];
+    }
+}
+
+
+static
+gint64 gel_ndarray_read_int64(const GelNdarray *self, gssize pos)
+{
+    if(self->type == GEL_NDARRAY_INT64)
+        return ((const gint64*)self->buffer->data)[pos];
+    return (gint64)gel_ndarray_read_double(self, pos);
+}
+
+
+static
+void gel_ndarray_write_double(GelNdarray *self, gssize pos, gdouble value)
+{
+    switch(self->type)
+    {
+        case GEL_NDARRAY_INT64:
+            ((gint64*)self->buffer->data)[pos] = (gint64)value;
+            break;
+        case GEL_NDARRAY_DOUBLE:
+            ((gdouble*)self->buffer->data)[pos] = value;
+            break;
+        default:
+            ((gfloat*)self->buffer->data)[pos] = (gfloat)value;
+    }
+}
+
+
+static
+void gel_ndarray_write_int64(GelNdarray *self, gssize pos, gint64 value)
+{
+    if(self->type == GEL_NDARRAY_INT64)
+        ((gint64*)self->buffer->data)[pos] = value;
+    else
+        gel_ndarray_write_double(self, pos, value);
+}
+
+
+/*
+ * Moves @index and @pos to the next element in row-major order.
+ * Returns %FALSE after the last element.
+ */
+static
+gboolean gel_ndarray_next(const GelNdarray *self, gsize *index, gssize *pos)
+{
+    for(gint d = self->n_dims - 1; d >= 0; d--)
+    {
+        index[d]++;
+        *pos += self->strides[d];
+        if(index[d] < self->shape[d])
+            return TRUE;
+
+        *pos -= self->strides[d] * (gssize)index[d];
+        index[d] = 0;
+    }
+
+    return FALSE;
+}
+
+
+static
+gssize gel_ndarray_position(const GelNdarray *self, const gsize *index)
+{
+    gssize pos = self->offset;
+    for(guint d = 0; d < self->n_dims; d++)
+        pos += (gssize)index[d] * self->strides[d];
+    return pos;
+}
+
+
+static
+gboolean gel_ndarray_is_contiguous(const GelNdarray *self)
+{
+    gssize stride = 1;
+    for(gint d = self->n_dims - 1; d >= 0; d--)
+    {
+        if(self->shape[d] != 1 && self->strides[d] != stride)
+            return FALSE;
+        stride *= self->shape[d];
+    }
+
+    return TRUE;
+}
+
+
+GType gel_ndarray_get_type(void)
+{
+    static volatile gsize once = 0;
+    static GType type = G_TYPE_INVALID;
+
+    if(g_once_init_enter(&once))
+    {
+        type = g_boxed_type_register_static("GelNdarray",
+            (GBoxedCopyFunc)gel_ndarray_ref,
+            (GBoxedFreeFunc)gel_ndarray_unref);
+        g_once_init_leave(&once, 1);
+    }
+
+    return type;
+}
+
+
+/*
+ * Creates a contiguous ndarray of @type filled with zeros.
+ */
+GelNdarray* gel_ndarray_new(GelNdarrayType type,
+                            guint n_dims, const gsize *shape)
+{
+    g_return_val_if_fail(n_dims > 0 && n_dims <= GEL_NDARRAY_MAX_DIMS, NULL);
+    g_return_val_if_fail(shape != NULL, NULL);
+
+    GelNdarray *self = g_slice_new0(GelNdarray);
+    self->ref_count = 1;
+    self->type = type;
+    self->n_dims = n_dims;
+    self->shape = g_new(gsize, n_dims);
+    self->strides = g_new(gssize, n_dims);
+    memcpy(self->shape, shape, sizeof(gsize) * n_dims);
+
+    gssize stride = 1;
+    for(gint d = n_dims - 1; d >= 0; d--)
+    {
+        self->strides[d] = stride;
+        stride *= shape[d];
+    }
+
+    self->buffer =
+        gel_ndarray_buffer_new(stride * gel_ndarray_element_size(type));
+
+    return self;
+}
+
+
+/*
+ * Creates a contiguous copy of @self holding elements of @type.
+ */
+GelNdarray* gel_ndarray_copy(const GelNdarray *self, GelNdarrayType type)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+
+    GelNdarray *copy = gel_ndarray_new(type, self->n_dims, self->shape);
+    gsize size = gel_ndarray_get_size(self);
+    if(size == 0)
+        return copy;
+
+    gsize index[GEL_NDARRAY_MAX_DIMS] = {0};
+    gssize pos = self->offset;
+    gssize dest_pos = 0;
+
+    if(type == self->type && gel_ndarray_is_contiguous(self))
+        memcpy(copy->buffer->data,
+            (guint8*)self->buffer->data
+                + pos * gel_ndarray_element_size(type),
+            size * gel_ndarray_element_size(type));
+    else
+    if(type == GEL_NDARRAY_INT64)
+        do
+            gel_ndarray_write_int64(copy, dest_pos++,
+                gel_ndarray_read_int64(self, pos));
+        while(gel_ndarray_next(self, index, &pos));
+    else
+        do
+            gel_ndarray_write_double(copy, dest_pos++,
+                gel_ndarray_read_double(self, pos));
+        while(gel_ndarray_next(self, index, &pos));
+
+    return copy;
+}
+
+
+GelNdarray* gel_ndarray_ref(GelNdarray *self)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+
+    g_atomic_int_inc(&self->ref_count);
+    return self;
+}
+
+
+void gel_ndarray_unref(GelNdarray *self)
+{
+    g_return_if_fail(self != NULL);
+
+    if(g_atomic_int_dec_and_test(&self->ref_count))
+    {
+        gel_ndarray_buffer_unref(self->buffer);
+        g_free(self->shape);
+        g_free(self->strides);
+        g_slice_free(GelNdarray, self);
+    }
+}
+
+
+GelNdarrayType gel_ndarray_get_element_type(const GelNdarray *self)
+{
+    g_return_val_if_fail(self != NULL, GEL_NDARRAY_DOUBLE);
+
+    return self->type;
+}
+
+
+guint gel_ndarray_get_n_dims(const GelNdarray *self)
+{
+    g_return_val_if_fail(self != NULL, 0);
+
+    return self->n_dims;
+}
+
+
+const gsize* gel_ndarray_get_shape(const GelNdarray *self)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+
+    return self->shape;
+}
+
+
+gsize gel_ndarray_get_size(const GelNdarray *self)
+{
+    g_return_val_if_fail(self != NULL, 0);
+
+    gsize size = 1;
+    for(guint d = 0; d < self->n_dims; d++)
+        size *= self->shape[d];
+    return size;
+}
+
+
+/*
+ * Copies the element at @index (one position per dimension, each one
+ * within its bounds) to @dest_value, as an integer or as a double.
+ */
+void gel_ndarray_get_value(const GelNdarray *self, const gsize *index,
+                           GValue *dest_value)
+{
+    g_return_if_fail(self != NULL);
+    g_return_if_fail(index != NULL);
+
+    gssize pos = gel_ndarray_position(self, index);
+    if(self->type == GEL_NDARRAY_INT64)
+    {
+        g_value_init(dest_value, G_TYPE_INT64);
+        gel_value_set_int64(dest_value, gel_ndarray_read_int64(self, pos));
+    }
+    else
+    {
+        g_value_init(dest_value, G_TYPE_DOUBLE);
+        gel_value_set_double(dest_value, gel_ndarray_read_double(self, pos));
+    }
+}
+
+
+static
+void gel_ndarray_write_value(GelNdarray *self, gssize pos,
+                             const GValue *value)
+{
+    if(GEL_VALUE_TYPE(value) == G_TYPE_INT64)
+        gel_ndarray_write_int64(self, pos, gel_value_get_int64(value));
+    else
+        gel_ndarray_write_double(self, pos, gel_value_get_double(value));
+}
+
+
+/*
+ * Stores @value, an integer or a double, at @index.
+ */
+void gel_ndarray_set_value(GelNdarray *self, const gsize *index,
+                           const GValue *value)
+{
+    g_return_if_fail(self != NULL);
+    g_return_if_fail(index != NULL);
+    g_return_if_fail(value != NULL);
+
+    gel_ndarray_write_value(self, gel_ndarray_position(self, index), value);
+}
+
+
+/*
+ * Stores @value, an integer or a double, at @position of an ndarray
+ * just created with gel_ndarray_new().
+ */
+void gel_ndarray_set_flat(GelNdarray *self, gsize position,
+                          const GValue *value)
+{
+    g_return_if_fail(self != NULL);
+    g_return_if_fail(value != NULL);
+
+    gel_ndarray_write_value(self, self->offset + position, value);
+}
+
+
+/*
+ * Gives @self a new shape with the same number of elements.
+ * The result shares the buffer of @self unless it is not contiguous.
+ */
+GelNdarray* gel_ndarray_reshape(GelNdarray *self,
+                                guint n_dims, const gsize *shape)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+    g_return_val_if_fail(n_dims > 0 && n_dims <= GEL_NDARRAY_MAX_DIMS, NULL);
+
+    GelNdarray *base = gel_ndarray_is_contiguous(self)
+        ? gel_ndarray_ref(self) : gel_ndarray_copy(self, self->type);
+
+    GelNdarray *view = gel_ndarray_new_view(base, n_dims);
+    gssize stride = 1;
+    for(gint d = n_dims - 1; d >= 0; d--)
+    {
+        view->shape[d] = shape[d];
+        view->strides[d] = stride;
+        stride *= shape[d];
+    }
+
+    gel_ndarray_unref(base);
+    return view;
+}
+
+
+/*
+ * Creates a view of @self with its dimensions reversed.
+ */
+GelNdarray* gel_ndarray_transpose(GelNdarray *self)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+
+    GelNdarray *view = gel_ndarray_new_view(self, self->n_dims);
+    for(guint d = 0; d < self->n_dims; d++)
+    {
+        view->shape[d] = self->shape[self->n_dims - 1 - d];
+        view->strides[d] = self->strides[self->n_dims - 1 - d];
+    }
+
+    return view;
+}
+
+
+/*
+ * Creates a view of @self with the positions from @start to @stop
+ * (not included) every @step along @axis.
+ */
+GelNdarray* gel_ndarray_slice(GelNdarray *self, guint axis,
+                              gsize start, gsize stop, gsize step)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+    g_return_val_if_fail(axis < self->n_dims, NULL);
+    g_return_val_if_fail(step > 0, NULL);
+
+    stop = MIN(stop, self->shape[axis]);
+    start = MIN(start, stop);
+
+    GelNdarray *view = gel_ndarray_new_view(self, self->n_dims);
+    memcpy(view->shape, self->shape, sizeof(gsize) * self->n_dims);
+    memcpy(view->strides, self->strides, sizeof(gssize) * self->n_dims);
+
+    view->offset += (gssize)start * self->strides[axis];
+    view->shape[axis] = (stop - start + step - 1) / step;
+    view->strides[axis] *= step;
+
+    return view;
+}
+
+
+typedef struct _GelNdarrayMatmul GelNdarrayMatmul;
+
+struct _GelNdarrayMatmul
+{
+    gconstpointer a;
+    gconstpointer b;
+    gpointer c;
+    gsize first_row;
+    gsize last_row;
+    gsize k;
+    gsize n;
+};
+
+
+/*
+ * c[i][j] += a[i][p] * b[p][j] for the rows of the task, going through
+ * the matrices in blocks small enough to stay in the cache.
+ */
+static
+void gel_ndarray_matmul_doubles(const GelNdarrayMatmul *task)
+{
+    const gdouble *a = task->a;
+    const gdouble *b = task->b;
+    gdouble *c = task->c;
+    const gsize k = task->k;
+    const gsize n = task->n;
+
+    for(gsize i0 = task->first_row; i0 < task->last_row;
+            i0 += GEL_NDARRAY_BLOCK)
+    {
+        gsize i1 = MIN(i0 + GEL_NDARRAY_BLOCK, task->last_row);
+        for(gsize p0 = 0; p0 < k; p0 += GEL_NDARRAY_BLOCK)
+        {
+            gsize p1 = MIN(p0 + GEL_NDARRAY_BLOCK, k);
+            for(gsize j0 = 0; j0 < n; j0 += GEL_NDARRAY_BLOCK)
+            {
+                gsize j1 = MIN(j0 + GEL_NDARRAY_BLOCK, n);
+                for(gsize i = i0; i < i1; i++)
+                    for(gsize p = p0; p < p1; p++)
+                    {
+                        const gdouble aip = a[i * k + p];
+                        const gdouble *b_row = b + p * n;
+                        gdouble *c_row = c + i * n;
+                        for(gsize j = j0; j < j1; j++)
+                            c_row[j] += aip * b_row[j];
+                    }
+            }
+        }
+    }
+}
+
+
+static
+void gel_ndarray_matmul_int64s(const GelNdarrayMatmul *task)
+{
+    const gint64 *a = task->a;
+    const gint64 *b = task->b;
+    gint64 *c = task->c;
+    const gsize k = task->k;
+    const gsize n = task->n;
+
+    for(gsize i0 = task->first_row; i0 < task->last_row;
+            i0 += GEL_NDARRAY_BLOCK)
+    {
+        gsize i1 = MIN(i0 + GEL_NDARRAY_BLOCK, task->last_row);
+        for(gsize p0 = 0; p0 < k; p0 += GEL_NDARRAY_BLOCK)
+        {
+            gsize p1 = MIN(p0 + GEL_NDARRAY_BLOCK, k);
+            for(gsize j0 = 0; j0 < n; j0 += GEL_NDARRAY_BLOCK)
+            {
+                gsize j1 = MIN(j0 + GEL_NDARRAY_BLOCK, n);
+                for(gsize i = i0; i < i1; i++)
+                    for(gsize p = p0; p < p1; p++)
+                    {
+                        const gint64 aip = a[i * k + p];
+                        const gint64 *b_row = b + p * n;
+                        gint64 *c_row = c + i * n;
+                        for(gsize j = j0; j < j1; j++)
+                            c_row[j] += aip * b_row[j];
+                    }
+            }
+        }
+    }
+}
+
+
+static
+gpointer gel_ndarray_matmul_doubles_thread(gpointer data)
+{
+    gel_ndarray_matmul_doubles(data);
+    return NULL;
+}
+
+
+static
+gpointer gel_ndarray_matmul_int64s_thread(gpointer data)
+{
+    gel_ndarray_matmul_int64s(data);
+    return NULL;
+}
+
+
+/*
+ * Multiplies the matrices @a (m x k) and @b (k x n).
+ * Integers are multiplied as integers, anything else as doubles.
+ * Big products are split by rows among up to @n_threads threads,
+ * 0 meaning as many as processors.
+ */
+GelNdarray* gel_ndarray_matmul(const GelNdarray *a, const GelNdarray *b,
+                               guint n_threads)
+{
+    g_return_val_if_fail(a != NULL && a->n_dims == 2, NULL);
+    g_return_val_if_fail(b != NULL && b->n_dims == 2, NULL);
+    g_return_val_if_fail(a->shape[1] == b->shape[0], NULL);
+
+    const gsize m = a->shape[0];
+    const gsize k = a->shape[1];
+    const gsize n = b->shape[1];
+
+    GelNdarrayType type = GEL_NDARRAY_DOUBLE;
+    if(a->type == GEL_NDARRAY_INT64 && b->type == GEL_NDARRAY_INT64)
+        type = GEL_NDARRAY_INT64;
+
+    /* Contiguous operands, so the inner loop runs over consecutive data */
+    GelNdarray *ca = gel_ndarray_copy(a, type);
+    GelNdarray *cb = gel_ndarray_copy(b, type);
+    gsize shape[2] = {m, n};
+    GelNdarray *result = gel_ndarray_new(type, 2, shape);
+
+    if(n_threads == 0)
+        n_threads = g_get_num_processors();
+    if((gdouble)m * n * k < GEL_NDARRAY_PARALLEL_THRESHOLD)
+        n_threads = 1;
+    n_threads = MAX(1, MIN(n_threads, m));
+
+    GelNdarrayMatmul *tasks = g_new(GelNdarrayMatmul, n_threads);
+    GThread **threads = g_new0(GThread*, n_threads);
+    gsize rows = (m + n_threads - 1) / n_threads;
+
+    for(guint t = 0; t < n_threads; t++)
+    {
+        tasks[t].a = ca->buffer->data;
+        tasks[t].b = cb->buffer->data;
+        tasks[t].c = result->buffer->data;
+        tasks[t].first_row = MIN(t * rows, m);
+        tasks[t].last_row = MIN(tasks[t].first_row + rows, m);
+        tasks[t].k = k;
+        tasks[t].n = n;
+    }
+
+    GThreadFunc func = type == GEL_NDARRAY_INT64
+        ? gel_ndarray_matmul_int64s_thread
+        : gel_ndarray_matmul_doubles_thread;
+
+    for(guint t = 1; t < n_threads; t++)
+        threads[t] = g_thread_new("gel-matmul", func, tasks + t);
+    func(tasks + 0);
+    for(guint t = 1; t < n_threads; t++)
+        g_thread_join(threads[t]);
+
+    g_free(threads);
+    g_free(tasks);
+    gel_ndarray_unref(ca);
+    gel_ndarray_unref(cb);
+
+    if(a->type == GEL_NDARRAY_FLOAT32 && b->type == GEL_NDARRAY_FLOAT32)
+    {
+        GelNdarray *floats = gel_ndarray_copy(result, GEL_NDARRAY_FLOAT32);
+        gel_ndarray_unref(result);
+        result = floats;
+    }
+
+    return result;
+}
+
+
+static
+GelNdarrayType gel_ndarray_reduce_type(const GelNdarray *self,
+                                       GelKernelReduce op)
+{
+    return op == GEL_KERNEL_MEAN ? GEL_NDARRAY_DOUBLE : self->type;
+}
+
+
+/*
+ * Reduces the @n elements found every @stride from @pos, which must be
+ * at least one for %GEL_KERNEL_MIN and %GEL_KERNEL_MAX.
+ */
+static
+void gel_ndarray_reduce_line(const GelNdarray *self, gssize pos,
+                             gssize stride, gsize n, GelKernelReduce op,
+                             gint64 *int_result, gdouble *double_result)
+{
+    const GelKernels *kernels = gel_kernels_get();
+
+    if(self->type == GEL_NDARRAY_INT64 && op != GEL_KERNEL_MEAN)
+    {
+        const gint64 *ints = (const gint64*)self->buffer->data + pos;
+        if(stride == 1)
+            switch(op)
+            {
+                case GEL_KERNEL_SUM:
+                    *int_result = kernels->sum_int64s(ints, n);
+                    return;
+                case GEL_KERNEL_MIN:
+                    *int_result = kernels->min_int64s(ints, n);
+                    return;
+                default:
+                    *int_result = kernels->max_int64s(ints, n);
+                    return;
+            }
+
+        gint64 result = op == GEL_KERNEL_SUM ? 0 : ints[0];
+        for(gsize i = 0; i < n; i++)
+        {
+            gint64 value = ints[i * stride];
+            if(op == GEL_KERNEL_SUM)
+                result += value;
+            else
+            if(op == GEL_KERNEL_MIN ? value < result : value > result)
+                result = value;
+        }
+        *int_result = result;
+        return;
+    }
+
+    if(self->type == GEL_NDARRAY_DOUBLE && stride == 1)
+    {
+        const gdouble *doubles = (const gdouble*)self->buffer->data + pos;
+        switch(op)
+        {
+            case GEL_KERNEL_SUM:
+                *double_result = kernels->sum_doubles(doubles, n);
+                return;
+            case GEL_KERNEL_MEAN:
+                *double_result = kernels->sum_doubles(doubles, n) / n;
+                return;
+            case GEL_KERNEL_MIN:
+                *double_result = kernels->min_doubles(doubles, n);
+                return;
+            default:
+                *double_result = kernels->max_doubles(doubles, n);
+                return;
+        }
+    }
+
+    gdouble result =
+        op == GEL_KERNEL_MIN || op == GEL_KERNEL_MAX
+        ? gel_ndarray_read_double(self, pos) : 0;
+
+    for(gsize i = 0; i < n; i++)
+    {
+        gdouble value = gel_ndarray_read_double(self, pos + i * stride);
+        if(op == GEL_KERNEL_SUM || op == GEL_KERNEL_MEAN)
+            result += value;
+        else
+        if(op == GEL_KERNEL_MIN ? value < result : value > result)
+            result = value;
+    }
+
+    *double_result = op == GEL_KERNEL_MEAN ? result / n : result;
+}
+
+
+/*
+ * Reduces @self along @axis, giving an ndarray with one dimension less.
+ * @self must have at least two dimensions.
+ */
+GelNdarray* gel_ndarray_reduce(const GelNdarray *self, guint axis,
+                               GelKernelReduce op)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+    g_return_val_if_fail(self->n_dims > 1, NULL);
+    g_return_val_if_fail(axis < self->n_dims, NULL);
+
+    /* A view of @self without @axis, walked to find each line to reduce */
+    GelNdarray *lines = gel_ndarray_new_view((GelNdarray*)self,
+        self->n_dims - 1);
+    for(guint d = 0, l = 0; d < self->n_dims; d++)
+        if(d != axis)
+        {
+            lines->shape[l] = self->shape[d];
+            lines->strides[l] = self->strides[d];
+            l++;
+        }
+
+    GelNdarray *result = gel_ndarray_new(gel_ndarray_reduce_type(self, op),
+        lines->n_dims, lines->shape);
+
+    if(gel_ndarray_get_size(result) > 0)
+    {
+        gsize index[GEL_NDARRAY_MAX_DIMS] = {0};
+        gssize pos = lines->offset;
+        gssize dest_pos = 0;
+
+        do
+        {
+            gint64 int_result = 0;
+            gdouble double_result = 0;
+            gel_ndarray_reduce_line(self, pos, self->strides[axis],
+                self->shape[axis], op, &int_result, &double_result);
+
+            if(result->type == GEL_NDARRAY_INT64)
+                gel_ndarray_write_int64(result, dest_pos++, int_result);
+            else
+                gel_ndarray_write_double(result, dest_pos++, double_result);
+        }
+        while(gel_ndarray_next(lines, index, &pos));
+    }
+
+    gel_ndarray_unref(lines);
+    return result;
+}
+
+
+/*
+ * Reduces every element of @self into @dest_value.
+ */
+void gel_ndarray_reduce_all(const GelNdarray *self, GelKernelReduce op,
+                            GValue *dest_value)
+{
+    g_return_if_fail(self != NULL);
+
+    gint64 int_result = 0;
+    gdouble double_result = 0;
+    gsize size = gel_ndarray_get_size(self);
+
+    if(gel_ndarray_is_contiguous(self))
+        gel_ndarray_reduce_line(self, self->offset, 1, size,
+            op, &int_result, &double_result);
+    else
+    {
+        GelNdarray *copy = gel_ndarray_copy(self, self->type);
+        gel_ndarray_reduce_line(copy, 0, 1, size,
+            op, &int_result, &double_result);
+        gel_ndarray_unref(copy);
+    }
+
+    if(gel_ndarray_reduce_type(self, op) == GEL_NDARRAY_INT64)
+    {
+        g_value_init(dest_value, G_TYPE_INT64);
+        gel_value_set_int64(dest_value, int_result);
+    }
+    else
+    {
+        g_value_init(dest_value, G_TYPE_DOUBLE);
+        gel_value_set_double(dest_value, double_result);
+    }
+}
+
+
+static
+void gel_ndarray_append_string(const GelNdarray *self, GString *buffer,
+                               guint dim, gssize pos)
+{
+    if(dim == self->n_dims)
+    {
+        if(self->type == GEL_NDARRAY_INT64)
+            g_string_append_printf(buffer, "%" G_GINT64_FORMAT,
+                gel_ndarray_read_int64(self, pos));
+        else
+            g_string_append_printf(buffer, "%f",
+                gel_ndarray_read_double(self, pos));
+        return;
+    }
+
+    g_string_append_c(buffer, '(');
+    for(gsize i = 0; i < self->shape[dim]; i++)
+    {
+        if(i != 0)
+            g_string_append_c(buffer, ' ');
+        gel_ndarray_append_string(self, buffer,
+            dim + 1, pos + (gssize)i * self->strides[dim]);
+    }
+    g_string_append_c(buffer, ')');
+}
+
+
+/*
+ * Formats @self as nested arrays, one level for each dimension.
+ */
+gchar* gel_ndarray_to_string(const GelNdarray *self)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+
+    GString *buffer = g_string_new(NULL);
+    gel_ndarray_append_string(self, buffer, 0, self->offset);
+    return g_string_free(buffer, FALSE);
+}
+
+
+/*
+ * Compares the elements of @a and @b in row-major order,
+ * then their number of elements and then their shapes.
+ */
+gint gel_ndarray_cmp(const GelNdarray *a, const GelNdarray *b)
+{
+    g_return_val_if_fail(a != NULL, 0);
+    g_return_val_if_fail(b != NULL, 0);
+
+    gsize a_size = gel_ndarray_get_size(a);
+    gsize b_size = gel_ndarray_get_size(b);
+    gsize size = MIN(a_size, b_size);
+
+    gsize a_index[GEL_NDARRAY_MAX_DIMS] = {0};
+    gsize b_index[GEL_NDARRAY_MAX_DIMS] = {0};
+    gssize a_pos = a->offset;
+    gssize b_pos = b->offset;
+    gboolean ints = a->type == GEL_NDARRAY_INT64 && b->type == a->type;
+
+    for(gsize i = 0; i < size; i++)
+    {
+        if(ints)
+        {
+            gint64 i1 = gel_ndarray_read_int64(a, a_pos);
+            gint64 i2 = gel_ndarray_read_int64(b, b_pos);
+            if(i1 != i2)
+                return i1 > i2 ? 1 : -1;
+        }
+        else
+        {
+            gdouble d1 = gel_ndarray_read_double(a, a_pos);
+            gdouble d2 = gel_ndarray_read_double(b, b_pos);
+            if(d1 != d2)
+                return d1 > d2 ? 1 : -1;
+        }
+
+        gel_ndarray_next(a, a_index, &a_pos);
+        gel_ndarray_next(b, b_index, &b_pos);
+    }
+
+    if(a_size != b_size)
+        return a_size > b_size ? 1 : -1;
+
+    if(a->n_dims != b->n_dims)
+        return a->n_dims > b->n_dims ? 1 : -1;
+
+    for(guint d = 0; d < a->n_dims; d++)
+        if(a->shape[d] != b->shape[d])
+            return a->shape[d] > b->shape[d] ? 1 : -1;
+
+    return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef GEL_TYPE_NDARRAY
+#define GEL_TYPE_NDARRAY (gel_ndarray_get_type())
+
+#include <glib-object.h>
+
+#include <gelkernels.h>
+
+#define GEL_NDARRAY_MAX_DIMS 32
+
+typedef enum _GelNdarrayType
+{
+    GEL_NDARRAY_INT64,
+    GEL_NDARRAY_DOUBLE,
+    GEL_NDARRAY_FLOAT32
+} GelNdarrayType;
+
+typedef struct _GelNdarray GelNdarray;
+GType gel_ndarray_get_type(void) G_GNUC_CONST;
+
+GelNdarray* gel_ndarray_new(GelNdarrayType type,
+                            guint n_dims, const gsize *shape);
+GelNdarray* gel_ndarray_copy(const GelNdarray *self, GelNdarrayType type);
+GelNdarray* gel_ndarray_ref(GelNdarray *self);
+void gel_ndarray_unref(GelNdarray *self);
+
+GelNdarrayType gel_ndarray_get_element_type(const GelNdarray *self);
+guint gel_ndarray_get_n_dims(const GelNdarray *self);
+const gsize* gel_ndarray_get_shape(const GelNdarray *self);
+gsize gel_ndarray_get_size(const GelNdarray *self);
+
+void gel_ndarray_get_value(const GelNdarray *self, const gsize *index,
+                           GValue *dest_value);
+void gel_ndarray_set_value(GelNdarray *self, const gsize *index,
+                           const GValue *value);
+void gel_ndarray_set_flat(GelNdarray *self, gsize position,
+                          const GValue *value);
+
+GelNdarray* gel_ndarray_reshape(GelNdarray *self,
+                                guint n_dims, const gsize *shape);
+GelNdarray* gel_ndarray_transpose(GelNdarray *self);
+GelNdarray* gel_ndarray_slice(GelNdarray *self, guint axis,
+                              gsize start, gsize stop, gsize step);
+
+GelNdarray* gel_ndarray_matmul(const GelNdarray *a, const GelNdarray *b,
+                               guint n_threads);
+GelNdarray* gel_ndarray_reduce(const GelNdarray *self, guint axis,
+                               GelKernelReduce op);
+void gel_ndarray_reduce_all(const GelNdarray *self, GelKernelReduce op,
+                            GValue *dest_value);
+
+gchar* gel_ndarray_to_string(const GelNdarray *self);
+gint gel_ndarray_cmp(const GelNdarray *a, const GelNdarray *b);
+
+#endif
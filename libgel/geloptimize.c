@@ -0,0 +1,2117 @@
+#include <string.h>
+
+#include <geloptimize.h>
+#include <gelcontextprivate.h>
+#include <gelvalue.h>
+#include <gelvalueprivate.h>
+#include <gelarrayprivate.h>
+#include <gelsymbol.h>
+#include <gelvariable.h>
+#include <gelclosure.h>
+#include <gelclosureprivate.h>
+#include <gelerrors.h>
+
+
+/*
+ * Optimization pass run on code before a context evaluates it.
+ *
+ * Calls to pure predefined closures whose arguments are all literals are
+ * evaluated once and replaced by their result, if it is known to be no
+ * bigger than GEL_OPTIMIZE_MAX_CONSTANT before evaluating them. Containers built from
+ * literals are hoisted into a constant: a closure holding the container,
+ * that hands out a copy of it each time it is invoked, so code mutating
+ * the result never sees a container changed by a previous execution.
+ * Hashes are never hoisted, since copying them only adds a reference.
+ *
+ * Branches of if and cond that can not be taken are removed when their
+ * test is a literal.
+ *
+ * Calls to small closures whose code only uses their arguments and
+ * predefined values are replaced by their code, with the arguments in
+ * place, when the arguments are literals or variables. The call is kept
+ * next to the code, and made instead if the name of the closure refers
+ * to something else by the time it is evaluated.
+ *
+ * The types the values of the code can have are inferred from literals,
+ * the results of predefined closures and the values given to each name,
+ * wherever the code gives them. Arithmetic and comparisons with two
+ * operands, one of them known to be a number and the other one possibly
+ * a number, and indexing of variables with integers are replaced by
+ * specialized versions of them. These check the type of their operands
+ * and compute the result directly for int64 and double, leaving the rest
+ * to the predefined closure.
+ *
+ * Loops whose code can neither define names nor keep a reference to the
+ * context it is evaluated in are evaluated in the context they are
+ * called in, without creating one of their own. Calls to anything but
+ * predefined closures known not to do so, closures given a value in the
+ * code or the context among them, make a loop keep its own context.
+ *
+ * A case whose tests are literals of the same type, int64 or string,
+ * and a cond whose tests compare the same variable to such literals
+ * with =, look up the branch to take in a hash table of the literals,
+ * built once. Keys of other types are compared one by one as usual.
+ *
+ * Symbols are literals only if nothing in the code or the context can
+ * give them a value other than the predefined one.
+ */
+
+#ifndef GEL_OPTIMIZE_MAX_CONSTANT
+#define GEL_OPTIMIZE_MAX_CONSTANT 4096
+#endif
+
+#ifndef GEL_OPTIMIZE_MAX_INLINED
+#define GEL_OPTIMIZE_MAX_INLINED 32
+#endif
+
+/* Keys a case or cond needs to look up its branch in a table */
+#ifndef GEL_OPTIMIZE_MIN_DISPATCH
+#define GEL_OPTIMIZE_MIN_DISPATCH 4
+#endif
+
+typedef enum _GelOptimizeKind
+{
+    GEL_OPTIMIZE_CODE,
+    GEL_OPTIMIZE_SCALAR,
+    GEL_OPTIMIZE_CONTAINER
+} GelOptimizeKind;
+
+typedef enum _GelOptimizeFlags
+{
+    /* Can be evaluated before running the code */
+    GEL_OPTIMIZE_PURE = 1 << 0,
+    /* Can be used by the code of closures replacing their calls */
+    GEL_OPTIMIZE_INLINE = 1 << 1,
+    /* Defines names in the context it is called in, or keeps a reference
+       to it or to its variables */
+    GEL_OPTIMIZE_SCOPE = 1 << 2,
+    /* Invokes closures given to it in the context it is called in */
+    GEL_OPTIMIZE_CALLS = 1 << 3
+} GelOptimizeFlags;
+
+/* Sets of the types a value can have */
+typedef enum _GelOptimizeType
+{
+    GEL_OPTIMIZE_TYPE_INT64 = 1 << 0,
+    GEL_OPTIMIZE_TYPE_DOUBLE = 1 << 1,
+    GEL_OPTIMIZE_TYPE_OTHER = 1 << 2,
+    GEL_OPTIMIZE_TYPE_NUMBER =
+        GEL_OPTIMIZE_TYPE_INT64 | GEL_OPTIMIZE_TYPE_DOUBLE,
+    GEL_OPTIMIZE_TYPE_ANY =
+        GEL_OPTIMIZE_TYPE_NUMBER | GEL_OPTIMIZE_TYPE_OTHER
+} GelOptimizeType;
+
+typedef enum _GelOptimizeOperator
+{
+    GEL_OPTIMIZE_ADD,
+    GEL_OPTIMIZE_SUB,
+    GEL_OPTIMIZE_MUL,
+    GEL_OPTIMIZE_DIV,
+    GEL_OPTIMIZE_MOD,
+    GEL_OPTIMIZE_GT,
+    GEL_OPTIMIZE_GE,
+    GEL_OPTIMIZE_EQ,
+    GEL_OPTIMIZE_LE,
+    GEL_OPTIMIZE_LT,
+    GEL_OPTIMIZE_NE,
+    GEL_OPTIMIZE_GET
+} GelOptimizeOperator;
+
+typedef struct _GelOptimizer GelOptimizer;
+typedef struct _GelOptimizeInline GelOptimizeInline;
+typedef struct _GelOptimizeOperation GelOptimizeOperation;
+typedef struct _GelOptimizeAssignment GelOptimizeAssignment;
+typedef struct _GelOptimizeDispatch GelOptimizeDispatch;
+
+struct _GelOptimizer
+{
+    GelContext *context;
+
+    /* Names given a value by the code being optimized */
+    GHashTable *bound;
+
+    /* The types the values given to those names can have */
+    GHashTable *types;
+};
+
+/* What a call replaced by the code of its closure expects to call */
+struct _GelOptimizeInline
+{
+    gchar *name;
+    GelVariable *variable;
+    GClosure *closure;
+};
+
+/* A predefined closure that has a specialized version */
+struct _GelOptimizeOperation
+{
+    const gchar *name;
+    GelOptimizeOperator operator;
+
+    /* What the predefined closure reports errors as, and does */
+    const gchar *f;
+    GelValuesArithmetic arithmetic;
+    GelValuesLogic logic;
+};
+
+/* A value given to a name, or the type of it if @value is NULL */
+struct _GelOptimizeAssignment
+{
+    const gchar *name;
+    const GValue *value;
+    GelOptimizeType type;
+};
+
+/* The branches of a case or cond, by the literal they compare a key to */
+struct _GelOptimizeDispatch
+{
+    const gchar *name;
+
+    /* G_TYPE_INT64 or GEL_TYPE_STRING, the type of every literal */
+    GType type;
+    GHashTable *branches;
+
+    /* Branch taken when no literal is equal to the key, if any */
+    gint otherwise;
+
+    /* Where the key is in the first test of a cond */
+    guint operand;
+};
+
+static const GelOptimizeOperation gel_optimize_operations[] =
+{
+    {"+", GEL_OPTIMIZE_ADD, "add_", gel_values_add, NULL},
+    {"-", GEL_OPTIMIZE_SUB, "sub_", gel_values_sub, NULL},
+    {"*", GEL_OPTIMIZE_MUL, "mul_", gel_values_mul, NULL},
+    {"/", GEL_OPTIMIZE_DIV, "div_", gel_values_div, NULL},
+    {"%", GEL_OPTIMIZE_MOD, "mod_", gel_values_mod, NULL},
+    {">", GEL_OPTIMIZE_GT, "gt_", NULL, gel_values_gt},
+    {">=", GEL_OPTIMIZE_GE, "ge_", NULL, gel_values_ge},
+    {"=", GEL_OPTIMIZE_EQ, "eq_", NULL, gel_values_eq},
+    {"<=", GEL_OPTIMIZE_LE, "le_", NULL, gel_values_le},
+    {"<", GEL_OPTIMIZE_LT, "lt_", NULL, gel_values_lt},
+    {"!=", GEL_OPTIMIZE_NE, "ne_", NULL, gel_values_ne},
+    {"get", GEL_OPTIMIZE_GET, "get_", NULL, NULL},
+    {NULL, 0, NULL, NULL, NULL}
+};
+
+static
+GelOptimizeFlags gel_optimize_get_flags(const gchar *name)
+{
+    static volatile gsize once = 0;
+    static GHashTable *flags = NULL;
+
+    if(g_once_init_enter(&once))
+    {
+        static const gchar *pure[] =
+        {
+            "+", "-", "*", "/", "%",
+            ">", ">=", "=", "<", "<=", "!=", "and", "or",
+            "str", "size", "range", "array",
+            "sum", "min", "max", "mean", "dot", "cumsum",
+            ".+", ".-", ".*",
+            NULL
+        };
+        static const gchar *inline_[] =
+        {
+            "if", "cond", "do", "while", "get", "print", "type",
+            NULL
+        };
+        static const gchar *scope[] =
+        {
+            "define", "function", "eval", "var", "require",
+            NULL
+        };
+        static const gchar *calls[] =
+        {
+            "apply", "map", "find", "filter", "sort", ".",
+            NULL
+        };
+
+        flags = g_hash_table_new(g_str_hash, g_str_equal);
+        for(const gchar **name = pure; *name != NULL; name++)
+            g_hash_table_insert(flags, (gpointer)*name,
+                GUINT_TO_POINTER(GEL_OPTIMIZE_PURE | GEL_OPTIMIZE_INLINE));
+        for(const gchar **name = inline_; *name != NULL; name++)
+            g_hash_table_insert(flags, (gpointer)*name,
+                GUINT_TO_POINTER(GEL_OPTIMIZE_INLINE));
+        for(const gchar **name = scope; *name != NULL; name++)
+            g_hash_table_insert(flags, (gpointer)*name,
+                GUINT_TO_POINTER(GEL_OPTIMIZE_SCOPE));
+        for(const gchar **name = calls; *name != NULL; name++)
+            g_hash_table_insert(flags, (gpointer)*name,
+                GUINT_TO_POINTER(GEL_OPTIMIZE_CALLS));
+
+        g_once_init_leave(&once, 1);
+    }
+
+    return GPOINTER_TO_UINT(g_hash_table_lookup(flags, name));
+}
+
+
+static
+gboolean gel_optimize_compare(GelOptimizeOperator operator, gint cmp,
+                              GValue *dest_value)
+{
+    gboolean result = FALSE;
+    switch(operator)
+    {
+        case GEL_OPTIMIZE_GT:
+            result = cmp > 0;
+            break;
+        case GEL_OPTIMIZE_GE:
+            result = cmp >= 0;
+            break;
+        case GEL_OPTIMIZE_EQ:
+            result = cmp == 0;
+            break;
+        case GEL_OPTIMIZE_LE:
+            result = cmp <= 0;
+            break;
+        case GEL_OPTIMIZE_LT:
+            result = cmp < 0;
+            break;
+        case GEL_OPTIMIZE_NE:
+            result = cmp != 0;
+            break;
+        default:
+            return FALSE;
+    }
+
+    g_value_init(dest_value, G_TYPE_BOOLEAN);
+    gel_value_set_boolean(dest_value, result);
+    return TRUE;
+}
+
+
+/*
+ * Applies @operator to @a and @b, returning FALSE if the result
+ * has to be computed by the predefined closure.
+ */
+static
+gboolean gel_optimize_int64(GelOptimizeOperator operator, gint64 a, gint64 b,
+                            GValue *dest_value)
+{
+    gint64 result = 0;
+    switch(operator)
+    {
+        case GEL_OPTIMIZE_ADD:
+            result = a + b;
+            break;
+        case GEL_OPTIMIZE_SUB:
+            result = a - b;
+            break;
+        case GEL_OPTIMIZE_MUL:
+            result = a * b;
+            break;
+        case GEL_OPTIMIZE_DIV:
+            if(b == 0)
+                return FALSE;
+            result = a / b;
+            break;
+        case GEL_OPTIMIZE_MOD:
+            if(b == 0)
+                return FALSE;
+            result = a % b;
+            break;
+        default:
+            return gel_optimize_compare(operator,
+                a > b ? 1 : a < b ? -1 : 0, dest_value);
+    }
+
+    g_value_init(dest_value, G_TYPE_INT64);
+    gel_value_set_int64(dest_value, result);
+    return TRUE;
+}
+
+
+static
+gboolean gel_optimize_double(GelOptimizeOperator operator, gdouble a, gdouble b,
+                             GValue *dest_value)
+{
+    gdouble result = 0;
+    switch(operator)
+    {
+        case GEL_OPTIMIZE_ADD:
+            result = a + b;
+            break;
+        case GEL_OPTIMIZE_SUB:
+            result = a - b;
+            break;
+        case GEL_OPTIMIZE_MUL:
+            result = a * b;
+            break;
+        case GEL_OPTIMIZE_DIV:
+            result = a / b;
+            break;
+        case GEL_OPTIMIZE_MOD:
+            return FALSE;
+        default:
+            return gel_optimize_compare(operator,
+                a > b ? 1 : a < b ? -1 : 0, dest_value);
+    }
+
+    g_value_init(dest_value, G_TYPE_DOUBLE);
+    gel_value_set_double(dest_value, result);
+    return TRUE;
+}
+
+
+static
+gboolean gel_optimize_numbers(GelOptimizeOperator operator,
+                              const GValue *v1, const GValue *v2,
+                              GValue *dest_value)
+{
+    GType type1 = GEL_VALUE_TYPE(v1);
+    GType type2 = GEL_VALUE_TYPE(v2);
+
+    if(type1 == G_TYPE_INT64 && type2 == G_TYPE_INT64)
+        return gel_optimize_int64(operator,
+            gel_value_get_int64(v1), gel_value_get_int64(v2), dest_value);
+
+    if((type1 != G_TYPE_INT64 && type1 != G_TYPE_DOUBLE)
+        || (type2 != G_TYPE_INT64 && type2 != G_TYPE_DOUBLE))
+        return FALSE;
+
+    return gel_optimize_double(operator,
+        type1 == G_TYPE_INT64 ?
+            (gdouble)gel_value_get_int64(v1) : gel_value_get_double(v1),
+        type2 == G_TYPE_INT64 ?
+            (gdouble)gel_value_get_int64(v2) : gel_value_get_double(v2),
+        dest_value);
+}
+
+
+static
+void gel_optimize_array_get(GelValueArray *array, GValue *return_value,
+                            const GValue *value, GelContext *context)
+{
+    GValue tmp_value = {0};
+    const GValue *index_value =
+        gel_context_eval_param_into_value(context, value, &tmp_value);
+
+    if(!gel_context_error(context))
+    {
+        if(GEL_VALUE_HOLDS(index_value, G_TYPE_INT64))
+        {
+            guint array_n_values = gel_value_array_get_n_values(array);
+            gint64 index = gel_value_get_int64(index_value);
+
+            if(index < 0)
+                index += array_n_values;
+
+            if(index < 0 || index >= array_n_values)
+                gel_error_index_out_of_bounds(context, "array_get", index);
+            else
+                gel_value_array_get_value(array, index, return_value);
+        }
+        else
+            gel_error_value_not_of_type(context,
+                "array_get", index_value, G_TYPE_INT64);
+    }
+
+    if(GEL_IS_VALUE(&tmp_value))
+        g_value_unset(&tmp_value);
+}
+
+
+/* Gets an element of an array, or calls the predefined get */
+static
+void gel_optimize_get(GValue *return_value,
+                      guint n_values, const GValue *values,
+                      GelContext *context)
+{
+    GValue tmp_value = {0};
+    const GValue *value =
+        gel_context_eval_param_into_value(context, values + 0, &tmp_value);
+
+    if(!gel_context_error(context))
+    {
+        if(GEL_VALUE_HOLDS(value, GEL_TYPE_VALUE_ARRAY))
+            gel_optimize_array_get(gel_value_get_boxed(value),
+                return_value, values + 1, context);
+        else
+        {
+            /* The first argument is a symbol, it can be evaluated again */
+            GClosure *closure =
+                gel_value_get_boxed(gel_value_lookup_predefined("get"));
+            gel_closure_invoke(closure,
+                return_value, n_values, values, context);
+        }
+    }
+
+    if(GEL_IS_VALUE(&tmp_value))
+        g_value_unset(&tmp_value);
+}
+
+
+/* Does what the predefined closure of @operation does with @v1 and @v2 */
+static
+void gel_optimize_generic(const GelOptimizeOperation *operation,
+                          const GValue *v1, const GValue *v2,
+                          GValue *return_value, GelContext *context)
+{
+    if(operation->arithmetic != NULL)
+    {
+        if(!operation->arithmetic(v1, v2, return_value))
+        {
+            if(GEL_IS_VALUE(return_value))
+                g_value_unset(return_value);
+            gel_error_incompatible(context, operation->f, v1, v2);
+        }
+        return;
+    }
+
+    gint result = operation->logic(v1, v2);
+    if(result == -1)
+        gel_error_incompatible(context, operation->f, v1, v2);
+    else
+    {
+        g_value_init(return_value, G_TYPE_BOOLEAN);
+        gel_value_set_boolean(return_value, result == 1);
+    }
+}
+
+
+static
+void specialized_(GClosure *self, GValue *return_value,
+                  guint n_values, const GValue *values, GelContext *context,
+                  const GelOptimizeOperation *operation)
+{
+    if(operation->operator == GEL_OPTIMIZE_GET)
+    {
+        gel_optimize_get(return_value, n_values, values, context);
+        return;
+    }
+
+    GValue tmp1 = {0};
+    GValue tmp2 = {0};
+
+    const GValue *v1 = gel_context_eval_into_value(context, values + 0, &tmp1);
+
+    if(!gel_context_error(context))
+    {
+        const GValue *v2 =
+            gel_context_eval_into_value(context, values + 1, &tmp2);
+
+        if(!gel_context_error(context)
+            && !gel_optimize_numbers(operation->operator, v1, v2, return_value))
+            gel_optimize_generic(operation, v1, v2, return_value, context);
+    }
+
+    if(GEL_IS_VALUE(&tmp1))
+        g_value_unset(&tmp1);
+    if(GEL_IS_VALUE(&tmp2))
+        g_value_unset(&tmp2);
+}
+
+
+/* A while evaluating its code in the context it is called in */
+static
+void while_(GClosure *self, GValue *return_value,
+            guint n_values, const GValue *values, GelContext *context)
+{
+    gboolean running = TRUE;
+
+    while(running)
+    {
+        GValue tmp_value = {0};
+        const GValue *cond_value =
+            gel_context_eval_into_value(context, values + 0, &tmp_value);
+
+        running = !gel_context_error(context)
+            && gel_value_to_boolean(cond_value);
+
+        if(GEL_IS_VALUE(&tmp_value))
+            g_value_unset(&tmp_value);
+
+        gboolean iterating = running;
+        for(guint i = 1; i < n_values && iterating; i++)
+        {
+            const GValue *value =
+                gel_context_eval_into_value(context, values + i, &tmp_value);
+
+            if(gel_context_error(context))
+                iterating = FALSE;
+            else
+            if(i == n_values - 1 && GEL_IS_VALUE(value))
+                gel_value_copy(value, return_value);
+
+            if(GEL_IS_VALUE(&tmp_value))
+                g_value_unset(&tmp_value);
+        }
+
+        if(gel_context_error(context))
+            running = gel_context_loop_exit(context);
+    }
+}
+
+
+/* Gets the type of literal @value is as a key of a case or cond */
+static
+GType gel_optimize_key_type(const GValue *value)
+{
+    GType type = GEL_VALUE_TYPE(value);
+
+    if(type == G_TYPE_INT64)
+        return G_TYPE_INT64;
+
+    if((type == G_TYPE_STRING || type == GEL_TYPE_STRING)
+        && gel_value_get_string(value) != NULL)
+        return GEL_TYPE_STRING;
+
+    return G_TYPE_INVALID;
+}
+
+
+/*
+ * Gets the index of the value evaluated by the branch @dispatch takes
+ * for @key, 0 if it takes none, or -1 if @key has to be compared
+ * to every literal because it is not of their type.
+ */
+static
+gint gel_optimize_dispatch_lookup(const GelOptimizeDispatch *dispatch,
+                                  const GValue *key)
+{
+    if(gel_optimize_key_type(key) != dispatch->type)
+        return -1;
+
+    gpointer branch = NULL;
+    if(g_hash_table_lookup_extended(dispatch->branches, key, NULL, &branch))
+        return GPOINTER_TO_INT(branch);
+
+    return dispatch->otherwise;
+}
+
+
+/* Evaluates the value of the branch taken, as do does */
+static
+void gel_optimize_branch(GelContext *context, const GValue *value,
+                         GValue *return_value)
+{
+    GValue tmp_value = {0};
+    const GValue *result =
+        gel_context_eval_into_value(context, value, &tmp_value);
+
+    if(!gel_context_error(context) && GEL_IS_VALUE(result))
+        gel_value_copy(result, return_value);
+
+    if(GEL_IS_VALUE(&tmp_value))
+        g_value_unset(&tmp_value);
+}
+
+
+/*
+ * Gets the index of the value evaluated by the branch the case
+ * with @values takes for @key, or 0 if it takes none.
+ */
+static
+gint gel_optimize_case_branch(const GelOptimizeDispatch *dispatch,
+                              guint n_values, const GValue *values,
+                              const GValue *key)
+{
+    gint branch = gel_optimize_dispatch_lookup(dispatch, key);
+    if(branch >= 0)
+        return branch;
+
+    /* Keys of other types are compared as the predefined case does */
+    for(guint i = 1; i + 1 < n_values; i += 2)
+    {
+        GelValueArray *tests = gel_value_get_boxed(values + i);
+        const GValue *test_values = gel_value_array_get_values(tests);
+        guint test_n_values = gel_value_array_get_n_values(tests);
+
+        for(guint j = 0; j < test_n_values; j++)
+            if(gel_values_eq(test_values + j, key))
+                return i + 1;
+    }
+
+    return dispatch->otherwise;
+}
+
+
+/* A case looking up the branch to take by the value of its key */
+static
+void case_(GClosure *self, GValue *return_value,
+           guint n_values, const GValue *values, GelContext *context,
+           const GelOptimizeDispatch *dispatch)
+{
+    GValue tmp_value = {0};
+    const GValue *key =
+        gel_context_eval_param_into_value(context, values + 0, &tmp_value);
+
+    if(!gel_context_error(context))
+    {
+        if(GEL_VALUE_HOLDS(key, GEL_TYPE_SYMBOL))
+            gel_error_value_not_of_type(context,
+                __FUNCTION__, values + 0, G_TYPE_VALUE);
+        else
+        {
+            gint branch =
+                gel_optimize_case_branch(dispatch, n_values, values, key);
+            if(branch > 0)
+                gel_optimize_branch(context, values + branch, return_value);
+        }
+    }
+
+    if(GEL_IS_VALUE(&tmp_value))
+        g_value_unset(&tmp_value);
+}
+
+
+/*
+ * A cond whose tests compare the same variable to literals, looking up
+ * the branch to take by the value of the variable.
+ */
+static
+void cond_(GClosure *self, GValue *return_value,
+           guint n_values, const GValue *values, GelContext *context,
+           const GelOptimizeDispatch *dispatch)
+{
+    GelValueArray *test = gel_value_get_boxed(values + 0);
+    const GValue *operand =
+        gel_value_array_get_values(test) + dispatch->operand;
+
+    GValue tmp_value = {0};
+    const GValue *key =
+        gel_context_eval_param_into_value(context, operand, &tmp_value);
+
+    gint branch = -1;
+
+    /* The predefined cond reports it, as its first test fails */
+    if(gel_context_error(context))
+        gel_context_clear_error(context);
+    else
+        branch = gel_optimize_dispatch_lookup(dispatch, key);
+
+    if(branch < 0)
+    {
+        /* Evaluating a variable again changes nothing */
+        GClosure *closure =
+            gel_value_get_boxed(gel_value_lookup_predefined("cond"));
+        gel_closure_invoke(closure, return_value, n_values, values, context);
+    }
+    else
+    if(branch > 0)
+        gel_optimize_branch(context, values + branch, return_value);
+
+    if(GEL_IS_VALUE(&tmp_value))
+        g_value_unset(&tmp_value);
+}
+
+
+static
+const gchar* gel_optimize_symbol_name(const GValue *value)
+{
+    if(!GEL_VALUE_HOLDS(value, GEL_TYPE_SYMBOL))
+        return NULL;
+
+    return gel_symbol_get_name(gel_value_get_boxed(value));
+}
+
+
+static
+void gel_optimize_bind(GelOptimizer *self, const gchar *name)
+{
+    gchar *key = g_strdup(name);
+    g_hash_table_replace(self->bound, key, key);
+}
+
+
+/* Gets the index of the arguments in a call to function */
+static
+guint gel_optimize_args_index(const GValue *values, guint n_values)
+{
+    return (n_values > 1 && gel_optimize_symbol_name(values + 1) != NULL) ?
+        2 : 1;
+}
+
+
+/*
+ * Records in @self the names @value defines, looking into
+ * every list it contains.
+ */
+static
+void gel_optimize_collect(GelOptimizer *self, const GValue *value)
+{
+    if(!GEL_VALUE_HOLDS(value, GEL_TYPE_VALUE_ARRAY))
+        return;
+
+    GelValueArray *array = gel_value_get_boxed(value);
+    guint n_values = gel_value_array_get_n_values(array);
+    if(n_values == 0)
+        return;
+
+    const GValue *values = gel_value_array_get_values(array);
+    const gchar *head = gel_optimize_symbol_name(values + 0);
+
+    if(n_values > 1 && (g_strcmp0(head, "define") == 0
+        || g_strcmp0(head, "for") == 0 || g_strcmp0(head, "function") == 0
+        || g_strcmp0(head, "catch") == 0))
+    {
+        const gchar *name = gel_optimize_symbol_name(values + 1);
+        if(name != NULL)
+            gel_optimize_bind(self, name);
+    }
+
+    guint args = gel_optimize_args_index(values, n_values);
+
+    for(guint i = 1; i < n_values; i++)
+    {
+        const gchar *name = NULL;
+        if(i == args && g_strcmp0(head, "function") == 0
+            && GEL_VALUE_HOLDS(values + i, GEL_TYPE_VALUE_ARRAY))
+        {
+            /* Arguments of the function */
+            GelValueArray *args = gel_value_get_boxed(values + i);
+            const GValue *args_values = gel_value_array_get_values(args);
+            guint args_n_values = gel_value_array_get_n_values(args);
+
+            for(guint j = 0; j < args_n_values; j++)
+                if((name = gel_optimize_symbol_name(args_values + j)) != NULL)
+                    gel_optimize_bind(self, name);
+            continue;
+        }
+
+        if(i == 1 && g_strcmp0(head, "let") == 0
+            && GEL_VALUE_HOLDS(values + i, GEL_TYPE_VALUE_ARRAY))
+        {
+            /* Names of the bindings, their values are code */
+            GelValueArray *bindings = gel_value_get_boxed(values + i);
+            const GValue *bindings_values =
+                gel_value_array_get_values(bindings);
+            guint bindings_n_values = gel_value_array_get_n_values(bindings);
+
+            for(guint j = 0; j < bindings_n_values; j++)
+                if(j % 2 == 0)
+                {
+                    name = gel_optimize_symbol_name(bindings_values + j);
+                    if(name != NULL)
+                        gel_optimize_bind(self, name);
+                }
+                else
+                    gel_optimize_collect(self, bindings_values + j);
+            continue;
+        }
+
+        gel_optimize_collect(self, values + i);
+    }
+}
+
+
+/*
+ * Gets the predefined value of the symbol @name,
+ * or NULL if the code or the context may give it another one.
+ */
+static
+const GValue* gel_optimize_lookup(GelOptimizer *self, const gchar *name)
+{
+    if(g_hash_table_lookup(self->bound, name) != NULL
+        || gel_context_lookup_variable(self->context, name) != NULL)
+        return NULL;
+
+    return gel_value_lookup_predefined(name);
+}
+
+
+/*
+ * Gets the name of the predefined closure @value refers to, or of the one
+ * it is a version of, or NULL if it does not refer to one for sure.
+ */
+static
+const gchar* gel_optimize_closure_name(GelOptimizer *self,
+                                       const GValue *value)
+{
+    const gchar *name = gel_optimize_symbol_name(value);
+    if(name != NULL)
+        value = gel_optimize_lookup(self, name);
+
+    if(value == NULL || !GEL_VALUE_HOLDS(value, G_TYPE_CLOSURE))
+        return NULL;
+
+    GClosure *closure = gel_value_get_boxed(value);
+    if(gel_closure_is_native(closure, (GClosureMarshal)specialized_))
+        return ((const GelOptimizeOperation*)closure->data)->name;
+    if(gel_closure_is_native(closure, (GClosureMarshal)while_))
+        return "while";
+    if(gel_closure_is_native(closure, (GClosureMarshal)case_)
+        || gel_closure_is_native(closure, (GClosureMarshal)cond_))
+        return ((const GelOptimizeDispatch*)closure->data)->name;
+
+    name = gel_closure_get_name(closure);
+
+    const GValue *predefined = gel_value_lookup_predefined(name);
+    if(predefined == NULL || gel_value_get_boxed(predefined) != closure)
+        return NULL;
+
+    return name;
+}
+
+
+static
+gboolean gel_optimize_is_scalar(const GValue *value)
+{
+    GType type = GEL_VALUE_TYPE(value);
+    return type == G_TYPE_INT64 || type == G_TYPE_DOUBLE
+        || type == G_TYPE_BOOLEAN || type == G_TYPE_POINTER
+        || type == G_TYPE_STRING || type == GEL_TYPE_STRING;
+}
+
+
+/*
+ * Gets the literal @value stands for, if it is a literal or a symbol
+ * that can only have its predefined value, or NULL otherwise.
+ */
+static
+const GValue* gel_optimize_get_scalar(GelOptimizer *self, const GValue *value)
+{
+    const gchar *name = gel_optimize_symbol_name(value);
+    if(name != NULL)
+        value = gel_optimize_lookup(self, name);
+
+    if(value == NULL || !gel_optimize_is_scalar(value))
+        return NULL;
+
+    return value;
+}
+
+
+static
+GelOptimizeType gel_optimize_type(GelOptimizer *self, const GValue *value);
+
+
+static
+GelOptimizeType gel_optimize_arithmetic_type(GelOptimizer *self,
+                                             const GValue *values,
+                                             guint n_values)
+{
+    GelOptimizeType type = 0;
+    gboolean is_double = FALSE;
+
+    for(guint i = 1; i < n_values; i++)
+    {
+        GelOptimizeType value_type = gel_optimize_type(self, values + i);
+        if(value_type & ~GEL_OPTIMIZE_TYPE_NUMBER)
+            return GEL_OPTIMIZE_TYPE_ANY;
+
+        is_double = is_double || value_type == GEL_OPTIMIZE_TYPE_DOUBLE;
+        type |= value_type;
+    }
+
+    return is_double ? GEL_OPTIMIZE_TYPE_DOUBLE : type;
+}
+
+
+/*
+ * Gets the types @value can evaluate to. The types of names
+ * not inferred yet are empty, those not given a value by the code
+ * and not predefined can be anything.
+ */
+static
+GelOptimizeType gel_optimize_type(GelOptimizer *self, const GValue *value)
+{
+    const gchar *name = gel_optimize_symbol_name(value);
+    gpointer type = NULL;
+
+    if(name != NULL && g_hash_table_lookup_extended(self->types,
+            name, NULL, &type))
+        return GPOINTER_TO_UINT(type);
+
+    const GValue *scalar = gel_optimize_get_scalar(self, value);
+    if(scalar != NULL)
+    {
+        if(GEL_VALUE_HOLDS(scalar, G_TYPE_INT64))
+            return GEL_OPTIMIZE_TYPE_INT64;
+        if(GEL_VALUE_HOLDS(scalar, G_TYPE_DOUBLE))
+            return GEL_OPTIMIZE_TYPE_DOUBLE;
+        return GEL_OPTIMIZE_TYPE_OTHER;
+    }
+
+    if(name != NULL)
+        return GEL_OPTIMIZE_TYPE_ANY;
+
+    if(!GEL_VALUE_HOLDS(value, GEL_TYPE_VALUE_ARRAY))
+        return GEL_OPTIMIZE_TYPE_OTHER;
+
+    GelValueArray *array = gel_value_get_boxed(value);
+    const GValue *values = gel_value_array_get_values(array);
+    guint n_values = gel_value_array_get_n_values(array);
+
+    if(n_values == 0)
+        return GEL_OPTIMIZE_TYPE_OTHER;
+
+    name = gel_optimize_closure_name(self, values + 0);
+    if(name == NULL)
+        return GEL_OPTIMIZE_TYPE_ANY;
+
+    if(strcmp(name, "+") == 0 || strcmp(name, "-") == 0
+        || strcmp(name, "*") == 0 || strcmp(name, "/") == 0
+        || strcmp(name, "%") == 0)
+        return gel_optimize_arithmetic_type(self, values, n_values);
+
+    if(strcmp(name, ">") == 0 || strcmp(name, ">=") == 0
+        || strcmp(name, "=") == 0 || strcmp(name, "<=") == 0
+        || strcmp(name, "<") == 0 || strcmp(name, "!=") == 0
+        || strcmp(name, "and") == 0 || strcmp(name, "or") == 0
+        || strcmp(name, "not") == 0 || strcmp(name, "str") == 0)
+        return GEL_OPTIMIZE_TYPE_OTHER;
+
+    if(strcmp(name, "size") == 0)
+        return GEL_OPTIMIZE_TYPE_INT64;
+
+    if(strcmp(name, "if") == 0 && n_values > 2)
+        return gel_optimize_type(self, values + 2)
+            | (n_values > 3 ? gel_optimize_type(self, values + 3)
+                : GEL_OPTIMIZE_TYPE_OTHER);
+
+    if(strcmp(name, "do") == 0 && n_values > 1)
+        return gel_optimize_type(self, values + n_values - 1);
+
+    return GEL_OPTIMIZE_TYPE_ANY;
+}
+
+
+static
+void gel_optimize_assign(GArray *assignments, const gchar *name,
+                         const GValue *value, GelOptimizeType type)
+{
+    if(name == NULL)
+        return;
+
+    GelOptimizeAssignment assignment = {name, value, type};
+    g_array_append_val(assignments, assignment);
+}
+
+
+/*
+ * Appends to @assignments the values given to names by @value,
+ * looking into every list it contains.
+ */
+static
+void gel_optimize_assignments(GelOptimizer *self, const GValue *value,
+                              GArray *assignments)
+{
+    if(!GEL_VALUE_HOLDS(value, GEL_TYPE_VALUE_ARRAY))
+        return;
+
+    GelValueArray *array = gel_value_get_boxed(value);
+    guint n_values = gel_value_array_get_n_values(array);
+    if(n_values == 0)
+        return;
+
+    const GValue *values = gel_value_array_get_values(array);
+    const gchar *head = gel_optimize_symbol_name(values + 0);
+
+    if(n_values == 3 && (g_strcmp0(head, "define") == 0
+        || g_strcmp0(head, "set") == 0))
+        gel_optimize_assign(assignments,
+            gel_optimize_symbol_name(values + 1), values + 2, 0);
+    else
+    if(n_values > 2 && g_strcmp0(head, "for") == 0)
+    {
+        /* Elements of a range are numbers, others can be anything */
+        const gchar *name = NULL;
+        if(GEL_VALUE_HOLDS(values + 2, GEL_TYPE_VALUE_ARRAY)
+            && gel_value_array_get_n_values(
+                gel_value_get_boxed(values + 2)) > 0)
+            name = gel_optimize_closure_name(self,
+                gel_value_array_get_values(gel_value_get_boxed(values + 2)));
+
+        gel_optimize_assign(assignments,
+            gel_optimize_symbol_name(values + 1), NULL,
+            g_strcmp0(name, "range") == 0 ?
+                GEL_OPTIMIZE_TYPE_NUMBER : GEL_OPTIMIZE_TYPE_ANY);
+    }
+    else
+    if(n_values > 1 && (g_strcmp0(head, "function") == 0
+        || g_strcmp0(head, "catch") == 0))
+        gel_optimize_assign(assignments,
+            gel_optimize_symbol_name(values + 1), NULL, GEL_OPTIMIZE_TYPE_ANY);
+
+    guint args = gel_optimize_args_index(values, n_values);
+
+    for(guint i = 1; i < n_values; i++)
+    {
+        if(i == args && g_strcmp0(head, "function") == 0
+            && GEL_VALUE_HOLDS(values + i, GEL_TYPE_VALUE_ARRAY))
+        {
+            /* Arguments can be given anything */
+            GelValueArray *args = gel_value_get_boxed(values + i);
+            const GValue *args_values = gel_value_array_get_values(args);
+            guint args_n_values = gel_value_array_get_n_values(args);
+
+            for(guint j = 0; j < args_n_values; j++)
+                gel_optimize_assign(assignments,
+                    gel_optimize_symbol_name(args_values + j),
+                    NULL, GEL_OPTIMIZE_TYPE_ANY);
+            continue;
+        }
+
+        if(i == 1 && g_strcmp0(head, "let") == 0
+            && GEL_VALUE_HOLDS(values + i, GEL_TYPE_VALUE_ARRAY))
+        {
+            GelValueArray *bindings = gel_value_get_boxed(values + i);
+            const GValue *bindings_values =
+                gel_value_array_get_values(bindings);
+            guint bindings_n_values = gel_value_array_get_n_values(bindings);
+
+            for(guint j = 0; j + 1 < bindings_n_values; j += 2)
+            {
+                gel_optimize_assign(assignments,
+                    gel_optimize_symbol_name(bindings_values + j),
+                    bindings_values + j + 1, 0);
+                gel_optimize_assignments(self,
+                    bindings_values + j + 1, assignments);
+            }
+            continue;
+        }
+
+        gel_optimize_assignments(self, values + i, assignments);
+    }
+}
+
+
+/*
+ * Infers the types of the names @value gives a value to, as every type
+ * any of the values given to them can have, wherever they are given.
+ * Names already defined by the context can have any value.
+ */
+static
+void gel_optimize_infer(GelOptimizer *self, const GValue *value)
+{
+    GArray *assignments =
+        g_array_new(FALSE, FALSE, sizeof(GelOptimizeAssignment));
+    gel_optimize_assignments(self, value, assignments);
+
+    for(guint i = 0; i < assignments->len; i++)
+    {
+        const gchar *name =
+            g_array_index(assignments, GelOptimizeAssignment, i).name;
+        GelOptimizeType type =
+            gel_context_lookup_variable(self->context, name) != NULL ?
+                GEL_OPTIMIZE_TYPE_ANY : 0;
+
+        g_hash_table_insert(self->types,
+            g_strdup(name), GUINT_TO_POINTER(type));
+    }
+
+    gboolean changed = TRUE;
+    while(changed)
+    {
+        changed = FALSE;
+        for(guint i = 0; i < assignments->len; i++)
+        {
+            const GelOptimizeAssignment *assignment =
+                &g_array_index(assignments, GelOptimizeAssignment, i);
+            GelOptimizeType type = GPOINTER_TO_UINT(
+                g_hash_table_lookup(self->types, assignment->name));
+            GelOptimizeType new_type = type | (assignment->value != NULL ?
+                gel_optimize_type(self, assignment->value) : assignment->type);
+
+            if(new_type != type)
+            {
+                g_hash_table_insert(self->types,
+                    g_strdup(assignment->name), GUINT_TO_POINTER(new_type));
+                changed = TRUE;
+            }
+        }
+    }
+
+    /* Names never given a value that can be known */
+    for(guint i = 0; i < assignments->len; i++)
+    {
+        const gchar *name =
+            g_array_index(assignments, GelOptimizeAssignment, i).name;
+        if(g_hash_table_lookup(self->types, name) == NULL)
+            g_hash_table_insert(self->types, g_strdup(name),
+                GUINT_TO_POINTER(GEL_OPTIMIZE_TYPE_ANY));
+    }
+
+    g_array_free(assignments, TRUE);
+}
+
+
+/*
+ * Replaces the predefined closure @name called in @value by a version
+ * of it specialized for numbers, if the types of its operands
+ * make them likely to be numbers.
+ */
+static
+void gel_optimize_specialize(GelOptimizer *self, GValue *value,
+                             const gchar *name)
+{
+    GelValueArray *array = gel_value_get_boxed(value);
+    GValue *values = gel_value_array_get_values(array);
+
+    if(gel_value_array_get_n_values(array) != 3
+        || (GEL_VALUE_HOLDS(values + 0, G_TYPE_CLOSURE)
+            && gel_closure_is_native(gel_value_get_boxed(values + 0),
+                (GClosureMarshal)specialized_)))
+        return;
+
+    const GelOptimizeOperation *operation = gel_optimize_operations;
+    while(operation->name != NULL && strcmp(operation->name, name) != 0)
+        operation++;
+    if(operation->name == NULL)
+        return;
+
+    GelOptimizeType type1 = gel_optimize_type(self, values + 1);
+    GelOptimizeType type2 = gel_optimize_type(self, values + 2);
+
+    if(operation->operator == GEL_OPTIMIZE_GET)
+    {
+        /* The array is evaluated again if it is not one */
+        if(gel_optimize_symbol_name(values + 1) == NULL
+            || !(type1 & GEL_OPTIMIZE_TYPE_OTHER)
+            || type2 != GEL_OPTIMIZE_TYPE_INT64)
+            return;
+    }
+    else
+    if(!(type1 & GEL_OPTIMIZE_TYPE_NUMBER) || !(type2 & GEL_OPTIMIZE_TYPE_NUMBER)
+        || ((type1 & ~GEL_OPTIMIZE_TYPE_NUMBER)
+            && (type2 & ~GEL_OPTIMIZE_TYPE_NUMBER)))
+        return;
+
+    GClosure *closure =
+        gel_closure_new_native(name, (GClosureMarshal)specialized_);
+    closure->data = (gpointer)operation;
+    g_closure_ref(closure);
+    g_closure_sink(closure);
+
+    g_value_unset(values + 0);
+    g_value_init(values + 0, G_TYPE_CLOSURE);
+    gel_value_take_boxed(values + 0, closure);
+}
+
+
+static
+void constant_(GClosure *self, GValue *return_value,
+               guint n_values, const GValue *values, GelContext *context,
+               GelValueArray *array);
+
+
+static
+gboolean gel_optimize_escapes(GelOptimizer *self, const GValue *value);
+
+
+/*
+ * Checks whether @value can not evaluate to a closure other than
+ * a predefined one known not to define names in the context it is
+ * called in, for the closures invoking the ones they are given.
+ */
+static
+gboolean gel_optimize_is_contained(GelOptimizer *self, const GValue *value)
+{
+    if(gel_optimize_get_scalar(self, value) != NULL)
+        return TRUE;
+
+    const gchar *name = gel_optimize_closure_name(self, value);
+    if(name != NULL)
+        return (gel_optimize_get_flags(name)
+            & (GEL_OPTIMIZE_SCOPE | GEL_OPTIMIZE_CALLS)) == 0;
+
+    if(!GEL_VALUE_HOLDS(value, GEL_TYPE_VALUE_ARRAY))
+        return FALSE;
+
+    /* Literal containers, and the results of pure closures */
+    GelValueArray *array = gel_value_get_boxed(value);
+    const GValue *values = gel_value_array_get_values(array);
+    if(gel_value_array_get_n_values(array) == 0)
+        return FALSE;
+
+    if(GEL_VALUE_HOLDS(values + 0, G_TYPE_CLOSURE)
+        && gel_closure_is_native(gel_value_get_boxed(values + 0),
+            (GClosureMarshal)constant_))
+        return TRUE;
+
+    name = gel_optimize_closure_name(self, values + 0);
+    return name != NULL && (gel_optimize_get_flags(name) & GEL_OPTIMIZE_PURE)
+        && !gel_optimize_escapes(self, value);
+}
+
+
+/*
+ * Checks whether evaluating @value can define names in the context it is
+ * evaluated in, or keep a reference to it or to its variables.
+ * Names that can refer to closures doing so are enough, and so are calls
+ * to anything but predefined closures known not to do so: a name the code
+ * or the context gives a value to can refer to any of them.
+ */
+static
+gboolean gel_optimize_escapes(GelOptimizer *self, const GValue *value)
+{
+    const gchar *name = gel_optimize_symbol_name(value);
+    if(name != NULL)
+        return (gel_optimize_get_flags(name) & GEL_OPTIMIZE_SCOPE) != 0;
+
+    if(!GEL_VALUE_HOLDS(value, GEL_TYPE_VALUE_ARRAY))
+        return FALSE;
+
+    GelValueArray *array = gel_value_get_boxed(value);
+    const GValue *values = gel_value_array_get_values(array);
+    guint n_values = gel_value_array_get_n_values(array);
+    if(n_values == 0)
+        return FALSE;
+
+    if(GEL_VALUE_HOLDS(values + 0, G_TYPE_CLOSURE)
+        && gel_closure_is_native(gel_value_get_boxed(values + 0),
+            (GClosureMarshal)constant_))
+        return FALSE;
+
+    const gchar *head = gel_optimize_closure_name(self, values + 0);
+    if(head == NULL)
+        return TRUE;
+
+    GelOptimizeFlags flags = gel_optimize_get_flags(head);
+    if(flags & GEL_OPTIMIZE_SCOPE)
+        return TRUE;
+
+    for(guint i = 1; i < n_values; i++)
+    {
+        const GValue *arg = values + i;
+        const GValue *arg_values = NULL;
+        guint arg_n_values = 0;
+        if(GEL_VALUE_HOLDS(arg, GEL_TYPE_VALUE_ARRAY))
+        {
+            GelValueArray *arg_array = gel_value_get_boxed(arg);
+            arg_values = gel_value_array_get_values(arg_array);
+            arg_n_values = gel_value_array_get_n_values(arg_array);
+        }
+
+        if((flags & GEL_OPTIMIZE_CALLS)
+            && !gel_optimize_is_contained(self, arg))
+            return TRUE;
+
+        /* Tests of a case are lists of literals */
+        if(strcmp(head, "case") == 0 && i >= 2 && i % 2 == 0
+            && i + 1 < n_values)
+            continue;
+
+        if(strcmp(head, "let") == 0 && i == 1 && arg_values != NULL)
+        {
+            /* Names of the bindings, their values are code */
+            for(guint j = 1; j < arg_n_values; j += 2)
+                if(gel_optimize_escapes(self, arg_values + j))
+                    return TRUE;
+            continue;
+        }
+
+        if(strcmp(head, "try") == 0 && i == n_values - 1 && arg_n_values >= 2
+            && g_strcmp0(gel_optimize_symbol_name(arg_values + 0),
+                "catch") == 0)
+        {
+            /* (catch name code...) */
+            for(guint j = 2; j < arg_n_values; j++)
+                if(gel_optimize_escapes(self, arg_values + j))
+                    return TRUE;
+            continue;
+        }
+
+        if(gel_optimize_escapes(self, arg))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+/*
+ * Makes the while in @value evaluate its code in the context it is
+ * called in, instead of a context of its own, if nothing in its code
+ * can tell the difference.
+ */
+static
+void gel_optimize_unscope(GelOptimizer *self, GValue *value)
+{
+    GelValueArray *array = gel_value_get_boxed(value);
+    GValue *values = gel_value_array_get_values(array);
+    guint n_values = gel_value_array_get_n_values(array);
+
+    if(n_values < 3 || (GEL_VALUE_HOLDS(values + 0, G_TYPE_CLOSURE)
+        && gel_closure_is_native(gel_value_get_boxed(values + 0),
+            (GClosureMarshal)while_)))
+        return;
+
+    for(guint i = 1; i < n_values; i++)
+        if(gel_optimize_escapes(self, values + i))
+            return;
+
+    GClosure *closure =
+        gel_closure_new_native("while", (GClosureMarshal)while_);
+    g_closure_ref(closure);
+    g_closure_sink(closure);
+
+    g_value_unset(values + 0);
+    g_value_init(values + 0, G_TYPE_CLOSURE);
+    gel_value_take_boxed(values + 0, closure);
+}
+
+
+static
+void gel_optimize_dispatch_free(GelOptimizeDispatch *self)
+{
+    g_hash_table_unref(self->branches);
+    g_slice_free(GelOptimizeDispatch, self);
+}
+
+
+/*
+ * Adds to @dispatch the literal @key of the branch evaluating the value
+ * at @branch, returning FALSE if it is not of the type of the others.
+ */
+static
+gboolean gel_optimize_add_key(GelOptimizeDispatch *dispatch,
+                              const GValue *key, gint branch)
+{
+    GType type = gel_optimize_key_type(key);
+    if(type == G_TYPE_INVALID
+        || (dispatch->type != G_TYPE_INVALID && type != dispatch->type))
+        return FALSE;
+
+    dispatch->type = type;
+
+    /* The first branch comparing equal is the one taken */
+    if(!g_hash_table_lookup_extended(dispatch->branches, key, NULL, NULL))
+        g_hash_table_insert(dispatch->branches,
+            gel_value_dup(key), GINT_TO_POINTER(branch));
+
+    return TRUE;
+}
+
+
+/*
+ * Gets which operand of the test of a cond in @value is the variable
+ * @subject, or any variable if NULL, compared by = to a literal left in
+ * @key, or 0 if it is not such a test.
+ */
+static
+guint gel_optimize_cond_operand(GelOptimizer *self, const GValue *value,
+                                const gchar *subject, const GValue **key)
+{
+    if(!GEL_VALUE_HOLDS(value, GEL_TYPE_VALUE_ARRAY))
+        return 0;
+
+    GelValueArray *array = gel_value_get_boxed(value);
+    const GValue *values = gel_value_array_get_values(array);
+
+    if(gel_value_array_get_n_values(array) != 3
+        || g_strcmp0(gel_optimize_closure_name(self, values + 0), "=") != 0)
+        return 0;
+
+    for(guint i = 1; i <= 2; i++)
+    {
+        const gchar *name = gel_optimize_symbol_name(values + i);
+        *key = gel_optimize_get_scalar(self, values + 3 - i);
+
+        if(name != NULL && *key != NULL
+            && gel_optimize_get_scalar(self, values + i) == NULL
+            && (subject == NULL || strcmp(name, subject) == 0))
+            return i;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Makes the case or cond @name in @value look up the branch to take
+ * in a table, if it compares its key only to literals of the same type,
+ * and to enough of them.
+ */
+static
+void gel_optimize_dispatch(GelOptimizer *self, GValue *value,
+                           const gchar *name)
+{
+    GelValueArray *array = gel_value_get_boxed(value);
+    GValue *values = gel_value_array_get_values(array);
+    guint n_values = gel_value_array_get_n_values(array);
+
+    gboolean is_case = (strcmp(name, "case") == 0);
+    guint first = is_case ? 2 : 1;
+
+    if(n_values < first + 2)
+        return;
+
+    GelOptimizeDispatch *dispatch = g_slice_new0(GelOptimizeDispatch);
+    dispatch->name = is_case ? "case" : "cond";
+    dispatch->type = G_TYPE_INVALID;
+    dispatch->branches = g_hash_table_new_full(
+        (GHashFunc)gel_value_hash, (GEqualFunc)gel_values_eq,
+        (GDestroyNotify)gel_value_free, NULL);
+
+    const gchar *subject = NULL;
+    gboolean valid = TRUE;
+    guint i = first;
+
+    /* Branches are indexes of the arguments, after the closure */
+    for(; i + 1 < n_values && valid; i += 2)
+        if(is_case)
+        {
+            valid = GEL_VALUE_HOLDS(values + i, GEL_TYPE_VALUE_ARRAY);
+            if(!valid)
+                break;
+
+            GelValueArray *tests = gel_value_get_boxed(values + i);
+            const GValue *test_values = gel_value_array_get_values(tests);
+            guint test_n_values = gel_value_array_get_n_values(tests);
+
+            for(guint j = 0; j < test_n_values && valid; j++)
+                valid = gel_optimize_add_key(dispatch, test_values + j, i);
+        }
+        else
+        {
+            const GValue *key = NULL;
+            guint operand =
+                gel_optimize_cond_operand(self, values + i, subject, &key);
+
+            valid = (operand != 0 && gel_optimize_add_key(dispatch, key, i));
+            if(valid && subject == NULL)
+            {
+                const GValue *test_values = gel_value_array_get_values(
+                    gel_value_get_boxed(values + i));
+                subject = gel_optimize_symbol_name(test_values + operand);
+                dispatch->operand = operand;
+            }
+        }
+
+    /* The value left is evaluated when no branch is taken */
+    if(valid && i < n_values)
+        dispatch->otherwise = i - 1;
+
+    if(!valid || g_hash_table_size(dispatch->branches)
+            < GEL_OPTIMIZE_MIN_DISPATCH)
+    {
+        gel_optimize_dispatch_free(dispatch);
+        return;
+    }
+
+    GClosure *closure = gel_closure_new_native(dispatch->name,
+        is_case ? (GClosureMarshal)case_ : (GClosureMarshal)cond_);
+    closure->data = dispatch;
+    g_closure_add_finalize_notifier(closure,
+        dispatch, (GClosureNotify)gel_optimize_dispatch_free);
+    g_closure_ref(closure);
+    g_closure_sink(closure);
+
+    g_value_unset(values + 0);
+    g_value_init(values + 0, G_TYPE_CLOSURE);
+    gel_value_take_boxed(values + 0, closure);
+}
+
+
+static
+void constant_(GClosure *self, GValue *return_value,
+               guint n_values, const GValue *values, GelContext *context,
+               GelValueArray *array)
+{
+    g_value_init(return_value, GEL_TYPE_VALUE_ARRAY);
+    gel_value_take_boxed(return_value, gel_value_array_copy(array));
+}
+
+
+/* Replaces @value by a call to a closure returning copies of @array */
+static
+void gel_optimize_hoist(GValue *value, GelValueArray *array)
+{
+    GClosure *closure =
+        gel_closure_new_native("constant", (GClosureMarshal)constant_);
+    closure->data = array;
+    g_closure_add_finalize_notifier(closure,
+        array, (GClosureNotify)gel_value_array_free);
+    g_closure_ref(closure);
+    g_closure_sink(closure);
+
+    GValue closure_value = {0};
+    g_value_init(&closure_value, G_TYPE_CLOSURE);
+    gel_value_take_boxed(&closure_value, closure);
+
+    GelValueArray *code = gel_value_array_new(1);
+    gel_value_array_take(code, &closure_value);
+
+    g_value_unset(value);
+    g_value_init(value, GEL_TYPE_VALUE_ARRAY);
+    gel_value_take_boxed(value, code);
+}
+
+
+/* Moves the value at @index of @array to @value */
+static
+void gel_optimize_replace(GValue *value, GelValueArray *array, guint index)
+{
+    GValue *values = gel_value_array_get_values(array);
+    GValue tmp_value = values[index];
+
+    memset(values + index, 0, sizeof(GValue));
+    g_value_unset(value);
+    *value = tmp_value;
+}
+
+
+static
+gboolean gel_optimize_is_zero(const GValue *value)
+{
+    if(value == NULL)
+        return FALSE;
+    if(GEL_VALUE_HOLDS(value, G_TYPE_INT64))
+        return gel_value_get_int64(value) == 0;
+    if(GEL_VALUE_HOLDS(value, G_TYPE_DOUBLE))
+        return (gint64)gel_value_get_double(value) == 0;
+    return FALSE;
+}
+
+
+/*
+ * Gets how big the literal @value is: the length of a string,
+ * the number of values of a container, or 1 for the rest.
+ */
+static
+gsize gel_optimize_size(GelOptimizer *self, const GValue *value)
+{
+    const GValue *scalar = gel_optimize_get_scalar(self, value);
+    if(scalar != NULL)
+    {
+        if(GEL_VALUE_TYPE(scalar) == GEL_TYPE_STRING)
+            return gel_string_get_length(gel_value_get_string(scalar));
+        if(GEL_VALUE_TYPE(scalar) == G_TYPE_STRING)
+            return strlen(gel_value_get_string(scalar));
+        return 1;
+    }
+
+    /* Containers are hoisted into a constant */
+    if(!GEL_VALUE_HOLDS(value, GEL_TYPE_VALUE_ARRAY))
+        return G_MAXSIZE;
+
+    const GelValueArray *array = gel_value_get_boxed(value);
+    const GValue *values = gel_value_array_get_values(array);
+    if(gel_value_array_get_n_values(array) == 0
+        || !GEL_VALUE_HOLDS(values + 0, G_TYPE_CLOSURE)
+        || !gel_closure_is_native(gel_value_get_boxed(values + 0),
+            (GClosureMarshal)constant_))
+        return G_MAXSIZE;
+
+    const GClosure *closure = gel_value_get_boxed(values + 0);
+    return gel_value_array_get_n_values(closure->data);
+}
+
+
+/*
+ * Checks that the result of the call to the pure closure @name in @value,
+ * whose arguments are literals, is small enough to be kept as a literal,
+ * without evaluating it. Evaluating a call to range could otherwise take
+ * as long and as much memory while optimizing as it would running code
+ * that might never run.
+ */
+static
+gboolean gel_optimize_is_small(GelOptimizer *self, const GValue *value,
+                               const gchar *name)
+{
+    GelValueArray *array = gel_value_get_boxed(value);
+    const GValue *values = gel_value_array_get_values(array);
+    guint n_values = gel_value_array_get_n_values(array);
+
+    if(strcmp(name, "range") == 0)
+    {
+        if(n_values != 3)
+            return TRUE;
+
+        const GValue *first = gel_optimize_get_scalar(self, values + 1);
+        const GValue *last = gel_optimize_get_scalar(self, values + 2);
+        if(first == NULL || !GEL_VALUE_HOLDS(first, G_TYPE_INT64)
+            || last == NULL || !GEL_VALUE_HOLDS(last, G_TYPE_INT64))
+            return FALSE;
+
+        guint64 a = gel_value_get_int64(first);
+        guint64 b = gel_value_get_int64(last);
+        guint64 count = (gint64)a < (gint64)b ? b - a : a - b;
+
+        return count < GEL_OPTIMIZE_MAX_CONSTANT;
+    }
+
+    if(strcmp(name, "array") == 0)
+        return n_values - 1 <= GEL_OPTIMIZE_MAX_CONSTANT;
+
+    /* The string of a container can be much bigger than it */
+    if(strcmp(name, "str") == 0)
+        return n_values == 2
+            && gel_optimize_get_scalar(self, values + 1) != NULL
+            && gel_optimize_size(self, values + 1) <= GEL_OPTIMIZE_MAX_CONSTANT;
+
+    /* Concatenations, the rest is no bigger than its arguments */
+    if(strcmp(name, "+") == 0)
+    {
+        gsize size = 0;
+        for(guint i = 1; i < n_values; i++)
+        {
+            size += MIN(gel_optimize_size(self, values + i),
+                GEL_OPTIMIZE_MAX_CONSTANT + 1);
+            if(size > GEL_OPTIMIZE_MAX_CONSTANT)
+                return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * Evaluates the call to the pure closure @name in @value,
+ * replacing it by its result if it can be kept as a literal.
+ */
+static
+GelOptimizeKind gel_optimize_eval(GelOptimizer *self, GValue *value,
+                                  const gchar *name)
+{
+    GelValueArray *array = gel_value_get_boxed(value);
+    const GValue *values = gel_value_array_get_values(array);
+    guint n_values = gel_value_array_get_n_values(array);
+
+    if(!gel_optimize_is_small(self, value, name))
+        return GEL_OPTIMIZE_CODE;
+
+    /* Integer remainders by 0 are not checked */
+    if(strcmp(name, "%") == 0)
+        for(guint i = 2; i < n_values; i++)
+            if(gel_optimize_is_zero(gel_optimize_get_scalar(self, values + i)))
+                return GEL_OPTIMIZE_CODE;
+
+    GValue result = {0};
+    gel_context_eval_value(self->context, value, &result);
+
+    GelOptimizeKind kind = GEL_OPTIMIZE_CODE;
+
+    if(gel_context_error(self->context))
+        gel_context_clear_error(self->context);
+    else
+    if(gel_optimize_is_scalar(&result))
+    {
+        g_value_unset(value);
+        *value = result;
+        return GEL_OPTIMIZE_SCALAR;
+    }
+    else
+    if(GEL_VALUE_HOLDS(&result, GEL_TYPE_VALUE_ARRAY)
+        && gel_value_array_get_n_values(gel_value_get_boxed(&result))
+            <= GEL_OPTIMIZE_MAX_CONSTANT)
+    {
+        gel_optimize_hoist(value, g_value_dup_boxed(&result));
+        kind = GEL_OPTIMIZE_CONTAINER;
+    }
+
+    if(GEL_IS_VALUE(&result))
+        g_value_unset(&result);
+
+    return kind;
+}
+
+
+/*
+ * Removes the branches of the cond in @value that can not be taken,
+ * replacing the cond by the expression that is always evaluated, if any.
+ */
+static
+GelOptimizeKind gel_optimize_cond(GelOptimizer *self, GValue *value)
+{
+    GelValueArray *array = gel_value_get_boxed(value);
+    guint n_values = gel_value_array_get_n_values(array);
+
+    guint i = 1;
+    while(i + 1 < n_values)
+    {
+        const GValue *values = gel_value_array_get_values(array);
+        const GValue *test = gel_optimize_get_scalar(self, values + i);
+
+        /* The last branch is kept, a cond needs at least one */
+        if(test == NULL || (i == 1 && n_values == 3
+            && !gel_value_to_boolean(test)))
+            i += 2;
+        else
+        if(gel_value_to_boolean(test))
+        {
+            /* The rest is never evaluated, the expression becomes else */
+            gel_value_array_remove(array, i);
+            gel_value_array_set_n_values(array, i + 1);
+            n_values = i + 1;
+        }
+        else
+        {
+            gel_value_array_remove(array, i);
+            gel_value_array_remove(array, i);
+            n_values -= 2;
+        }
+    }
+
+    if(n_values != 2)
+    {
+        gel_optimize_dispatch(self, value, "cond");
+        return GEL_OPTIMIZE_CODE;
+    }
+
+    gel_optimize_replace(value, array, 1);
+    return gel_optimize_get_scalar(self, value) != NULL ?
+        GEL_OPTIMIZE_SCALAR : GEL_OPTIMIZE_CODE;
+}
+
+
+static
+GelOptimizeKind gel_optimize_fold(GelOptimizer *self, GValue *value,
+                                  gboolean replace);
+
+
+static
+void inline_(GClosure *self, GValue *return_value,
+             guint n_values, const GValue *values, GelContext *context,
+             GelOptimizeInline *inline_call)
+{
+    const GelVariable *variable =
+        gel_context_lookup_variable(context, inline_call->name);
+    const GValue *value =
+        (variable != NULL) ? gel_variable_get_value(variable) : NULL;
+
+    if(variable == inline_call->variable && value != NULL
+        && GEL_VALUE_HOLDS(value, G_TYPE_CLOSURE)
+        && gel_value_get_boxed(value) == inline_call->closure)
+        gel_context_eval_value(context, values + 0, return_value);
+    else
+        gel_context_eval_value(context, values + 1, return_value);
+}
+
+
+static
+void gel_optimize_inline_free(GelOptimizeInline *self)
+{
+    g_free(self->name);
+    gel_variable_unref(self->variable);
+    g_closure_unref(self->closure);
+    g_slice_free(GelOptimizeInline, self);
+}
+
+
+static
+gint gel_optimize_arg_index(const GList *args, const gchar *name)
+{
+    gint index = 0;
+    for(const GList *iter = args; iter != NULL; iter = iter->next, index++)
+        if(strcmp(iter->data, name) == 0)
+            return index;
+
+    return -1;
+}
+
+
+/*
+ * Checks whether @value, part of the code of a closure taking @args,
+ * can be evaluated where the closure is called instead: it can only
+ * use the arguments and predefined values, and call predefined closures
+ * that neither define names nor change their arguments.
+ * @size counts the values checked, up to GEL_OPTIMIZE_MAX_INLINED.
+ */
+static
+gboolean gel_optimize_can_inline(GelOptimizer *self, const GValue *value,
+                                 const GList *args, guint *size)
+{
+    if(++*size > GEL_OPTIMIZE_MAX_INLINED)
+        return FALSE;
+
+    const gchar *name = gel_optimize_symbol_name(value);
+    if(name != NULL)
+        return gel_optimize_arg_index(args, name) >= 0
+            || gel_optimize_lookup(self, name) != NULL;
+
+    if(GEL_VALUE_HOLDS(value, G_TYPE_CLOSURE))
+        return gel_optimize_closure_name(self, value) != NULL;
+
+    if(!GEL_VALUE_HOLDS(value, GEL_TYPE_VALUE_ARRAY))
+        return TRUE;
+
+    GelValueArray *array = gel_value_get_boxed(value);
+    const GValue *values = gel_value_array_get_values(array);
+    guint n_values = gel_value_array_get_n_values(array);
+    if(n_values == 0)
+        return TRUE;
+
+    if(GEL_VALUE_HOLDS(values + 0, G_TYPE_CLOSURE)
+        && gel_closure_is_native(gel_value_get_boxed(values + 0),
+            (GClosureMarshal)constant_))
+        return TRUE;
+
+    /* Arguments called as closures are not known */
+    name = gel_optimize_symbol_name(values + 0);
+    if(name != NULL && gel_optimize_arg_index(args, name) >= 0)
+        return FALSE;
+
+    name = gel_optimize_closure_name(self, values + 0);
+    if(name == NULL || !(gel_optimize_get_flags(name) & GEL_OPTIMIZE_INLINE))
+        return FALSE;
+
+    for(guint i = 1; i < n_values; i++)
+        if(!gel_optimize_can_inline(self, values + i, args, size))
+            return FALSE;
+
+    return TRUE;
+}
+
+
+/* Copies @value to @dest_value replacing @args by @params */
+static
+void gel_optimize_substitute(const GValue *value, const GList *args,
+                             const GValue *params, GValue *dest_value)
+{
+    const gchar *name = gel_optimize_symbol_name(value);
+    gint index = (name != NULL) ? gel_optimize_arg_index(args, name) : -1;
+
+    if(index >= 0)
+        gel_value_copy(params + index, dest_value);
+    else
+    if(GEL_VALUE_HOLDS(value, GEL_TYPE_VALUE_ARRAY))
+    {
+        GelValueArray *array = gel_value_get_boxed(value);
+        const GValue *values = gel_value_array_get_values(array);
+        guint n_values = gel_value_array_get_n_values(array);
+
+        /* Copied to keep where the code came from */
+        GelValueArray *copy = gel_value_array_copy(array);
+        GValue *copy_values = gel_value_array_get_values(copy);
+
+        for(guint i = 0; i < n_values; i++)
+        {
+            g_value_unset(copy_values + i);
+            gel_optimize_substitute(values + i, args, params, copy_values + i);
+        }
+
+        g_value_init(dest_value, GEL_TYPE_VALUE_ARRAY);
+        gel_value_take_boxed(dest_value, copy);
+    }
+    else
+        gel_value_copy(value, dest_value);
+}
+
+
+/*
+ * Replaces the call in @value by the code of the closure it calls,
+ * if it is small enough and can be evaluated where it is called.
+ */
+static
+void gel_optimize_inline(GelOptimizer *self, GValue *value,
+                         const GelOptimizeKind *kinds)
+{
+    GelValueArray *array = gel_value_get_boxed(value);
+    const GValue *values = gel_value_array_get_values(array);
+    guint n_values = gel_value_array_get_n_values(array);
+
+    /* Names with a predefined value are looked up differently */
+    const gchar *name = gel_optimize_symbol_name(values + 0);
+    if(name == NULL || g_hash_table_lookup(self->bound, name) != NULL
+        || gel_variable_lookup_predefined(name) != NULL)
+        return;
+
+    GelVariable *variable = gel_context_lookup_variable(self->context, name);
+    const GValue *closure_value =
+        (variable != NULL) ? gel_variable_get_value(variable) : NULL;
+    if(closure_value == NULL || !GEL_VALUE_HOLDS(closure_value, G_TYPE_CLOSURE))
+        return;
+
+    GClosure *closure = gel_value_get_boxed(closure_value);
+    const GList *args = NULL;
+    GelValueArray *code = NULL;
+
+    if(!gel_closure_peek_code(closure, &args, &code)
+        || g_list_length((GList*)args) != n_values - 1)
+        return;
+
+    /* Arguments are evaluated as many times as they are used */
+    for(guint i = 1; i < n_values; i++)
+        if(kinds[i] == GEL_OPTIMIZE_CODE
+            && gel_optimize_symbol_name(values + i) == NULL)
+            return;
+
+    const GValue *code_values = gel_value_array_get_values(code);
+    guint code_n_values = gel_value_array_get_n_values(code);
+    guint size = 0;
+
+    if(code_n_values == 0)
+        return;
+    for(guint i = 0; i < code_n_values; i++)
+        if(!gel_optimize_can_inline(self, code_values + i, args, &size))
+            return;
+
+    GValue body = {0};
+    if(code_n_values == 1)
+        gel_optimize_substitute(code_values + 0, args, values + 1, &body);
+    else
+    {
+        GelValueArray *block = gel_value_array_new(code_n_values + 1);
+        gel_value_array_append(block, gel_value_lookup_predefined("do"));
+
+        for(guint i = 0; i < code_n_values; i++)
+        {
+            GValue tmp_value = {0};
+            gel_optimize_substitute(code_values + i, args, values + 1,
+                &tmp_value);
+            gel_value_array_take(block, &tmp_value);
+        }
+
+        g_value_init(&body, GEL_TYPE_VALUE_ARRAY);
+        gel_value_take_boxed(&body, block);
+    }
+
+    gel_optimize_fold(self, &body, TRUE);
+
+    GelOptimizeInline *inline_call = g_slice_new(GelOptimizeInline);
+    inline_call->name = g_strdup(name);
+    inline_call->variable = gel_variable_ref(variable);
+    inline_call->closure = g_closure_ref(closure);
+
+    GClosure *guard =
+        gel_closure_new_native("inline", (GClosureMarshal)inline_);
+    guard->data = inline_call;
+    g_closure_add_finalize_notifier(guard,
+        inline_call, (GClosureNotify)gel_optimize_inline_free);
+    g_closure_ref(guard);
+    g_closure_sink(guard);
+
+    GValue guard_value = {0};
+    g_value_init(&guard_value, G_TYPE_CLOSURE);
+    gel_value_take_boxed(&guard_value, guard);
+
+    /* The call is kept as it was, to be made if the name changes */
+    GValue call = *value;
+    memset(value, 0, sizeof(GValue));
+
+    GelValueArray *inlined = gel_value_array_new(3);
+    gel_value_array_take(inlined, &guard_value);
+    gel_value_array_take(inlined, &body);
+    gel_value_array_take(inlined, &call);
+
+    g_value_init(value, GEL_TYPE_VALUE_ARRAY);
+    gel_value_take_boxed(value, inlined);
+}
+
+
+static
+GelOptimizeKind gel_optimize_fold(GelOptimizer *self, GValue *value,
+                                  gboolean replace)
+{
+    if(gel_optimize_get_scalar(self, value) != NULL)
+        return GEL_OPTIMIZE_SCALAR;
+
+    if(!GEL_VALUE_HOLDS(value, GEL_TYPE_VALUE_ARRAY))
+        return GEL_OPTIMIZE_CODE;
+
+    GelValueArray *array = gel_value_get_boxed(value);
+    guint n_values = gel_value_array_get_n_values(array);
+    if(n_values == 0)
+        return GEL_OPTIMIZE_CODE;
+
+    GValue *values = gel_value_array_get_values(array);
+
+    /* Code the optimizer already went through */
+    if(GEL_VALUE_HOLDS(values + 0, G_TYPE_CLOSURE))
+    {
+        GClosure *closure = gel_value_get_boxed(values + 0);
+        if(gel_closure_is_native(closure, (GClosureMarshal)constant_))
+            return GEL_OPTIMIZE_CONTAINER;
+        if(gel_closure_is_native(closure, (GClosureMarshal)inline_)
+            || gel_closure_is_native(closure, (GClosureMarshal)case_)
+            || gel_closure_is_native(closure, (GClosureMarshal)cond_))
+            return GEL_OPTIMIZE_CODE;
+    }
+
+    const gchar *name = gel_optimize_closure_name(self, values + 0);
+
+    guint args = gel_optimize_args_index(values, n_values);
+    GelOptimizeKind *kinds = g_newa(GelOptimizeKind, n_values);
+    gboolean literals = TRUE;
+    kinds[0] = GEL_OPTIMIZE_CODE;
+
+    for(guint i = 1; i < n_values; i++)
+    {
+        kinds[i] = GEL_OPTIMIZE_CODE;
+
+        /* Arguments of the function, the rest is its code */
+        if(g_strcmp0(name, "function") == 0 && i <= args)
+            continue;
+
+        if(g_strcmp0(name, "let") == 0 && i == 1
+            && GEL_VALUE_HOLDS(values + i, GEL_TYPE_VALUE_ARRAY))
+        {
+            GelValueArray *bindings = gel_value_get_boxed(values + i);
+            GValue *bindings_values = gel_value_array_get_values(bindings);
+            guint bindings_n_values = gel_value_array_get_n_values(bindings);
+
+            for(guint j = 1; j < bindings_n_values; j += 2)
+                gel_optimize_fold(self, bindings_values + j, TRUE);
+            continue;
+        }
+
+        /* Tests of case are kept as they are written */
+        if(g_strcmp0(name, "case") == 0 && i >= 2 && i % 2 == 0
+            && i + 1 < n_values)
+            continue;
+
+        kinds[i] = gel_optimize_fold(self, values + i, TRUE);
+        if(kinds[i] == GEL_OPTIMIZE_CODE)
+            literals = FALSE;
+    }
+
+    if(!replace)
+        return GEL_OPTIMIZE_CODE;
+
+    if(name == NULL)
+    {
+        gel_optimize_inline(self, value, kinds);
+        return GEL_OPTIMIZE_CODE;
+    }
+
+    if(literals && (gel_optimize_get_flags(name) & GEL_OPTIMIZE_PURE))
+        return gel_optimize_eval(self, value, name);
+
+    gel_optimize_specialize(self, value, name);
+
+    if(strcmp(name, "if") == 0 && (n_values == 3 || n_values == 4))
+    {
+        const GValue *test = gel_optimize_get_scalar(self, values + 1);
+        guint branch = 0;
+
+        if(test != NULL)
+            branch = gel_value_to_boolean(test) ? 2 : 3;
+
+        if(branch != 0 && branch < n_values)
+        {
+            gel_optimize_replace(value, array, branch);
+            return kinds[branch];
+        }
+    }
+    else
+    if(strcmp(name, "cond") == 0 && n_values > 2)
+        return gel_optimize_cond(self, value);
+    else
+    if(strcmp(name, "case") == 0)
+        gel_optimize_dispatch(self, value, name);
+    else
+    if(strcmp(name, "while") == 0)
+        gel_optimize_unscope(self, value);
+
+    return GEL_OPTIMIZE_CODE;
+}
+
+
+/*
+ * Optimizes @code before it is evaluated in @context, changing it in place.
+ * The lists it is made of are replaced, @code itself is only changed inside.
+ */
+void gel_optimize_code(GelContext *context, GValue *code)
+{
+    g_return_if_fail(context != NULL);
+    g_return_if_fail(code != NULL);
+
+    GelOptimizer self = {context, NULL, NULL};
+    self.bound = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    self.types = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    gel_optimize_collect(&self, code);
+    gel_optimize_infer(&self, code);
+    gel_optimize_fold(&self, code, FALSE);
+
+    g_hash_table_unref(self.types);
+    g_hash_table_unref(self.bound);
+}
@@ -0,0 +1,10 @@
+#ifndef __GEL_OPTIMIZE_H__
+#define __GEL_OPTIMIZE_H__
+
+#include <glib-object.h>
+#include <gelcontext.h>
+
+void gel_optimize_code(GelContext *context, GValue *code);
+
+#endif
+
@@ -1,12 +1,25 @@
+#include <config.h>
+
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <gelparser.h>
-#include <gelsymbol.h>
 #include <gelvalue.h>
 #include <gelvalueprivate.h>
 #include <gelmacro.h>
+#include <gellexer.h>
+#include <gelast.h>
+#include <gelarrayprivate.h>
+
+#define GEL_PARSE_NO_NODE G_MAXUINT
 
-#define ARRAY_N_PREALLOCATED 8
+/* Arrays that can be nested, as they are parsed recursively */
+#ifndef GEL_PARSE_MAX_DEPTH
+#define GEL_PARSE_MAX_DEPTH 10000
+#endif
 
 
 /**
@@ -17,8 +30,25 @@
  *
  * Functions to convert input (plain text or files) into #GelValueArray.
  * The resulting #GelValueArray can be used to feed a #GelContext.
+ *
+ * A #GelParser reads its input in chunks and returns the top-level values
+ * one at a time, so they can be evaluated and released while the rest of
+ * the input is still unread.
+ *
+ * Parsed code is stored as compact nodes in an arena (see gelast.c),
+ * and the arrays returned are views of it until their values are needed.
  */
 
+struct _GelParser
+{
+    GelLexer *lexer;
+    GelMacros *macros;
+    GelAst *ast;
+    GArray *stack;
+    guint n_stack_read;
+    guint depth;
+};
+
 GQuark gel_parse_error_quark(void)
 {
     return g_quark_from_static_string("gel-parse-error");
@@ -37,11 +67,201 @@ const gchar *scanner_errors[] = {
 };
 
 
+/*
+ * Handles the tokens that are not values: closing delimiters, the end
+ * of the input and errors, for the array opened with @delim at @line
+ * and @pos (or the top level when @delim is 0).
+ * @parsing is set to %FALSE when the array is closed or the input ends.
+ */
 static
-GelValueArray* gel_parse_scanner(GScanner *scanner, guint line, guint pos,
-                               gchar delim, GError **error)
+gboolean gel_parse_end_token(GelLexer *lexer,
+                             guint line, guint pos, gchar delim,
+                             guint token, gboolean *parsing, GError **error)
 {
-    GelValueArray *array = gel_value_array_new(ARRAY_N_PREALLOCATED);
+    gboolean failed = FALSE;
+
+    switch(token)
+    {
+        case ')':
+        case ']':
+        case '}':
+            if((delim == '(' && token != ')') ||
+               (delim == '[' && token != ']') ||
+               (delim == '{' && token != '}'))
+            {
+                g_propagate_error(error, g_error_new(
+                    GEL_PARSE_ERROR, GEL_PARSE_ERROR_UNEXP_DELIM,
+                    "Cannot close '%c' at line %u, char %u "
+                    "with '%c' at line %u, char %u",
+                    delim, line, pos, token,
+                    lexer->next_line, lexer->next_position));
+                failed = TRUE;
+            }
+            else
+            if(delim == 0)
+            {
+                g_propagate_error(error, g_error_new(
+                    GEL_PARSE_ERROR, GEL_PARSE_ERROR_UNEXP_DELIM,
+                    "Unexpected '%c' at line %u, char %u",
+                    token, lexer->next_line, lexer->next_position));
+                failed = TRUE;
+            }
+            else
+            {
+                gel_lexer_get_next_token(lexer);
+                *parsing = FALSE;
+            }
+            break;
+        case G_TOKEN_EOF:
+            if(line != 0)
+            {
+                g_propagate_error(error, g_error_new(
+                    GEL_PARSE_ERROR, GEL_PARSE_ERROR_UNEXP_EOF_IN_ARRAY,
+                    "'%c' opened at line %u, char %u was not closed",
+                    delim, line, pos));
+                failed = TRUE;
+            }
+            *parsing = FALSE;
+            break;
+        case G_TOKEN_ERROR:
+            gel_lexer_get_next_token(lexer);
+            g_propagate_error(error, g_error_new(
+                GEL_PARSE_ERROR, lexer->value.v_error,
+                "%s at line %u, char %u",
+                scanner_errors[lexer->value.v_error],
+                lexer->line, lexer->position));
+            failed = TRUE;
+            break;
+        default:
+            g_propagate_error(error, g_error_new(
+                GEL_PARSE_ERROR, GEL_PARSE_ERROR_UNKNOWN_TOKEN,
+                "Unknown token '%c' (%d) at line %u, char %u",
+                token, token, lexer->next_line, lexer->next_position));
+            failed = TRUE;
+            break;
+    }
+
+    return !failed;
+}
+
+
+/*
+ * Checks that an array just opened, inside @depth others,
+ * does not nest them deeper than allowed.
+ */
+static
+gboolean gel_parse_check_depth(GelLexer *lexer, guint depth, GError **error)
+{
+    if(depth < GEL_PARSE_MAX_DEPTH)
+        return TRUE;
+
+    g_propagate_error(error, g_error_new(
+        GEL_PARSE_ERROR, GEL_PARSE_ERROR_TOO_DEEP,
+        "Arrays nested deeper than %u at line %u, char %u",
+        GEL_PARSE_MAX_DEPTH, lexer->line, lexer->position));
+    return FALSE;
+}
+
+
+static
+gboolean gel_parse_array(GelParser *self,
+                         guint line, guint pos, gchar delim,
+                         guint *node, GError **error);
+
+
+/*
+ * Reads the next value inside the array opened with @delim at @line
+ * and @pos (or at the top level when @delim is 0) into a new @node.
+ * @node is set to GEL_PARSE_NO_NODE when the array is closed or the
+ * input ends, and then @parsing is set to %FALSE.
+ */
+static
+gboolean gel_parse_token(GelParser *self,
+                         guint line, guint pos, gchar delim,
+                         guint *node, gboolean *parsing, GError **error)
+{
+    GelLexer *lexer = self->lexer;
+    gboolean failed = FALSE;
+    guint token = gel_lexer_peek_next_token(lexer);
+
+    *node = GEL_PARSE_NO_NODE;
+
+
+    switch(token)
+    {
+        case G_TOKEN_IDENTIFIER:
+            gel_lexer_get_next_token(lexer);
+            *node = gel_ast_append_symbol(self->ast,
+                lexer->value.v_identifier);
+            break;
+        case G_TOKEN_FLOAT:
+            gel_lexer_get_next_token(lexer);
+            *node = gel_ast_append_double(self->ast,
+                (gdouble)lexer->value.v_float);
+            break;
+        case G_TOKEN_INT:
+            gel_lexer_get_next_token(lexer);
+            *node = gel_ast_append_int64(self->ast,
+                (gint64)lexer->value.v_int64);
+            break;
+        case '(':
+        case '[':
+        case '{':
+            gel_lexer_get_next_token(lexer);
+            if(!gel_parse_check_depth(lexer, self->depth, error))
+                failed = TRUE;
+            else
+            {
+                self->depth++;
+                if(!gel_parse_array(self,
+                        lexer->line, lexer->position, token, node, error))
+                    failed = TRUE;
+                self->depth--;
+            }
+            break;
+        case G_TOKEN_STRING:
+            gel_lexer_get_next_token(lexer);
+            *node = gel_ast_append_string(self->ast, lexer->value.v_string);
+            break;
+        default:
+            failed = !gel_parse_end_token(lexer,
+                line, pos, delim, token, parsing, error);
+            break;
+    }
+
+    return !failed;
+}
+
+
+/*
+ * Pushes @node to the stack of the array being parsed,
+ * or the code it expands to when @node invokes or defines a macro.
+ */
+static
+gboolean gel_parse_append(GelParser *self, guint node, GError **error)
+{
+    GError *macro_error = NULL;
+    if(gel_macros_expand(self->macros,
+            self->ast, node, self->stack, &macro_error))
+        return TRUE;
+
+    if(macro_error != NULL)
+    {
+        g_propagate_error(error, macro_error);
+        return FALSE;
+    }
+
+    g_array_append_val(self->stack, node);
+    return TRUE;
+}
+
+
+static
+gboolean gel_parse_array(GelParser *self,
+                         guint line, guint pos, gchar delim,
+                         guint *node, GError **error)
+{
+    guint start = self->stack->len;
 
     const gchar *pre_symbol = NULL;
     switch(delim)
@@ -60,7 +280,10 @@ GelValueArray* gel_parse_scanner(GScanner *scanner, guint line, guint pos,
     {
         const GValue *pre_value = gel_value_lookup_predefined(pre_symbol);
         if(pre_value != NULL)
-            gel_value_array_append(array, pre_value);
+        {
+            guint pre_node = gel_ast_append_predefined(self->ast, pre_symbol);
+            g_array_append_val(self->stack, pre_node);
+        }
     }
 
     gboolean failed = FALSE;
@@ -68,175 +291,529 @@ GelValueArray* gel_parse_scanner(GScanner *scanner, guint line, guint pos,
 
     while(parsing && !failed)
     {
-        GValue value = {0};
-        const gchar *name = NULL;
-        guint token = g_scanner_peek_next_token(scanner);
+        guint inner_node = GEL_PARSE_NO_NODE;
+
+        if(!gel_parse_token(self,
+                line, pos, delim, &inner_node, &parsing, error))
+            failed = TRUE;
+        else
+        if(inner_node != GEL_PARSE_NO_NODE
+            && !gel_parse_append(self, inner_node, error))
+            failed = TRUE;
+    }
+
+    if(!failed)
+    {
+        *node = gel_ast_append_list(self->ast, self->stack->len - start,
+            &g_array_index(self->stack, guint, start));
+        if(line != 0)
+            gel_ast_add_span(self->ast, *node, line, pos);
+    }
+
+    g_array_set_size(self->stack, start);
+    return !failed;
+}
+
+
+/*
+ * Parses the whole input of @self into an array, whose node is
+ * stored in @root if it is not NULL.
+ */
+static
+GelValueArray* gel_parse_all(GelParser *self, guint *root, GError **error)
+{
+    guint node = GEL_PARSE_NO_NODE;
+    if(!gel_parse_array(self, 0, 0, 0, &node, error))
+        return NULL;
+
+    if(root != NULL)
+        *root = node;
+
+    return gel_value_array_new_ast(self->ast, node);
+}
+
+
+/*
+ * Gets where the parsed code of @file is cached, or NULL if caching
+ * is disabled. Files are named after the checksum of the absolute path
+ * of @file, in the directory set in GEL_CACHE_DIR or in a "gel"
+ * directory in the user cache directory. Setting GEL_CACHE_DIR to an
+ * empty string disables caching.
+ */
+static
+gchar* gel_parse_cache_file(const gchar *file)
+{
+    const gchar *cache_dir = g_getenv("GEL_CACHE_DIR");
+    if(cache_dir != NULL && *cache_dir == 0)
+        return NULL;
+
+    gchar *path = NULL;
+    if(g_path_is_absolute(file))
+        path = g_strdup(file);
+    else
+    {
+        gchar *current_dir = g_get_current_dir();
+        path = g_build_filename(current_dir, file, NULL);
+        g_free(current_dir);
+    }
+
+    gchar *checksum = g_compute_checksum_for_string(G_CHECKSUM_SHA1, path, -1);
+    gchar *name = g_strconcat(checksum, ".gelc", NULL);
+    gchar *cache_file = cache_dir != NULL
+        ? g_build_filename(cache_dir, name, NULL)
+        : g_build_filename(g_get_user_cache_dir(), "gel", name, NULL);
 
-        switch(token)
+    g_free(name);
+    g_free(checksum);
+    g_free(path);
+
+    return cache_file;
+}
+
+
+/*
+ * Gets what tells apart the versions of the file @file_stat describes,
+ * so the cache is not used after an edit that keeps its size, even
+ * if it happens within the same second it was cached.
+ */
+static
+void gel_parse_stamp(const struct stat *file_stat, GelAstStamp *stamp)
+{
+    stamp->size = file_stat->st_size;
+    stamp->inode = file_stat->st_ino;
+    stamp->device = file_stat->st_dev;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+    stamp->mtime = file_stat->st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000)
+        + file_stat->st_mtim.tv_nsec;
+    stamp->ctime = file_stat->st_ctim.tv_sec * G_GINT64_CONSTANT(1000000000)
+        + file_stat->st_ctim.tv_nsec;
+#else
+    stamp->mtime = file_stat->st_mtime * G_GINT64_CONSTANT(1000000000);
+    stamp->ctime = file_stat->st_ctime * G_GINT64_CONSTANT(1000000000);
+#endif
+}
+
+
+/**
+ * gel_parse_file:
+ * @file: path to a file
+ * @error: return location for a #GError, or NULL
+ *
+ * Reads the content of @file in chunks with a #GelParser,
+ * as #gel_parse_text would do with the whole content.
+ *
+ * The parsed code of regular files is cached, with macros already
+ * expanded, and the cache is mapped instead of parsing @file again
+ * until it changes, as told by its size, inode and times.
+ * The cache is kept in the directory set in the environment variable
+ * GEL_CACHE_DIR, or in the user cache directory if it is not set.
+ * Setting GEL_CACHE_DIR to an empty string disables the cache.
+ *
+ * Returns: A #GelValueArray with the parsed value literals
+ */
+GelValueArray* gel_parse_file(const gchar *file, GError **error)
+{
+    gint fd = open(file, O_RDONLY);
+    if(fd < 0)
+    {
+        gint saved_errno = errno;
+        gchar *display_name = g_filename_display_name(file);
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+            "Failed to open file '%s': %s",
+            display_name, g_strerror(saved_errno));
+        g_free(display_name);
+        return NULL;
+    }
+
+    struct stat file_stat;
+    GelAstStamp stamp = {0};
+    gchar *cache_file = NULL;
+
+    if(fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode))
+    {
+        gel_parse_stamp(&file_stat, &stamp);
+        cache_file = gel_parse_cache_file(file);
+    }
+
+    if(cache_file != NULL)
+    {
+        guint root = 0;
+        GelAst *ast = gel_ast_load(cache_file, &stamp, &root);
+
+        if(ast != NULL)
         {
-            case G_TOKEN_IDENTIFIER:
-                g_scanner_get_next_token(scanner);
-                name = scanner->value.v_identifier;
-                break;
-            case G_TOKEN_FLOAT:
-                g_scanner_get_next_token(scanner);
-                g_value_init(&value, G_TYPE_DOUBLE);
-                gel_value_set_double(&value, (gdouble)scanner->value.v_float);
-                break;
-            case G_TOKEN_INT:
-                g_scanner_get_next_token(scanner);
-                g_value_init(&value, G_TYPE_INT64);
-                gel_value_set_int64(&value, (gint64)scanner->value.v_int64);
-                break;
-            case '(':
-            case '[':
-            case '{':
+            gel_ast_set_file(ast, file);
+            GelValueArray *array = gel_value_array_new_ast(ast, root);
+            gel_ast_unref(ast);
+            g_free(cache_file);
+            close(fd);
+            return array;
+        }
+    }
+
+    GelParser *parser = gel_parser_new();
+    gel_parser_input_fd(parser, fd);
+    gel_ast_set_file(parser->ast, file);
+
+    guint root = 0;
+    GelValueArray *array = gel_parse_all(parser, &root, error);
+
+    /* The cache is only an optimization, failing to write it is fine */
+    if(array != NULL && cache_file != NULL)
+    {
+        gchar *cache_dir = g_path_get_dirname(cache_file);
+        if(g_mkdir_with_parents(cache_dir, 0700) == 0)
+            gel_ast_save(parser->ast, root, cache_file, &stamp, NULL);
+        g_free(cache_dir);
+    }
+
+    gel_parser_free(parser);
+    g_free(cache_file);
+    close(fd);
+
+    return array;
+}
+
+
+typedef struct _GelParseFilesTask GelParseFilesTask;
+
+struct _GelParseFilesTask
+{
+    const gchar *file;
+    GelValueArray *array;
+    GError *error;
+};
+
+
+static
+void gel_parse_files_task(GelParseFilesTask *task, gpointer user_data)
+{
+    task->array = gel_parse_file(task->file, &task->error);
+}
+
+
+/**
+ * gel_parse_files:
+ * @files: array of paths to files
+ * @n_files: number of paths in @files
+ * @n_threads: maximum number of threads to use, or 0 to use one per processor
+ * @error: return location for a #GError, or NULL
+ *
+ * Parses each of @files as #gel_parse_file would, spreading them
+ * among a pool of threads. Each file is read by a #GelParser of its own,
+ * so the macros defined in a file are not available to the others.
+ *
+ * Returns: A #GelValueArray with an array of parsed value literals
+ * for each file, in the same order as @files, or NULL if any of them
+ * failed, in which case @error is set to the error of the first one.
+ */
+GelValueArray* gel_parse_files(const gchar * const *files, guint n_files,
+                               guint n_threads, GError **error)
+{
+    g_return_val_if_fail(files != NULL || n_files == 0, NULL);
+
+    GelParseFilesTask *tasks = g_new0(GelParseFilesTask, MAX(n_files, 1));
+    for(guint i = 0; i < n_files; i++)
+        tasks[i].file = files[i];
+
+    if(n_threads == 0)
+        n_threads = g_get_num_processors();
+    n_threads = MAX(1, MIN(n_threads, n_files));
+
+    GThreadPool *pool = n_threads > 1
+        ? g_thread_pool_new((GFunc)gel_parse_files_task,
+            NULL, n_threads, TRUE, NULL)
+        : NULL;
+
+    for(guint i = 0; i < n_files; i++)
+        if(pool == NULL || !g_thread_pool_push(pool, tasks + i, NULL))
+            gel_parse_files_task(tasks + i, NULL);
+
+    /* Waits for every file to be parsed */
+    if(pool != NULL)
+        g_thread_pool_free(pool, FALSE, TRUE);
+
+    GelValueArray *arrays = gel_value_array_new(n_files);
+    GValue value = {0};
+    g_value_init(&value, GEL_TYPE_VALUE_ARRAY);
+
+    for(guint i = 0; i < n_files; i++)
+    {
+        if(tasks[i].error != NULL)
+        {
+            if(arrays != NULL)
             {
-                g_scanner_get_next_token(scanner);
-                GelValueArray *inner_array = gel_parse_scanner(scanner,
-                    scanner->line, scanner->position, token, error);
-                if(inner_array != NULL)
-                {
-                    g_value_init(&value, GEL_TYPE_VALUE_ARRAY);
-                    gel_value_take_boxed(&value, inner_array);
-                }
-                else
-                    failed = TRUE;
-                break;
+                g_propagate_error(error, tasks[i].error);
+                gel_value_array_free(arrays);
+                arrays = NULL;
             }
-            case ')':
-            case ']':
-            case '}':
-                if((delim == '(' && token != ')') ||
-                   (delim == '[' && token != ']') ||
-                   (delim == '{' && token != '}'))
-                {
-                    g_propagate_error(error, g_error_new(
-                        GEL_PARSE_ERROR, GEL_PARSE_ERROR_UNEXP_DELIM,
-                        "Cannot close '%c' at line %u, char %u "
-                        "with '%c' at line %u, char %u",
-                        delim, line, pos, token,
-                        scanner->next_line, scanner->next_position));
-                    failed = TRUE;
-                }
-                else
-                if(delim == 0)
-                {
-                    g_propagate_error(error, g_error_new(
-                        GEL_PARSE_ERROR, GEL_PARSE_ERROR_UNEXP_DELIM,
-                        "Unexpected '%c' at line %u, char %u",
-                        token, scanner->next_line, scanner->next_position));
-                    failed = TRUE;
-                }
-                else
-                {
-                    g_scanner_get_next_token(scanner);
-                    parsing = FALSE;
-                }
-                break;
-            case G_TOKEN_EOF:
-                if(line != 0)
-                {
-                    g_propagate_error(error, g_error_new(
-                        GEL_PARSE_ERROR, GEL_PARSE_ERROR_UNEXP_EOF_IN_ARRAY,
-                        "'%c' opened at line %u, char %u was not closed",
-                        delim, line, pos));
-                    failed = TRUE;
-                }
-                parsing = FALSE;
-                break;
-            case G_TOKEN_STRING:
-                g_scanner_get_next_token(scanner);
-                g_value_init(&value, G_TYPE_STRING);
-                g_value_set_string(&value, scanner->value.v_string);
-                break;
-            case G_TOKEN_ERROR:
-                g_scanner_get_next_token(scanner);
-                g_propagate_error(error, g_error_new(
-                    GEL_PARSE_ERROR, scanner->value.v_error,
-                    "%s at line %u, char %u",
-                    scanner_errors[scanner->value.v_error],
-                    scanner->line, scanner->position));
-                failed = TRUE;
-                break;
+            else
+                g_error_free(tasks[i].error);
+        }
+        else
+        if(arrays != NULL)
+        {
+            gel_value_take_boxed(&value, tasks[i].array);
+            gel_value_array_append(arrays, &value);
+            g_value_reset(&value);
+        }
+        else
+            gel_value_array_free(tasks[i].array);
+    }
+
+    g_value_unset(&value);
+    g_free(tasks);
+
+    return arrays;
+}
+
+
+/**
+ * gel_parse_text:
+ * @text: text to parse
+ * @text_len: length of the content to parse, or -1 if it is zero terminated.
+ * @error: return location for a #GError, or NULL
+ *
+ * Parses @text, operators are replaced with their
+ * corresponding functions (add for +, mul for *, etc). Characters [ ] are
+ * used to build array literals. Integers are considered #gint64 literals,
+ * strings are #gchararray literals and floats are #gdouble literals.
+ *
+ * #gel_context_eval_value considers array literals as closure's invokes.
+ *
+ * Returns: A #GelValueArray with the parsed value literals.
+ */
+GelValueArray* gel_parse_text(const gchar *text, guint text_len, GError **error)
+{
+    GelParser *parser = gel_parser_new();
+    gel_parser_input_text(parser,
+        text, text_len == (guint)-1 ? strlen(text) : text_len);
+
+    GelValueArray *array = gel_parse_all(parser, NULL, error);
+    gel_parser_free(parser);
+
+    return array;
+}
+
+
+static
+gboolean gel_parse_data_next(GelLexer *lexer,
+                             guint line, guint pos, gchar delim, guint depth,
+                             GValue *dest_value, gboolean *parsing,
+                             GError **error);
+
+
+/*
+ * Reads the values of the array opened with '[' at @line and @pos,
+ * inside @depth others, or of the whole input when @line is 0,
+ * into @array.
+ */
+static
+gboolean gel_parse_data_array(GelLexer *lexer,
+                              guint line, guint pos, guint depth,
+                              GelValueArray *array, GError **error)
+{
+    gchar delim = line != 0 ? '[' : 0;
+    gboolean parsing = TRUE;
+    GValue value = {0};
+
+    while(parsing)
+    {
+        /* Numbers are packed as they are read */
+        switch(gel_lexer_peek_next_token(lexer))
+        {
+            case G_TOKEN_INT:
+                gel_lexer_get_next_token(lexer);
+                gel_value_array_append_int64(array,
+                    (gint64)lexer->value.v_int64);
+                continue;
+            case G_TOKEN_FLOAT:
+                gel_lexer_get_next_token(lexer);
+                gel_value_array_append_double(array,
+                    (gdouble)lexer->value.v_float);
+                continue;
             default:
-                g_propagate_error(error, g_error_new(
-                    GEL_PARSE_ERROR, GEL_PARSE_ERROR_UNKNOWN_TOKEN,
-                    "Unknown token '%c' (%d) at line %u, char %u",
-                    token, token, scanner->next_line, scanner->next_position));
-                failed = TRUE;
                 break;
         }
 
-        if(name != NULL)
+        if(!gel_parse_data_next(lexer,
+                line, pos, delim, depth, &value, &parsing, error))
+            return FALSE;
+
+        if(parsing)
+            gel_value_array_take(array, &value);
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * Reads the keys and values of the hash opened with '{'
+ * at @line and @pos, inside @depth arrays, into @hash.
+ */
+static
+gboolean gel_parse_data_hash(GelLexer *lexer,
+                             guint line, guint pos, guint depth,
+                             GHashTable *hash, GError **error)
+{
+    gboolean parsing = TRUE;
+
+    while(parsing)
+    {
+        GValue *key = g_new0(GValue, 1);
+        gboolean parsed = gel_parse_data_next(lexer,
+            line, pos, '{', depth, key, &parsing, error);
+
+        if(!parsed || !parsing)
+        {
+            g_free(key);
+            return parsed;
+        }
+
+        GValue *value = g_new0(GValue, 1);
+        parsed = gel_parse_data_next(lexer,
+            line, pos, '{', depth, value, &parsing, error);
+
+        if(parsed && !parsing)
+        {
+            g_propagate_error(error, g_error_new(
+                GEL_PARSE_ERROR, GEL_PARSE_ERROR_NOT_DATA,
+                "'{' opened at line %u, char %u "
+                "has a key without a value", line, pos));
+            parsed = FALSE;
+        }
+
+        if(!parsed)
         {
-            gboolean is_number = FALSE;
-            guint len = strlen(name);
-            if(name[0] == '-' && len > 1)
+            gel_value_free(key);
+            g_free(value);
+            return FALSE;
+        }
+
+        g_hash_table_insert(hash, key, value);
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * Reads the next value inside the array or hash opened with @delim
+ * at @line and @pos (or at the top level when @delim is 0), which is
+ * nested inside @depth arrays, into @dest_value, which is left unset
+ * when the array is closed or the input ends, and then @parsing
+ * is set to %FALSE.
+ */
+static
+gboolean gel_parse_data_next(GelLexer *lexer,
+                             guint line, guint pos, gchar delim, guint depth,
+                             GValue *dest_value, gboolean *parsing,
+                             GError **error)
+{
+    guint token = gel_lexer_peek_next_token(lexer);
+    guint token_line = lexer->next_line;
+    guint token_pos = lexer->next_position;
+
+    switch(token)
+    {
+        case G_TOKEN_IDENTIFIER:
+        {
+            gel_lexer_get_next_token(lexer);
+            const GValue *value =
+                gel_value_lookup_predefined(lexer->value.v_identifier);
+
+            if(value == NULL || GEL_VALUE_HOLDS(value, G_TYPE_CLOSURE))
             {
-                GScanner *num_scanner = g_scanner_new(NULL);
-                num_scanner->config->store_int64 = TRUE;
-
-                g_scanner_input_text(num_scanner, name+1, len-1);
-                guint num_token = g_scanner_get_next_token(num_scanner);
-
-                if(g_scanner_peek_next_token(num_scanner) != G_TOKEN_EOF)
-                    num_token = G_TOKEN_EOF;
-
-                switch(num_token)
-                {
-                    case G_TOKEN_FLOAT:
-                        g_value_init(&value, G_TYPE_DOUBLE);
-                        gel_value_set_double(&value,
-                            -(gdouble)num_scanner->value.v_float);
-                        is_number = TRUE;
-                        break;
-                    case G_TOKEN_INT:
-                        g_value_init(&value, G_TYPE_INT64);
-                        gel_value_set_int64(&value,
-                            -(gint64)num_scanner->value.v_int64);
-                        is_number = TRUE;
-                        break;
-                    default:
-                        break;
-                }
-
-                g_scanner_destroy(num_scanner);
+                g_propagate_error(error, g_error_new(
+                    GEL_PARSE_ERROR, GEL_PARSE_ERROR_NOT_DATA,
+                    "Symbol '%s' at line %u, char %u is not a value",
+                    lexer->value.v_identifier, token_line, token_pos));
+                return FALSE;
             }
-            
-            if(!is_number)
+
+            gel_value_copy(value, dest_value);
+            return TRUE;
+        }
+        case G_TOKEN_FLOAT:
+            gel_lexer_get_next_token(lexer);
+            g_value_init(dest_value, G_TYPE_DOUBLE);
+            gel_value_set_double(dest_value, (gdouble)lexer->value.v_float);
+            return TRUE;
+        case G_TOKEN_INT:
+            gel_lexer_get_next_token(lexer);
+            g_value_init(dest_value, G_TYPE_INT64);
+            gel_value_set_int64(dest_value, (gint64)lexer->value.v_int64);
+            return TRUE;
+        case G_TOKEN_STRING:
+            gel_lexer_get_next_token(lexer);
+            g_value_init(dest_value, GEL_TYPE_STRING);
+            gel_value_take_boxed(dest_value,
+                gel_string_new(lexer->value.v_string));
+            return TRUE;
+        case '[':
+        {
+            gel_lexer_get_next_token(lexer);
+            if(!gel_parse_check_depth(lexer, depth, error))
+                return FALSE;
+
+            GelValueArray *array = gel_value_array_new(0);
+
+            if(!gel_parse_data_array(lexer,
+                    lexer->line, lexer->position, depth + 1, array, error))
             {
-                GelVariable *variable = gel_variable_lookup_predefined(name);
-                GelSymbol *symbol = gel_symbol_new(name, variable);
-                g_value_init(&value, GEL_TYPE_SYMBOL);
-                gel_value_take_boxed(&value, symbol);
+                gel_value_array_free(array);
+                return FALSE;
             }
+
+            g_value_init(dest_value, GEL_TYPE_VALUE_ARRAY);
+            gel_value_take_boxed(dest_value, array);
+            return TRUE;
         }
-    
-        if(G_IS_VALUE(&value))
+        case '{':
         {
-            GelValueArray *code = gel_macro_code_from_value(&value, error);
-            if(code != NULL)
-            {
-                GValue *code_values = gel_value_array_get_values(code);
-                guint code_n_values = gel_value_array_get_n_values(code);
+            gel_lexer_get_next_token(lexer);
+            if(!gel_parse_check_depth(lexer, depth, error))
+                return FALSE;
 
-                for(guint i = 0; i < code_n_values; i++)
-                    gel_value_array_append(array, code_values + i);
+            GHashTable *hash = gel_hash_table_new();
 
-                gel_value_array_free(code);
+            if(!gel_parse_data_hash(lexer,
+                    lexer->line, lexer->position, depth + 1, hash, error))
+            {
+                g_hash_table_unref(hash);
+                return FALSE;
             }
-            else
-                gel_value_array_append(array, &value);
 
-            g_value_unset(&value);
+            g_value_init(dest_value, G_TYPE_HASH_TABLE);
+            gel_value_take_boxed(dest_value, hash);
+            return TRUE;
         }
+        case '(':
+            gel_lexer_get_next_token(lexer);
+            g_propagate_error(error, g_error_new(
+                GEL_PARSE_ERROR, GEL_PARSE_ERROR_NOT_DATA,
+                "Code at line %u, char %u is not a value",
+                token_line, token_pos));
+            return FALSE;
+        default:
+            return gel_parse_end_token(lexer,
+                line, pos, delim, token, parsing, error);
     }
+}
 
-    if(failed)
+
+/*
+ * Reads the whole input of @lexer as data.
+ */
+static
+GelValueArray* gel_parse_data_all(GelLexer *lexer, GError **error)
+{
+    GelValueArray *array = gel_value_array_new(0);
+    if(!gel_parse_data_array(lexer, 0, 0, 0, array, error))
     {
         gel_value_array_free(array);
-        array = NULL;
+        return NULL;
     }
 
     return array;
@@ -244,65 +821,209 @@ GelValueArray* gel_parse_scanner(GScanner *scanner, guint line, guint pos,
 
 
 /**
- * gel_parse_file:
- * @file: path to a file
+ * gel_parse_data_text:
+ * @text: text to parse
+ * @text_len: length of the content to parse, or -1 if it is zero terminated.
  * @error: return location for a #GError, or NULL
  *
- * Reads the content of @file and then pass the content to #gel_parse_string
+ * Parses @text as data: its values must be literals, built without
+ * evaluating any code. Characters [ ] build arrays, with their numbers
+ * packed when they all have the same type, characters { } build hashes
+ * from pairs of keys and values, and the symbols TRUE, FALSE and NULL
+ * are replaced with their values. Other symbols, code between ( ) and
+ * macros are reported as #GEL_PARSE_ERROR_NOT_DATA.
  *
- * Returns: A #GelValueArray with the parsed value literals
+ * Returns: A #GelValueArray with the values of @text.
  */
-GelValueArray* gel_parse_file(const gchar *file, GError **error)
+GelValueArray* gel_parse_data_text(const gchar *text, guint text_len,
+                                   GError **error)
 {
-    gchar *content = NULL;
-    gsize content_len = 0;
-    GelValueArray *array = NULL;
+    g_return_val_if_fail(text != NULL, NULL);
+
+    GelLexer *lexer = gel_lexer_new();
+    gel_lexer_input_text(lexer,
+        text, text_len == (guint)-1 ? strlen(text) : text_len);
+
+    GelValueArray *array = gel_parse_data_all(lexer, error);
+    gel_lexer_free(lexer);
+
+    return array;
+}
+
 
-    if(g_file_get_contents(file, &content, &content_len, error))
+/**
+ * gel_parse_data_file:
+ * @file: path to a file
+ * @error: return location for a #GError, or NULL
+ *
+ * Reads the content of @file in chunks as data,
+ * as #gel_parse_data_text would do with the whole content.
+ *
+ * Returns: A #GelValueArray with the values of @file.
+ */
+GelValueArray* gel_parse_data_file(const gchar *file, GError **error)
+{
+    gint fd = open(file, O_RDONLY);
+    if(fd < 0)
     {
-        array = gel_parse_text(content, content_len, error);
-        g_free(content);
+        gint saved_errno = errno;
+        gchar *display_name = g_filename_display_name(file);
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+            "Failed to open file '%s': %s",
+            display_name, g_strerror(saved_errno));
+        g_free(display_name);
+        return NULL;
     }
 
+    GelLexer *lexer = gel_lexer_new();
+    gel_lexer_input_fd(lexer, fd);
+
+    GelValueArray *array = gel_parse_data_all(lexer, error);
+    gel_lexer_free(lexer);
+    close(fd);
+
     return array;
 }
 
 
 /**
- * gel_parse_text:
- * @text: text to parse
- * @text_len: length of the content to parse, or -1 if it is zero terminated.
- * @error: return location for a #GError, or NULL
+ * gel_parser_new:
  *
- * Uses a #GScanner to parse @content, operators are replaced with their
- * corresponding functions (add for +, mul for *, etc). Characters [ ] are
- * used to build array literals. Integers are considered #gint64 literals,
- * strings are #gchararray literals and floats are #gdouble literals.
+ * Creates a #GelParser, which needs an input before it can be used.
+ * See #gel_parser_input_fd and #gel_parser_input_text.
  *
- * #gel_context_eval_value considers array literals as closure's invokes.
+ * Returns: A new #GelParser
+ */
+GelParser* gel_parser_new(void)
+{
+    GelParser *self = g_slice_new0(GelParser);
+    self->lexer = gel_lexer_new();
+    self->macros = gel_macros_new();
+    self->ast = gel_ast_new();
+    self->stack = g_array_new(FALSE, FALSE, sizeof(guint));
+
+    return self;
+}
+
+
+/**
+ * gel_parser_free:
+ * @self: a #GelParser
  *
- * Returns: A #GelValueArray with the parsed value literals.
+ * Releases @self and its reference to the macros defined in its input.
+ * File descriptors given to #gel_parser_input_fd are not closed.
  */
-GelValueArray* gel_parse_text(const gchar *text, guint text_len, GError **error)
+void gel_parser_free(GelParser *self)
 {
-    gel_macros_new();
-    GScanner *scanner = g_scanner_new(NULL);
-    GScannerConfig *config = scanner->config;
+    g_return_if_fail(self != NULL);
 
-    config->cset_identifier_first =
-        G_CSET_a_2_z G_CSET_A_2_Z "=_+-*/%!&<>.";
-    config->cset_identifier_nth =
-        G_CSET_a_2_z G_CSET_A_2_Z "=_+-*/%!&<>.?" G_CSET_DIGITS;
-    config->cpair_comment_single = "#\n";
-    config->scan_identifier_1char = TRUE;
-    config->store_int64 = TRUE;
+    gel_lexer_free(self->lexer);
+    gel_macros_unref(self->macros);
+    gel_ast_unref(self->ast);
+    g_array_free(self->stack, TRUE);
+    g_slice_free(GelParser, self);
+}
 
-    g_scanner_input_text(scanner, text, text_len);
-    GelValueArray *array = gel_parse_scanner(scanner, 0, 0, 0, error);
 
-    g_scanner_destroy(scanner);
-    gel_macros_free();
+/**
+ * gel_parser_input_fd:
+ * @self: a #GelParser
+ * @fd: a file descriptor open for reading
+ *
+ * Sets @fd as the input of @self. The content is read in chunks,
+ * as #gel_parser_next needs it.
+ */
+void gel_parser_input_fd(GelParser *self, gint fd)
+{
+    g_return_if_fail(self != NULL);
+    g_return_if_fail(fd >= 0);
 
-    return array;
+    gel_lexer_input_fd(self->lexer, fd);
+}
+
+
+/**
+ * gel_parser_set_macros:
+ * @self: a #GelParser
+ * @macros: a #GelMacros
+ *
+ * Makes @self expand the macros in @macros, and define there
+ * the macros found in its input, instead of in a set of its own.
+ * Sharing @macros between parsers makes the macros defined
+ * in the input of one of them available to the others.
+ */
+void gel_parser_set_macros(GelParser *self, GelMacros *macros)
+{
+    g_return_if_fail(self != NULL);
+    g_return_if_fail(macros != NULL);
+
+    gel_macros_ref(macros);
+    gel_macros_unref(self->macros);
+    self->macros = macros;
+}
+
+
+/**
+ * gel_parser_input_text:
+ * @self: a #GelParser
+ * @text: text to parse, which must be valid while @self reads it
+ * @text_len: length of @text
+ *
+ * Sets @text as the input of @self.
+ */
+void gel_parser_input_text(GelParser *self, const gchar *text, guint text_len)
+{
+    g_return_if_fail(self != NULL);
+    g_return_if_fail(text != NULL);
+
+    gel_lexer_input_text(self->lexer, text, text_len);
 }
 
+
+/**
+ * gel_parser_next:
+ * @self: a #GelParser
+ * @dest_value: an uninitialized #GValue to store the next value
+ * @error: return location for a #GError, or NULL
+ *
+ * Reads the input of @self until it gets a complete top-level value,
+ * expanding the macros found on the way.
+ *
+ * Returns: %TRUE if @dest_value was set, %FALSE at the end of the input
+ * or if an error occurred.
+ */
+gboolean gel_parser_next(GelParser *self, GValue *dest_value, GError **error)
+{
+    g_return_val_if_fail(self != NULL, FALSE);
+    g_return_val_if_fail(dest_value != NULL, FALSE);
+
+    while(TRUE)
+    {
+        /* A top-level macro may have expanded to several values */
+        if(self->n_stack_read < self->stack->len)
+        {
+            gel_ast_get_value(self->ast,
+                g_array_index(self->stack, guint, self->n_stack_read++),
+                dest_value);
+            return TRUE;
+        }
+
+        g_array_set_size(self->stack, 0);
+        self->n_stack_read = 0;
+
+        /* Nodes of values already released can be dropped */
+        gel_ast_recycle(self->ast);
+
+        guint node = GEL_PARSE_NO_NODE;
+        gboolean parsing = TRUE;
+
+        if(!gel_parse_token(self, 0, 0, 0, &node, &parsing, error))
+            return FALSE;
+
+        if(!parsing)
+            return FALSE;
+
+        if(node != GEL_PARSE_NO_NODE && !gel_parse_append(self, node, error))
+            return FALSE;
+    }
+}
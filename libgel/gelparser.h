@@ -33,6 +33,8 @@ GQuark gel_parse_error_quark(void);
  * @GEL_PARSE_ERROR_UNKNOWN_TOKEN: unknown token
  * @GEL_PARSE_ERROR_MACRO_MALFORMED: malformed macro
  * @GEL_PARSE_ERROR_MACRO_ARGUMENTS: wrong arguments for macro
+ * @GEL_PARSE_ERROR_NOT_DATA: code or symbols found while parsing data
+ * @GEL_PARSE_ERROR_TOO_DEEP: arrays nested too deep
  *
  * Error codes reported by #gel_parse_text and #gel_parse_file
  */
@@ -51,11 +53,46 @@ typedef enum _GelParseError
     GEL_PARSE_ERROR_UNEXP_EOF_IN_ARRAY,
     GEL_PARSE_ERROR_UNKNOWN_TOKEN,
     GEL_PARSE_ERROR_MACRO_MALFORMED,
-    GEL_PARSE_ERROR_MACRO_ARGUMENTS
+    GEL_PARSE_ERROR_MACRO_ARGUMENTS,
+    GEL_PARSE_ERROR_NOT_DATA,
+    GEL_PARSE_ERROR_TOO_DEEP
 } GelParseError;
 
 GelValueArray* gel_parse_file(const gchar *file, GError **error);
+GelValueArray* gel_parse_files(const gchar * const *files, guint n_files,
+                               guint n_threads, GError **error);
 GelValueArray* gel_parse_text(const gchar *text, guint text_len, GError **error);
+GelValueArray* gel_parse_data_file(const gchar *file, GError **error);
+GelValueArray* gel_parse_data_text(const gchar *text, guint text_len,
+                                   GError **error);
+
+/**
+ * GelParser:
+ *
+ * Reads its input incrementally and returns one top-level value at a time.
+ */
+
+typedef struct _GelParser GelParser;
+
+/**
+ * GelMacros:
+ *
+ * A set of macros. Each #GelParser defines the macros it reads
+ * in its own set, unless it is given one with #gel_parser_set_macros.
+ */
+
+typedef struct _GelMacros GelMacros;
+
+GelMacros* gel_macros_new(void);
+GelMacros* gel_macros_ref(GelMacros *self);
+void gel_macros_unref(GelMacros *self);
+
+GelParser* gel_parser_new(void);
+void gel_parser_free(GelParser *self);
+void gel_parser_set_macros(GelParser *self, GelMacros *macros);
+void gel_parser_input_fd(GelParser *self, gint fd);
+void gel_parser_input_text(GelParser *self, const gchar *text, guint text_len);
+gboolean gel_parser_next(GelParser *self, GValue *dest_value, GError **error);
 
 #endif
 
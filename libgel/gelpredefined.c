@@ -5,7 +5,11 @@
 #include <gelerrors.h>
 #include <gelvalue.h>
 #include <gelvalueprivate.h>
+#include <gelarrayprivate.h>
+#include <gelkernels.h>
 #include <gelsymbol.h>
+#include <gelrecord.h>
+#include <gelndarray.h>
 #include <gelclosure.h>
 #include <gelclosureprivate.h>
 
@@ -37,7 +41,7 @@ void symbol_set(GValue *return_value,
         if(dest_value == NULL)
         {
             const gchar *name = gel_symbol_get_name(symbol);
-            dest_value = gel_context_lookup(context, name);
+            dest_value = gel_context_lookup_value(context, name);
         }
     }
     else
@@ -102,7 +106,7 @@ void array_set(GelValueArray *array, GValue *return_value,
             gel_error_index_out_of_bounds(context, __FUNCTION__, index);
             return;
         }
-        gel_value_copy(value, gel_value_array_get_values(array) + index);
+        gel_value_array_set_value(array, index, value);
     }
 
     gel_value_list_free(tmp_list);
@@ -125,6 +129,41 @@ void hash_set(GHashTable *hash, GValue *return_value,
 }
 
 
+static
+void record_set(GelRecord *record, GValue *return_value,
+                guint n_values, const GValue *values, GelContext *context)
+{
+    GList *tmp_list = NULL;
+    const GValue *site = values;
+    GValue *name = NULL;
+    GValue *value = NULL;
+
+    if(gel_context_eval_params(context, __FUNCTION__,
+            &n_values, &values, &tmp_list, "VV", &name, &value))
+    {
+        if(!GEL_VALUE_HOLDS_STRING(name))
+            gel_error_value_not_of_type(context,
+                __FUNCTION__, name, G_TYPE_STRING);
+        else
+        {
+            GValue *field_value =
+                gel_record_lookup_cached(record, site, name);
+
+            if(field_value != NULL)
+            {
+                g_value_unset(field_value);
+                gel_value_copy(value, field_value);
+            }
+            else
+                gel_record_insert(record,
+                    gel_value_get_string(name), value);
+        }
+    }
+
+    gel_value_list_free(tmp_list);
+}
+
+
 static
 void object_set(GObject *object, GValue *return_value,
                 guint n_values, const GValue *values, GelContext *context)
@@ -161,6 +200,71 @@ void object_set(GObject *object, GValue *return_value,
 }
 
 
+/*
+ * Evaluates one index for each dimension of @ndarray into @index,
+ * counting negative indices from the end of their dimension.
+ */
+static
+gboolean ndarray_index(GelNdarray *ndarray, gsize *index,
+                       guint *n_values, const GValue **values,
+                       GList **tmp_list, GelContext *context, const gchar *f)
+{
+    const guint n_dims = gel_ndarray_get_n_dims(ndarray);
+    const gsize *shape = gel_ndarray_get_shape(ndarray);
+
+    for(guint d = 0; d < n_dims; d++)
+    {
+        gint64 i = 0;
+        if(!gel_context_eval_params(context, f,
+                n_values, values, tmp_list, "I*", &i))
+            return FALSE;
+
+        if(i < 0)
+            i += shape[d];
+        if(i < 0 || i >= shape[d])
+        {
+            gel_error_index_out_of_bounds(context, f, i);
+            return FALSE;
+        }
+        index[d] = i;
+    }
+
+    return TRUE;
+}
+
+
+static
+void ndarray_set(GelNdarray *ndarray, GValue *return_value,
+                 guint n_values, const GValue *values, GelContext *context)
+{
+    guint n_args = gel_ndarray_get_n_dims(ndarray) + 1;
+    if(n_values != n_args)
+    {
+        gel_error_needs_n_arguments(context, __FUNCTION__, n_args);
+        return;
+    }
+
+    GList *tmp_list = NULL;
+    gsize index[GEL_NDARRAY_MAX_DIMS];
+    GValue *value = NULL;
+
+    if(ndarray_index(ndarray, index,
+            &n_values, &values, &tmp_list, context, __FUNCTION__)
+        && gel_context_eval_params(context, __FUNCTION__,
+            &n_values, &values, &tmp_list, "V", &value))
+    {
+        if(GEL_VALUE_HOLDS(value, G_TYPE_INT64)
+            || GEL_VALUE_HOLDS(value, G_TYPE_DOUBLE))
+            gel_ndarray_set_value(ndarray, index, value);
+        else
+            gel_error_value_not_of_type(context,
+                __FUNCTION__, value, G_TYPE_DOUBLE);
+    }
+
+    gel_value_list_free(tmp_list);
+}
+
+
 static
 void array_get(GelValueArray *array, GValue *return_value,
                guint n_values, const GValue *values, GelContext *context)
@@ -181,7 +285,7 @@ void array_get(GelValueArray *array, GValue *return_value,
             return;
         }
 
-        gel_value_copy(gel_value_array_get_values(array) + index, return_value);
+        gel_value_array_get_value(array, index, return_value);
     }
 
     gel_value_list_free(tmp_list);
@@ -209,6 +313,34 @@ void hash_get(GHashTable *hash, GValue *return_value,
 }
 
 
+static
+void record_get(GelRecord *record, GValue *return_value,
+                guint n_values, const GValue *values, GelContext *context)
+{
+    GList *tmp_list = NULL;
+    const GValue *site = values;
+    GValue *name = NULL;
+
+    if(gel_context_eval_params(context, __FUNCTION__,
+            &n_values, &values, &tmp_list, "V", &name))
+    {
+        const GValue *value = NULL;
+
+        if(!GEL_VALUE_HOLDS_STRING(name))
+            gel_error_value_not_of_type(context,
+                __FUNCTION__, name, G_TYPE_STRING);
+        else
+        if((value = gel_record_lookup_cached(record, site, name)) != NULL)
+            gel_value_copy(value, return_value);
+        else
+            gel_error_no_such_field(context,
+                __FUNCTION__, gel_value_get_string(name));
+    }
+
+    gel_value_list_free(tmp_list);
+}
+
+
 static
 void object_get(GObject *object, GValue *return_value,
                 guint n_values, const GValue *values, GelContext *context)
@@ -236,6 +368,28 @@ void object_get(GObject *object, GValue *return_value,
 }
 
 
+static
+void ndarray_get(GelNdarray *ndarray, GValue *return_value,
+                 guint n_values, const GValue *values, GelContext *context)
+{
+    guint n_args = gel_ndarray_get_n_dims(ndarray);
+    if(n_values != n_args)
+    {
+        gel_error_needs_n_arguments(context, __FUNCTION__, n_args);
+        return;
+    }
+
+    GList *tmp_list = NULL;
+    gsize index[GEL_NDARRAY_MAX_DIMS];
+
+    if(ndarray_index(ndarray, index,
+            &n_values, &values, &tmp_list, context, __FUNCTION__))
+        gel_ndarray_get_value(ndarray, index, return_value);
+
+    gel_value_list_free(tmp_list);
+}
+
+
 static
 void array_append(GelValueArray *array, GValue *return_value,
                   guint n_values, const GValue *values, GelContext *context)
@@ -288,6 +442,31 @@ void hash_append(GHashTable *hash, GValue *return_value,
 }
 
 
+static
+void record_append(GelRecord *record, GValue *return_value,
+                   guint n_values, const GValue *values, GelContext *context)
+{
+    GList *tmp_list = NULL;
+
+    if(n_values % 2 == 0)
+        while(n_values > 0)
+        {
+            const gchar *name = NULL;
+            GValue *value = NULL;
+
+            if(gel_context_eval_params(context, __FUNCTION__,
+                    &n_values, &values, &tmp_list, "SV*", &name, &value))
+                gel_record_insert(record, name, value);
+            else
+                break;
+        }
+    else
+        gel_error_expected(context, __FUNCTION__, "an even number of values");
+
+    gel_value_list_free(tmp_list);
+}
+
+
 static
 void array_remove(GelValueArray *array, GValue *return_value,
                   guint n_values, const GValue *values, GelContext *context)
@@ -307,7 +486,7 @@ void array_remove(GelValueArray *array, GValue *return_value,
             return;
         }
 
-        gel_value_copy(gel_value_array_get_values(array) + index, return_value);
+        gel_value_array_get_value(array, index, return_value);
         gel_value_array_remove(array, index);
     }
 
@@ -364,23 +543,44 @@ void hash_size(GHashTable *hash, GValue *return_value,
 }
 
 
+static
+void record_size(GelRecord *record, GValue *return_value,
+                 guint n_values, const GValue *values, GelContext *context)
+{
+    g_value_init(return_value, G_TYPE_INT64);
+    gel_value_set_int64(return_value, gel_record_get_n_fields(record));
+}
+
+
+static
+void ndarray_size(GelNdarray *ndarray, GValue *return_value,
+                  guint n_values, const GValue *values, GelContext *context)
+{
+    g_value_init(return_value, G_TYPE_INT64);
+    gel_value_set_int64(return_value, gel_ndarray_get_size(ndarray));
+}
+
+
 static
 void array_find(GClosure *closure, GelValueArray *array, GValue *return_value,
                 guint n_values, const GValue *values, GelContext *context)
 {
     GList *tmp_list = NULL;
 
-    const GValue *array_values = gel_value_array_get_values(array);
     guint array_n_values = gel_value_array_get_n_values(array);
     gint64 result = -1;
 
     for(guint i = 0; i < array_n_values && result == -1; i++)
     {
+        GValue iter_value = {0};
         GValue value = {0};
-        g_closure_invoke(closure, &value, 1, array_values + i, context);
+        gel_value_array_get_value(array, i, &iter_value);
+        gel_closure_invoke(closure, &value, 1, &iter_value, context);
         if(gel_value_to_boolean(&value))
             result = i;
         g_value_unset(&value);
+        if(GEL_IS_VALUE(&iter_value))
+            g_value_unset(&iter_value);
     }
 
     g_value_init(return_value, G_TYPE_INT64);
@@ -406,7 +606,7 @@ void hash_find(GClosure *closure, GHashTable *hash, GValue *return_value,
     while(g_hash_table_iter_next(&iter, (void**)&k, (void**)&v) && running)
     {
         GValue value = {0};
-        g_closure_invoke(closure, &value, 1, v, context);
+        gel_closure_invoke(closure, &value, 1, v, context);
         if(gel_value_to_boolean(&value))
         {
             gel_value_copy(k, return_value);
@@ -426,17 +626,20 @@ void array_filter(GClosure *closure, GelValueArray *array, GValue *return_value,
     GList *tmp_list = NULL;
 
     guint array_n_values = gel_value_array_get_n_values(array);
-    GValue *array_values = gel_value_array_get_values(array);
     GelValueArray *result_array = gel_value_array_new(array_n_values);
 
     for(guint i = 0; i < array_n_values; i++)
     {
+        GValue iter_value = {0};
         GValue tmp_value = {0};
-        g_closure_invoke(closure,
-            &tmp_value, 1, array_values + i, context);
+        gel_value_array_get_value(array, i, &iter_value);
+        gel_closure_invoke(closure,
+            &tmp_value, 1, &iter_value, context);
         if(gel_value_to_boolean(&tmp_value))
-            gel_value_array_append(result_array, array_values + i);
+            gel_value_array_append(result_array, &iter_value);
         g_value_unset(&tmp_value);
+        if(GEL_IS_VALUE(&iter_value))
+            g_value_unset(&iter_value);
     }
 
     g_value_init(return_value, GEL_TYPE_VALUE_ARRAY);
@@ -462,7 +665,7 @@ void hash_filter(GClosure *closure, GHashTable *hash, GValue *return_value,
     while(g_hash_table_iter_next(&iter, (void**)&k, (void**)&v))
     {
         GValue value = {0};
-        g_closure_invoke(closure, &value, 1, v, context);
+        gel_closure_invoke(closure, &value, 1, v, context);
         if(gel_value_to_boolean(&value))
             g_hash_table_insert(result_hash,
                 gel_value_dup(k), gel_value_dup(v));
@@ -694,8 +897,8 @@ void name_(GClosure *self, GValue *return_value,
     {
         const GelSymbol *symbol = gel_value_get_boxed(values + 0);
         const gchar *name = gel_symbol_get_name(symbol);
-        g_value_init(return_value, G_TYPE_STRING);
-        g_value_set_string(return_value, name);
+        g_value_init(return_value, GEL_TYPE_STRING);
+        gel_value_take_boxed(return_value, gel_string_new(name));
     }
     else
         gel_error_expected(context, __FUNCTION__, "symbol");
@@ -712,11 +915,21 @@ void apply_(GClosure *self, GValue *return_value,
 
     if(gel_context_eval_params(context, __FUNCTION__,
             &n_values, &values, &tmp_list, "CA", &closure, &array))
-        g_closure_invoke(closure, return_value,
+    {
+        /* Packed arrays are applied through a copy so they stay packed */
+        GelValueArray *args =
+            gel_value_array_get_storage(array) != GEL_ARRAY_STORAGE_GENERIC
+            ? gel_value_array_copy(array) : NULL;
+
+        gel_closure_invoke(closure, return_value,
             gel_value_array_get_n_values(array),
-            gel_value_array_get_values(array),
+            gel_value_array_get_values(args != NULL ? args : array),
             context);
 
+        if(args != NULL)
+            gel_value_array_free(args);
+    }
+
     gel_value_list_free(tmp_list);
 }
 
@@ -752,20 +965,16 @@ void map_(GClosure *self, GValue *return_value,
         if(i_array == n_arrays)
         {
             GelValueArray *result_array = gel_value_array_new(result_n_values);
+            GValue *args = g_new0(GValue, n_arrays);
 
             for(guint iv = 0; iv < result_n_values; iv++)
             {
-                GelValueArray *array = gel_value_array_new(n_arrays);
                 for(guint ia = 0; ia < n_arrays; ia++)
-                    gel_value_array_append(array,
-                        gel_value_array_get_values(arrays[ia]) + iv);
-                    
+                    gel_value_array_get_value(arrays[ia], iv, args + ia);
 
                 GValue tmp_value = {0};
-                g_closure_invoke(closure, &tmp_value,
-                    gel_value_array_get_n_values(array),
-                    gel_value_array_get_values(array),
-                    context);
+                gel_closure_invoke(closure, &tmp_value,
+                    n_arrays, args, context);
 
                 if(GEL_IS_VALUE(&tmp_value))
                 {
@@ -773,9 +982,13 @@ void map_(GClosure *self, GValue *return_value,
                     g_value_unset(&tmp_value);
                 }
 
-                gel_value_array_free(array);
+                for(guint ia = 0; ia < n_arrays; ia++)
+                    if(GEL_IS_VALUE(args + ia))
+                        g_value_unset(args + ia);
             }
 
+            g_free(args);
+
             g_value_init(return_value, GEL_TYPE_VALUE_ARRAY);
             gel_value_take_boxed(return_value, result_array);
         }
@@ -846,6 +1059,24 @@ void hash_(GClosure *self, GValue *return_value,
 }
 
 
+static
+void record_(GClosure *self, GValue *return_value,
+             guint n_values, const GValue *values, GelContext *context)
+{
+    GelRecord *record = gel_record_new();
+
+    record_append(record, return_value, n_values, values, context);
+
+    if(!gel_context_error(context))
+    {
+        g_value_init(return_value, GEL_TYPE_RECORD);
+        gel_value_take_boxed(return_value, record);
+    }
+    else
+        gel_record_unref(record);
+}
+
+
 static
 void var_(GClosure *self, GValue *return_value,
           guint n_values, const GValue *values, GelContext *context)
@@ -860,17 +1091,18 @@ void var_(GClosure *self, GValue *return_value,
     if(GEL_VALUE_HOLDS(values, GEL_TYPE_SYMBOL))
     {
         GelSymbol *symbol = gel_value_get_boxed(values);
+        const gchar *name = gel_symbol_get_name(symbol);
         GelVariable *variable = gel_symbol_get_variable(symbol);
+        if(variable == NULL)
+            variable = gel_context_lookup_variable(context, name);
+
         if(variable != NULL)
         {
             g_value_init(return_value, GEL_TYPE_VARIABLE);
             g_value_set_boxed(return_value, variable);
         }
         else
-        {
-            const gchar *name = gel_symbol_get_name(symbol);
             gel_error_unknown_symbol(context, __FUNCTION__, name);
-        }
     }
     else
         gel_error_value_not_of_type(context,
@@ -915,6 +1147,18 @@ void set_(GClosure *self, GValue *return_value,
             hash_set(hash, return_value, n_values, values, context);
         }
         else
+        if(type == GEL_TYPE_RECORD)
+        {
+            GelRecord *record = gel_value_get_boxed(value);
+            record_set(record, return_value, n_values, values, context);
+        }
+        else
+        if(type == GEL_TYPE_NDARRAY)
+        {
+            GelNdarray *ndarray = gel_value_get_boxed(value);
+            ndarray_set(ndarray, return_value, n_values, values, context);
+        }
+        else
         if(G_TYPE_IS_OBJECT(type))
         {
             GObject *object = gel_value_get_object(value);
@@ -922,7 +1166,7 @@ void set_(GClosure *self, GValue *return_value,
         }
         else
             gel_error_expected(context,
-                __FUNCTION__, "array, hash or object");
+                __FUNCTION__, "array, hash, record, ndarray or object");
     }
 
     gel_value_list_free(tmp_list);
@@ -957,98 +1201,1023 @@ void arithmetic(GClosure *self, GValue *return_value,
         const GValue *v1 =
             gel_context_eval_into_value(context, values + 1, &tmp2);
 
-        if(!gel_context_error(context))
-            running = values_function(v0, v1, &tmp3);
+        if(!gel_context_error(context))
+        {
+            running = values_function(v0, v1, &tmp3);
+            if(!running)
+                gel_error_incompatible(context, f, v0, v1);
+        }
+    }
+
+    if(GEL_IS_VALUE(&tmp1))
+        g_value_unset(&tmp1);
+    if(GEL_IS_VALUE(&tmp2))
+        g_value_unset(&tmp2);
+
+    for(guint i = 2; i < n_values && running; i++)
+    {
+        GValue *v1;
+
+        if(i%2 == 0)
+            v1 = &tmp3, v2 = &tmp2;
+        else
+            v2 = &tmp3, v1 = &tmp2;
+
+        const GValue *v =
+            gel_context_eval_into_value(context, values + i, &tmp1);
+
+        if(!gel_context_error(context))
+        {
+            running = values_function(v1, v, v2);
+            if(!running)
+                gel_error_incompatible(context, f, v1, v);
+        }
+
+        if(GEL_IS_VALUE(v1))
+            g_value_unset(v1);
+        if(GEL_IS_VALUE(&tmp1))
+            g_value_unset(&tmp1);
+
+        if(gel_context_error(context))
+        {
+            running = FALSE;
+            break;
+        }
+    }
+
+    if(running)
+        gel_value_copy(v2, return_value);
+    if(GEL_IS_VALUE(v2))
+        g_value_unset(v2);
+}
+
+
+static
+void add_(GClosure *self, GValue *return_value,
+          guint n_values, const GValue *values, GelContext *context)
+{
+    arithmetic(self, return_value, n_values, values,
+        context, gel_values_add, __FUNCTION__);
+}
+
+
+static
+void sub_(GClosure *self, GValue *return_value,
+          guint n_values, const GValue *values, GelContext *context)
+{
+    arithmetic(self, return_value, n_values, values,
+        context, gel_values_sub, __FUNCTION__);
+}
+
+
+static
+void mul_(GClosure *self, GValue *return_value,
+          guint n_values, const GValue *values, GelContext *context)
+{
+    arithmetic(self, return_value, n_values, values,
+        context, gel_values_mul, __FUNCTION__);
+}
+
+
+static
+void div_(GClosure *self, GValue *return_value,
+          guint n_values, const GValue *values, GelContext *context)
+{
+    arithmetic(self, return_value, n_values, values,
+        context, gel_values_div, __FUNCTION__);
+}
+
+
+static
+void mod_(GClosure *self, GValue *return_value,
+          guint n_values, const GValue *values, GelContext *context)
+{
+    arithmetic(self, return_value, n_values, values,
+        context, gel_values_mod, __FUNCTION__);
+}
+
+
+/*
+ * Evaluates an array of numbers and tells how it can be packed.
+ */
+static
+gboolean numeric_array_param(GelContext *context, const gchar *f,
+                             guint *n_values, const GValue **values,
+                             GList **tmp_list, GelValueArray **array,
+                             GelArrayStorage *storage)
+{
+    if(!gel_context_eval_params(context, f,
+            n_values, values, tmp_list, "A", array))
+        return FALSE;
+
+    *storage = gel_value_array_get_numeric_storage(*array);
+    if(*storage == GEL_ARRAY_STORAGE_GENERIC)
+    {
+        gel_error_expected(context, f, "array of numbers");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * Gets the values of @array packed as @storage, converting them
+ * into a new array stored at @tmp_array when they are kept otherwise.
+ */
+static
+gpointer array_numbers(GelValueArray *array, GelArrayStorage storage,
+                       GelValueArray **tmp_array)
+{
+    if(gel_value_array_get_storage(array) != storage)
+        array = *tmp_array = gel_value_array_to_numeric(array, storage);
+
+    return gel_value_array_peek_data(array);
+}
+
+
+/*
+ * Reduces the numbers of @array with @op.
+ */
+static
+void array_reduce(GelValueArray *array, GValue *return_value,
+                  GelKernelReduce op, GelContext *context, const gchar *f)
+{
+    GelArrayStorage storage = gel_value_array_get_numeric_storage(array);
+    if(storage == GEL_ARRAY_STORAGE_GENERIC)
+    {
+        gel_error_expected(context, f, "array of numbers");
+        return;
+    }
+
+    guint n = gel_value_array_get_n_values(array);
+    if(n == 0 && op != GEL_KERNEL_SUM)
+    {
+        gel_error_expected(context, f, "a non empty array");
+        return;
+    }
+
+    const GelKernels *kernels = gel_kernels_get();
+    GelValueArray *tmp_array = NULL;
+    gpointer numbers = array_numbers(array, storage, &tmp_array);
+
+    if(storage == GEL_ARRAY_STORAGE_INT64 && op != GEL_KERNEL_MEAN)
+    {
+        g_value_init(return_value, G_TYPE_INT64);
+        gel_value_set_int64(return_value,
+            op == GEL_KERNEL_SUM ? kernels->sum_int64s(numbers, n) :
+            op == GEL_KERNEL_MIN ? kernels->min_int64s(numbers, n) :
+                                   kernels->max_int64s(numbers, n));
+    }
+    else
+    if(op == GEL_KERNEL_MEAN)
+    {
+        gdouble sum = storage == GEL_ARRAY_STORAGE_INT64
+            ? kernels->sum_int64s(numbers, n)
+            : kernels->sum_doubles(numbers, n);
+
+        g_value_init(return_value, G_TYPE_DOUBLE);
+        gel_value_set_double(return_value, sum / n);
+    }
+    else
+    {
+        g_value_init(return_value, G_TYPE_DOUBLE);
+        gel_value_set_double(return_value,
+            op == GEL_KERNEL_SUM ? kernels->sum_doubles(numbers, n) :
+            op == GEL_KERNEL_MIN ? kernels->min_doubles(numbers, n) :
+                                   kernels->max_doubles(numbers, n));
+    }
+
+    if(tmp_array != NULL)
+        gel_value_array_free(tmp_array);
+}
+
+
+/*
+ * Reduces all the elements of @ndarray with @op or, when an axis
+ * is given, the elements along that axis.
+ */
+static
+void ndarray_reduce(GelNdarray *ndarray, GValue *return_value,
+                    guint n_values, const GValue *values,
+                    GelKernelReduce op, GelContext *context, const gchar *f)
+{
+    GList *tmp_list = NULL;
+    gint64 axis = 0;
+    const guint n_dims = gel_ndarray_get_n_dims(ndarray);
+    const gsize *shape = gel_ndarray_get_shape(ndarray);
+
+    if(n_values == 0)
+    {
+        if(op != GEL_KERNEL_SUM && gel_ndarray_get_size(ndarray) == 0)
+            gel_error_expected(context, f, "a non empty ndarray");
+        else
+            gel_ndarray_reduce_all(ndarray, op, return_value);
+    }
+    else
+    if(gel_context_eval_params(context, f,
+            &n_values, &values, &tmp_list, "I", &axis))
+    {
+        if(axis < 0)
+            axis += n_dims;
+
+        if(axis < 0 || axis >= n_dims)
+            gel_error_index_out_of_bounds(context, f, axis);
+        else
+        if(op != GEL_KERNEL_SUM && shape[axis] == 0)
+            gel_error_expected(context, f, "a non empty axis");
+        else
+        if(n_dims == 1)
+            gel_ndarray_reduce_all(ndarray, op, return_value);
+        else
+        {
+            g_value_init(return_value, GEL_TYPE_NDARRAY);
+            gel_value_take_boxed(return_value,
+                gel_ndarray_reduce(ndarray, axis, op));
+        }
+    }
+
+    gel_value_list_free(tmp_list);
+}
+
+
+static
+void reduce(GClosure *self, GValue *return_value,
+            guint n_values, const GValue *values, GelContext *context,
+            GelKernelReduce op, const gchar *f)
+{
+    GList *tmp_list = NULL;
+    GValue *value = NULL;
+
+    if(gel_context_eval_params(context, f,
+            &n_values, &values, &tmp_list, "V*", &value))
+    {
+        if(GEL_VALUE_HOLDS(value, GEL_TYPE_NDARRAY))
+            ndarray_reduce(gel_value_get_boxed(value), return_value,
+                n_values, values, op, context, f);
+        else
+        if(n_values != 0)
+            gel_error_needs_n_arguments(context, f, 1);
+        else
+        if(GEL_VALUE_HOLDS(value, GEL_TYPE_VALUE_ARRAY))
+            array_reduce(gel_value_get_boxed(value), return_value,
+                op, context, f);
+        else
+            gel_error_expected(context, f, "array or ndarray");
+    }
+
+    gel_value_list_free(tmp_list);
+}
+
+
+static
+void sum_(GClosure *self, GValue *return_value,
+          guint n_values, const GValue *values, GelContext *context)
+{
+    reduce(self, return_value, n_values, values,
+        context, GEL_KERNEL_SUM, __FUNCTION__);
+}
+
+
+static
+void min_(GClosure *self, GValue *return_value,
+          guint n_values, const GValue *values, GelContext *context)
+{
+    reduce(self, return_value, n_values, values,
+        context, GEL_KERNEL_MIN, __FUNCTION__);
+}
+
+
+static
+void max_(GClosure *self, GValue *return_value,
+          guint n_values, const GValue *values, GelContext *context)
+{
+    reduce(self, return_value, n_values, values,
+        context, GEL_KERNEL_MAX, __FUNCTION__);
+}
+
+
+static
+void mean_(GClosure *self, GValue *return_value,
+           guint n_values, const GValue *values, GelContext *context)
+{
+    reduce(self, return_value, n_values, values,
+        context, GEL_KERNEL_MEAN, __FUNCTION__);
+}
+
+
+static
+void dot_product_(GClosure *self, GValue *return_value,
+                  guint n_values, const GValue *values, GelContext *context)
+{
+    GList *tmp_list = NULL;
+    GelValueArray *a1 = NULL;
+    GelValueArray *a2 = NULL;
+    GelValueArray *tmp1 = NULL;
+    GelValueArray *tmp2 = NULL;
+
+    if(gel_context_eval_params(context, __FUNCTION__,
+            &n_values, &values, &tmp_list, "AA", &a1, &a2))
+    {
+        const GelKernels *kernels = gel_kernels_get();
+        GelArrayStorage s1 = gel_value_array_get_numeric_storage(a1);
+        GelArrayStorage s2 = gel_value_array_get_numeric_storage(a2);
+        guint n = gel_value_array_get_n_values(a1);
+
+        if(s1 == GEL_ARRAY_STORAGE_GENERIC || s2 == GEL_ARRAY_STORAGE_GENERIC)
+            gel_error_expected(context, __FUNCTION__, "arrays of numbers");
+        else
+        if(n != gel_value_array_get_n_values(a2))
+            gel_error_expected(context, __FUNCTION__,
+                "arrays of the same size");
+        else
+        if(s1 == GEL_ARRAY_STORAGE_INT64 && s2 == GEL_ARRAY_STORAGE_INT64)
+        {
+            g_value_init(return_value, G_TYPE_INT64);
+            gel_value_set_int64(return_value, kernels->dot_int64s(
+                array_numbers(a1, s1, &tmp1),
+                array_numbers(a2, s2, &tmp2), n));
+        }
+        else
+        {
+            g_value_init(return_value, G_TYPE_DOUBLE);
+            gel_value_set_double(return_value, kernels->dot_doubles(
+                array_numbers(a1, GEL_ARRAY_STORAGE_DOUBLE, &tmp1),
+                array_numbers(a2, GEL_ARRAY_STORAGE_DOUBLE, &tmp2), n));
+        }
+    }
+
+    if(tmp1 != NULL)
+        gel_value_array_free(tmp1);
+    if(tmp2 != NULL)
+        gel_value_array_free(tmp2);
+    gel_value_list_free(tmp_list);
+}
+
+
+static
+GelArrayStorage numeric_storage(const GValue *value)
+{
+    if(GEL_VALUE_HOLDS(value, GEL_TYPE_VALUE_ARRAY))
+        return gel_value_array_get_numeric_storage(
+            gel_value_get_boxed(value));
+
+    switch(GEL_VALUE_TYPE(value))
+    {
+        case G_TYPE_INT64:
+            return GEL_ARRAY_STORAGE_INT64;
+        case G_TYPE_DOUBLE:
+            return GEL_ARRAY_STORAGE_DOUBLE;
+        default:
+            return GEL_ARRAY_STORAGE_GENERIC;
+    }
+}
+
+
+static
+gboolean numeric_has_zero(const GValue *value, GelArrayStorage storage,
+                          gconstpointer numbers, guint n)
+{
+    if(storage != GEL_ARRAY_STORAGE_INT64)
+        return FALSE;
+
+    if(numbers == NULL)
+        return gel_value_get_int64(value) == 0;
+
+    const gint64 *ints = numbers;
+    for(guint i = 0; i < n; i++)
+        if(ints[i] == 0)
+            return TRUE;
+
+    return FALSE;
+}
+
+
+/*
+ * Applies @op to each pair of values of two arrays of the same size,
+ * or to each value of an array and a number, giving a new array.
+ */
+static
+void elementwise(GClosure *self, GValue *return_value,
+                 guint n_values, const GValue *values, GelContext *context,
+                 GelKernelOp op, const gchar *f)
+{
+    GList *tmp_list = NULL;
+    GValue *v1 = NULL;
+    GValue *v2 = NULL;
+    GelValueArray *tmp1 = NULL;
+    GelValueArray *tmp2 = NULL;
+
+    if(!gel_context_eval_params(context, f,
+            &n_values, &values, &tmp_list, "VV", &v1, &v2))
+        goto end;
+
+    gboolean is_array1 = GEL_VALUE_HOLDS(v1, GEL_TYPE_VALUE_ARRAY);
+    gboolean is_array2 = GEL_VALUE_HOLDS(v2, GEL_TYPE_VALUE_ARRAY);
+    GelArrayStorage s1 = numeric_storage(v1);
+    GelArrayStorage s2 = numeric_storage(v2);
+
+    if(!(is_array1 || is_array2)
+        || s1 == GEL_ARRAY_STORAGE_GENERIC || s2 == GEL_ARRAY_STORAGE_GENERIC)
+    {
+        gel_error_incompatible(context, f, v1, v2);
+        goto end;
+    }
+
+    GelValueArray *a1 = is_array1 ? gel_value_get_boxed(v1) : NULL;
+    GelValueArray *a2 = is_array2 ? gel_value_get_boxed(v2) : NULL;
+    guint n = gel_value_array_get_n_values(a1 != NULL ? a1 : a2);
+
+    if(a1 != NULL && a2 != NULL && n != gel_value_array_get_n_values(a2))
+    {
+        gel_error_incompatible(context, f, v1, v2);
+        goto end;
+    }
+
+    GelArrayStorage storage =
+        s1 == GEL_ARRAY_STORAGE_DOUBLE || s2 == GEL_ARRAY_STORAGE_DOUBLE
+        ? GEL_ARRAY_STORAGE_DOUBLE : GEL_ARRAY_STORAGE_INT64;
+
+    gpointer n1 = a1 != NULL ? array_numbers(a1, storage, &tmp1) : NULL;
+    gpointer n2 = a2 != NULL ? array_numbers(a2, storage, &tmp2) : NULL;
+
+    if(op == GEL_KERNEL_DIV && numeric_has_zero(v2, storage, n2, n))
+    {
+        gel_error_incompatible(context, f, v1, v2);
+        goto end;
+    }
+
+    const GelKernels *kernels = gel_kernels_get();
+    GelValueArray *array = gel_value_array_new_packed(storage, n);
+    gpointer dest = gel_value_array_peek_data(array);
+
+    if(n1 != NULL && n2 != NULL)
+    {
+        if(storage == GEL_ARRAY_STORAGE_INT64)
+            kernels->map_int64s(op, n1, n2, dest, n);
+        else
+            kernels->map_doubles(op, n1, n2, dest, n);
+    }
+    else
+    {
+        /* An array and a number, maybe the number comes first */
+        const GValue *scalar = n1 != NULL ? v2 : v1;
+        gpointer numbers = n1 != NULL ? n1 : n2;
+
+        if(n1 == NULL)
+            op = op == GEL_KERNEL_SUB ? GEL_KERNEL_RSUB
+                : op == GEL_KERNEL_DIV ? GEL_KERNEL_RDIV : op;
+
+        if(storage == GEL_ARRAY_STORAGE_INT64)
+            kernels->map_int64s_scalar(op, numbers,
+                gel_value_get_int64(scalar), dest, n);
+        else
+            kernels->map_doubles_scalar(op, numbers,
+                GEL_VALUE_TYPE(scalar) == G_TYPE_INT64
+                    ? gel_value_get_int64(scalar)
+                    : gel_value_get_double(scalar),
+                dest, n);
+    }
+
+    g_value_init(return_value, GEL_TYPE_VALUE_ARRAY);
+    gel_value_take_boxed(return_value, array);
+
+    end:
+    if(tmp1 != NULL)
+        gel_value_array_free(tmp1);
+    if(tmp2 != NULL)
+        gel_value_array_free(tmp2);
+    gel_value_list_free(tmp_list);
+}
+
+
+static
+void elementwise_add_(GClosure *self, GValue *return_value,
+                      guint n_values, const GValue *values,
+                      GelContext *context)
+{
+    elementwise(self, return_value, n_values, values,
+        context, GEL_KERNEL_ADD, __FUNCTION__);
+}
+
+
+static
+void elementwise_sub_(GClosure *self, GValue *return_value,
+                      guint n_values, const GValue *values,
+                      GelContext *context)
+{
+    elementwise(self, return_value, n_values, values,
+        context, GEL_KERNEL_SUB, __FUNCTION__);
+}
+
+
+static
+void elementwise_mul_(GClosure *self, GValue *return_value,
+                      guint n_values, const GValue *values,
+                      GelContext *context)
+{
+    elementwise(self, return_value, n_values, values,
+        context, GEL_KERNEL_MUL, __FUNCTION__);
+}
+
+
+static
+void elementwise_div_(GClosure *self, GValue *return_value,
+                      guint n_values, const GValue *values,
+                      GelContext *context)
+{
+    elementwise(self, return_value, n_values, values,
+        context, GEL_KERNEL_DIV, __FUNCTION__);
+}
+
+
+static
+void cumsum_(GClosure *self, GValue *return_value,
+             guint n_values, const GValue *values, GelContext *context)
+{
+    GList *tmp_list = NULL;
+    GelValueArray *array = NULL;
+    GelValueArray *tmp_array = NULL;
+    GelArrayStorage storage;
+
+    if(numeric_array_param(context, __FUNCTION__,
+            &n_values, &values, &tmp_list, &array, &storage))
+    {
+        const GelKernels *kernels = gel_kernels_get();
+        guint n = gel_value_array_get_n_values(array);
+        gpointer numbers = array_numbers(array, storage, &tmp_array);
+
+        GelValueArray *result_array = gel_value_array_new_packed(storage, n);
+        gpointer dest = gel_value_array_peek_data(result_array);
+
+        if(storage == GEL_ARRAY_STORAGE_INT64)
+            kernels->cumsum_int64s(numbers, dest, n);
+        else
+            kernels->cumsum_doubles(numbers, dest, n);
+
+        g_value_init(return_value, GEL_TYPE_VALUE_ARRAY);
+        gel_value_take_boxed(return_value, result_array);
+    }
+
+    if(tmp_array != NULL)
+        gel_value_array_free(tmp_array);
+    gel_value_list_free(tmp_list);
+}
+
+
+/*
+ * Reads the optional element type name of an ndarray.
+ */
+static
+gboolean ndarray_type_param(GelContext *context, const gchar *f,
+                            guint *n_values, const GValue **values,
+                            GList **tmp_list, GelNdarrayType *type)
+{
+    const gchar *name = NULL;
+
+    if(*n_values == 0)
+        return TRUE;
+
+    if(!gel_context_eval_params(context, f,
+            n_values, values, tmp_list, "S", &name))
+        return FALSE;
+
+    if(g_strcmp0(name, "int64") == 0)
+        *type = GEL_NDARRAY_INT64;
+    else
+    if(g_strcmp0(name, "double") == 0)
+        *type = GEL_NDARRAY_DOUBLE;
+    else
+    if(g_strcmp0(name, "float32") == 0)
+        *type = GEL_NDARRAY_FLOAT32;
+    else
+    {
+        gel_error_expected(context, f, "int64, double or float32");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * Reads an array of sizes, one for each dimension.
+ */
+static
+gboolean ndarray_shape(GelValueArray *array, gsize *shape, guint *n_dims,
+                       GelContext *context, const gchar *f)
+{
+    guint n = gel_value_array_get_n_values(array);
+
+    if(n == 0 || n > GEL_NDARRAY_MAX_DIMS
+        || gel_value_array_get_numeric_storage(array)
+            != GEL_ARRAY_STORAGE_INT64)
+    {
+        gel_error_expected(context, f, "array of sizes");
+        return FALSE;
+    }
+
+    GelValueArray *tmp_array = NULL;
+    const gint64 *sizes =
+        array_numbers(array, GEL_ARRAY_STORAGE_INT64, &tmp_array);
+
+    gboolean valid = TRUE;
+    for(guint d = 0; d < n && valid; d++)
+        if(sizes[d] < 0)
+        {
+            gel_error_expected(context, f, "array of sizes");
+            valid = FALSE;
+        }
+        else
+            shape[d] = sizes[d];
+    *n_dims = n;
+
+    if(tmp_array != NULL)
+        gel_value_array_free(tmp_array);
+    return valid;
+}
+
+
+/*
+ * Checks that @array has the shape @shape from @dim on, telling whether
+ * it holds any double in @doubles. When @ndarray is not %NULL, it also
+ * copies the numbers to it from @position on.
+ */
+static
+gboolean ndarray_nested(const GelValueArray *array,
+                        const gsize *shape, guint n_dims, guint dim,
+                        gboolean *doubles,
+                        GelNdarray *ndarray, gsize *position)
+{
+    guint n = gel_value_array_get_n_values(array);
+    if(n != shape[dim])
+        return FALSE;
+    if(n == 0)
+        return TRUE;
+
+    GelArrayStorage storage = gel_value_array_get_storage(array);
+
+    if(dim + 1 < n_dims)
+    {
+        if(storage != GEL_ARRAY_STORAGE_GENERIC)
+            return FALSE;
+
+        const GValue *values = gel_value_array_peek_data(array);
+        for(guint i = 0; i < n; i++)
+            if(!GEL_VALUE_HOLDS(values + i, GEL_TYPE_VALUE_ARRAY)
+                || !ndarray_nested(gel_value_get_boxed(values + i),
+                        shape, n_dims, dim + 1, doubles, ndarray, position))
+                return FALSE;
+        return TRUE;
+    }
+
+    storage = gel_value_array_get_numeric_storage(array);
+    if(storage == GEL_ARRAY_STORAGE_GENERIC)
+        return FALSE;
+    if(storage == GEL_ARRAY_STORAGE_DOUBLE)
+        *doubles = TRUE;
+    if(ndarray == NULL)
+        return TRUE;
+
+    GelValueArray *tmp_array = NULL;
+    gconstpointer numbers =
+        array_numbers((GelValueArray*)array, storage, &tmp_array);
+    GValue tmp_value = {0};
+
+    if(storage == GEL_ARRAY_STORAGE_INT64)
+    {
+        const gint64 *ints = numbers;
+        g_value_init(&tmp_value, G_TYPE_INT64);
+        for(guint i = 0; i < n; i++)
+        {
+            gel_value_set_int64(&tmp_value, ints[i]);
+            gel_ndarray_set_flat(ndarray, (*position)++, &tmp_value);
+        }
+    }
+    else
+    {
+        const gdouble *reals = numbers;
+        g_value_init(&tmp_value, G_TYPE_DOUBLE);
+        for(guint i = 0; i < n; i++)
+        {
+            gel_value_set_double(&tmp_value, reals[i]);
+            gel_ndarray_set_flat(ndarray, (*position)++, &tmp_value);
+        }
+    }
+
+    g_value_unset(&tmp_value);
+    if(tmp_array != NULL)
+        gel_value_array_free(tmp_array);
+    return TRUE;
+}
+
+
+static
+void ndarray_(GClosure *self, GValue *return_value,
+              guint n_values, const GValue *values, GelContext *context)
+{
+    GList *tmp_list = NULL;
+    GValue *value = NULL;
+
+    if(!gel_context_eval_params(context, __FUNCTION__,
+            &n_values, &values, &tmp_list, "V*", &value))
+    {
+        gel_value_list_free(tmp_list);
+        return;
+    }
+
+    GelNdarray *ndarray = NULL;
+
+    if(GEL_VALUE_HOLDS(value, GEL_TYPE_NDARRAY))
+    {
+        GelNdarray *source = gel_value_get_boxed(value);
+        GelNdarrayType type = gel_ndarray_get_element_type(source);
+
+        if(ndarray_type_param(context, __FUNCTION__,
+                &n_values, &values, &tmp_list, &type))
+            ndarray = gel_ndarray_copy(source, type);
+    }
+    else
+    if(GEL_VALUE_HOLDS(value, GEL_TYPE_VALUE_ARRAY))
+    {
+        const GelValueArray *array = gel_value_get_boxed(value);
+        gsize shape[GEL_NDARRAY_MAX_DIMS];
+        guint n_dims = 0;
+
+        /* The first element at each level gives the size of the next */
+        const GelValueArray *first = array;
+        while(first != NULL && n_dims < GEL_NDARRAY_MAX_DIMS)
+        {
+            guint n = gel_value_array_get_n_values(first);
+            shape[n_dims++] = n;
+
+            const GValue *elements = gel_value_array_peek_data(first);
+            if(n > 0
+                && gel_value_array_get_storage(first)
+                    == GEL_ARRAY_STORAGE_GENERIC
+                && GEL_VALUE_HOLDS(elements, GEL_TYPE_VALUE_ARRAY))
+                first = gel_value_get_boxed(elements);
+            else
+                first = NULL;
+        }
+
+        gboolean doubles = FALSE;
+        if(!ndarray_nested(array, shape, n_dims, 0, &doubles, NULL, NULL))
+            gel_error_expected(context,
+                __FUNCTION__, "rectangular arrays of numbers");
+        else
+        {
+            GelNdarrayType type =
+                doubles ? GEL_NDARRAY_DOUBLE : GEL_NDARRAY_INT64;
+
+            if(ndarray_type_param(context, __FUNCTION__,
+                    &n_values, &values, &tmp_list, &type))
+            {
+                gsize position = 0;
+                ndarray = gel_ndarray_new(type, n_dims, shape);
+                ndarray_nested(array, shape, n_dims, 0,
+                    &doubles, ndarray, &position);
+            }
+        }
+    }
+    else
+        gel_error_expected(context, __FUNCTION__, "array or ndarray");
+
+    if(ndarray != NULL)
+    {
+        if(n_values != 0)
+        {
+            gel_error_needs_n_arguments(context, __FUNCTION__, 2);
+            gel_ndarray_unref(ndarray);
+        }
+        else
+        {
+            g_value_init(return_value, GEL_TYPE_NDARRAY);
+            gel_value_take_boxed(return_value, ndarray);
+        }
+    }
+
+    gel_value_list_free(tmp_list);
+}
+
+
+static
+void zeros_(GClosure *self, GValue *return_value,
+            guint n_values, const GValue *values, GelContext *context)
+{
+    GList *tmp_list = NULL;
+    GelValueArray *array = NULL;
+    GelNdarrayType type = GEL_NDARRAY_DOUBLE;
+    gsize shape[GEL_NDARRAY_MAX_DIMS];
+    guint n_dims = 0;
+
+    if(gel_context_eval_params(context, __FUNCTION__,
+            &n_values, &values, &tmp_list, "A*", &array)
+        && ndarray_shape(array, shape, &n_dims, context, __FUNCTION__)
+        && ndarray_type_param(context, __FUNCTION__,
+            &n_values, &values, &tmp_list, &type))
+    {
+        if(n_values != 0)
+            gel_error_needs_n_arguments(context, __FUNCTION__, 2);
+        else
+        {
+            g_value_init(return_value, GEL_TYPE_NDARRAY);
+            gel_value_take_boxed(return_value,
+                gel_ndarray_new(type, n_dims, shape));
+        }
+    }
+
+    gel_value_list_free(tmp_list);
+}
+
+
+/*
+ * Evaluates an ndarray followed by @format.
+ */
+static
+gboolean ndarray_params(GelContext *context, const gchar *f,
+                        guint *n_values, const GValue **values,
+                        GList **tmp_list, GelNdarray **ndarray,
+                        const gchar *format)
+{
+    GValue *value = NULL;
+
+    if(!gel_context_eval_params(context, f,
+            n_values, values, tmp_list, format, &value))
+        return FALSE;
 
-        if(!running)
-            gel_error_incompatible(context, f, v0, v1);
+    if(!GEL_VALUE_HOLDS(value, GEL_TYPE_NDARRAY))
+    {
+        gel_error_value_not_of_type(context, f, value, GEL_TYPE_NDARRAY);
+        return FALSE;
     }
 
-    if(GEL_IS_VALUE(&tmp1))
-        g_value_unset(&tmp1);
-    if(GEL_IS_VALUE(&tmp2))
-        g_value_unset(&tmp2);
+    *ndarray = gel_value_get_boxed(value);
+    return TRUE;
+}
 
-    for(guint i = 2; i < n_values && running; i++)
+
+static
+void shape_(GClosure *self, GValue *return_value,
+            guint n_values, const GValue *values, GelContext *context)
+{
+    GList *tmp_list = NULL;
+    GelNdarray *ndarray = NULL;
+
+    if(ndarray_params(context, __FUNCTION__,
+            &n_values, &values, &tmp_list, &ndarray, "V"))
     {
-        GValue *v1;
+        const guint n_dims = gel_ndarray_get_n_dims(ndarray);
+        const gsize *shape = gel_ndarray_get_shape(ndarray);
 
-        if(i%2 == 0)
-            v1 = &tmp3, v2 = &tmp2;
-        else
-            v2 = &tmp3, v1 = &tmp2;
+        GelValueArray *array =
+            gel_value_array_new_packed(GEL_ARRAY_STORAGE_INT64, n_dims);
+        gint64 *ints = gel_value_array_peek_int64s(array);
+        for(guint d = 0; d < n_dims; d++)
+            ints[d] = shape[d];
 
-        const GValue *v =
-            gel_context_eval_into_value(context, values + i, &tmp1);
+        g_value_init(return_value, GEL_TYPE_VALUE_ARRAY);
+        gel_value_take_boxed(return_value, array);
+    }
 
-        if(!gel_context_error(context))
-        {
-            running = values_function(v1, v, v2);
-            if(!running)
-                gel_error_incompatible(context, f, v1, v);
-        }
+    gel_value_list_free(tmp_list);
+}
 
-        if(GEL_IS_VALUE(v1))
-            g_value_unset(v1);
-        if(GEL_IS_VALUE(&tmp1))
-            g_value_unset(&tmp1);
 
-        if(gel_context_error(context))
+static
+void reshape_(GClosure *self, GValue *return_value,
+              guint n_values, const GValue *values, GelContext *context)
+{
+    GList *tmp_list = NULL;
+    GelNdarray *ndarray = NULL;
+    GelValueArray *array = NULL;
+    gsize shape[GEL_NDARRAY_MAX_DIMS];
+    guint n_dims = 0;
+
+    if(ndarray_params(context, __FUNCTION__,
+            &n_values, &values, &tmp_list, &ndarray, "V*")
+        && gel_context_eval_params(context, __FUNCTION__,
+            &n_values, &values, &tmp_list, "A", &array)
+        && ndarray_shape(array, shape, &n_dims, context, __FUNCTION__))
+    {
+        gsize size = 1;
+        for(guint d = 0; d < n_dims; d++)
+            size *= shape[d];
+
+        if(size != gel_ndarray_get_size(ndarray))
+            gel_error_expected(context,
+                __FUNCTION__, "a shape with the same size");
+        else
         {
-            running = FALSE;
-            break;
+            g_value_init(return_value, GEL_TYPE_NDARRAY);
+            gel_value_take_boxed(return_value,
+                gel_ndarray_reshape(ndarray, n_dims, shape));
         }
     }
 
-    if(running)
-        gel_value_copy(v2, return_value);
-    if(GEL_IS_VALUE(v2))
-        g_value_unset(v2);
+    gel_value_list_free(tmp_list);
 }
 
 
 static
-void add_(GClosure *self, GValue *return_value,
-          guint n_values, const GValue *values, GelContext *context)
+void transpose_(GClosure *self, GValue *return_value,
+                guint n_values, const GValue *values, GelContext *context)
 {
-    arithmetic(self, return_value, n_values, values,
-        context, gel_values_add, __FUNCTION__);
-}
+    GList *tmp_list = NULL;
+    GelNdarray *ndarray = NULL;
 
+    if(ndarray_params(context, __FUNCTION__,
+            &n_values, &values, &tmp_list, &ndarray, "V"))
+    {
+        g_value_init(return_value, GEL_TYPE_NDARRAY);
+        gel_value_take_boxed(return_value, gel_ndarray_transpose(ndarray));
+    }
 
-static
-void sub_(GClosure *self, GValue *return_value,
-          guint n_values, const GValue *values, GelContext *context)
-{
-    arithmetic(self, return_value, n_values, values,
-        context, gel_values_sub, __FUNCTION__);
+    gel_value_list_free(tmp_list);
 }
 
 
 static
-void mul_(GClosure *self, GValue *return_value,
-          guint n_values, const GValue *values, GelContext *context)
+void slice_(GClosure *self, GValue *return_value,
+            guint n_values, const GValue *values, GelContext *context)
 {
-    arithmetic(self, return_value, n_values, values,
-        context, gel_values_mul, __FUNCTION__);
-}
+    GList *tmp_list = NULL;
+    GelNdarray *ndarray = NULL;
+    gint64 axis = 0;
+    gint64 start = 0;
+    gint64 stop = 0;
+    gint64 step = 1;
+
+    if(!ndarray_params(context, __FUNCTION__,
+            &n_values, &values, &tmp_list, &ndarray, "V*")
+        || !gel_context_eval_params(context, __FUNCTION__,
+            &n_values, &values, &tmp_list, "III*", &axis, &start, &stop)
+        || (n_values > 0 && !gel_context_eval_params(context, __FUNCTION__,
+            &n_values, &values, &tmp_list, "I", &step)))
+    {
+        gel_value_list_free(tmp_list);
+        return;
+    }
 
+    const guint n_dims = gel_ndarray_get_n_dims(ndarray);
+    if(axis < 0)
+        axis += n_dims;
 
-static
-void div_(GClosure *self, GValue *return_value,
-          guint n_values, const GValue *values, GelContext *context)
-{
-    arithmetic(self, return_value, n_values, values,
-        context, gel_values_div, __FUNCTION__);
+    if(axis < 0 || axis >= n_dims)
+        gel_error_index_out_of_bounds(context, __FUNCTION__, axis);
+    else
+    if(step < 1)
+        gel_error_expected(context, __FUNCTION__, "a positive step");
+    else
+    {
+        const gint64 size = gel_ndarray_get_shape(ndarray)[axis];
+        if(start < 0)
+            start = MAX(start + size, 0);
+        if(stop < 0)
+            stop = MAX(stop + size, 0);
+
+        g_value_init(return_value, GEL_TYPE_NDARRAY);
+        gel_value_take_boxed(return_value,
+            gel_ndarray_slice(ndarray, axis, start, stop, step));
+    }
+
+    gel_value_list_free(tmp_list);
 }
 
 
 static
-void mod_(GClosure *self, GValue *return_value,
-          guint n_values, const GValue *values, GelContext *context)
+void matmul_(GClosure *self, GValue *return_value,
+             guint n_values, const GValue *values, GelContext *context)
 {
-    arithmetic(self, return_value, n_values, values,
-        context, gel_values_mod, __FUNCTION__);
+    GList *tmp_list = NULL;
+    GValue *v1 = NULL;
+    GValue *v2 = NULL;
+
+    if(gel_context_eval_params(context, __FUNCTION__,
+            &n_values, &values, &tmp_list, "VV", &v1, &v2))
+    {
+        if(!GEL_VALUE_HOLDS(v1, GEL_TYPE_NDARRAY)
+            || !GEL_VALUE_HOLDS(v2, GEL_TYPE_NDARRAY))
+            gel_error_expected(context, __FUNCTION__, "ndarray");
+        else
+        {
+            GelNdarray *a = gel_value_get_boxed(v1);
+            GelNdarray *b = gel_value_get_boxed(v2);
+
+            if(gel_ndarray_get_n_dims(a) != 2
+                || gel_ndarray_get_n_dims(b) != 2
+                || gel_ndarray_get_shape(a)[1] != gel_ndarray_get_shape(b)[0])
+                gel_error_incompatible(context, __FUNCTION__, v1, v2);
+            else
+            {
+                g_value_init(return_value, GEL_TYPE_NDARRAY);
+                gel_value_take_boxed(return_value,
+                    gel_ndarray_matmul(a, b, 0));
+            }
+        }
+    }
+
+    gel_value_list_free(tmp_list);
 }
 
 
@@ -1269,7 +2438,13 @@ void append_(GClosure *self, GValue *return_value,
             hash_append(hash, return_value, n_values, values, context);
         }
         else
-            gel_error_expected(context, __FUNCTION__, "array or hash");
+        if(type == GEL_TYPE_RECORD)
+        {
+            GelRecord *record = gel_value_get_boxed(value);
+            record_append(record, return_value, n_values, values, context);
+        }
+        else
+            gel_error_expected(context, __FUNCTION__, "array, hash or record");
     }
 
     gel_value_list_free(tmp_list);
@@ -1281,9 +2456,9 @@ void get_(GClosure *self, GValue *return_value,
           guint n_values, const GValue *values, GelContext *context)
 {
     guint n_args = 2;
-    if(n_values != n_args)
+    if(n_values < n_args)
     {
-        gel_error_needs_n_arguments(context, __FUNCTION__, n_args);
+        gel_error_needs_at_least_n_arguments(context, __FUNCTION__, n_args);
         return;
     }
 
@@ -1306,6 +2481,18 @@ void get_(GClosure *self, GValue *return_value,
             hash_get(hash, return_value, n_values, values, context);
         }
         else
+        if(type == GEL_TYPE_RECORD)
+        {
+            GelRecord *record = gel_value_get_boxed(value);
+            record_get(record, return_value, n_values, values, context);
+        }
+        else
+        if(type == GEL_TYPE_NDARRAY)
+        {
+            GelNdarray *ndarray = gel_value_get_boxed(value);
+            ndarray_get(ndarray, return_value, n_values, values, context);
+        }
+        else
         if(G_TYPE_IS_OBJECT(type))
         {
             GObject *object = gel_value_get_object(value);
@@ -1313,7 +2500,7 @@ void get_(GClosure *self, GValue *return_value,
         }
         else
             gel_error_expected(context,
-                __FUNCTION__, "array, hash or object");
+                __FUNCTION__, "array, hash, record, ndarray or object");
     }
 
     gel_value_list_free(tmp_list);
@@ -1387,7 +2574,20 @@ void size_(GClosure *self, GValue *return_value,
             hash_size(hash, return_value, n_values, values, context);
         }
         else
-            gel_error_expected(context, __FUNCTION__, "array or hash");
+        if(type == GEL_TYPE_RECORD)
+        {
+            GelRecord *record = gel_value_get_boxed(value);
+            record_size(record, return_value, n_values, values, context);
+        }
+        else
+        if(type == GEL_TYPE_NDARRAY)
+        {
+            GelNdarray *ndarray = gel_value_get_boxed(value);
+            ndarray_size(ndarray, return_value, n_values, values, context);
+        }
+        else
+            gel_error_expected(context,
+                __FUNCTION__, "array, hash, record or ndarray");
     }
 
     gel_value_list_free(tmp_list);
@@ -1505,26 +2705,37 @@ void sort_(GClosure *self, GValue *return_value,
     {
         gint compare(GValue *v1, GValue *v2)
         {
-            GelValueArray *pair = gel_value_array_new(2);
-            gel_value_array_append(pair, v1);
-            gel_value_array_append(pair, v2);
+            /* Shallow copies, the closure does not take the arguments */
+            GValue pair[2];
+            pair[0] = *v1;
+            pair[1] = *v2;
 
             GValue tmp_value = {0};
-            g_closure_invoke(closure, &tmp_value, 2,
-            gel_value_array_get_values(pair),
-            context);
+            gel_closure_invoke(closure, &tmp_value, 2, pair, context);
 
             gboolean result = gel_value_to_boolean(&tmp_value) ? -1 : 1;
 
             if(GEL_IS_VALUE(&tmp_value))
                 g_value_unset(&tmp_value);
-            gel_value_array_free(pair);
 
             return result;
         }
 
         GelValueArray *result_array = gel_value_array_copy(array);
-        gel_value_array_sort(result_array, (GCompareFunc)compare);
+
+        /* Numbers compared with < or > are sorted without calling back */
+        const GValue *lt_value = gel_value_lookup_predefined("<");
+        const GValue *gt_value = gel_value_lookup_predefined(">");
+        gboolean sorted = FALSE;
+
+        if(closure == gel_value_get_boxed(lt_value))
+            sorted = gel_value_array_sort_packed(result_array, FALSE);
+        else
+        if(closure == gel_value_get_boxed(gt_value))
+            sorted = gel_value_array_sort_packed(result_array, TRUE);
+
+        if(!sorted)
+            gel_value_array_sort(result_array, (GCompareFunc)compare);
 
         g_value_init(return_value, GEL_TYPE_VALUE_ARRAY);
         g_value_take_boxed(return_value, result_array);
@@ -1545,11 +2756,16 @@ void reverse_(GClosure *self, GValue *return_value,
             &n_values, &values, &tmp_list, "A", &array))
     {
         guint array_n_values = gel_value_array_get_n_values(array);
-        const GValue *array_values = gel_value_array_get_values(array);
         GelValueArray *result_array = gel_value_array_new(array_n_values);
         
         for(guint i = array_n_values; i > 0; i--)
-            gel_value_array_append(result_array, array_values + (i-1));
+        {
+            GValue tmp_value = {0};
+            gel_value_array_get_value(array, i - 1, &tmp_value);
+            gel_value_array_append(result_array, &tmp_value);
+            if(GEL_IS_VALUE(&tmp_value))
+                g_value_unset(&tmp_value);
+        }
 
         g_value_init(return_value, GEL_TYPE_VALUE_ARRAY);
         gel_value_take_boxed(return_value, result_array);
@@ -1563,21 +2779,48 @@ void keys_(GClosure *self, GValue *return_value,
            guint n_values, const GValue *values, GelContext *context)
 {
     GList *tmp_list = NULL;
-    GHashTable *hash = NULL;
+    GValue *value = NULL;
 
     if(gel_context_eval_params(context, __FUNCTION__,
-            &n_values, &values, &tmp_list, "H", &hash))
+            &n_values, &values, &tmp_list, "V", &value))
     {
-        guint size = g_hash_table_size(hash);
-        GelValueArray *array = gel_value_array_new(size);
-        GList *keys = g_hash_table_get_keys(hash);
+        GType type = GEL_VALUE_TYPE(value);
+        if(type == G_TYPE_HASH_TABLE)
+        {
+            GHashTable *hash = gel_value_get_boxed(value);
+            guint size = g_hash_table_size(hash);
+            GelValueArray *array = gel_value_array_new(size);
+            GList *keys = g_hash_table_get_keys(hash);
 
-        for(GList *iter = keys; iter != NULL; iter = g_list_next(iter))
-            gel_value_array_append(array, iter->data);
+            for(GList *iter = keys; iter != NULL; iter = g_list_next(iter))
+                gel_value_array_append(array, iter->data);
 
-        g_value_init(return_value, GEL_TYPE_VALUE_ARRAY);
-        gel_value_take_boxed(return_value, array);
-        g_list_free(keys);
+            g_value_init(return_value, GEL_TYPE_VALUE_ARRAY);
+            gel_value_take_boxed(return_value, array);
+            g_list_free(keys);
+        }
+        else
+        if(type == GEL_TYPE_RECORD)
+        {
+            GelRecord *record = gel_value_get_boxed(value);
+            guint n_fields = gel_record_get_n_fields(record);
+            GelValueArray *array = gel_value_array_new(n_fields);
+
+            for(guint i = 0; i < n_fields; i++)
+            {
+                GValue name_value = {0};
+                g_value_init(&name_value, GEL_TYPE_STRING);
+                gel_value_take_boxed(&name_value,
+                    gel_string_new(gel_record_get_field_name(record, i)));
+                gel_value_array_append(array, &name_value);
+                g_value_unset(&name_value);
+            }
+
+            g_value_init(return_value, GEL_TYPE_VALUE_ARRAY);
+            gel_value_take_boxed(return_value, array);
+        }
+        else
+            gel_error_expected(context, __FUNCTION__, "hash or record");
     }
 
     gel_value_list_free(tmp_list);
@@ -1603,7 +2846,7 @@ void new_(GClosure *self, GValue *return_value,
     GType type = G_TYPE_INVALID;
 
     GType value_type = GEL_VALUE_TYPE(value);
-    if(value_type == G_TYPE_STRING)
+    if(GEL_VALUE_HOLDS_STRING(value))
     {
         const gchar *type_name = gel_value_get_string(value);
         type = g_type_from_name(type_name);
@@ -1804,7 +3047,7 @@ void while_(GClosure *self, GValue *return_value,
             running = FALSE;
 
         if(gel_context_error(loop_context))
-            running = FALSE;
+            running = gel_context_loop_exit(loop_context);
 
         if(GEL_IS_VALUE(&tmp_value))
             g_value_unset(&tmp_value);
@@ -1826,7 +3069,6 @@ void for_(GClosure *self, GValue *return_value,
             &n_values, &values,&tmp_list, "sA*", &iter_name, &array))
     {
         guint last = gel_value_array_get_n_values(array);
-        const GValue *array_values = gel_value_array_get_values(array);
 
         GelContext *loop_context = gel_context_new_with_outer(context);
         GValue *iter_value = gel_value_new();
@@ -1836,12 +3078,12 @@ void for_(GClosure *self, GValue *return_value,
 
         for(guint i = 0; i < last && running; i++)
         {
-            gel_value_copy(array_values + i, iter_value);
+            gel_value_array_get_value(array, i, iter_value);
             GValue tmp_value = {0};
             do_(self, &tmp_value, n_values, values, loop_context);
 
             if(gel_context_error(loop_context))
-                running = FALSE;
+                running = gel_context_loop_exit(loop_context);
 
             if(GEL_IS_VALUE(&tmp_value))
                 g_value_unset(&tmp_value);
@@ -1855,6 +3097,143 @@ void for_(GClosure *self, GValue *return_value,
 }
 
 
+static
+void break_(GClosure *self, GValue *return_value,
+            guint n_values, const GValue *values, GelContext *context)
+{
+    if(n_values != 0)
+    {
+        gel_error_needs_n_arguments(context, __FUNCTION__, 0);
+        return;
+    }
+
+    gel_context_exit(context, GEL_CONTEXT_EXIT_BREAK, NULL);
+}
+
+
+static
+void continue_(GClosure *self, GValue *return_value,
+               guint n_values, const GValue *values, GelContext *context)
+{
+    if(n_values != 0)
+    {
+        gel_error_needs_n_arguments(context, __FUNCTION__, 0);
+        return;
+    }
+
+    gel_context_exit(context, GEL_CONTEXT_EXIT_CONTINUE, NULL);
+}
+
+
+static
+void return_(GClosure *self, GValue *return_value,
+             guint n_values, const GValue *values, GelContext *context)
+{
+    if(n_values > 1)
+    {
+        gel_error_needs_n_arguments(context, __FUNCTION__, 1);
+        return;
+    }
+
+    GValue value = {0};
+    if(n_values == 1)
+        gel_context_eval_value(context, values + 0, &value);
+
+    if(!gel_context_error(context))
+        gel_context_exit(context, GEL_CONTEXT_EXIT_RETURN, &value);
+
+    if(GEL_IS_VALUE(&value))
+        g_value_unset(&value);
+}
+
+
+static
+gboolean uses_symbol(const GValue *values, guint n_values, const gchar *name)
+{
+    for(guint i = 0; i < n_values; i++)
+    {
+        const GValue *value = values + i;
+
+        if(GEL_VALUE_HOLDS(value, GEL_TYPE_SYMBOL))
+        {
+            if(g_strcmp0(gel_symbol_get_name(gel_value_get_boxed(value)),
+                    name) == 0)
+                return TRUE;
+        }
+        else
+        if(GEL_VALUE_HOLDS(value, GEL_TYPE_VALUE_ARRAY))
+        {
+            GelValueArray *array = gel_value_get_boxed(value);
+            if(uses_symbol(gel_value_array_get_values(array),
+                    gel_value_array_get_n_values(array), name))
+                return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+
+static
+void try_(GClosure *self, GValue *return_value,
+          guint n_values, const GValue *values, GelContext *context)
+{
+    guint n_args = 2;
+    if(n_values < n_args)
+    {
+        gel_error_needs_at_least_n_arguments(context, __FUNCTION__, n_args);
+        return;
+    }
+
+    /* The last value is (catch name code...) */
+    const GValue *catch_values = NULL;
+    guint catch_n_values = 0;
+
+    const GValue *last = values + n_values - 1;
+    if(GEL_VALUE_HOLDS(last, GEL_TYPE_VALUE_ARRAY))
+    {
+        GelValueArray *array = gel_value_get_boxed(last);
+        catch_values = gel_value_array_get_values(array);
+        catch_n_values = gel_value_array_get_n_values(array);
+    }
+
+    if(catch_n_values < 2
+        || !GEL_VALUE_HOLDS(catch_values + 0, GEL_TYPE_SYMBOL)
+        || g_strcmp0(gel_symbol_get_name(
+            gel_value_get_boxed(catch_values + 0)), "catch") != 0
+        || !GEL_VALUE_HOLDS(catch_values + 1, GEL_TYPE_SYMBOL))
+    {
+        gel_error_expected(context, __FUNCTION__, "(catch name code...)");
+        return;
+    }
+
+    do_(self, return_value, n_values - 1, values, context);
+
+    /* Non-local exits go through */
+    if(gel_context_get_exit(context) != GEL_CONTEXT_EXIT_ERROR)
+        return;
+
+    const gchar *name =
+        gel_symbol_get_name(gel_value_get_boxed(catch_values + 1));
+    GelContext *catch_context = gel_context_new_with_outer(context);
+
+    /* The message is only formatted if the handler can look at it */
+    if(uses_symbol(catch_values + 2, catch_n_values - 2, name))
+    {
+        GError *error = gel_context_steal_error(context);
+        gel_context_define(catch_context, name, gel_value_new_from_boxed(
+            GEL_TYPE_STRING, gel_string_new(error->message)));
+        g_error_free(error);
+    }
+    else
+        gel_context_clear_error(context);
+
+    do_(self, return_value, catch_n_values - 2, catch_values + 2,
+        catch_context);
+    gel_context_free(catch_context);
+}
+
+
 static
 void range_(GClosure *self, GValue *return_value,
             guint n_values, const GValue *values, GelContext *context)
@@ -1866,24 +3245,17 @@ void range_(GClosure *self, GValue *return_value,
     if(gel_context_eval_params(context, __FUNCTION__,
             &n_values, &values, &tmp_list, "II", &first, &last))
     {
-        GelValueArray *array = gel_value_array_new(ABS(last-first) + 1);
-        GValue value = {0};
-        g_value_init(&value, G_TYPE_INT64);
+        GelValueArray *array = gel_value_array_new_packed(
+            GEL_ARRAY_STORAGE_INT64, ABS(last-first) + 1);
+        gint64 *ints = gel_value_array_peek_int64s(array);
 
         if(last > first)
             for(gint64 i = first; i <= last; i++)
-            {
-                gel_value_set_int64(&value, i);
-                gel_value_array_append(array, &value);
-            }
+                *ints++ = i;
         else
             for(gint64 i = first; i >= last; i--)
-            {
-                gel_value_set_int64(&value, i);
-                gel_value_array_append(array, &value);
-            }
+                *ints++ = i;
 
-        g_value_unset(&value);
         g_value_init(return_value, GEL_TYPE_VALUE_ARRAY);
         gel_value_take_boxed(return_value, array);
     }
@@ -1938,8 +3310,10 @@ void str_(GClosure *self, GValue *return_value,
     if(gel_context_eval_params(context, __FUNCTION__,
             &n_values, &values, &tmp_list, "V", &value))
     {
-        g_value_init(return_value, G_TYPE_STRING);
-        g_value_take_string(return_value, gel_value_to_string(value));
+        gchar *string = gel_value_to_string(value);
+        g_value_init(return_value, GEL_TYPE_STRING);
+        gel_value_take_boxed(return_value, gel_string_new(string));
+        g_free(string);
     }
 
     g_list_free(tmp_list);
@@ -2079,7 +3453,7 @@ void dot_(GClosure *self, GValue *return_value,
             name = gel_symbol_get_name(symbol);
         }
         else
-        if(type == G_TYPE_STRING)
+        if(GEL_VALUE_HOLDS_STRING(value))
             name = gel_value_get_string(value);
 
         if(name != NULL)
@@ -2136,23 +3510,24 @@ GHashTable* gel_make_default_symbols(void)
         /* structures */
         CLOSURE(array),
         CLOSURE(hash),
+        CLOSURE(record),
 
         /* symbols */
         CLOSURE(var),
         CLOSURE(name),
 
         /* accesors */
-        CLOSURE(set), /* symbol variable array hash object */
-        CLOSURE(get), /* array hash object */
-        CLOSURE(append), /* array hash */
+        CLOSURE(set), /* symbol variable array hash record ndarray object */
+        CLOSURE(get), /* array hash record ndarray object */
+        CLOSURE(append), /* array hash record */
         CLOSURE(remove), /* array hash */
-        CLOSURE(size), /* array hash */
+        CLOSURE(size), /* array hash record ndarray */
         CLOSURE(find), /* array hash */
         CLOSURE(filter), /* array hash */
         CLOSURE(compare),
         CLOSURE(sort), /* array */
         CLOSURE(reverse), /* array */
-        CLOSURE(keys), /* hash */
+        CLOSURE(keys), /* hash record */
 
         /* objects */
         CLOSURE(new), /* object */
@@ -2168,6 +3543,12 @@ GHashTable* gel_make_default_symbols(void)
         CLOSURE(for),
         CLOSURE(range),
 
+        /* exits */
+        CLOSURE(break),
+        CLOSURE(continue),
+        CLOSURE(return),
+        CLOSURE(try),
+
         /* output */
         CLOSURE(print),
         CLOSURE(str),
@@ -2180,6 +3561,27 @@ GHashTable* gel_make_default_symbols(void)
         CLOSURE_NAME("/", div), /* number */
         CLOSURE_NAME("%", mod), /* number */
 
+        /* numeric */
+        CLOSURE(sum), /* array ndarray */
+        CLOSURE(min), /* array ndarray */
+        CLOSURE(max), /* array ndarray */
+        CLOSURE(mean), /* array ndarray */
+        CLOSURE_NAME("dot", dot_product), /* array */
+        CLOSURE_NAME(".+", elementwise_add), /* array number */
+        CLOSURE_NAME(".-", elementwise_sub), /* array number */
+        CLOSURE_NAME(".*", elementwise_mul), /* array number */
+        CLOSURE_NAME("./", elementwise_div), /* array number */
+        CLOSURE(cumsum), /* array */
+
+        /* ndarray */
+        CLOSURE(ndarray),
+        CLOSURE(zeros),
+        CLOSURE(shape),
+        CLOSURE(reshape),
+        CLOSURE(transpose),
+        CLOSURE(slice),
+        CLOSURE(matmul),
+
         /* logic */
         CLOSURE(and),
         CLOSURE(or),
@@ -0,0 +1,452 @@
+#include <string.h>
+
+#include <gelrecord.h>
+#include <gelstring.h>
+#include <gelvalue.h>
+#include <gelvalueprivate.h>
+
+
+/*
+ * A shape describes the layout of a record: the names of its fields and
+ * the slot each one is stored at. Records built by appending the same
+ * fields in the same order end up sharing the same shape, so a field
+ * lookup only has to resolve a name to a slot once per shape.
+ *
+ * Each shape only keeps the name of the field it appends to its parent,
+ * so the rest of its fields are found walking up to the root. Records
+ * with more fields than GEL_RECORD_MAX_SHAPE_FIELDS leave their shape
+ * and keep a table of their own names instead, as a hash would do.
+ *
+ * Shapes are referenced by their records and by the shapes that extend
+ * them, and are freed with the last of them.
+ */
+
+#ifndef GEL_RECORD_MAX_SHAPE_FIELDS
+#define GEL_RECORD_MAX_SHAPE_FIELDS 32
+#endif
+
+typedef struct _GelShape GelShape;
+
+struct _GelShape
+{
+    volatile gint ref_count;
+    GelShape *parent;
+    const gchar *name;
+    guint n_fields;
+
+    /* Shapes extending this one by a name, not referenced by it */
+    GHashTable *transitions;
+};
+
+
+struct _GelRecord
+{
+    volatile gint ref_count;
+    GelShape *shape;
+    GValue *slots;
+    guint n_fields;
+    guint n_prealloced;
+
+    /* Names of the fields and their slots once the record left its shape */
+    gchar **names;
+    GHashTable *index;
+};
+
+
+/* Shapes are shared between threads, so their transitions are locked */
+G_LOCK_DEFINE_STATIC(shapes);
+
+
+#ifndef GEL_RECORD_CACHE_SIZE
+#define GEL_RECORD_CACHE_SIZE 256
+#endif
+
+typedef struct _GelRecordCacheEntry GelRecordCacheEntry;
+
+/*
+ * Entries keep a reference to their shape and name,
+ * so a hit only has to compare pointers.
+ */
+struct _GelRecordCacheEntry
+{
+    gconstpointer site;
+    GelShape *shape;
+    gchar *name;
+    guint slot;
+};
+
+static void gel_record_cache_free(GelRecordCacheEntry *cache);
+
+/* Each thread has a cache of its own */
+static GPrivate record_CACHE =
+    G_PRIVATE_INIT((GDestroyNotify)gel_record_cache_free);
+
+
+static
+GelShape* gel_shape_new(GelShape *parent, const gchar *name)
+{
+    GelShape *self = g_slice_new0(GelShape);
+    self->ref_count = 1;
+
+    if(parent != NULL)
+    {
+        g_atomic_int_inc(&parent->ref_count);
+        self->parent = parent;
+        self->name = g_intern_string(name);
+        self->n_fields = parent->n_fields + 1;
+    }
+
+    return self;
+}
+
+
+static
+GelShape* gel_shape_root(void)
+{
+    static GelShape *root = NULL;
+    static volatile gsize once = 0;
+
+    if(g_once_init_enter(&once))
+    {
+        root = gel_shape_new(NULL, NULL);
+        g_once_init_leave(&once, 1);
+    }
+
+    return root;
+}
+
+
+/*
+ * Adds a reference to a shape the caller already holds one to.
+ */
+static
+GelShape* gel_shape_ref(GelShape *self)
+{
+    g_atomic_int_inc(&self->ref_count);
+    return self;
+}
+
+
+/*
+ * Releases @self, and its parents that are left unused with it.
+ * The root is never released, as it keeps the reference it was created with.
+ */
+static
+void gel_shape_unref(GelShape *self)
+{
+    /* Only the last reference has to be dropped with the lock held */
+    gint ref_count;
+    while((ref_count = g_atomic_int_get(&self->ref_count)) > 1)
+        if(g_atomic_int_compare_and_exchange(&self->ref_count,
+                ref_count, ref_count - 1))
+            return;
+
+    G_LOCK(shapes);
+    while(self != NULL && g_atomic_int_dec_and_test(&self->ref_count))
+    {
+        GelShape *parent = self->parent;
+        g_hash_table_remove(parent->transitions, self->name);
+
+        if(self->transitions != NULL)
+            g_hash_table_unref(self->transitions);
+        g_slice_free(GelShape, self);
+
+        self = parent;
+    }
+    G_UNLOCK(shapes);
+}
+
+
+/*
+ * Gets a reference to the shape that results from appending @name to @self.
+ */
+static
+GelShape* gel_shape_transition(GelShape *self, const gchar *name)
+{
+    G_LOCK(shapes);
+    if(self->transitions == NULL)
+        self->transitions = g_hash_table_new(g_str_hash, g_str_equal);
+
+    GelShape *shape = g_hash_table_lookup(self->transitions, name);
+    if(shape != NULL)
+        gel_shape_ref(shape);
+    else
+    {
+        shape = gel_shape_new(self, name);
+        g_hash_table_insert(self->transitions, (gpointer)shape->name, shape);
+    }
+    G_UNLOCK(shapes);
+
+    return shape;
+}
+
+
+static
+const gchar* gel_shape_get_name(const GelShape *self, guint slot)
+{
+    while(self->n_fields > slot + 1)
+        self = self->parent;
+
+    return self->name;
+}
+
+
+static
+gint gel_shape_lookup(const GelShape *self, const gchar *name)
+{
+    for(; self->parent != NULL; self = self->parent)
+        if(self->name == name || strcmp(self->name, name) == 0)
+            return self->n_fields - 1;
+
+    return -1;
+}
+
+
+/*
+ * Moves the names of the fields of @self out of its shape,
+ * into a table of its own.
+ */
+static
+void gel_record_leave_shape(GelRecord *self)
+{
+    self->names = g_new(gchar*, self->n_prealloced);
+    self->index = g_hash_table_new(g_str_hash, g_str_equal);
+
+    for(guint i = 0; i < self->n_fields; i++)
+    {
+        self->names[i] = g_strdup(gel_shape_get_name(self->shape, i));
+        g_hash_table_insert(self->index,
+            self->names[i], GUINT_TO_POINTER(i + 1));
+    }
+
+    gel_shape_unref(self->shape);
+    self->shape = NULL;
+}
+
+
+GType gel_record_get_type(void)
+{
+    static volatile gsize once = 0;
+    static GType type = G_TYPE_INVALID;
+
+    if(g_once_init_enter(&once))
+    {
+        type = g_boxed_type_register_static("GelRecord",
+            (GBoxedCopyFunc)gel_record_ref, (GBoxedFreeFunc)gel_record_unref);
+        g_once_init_leave(&once, 1);
+    }
+
+    return type;
+}
+
+
+GelRecord* gel_record_new(void)
+{
+    GelRecord *self = g_slice_new0(GelRecord);
+    self->ref_count = 1;
+    self->shape = gel_shape_ref(gel_shape_root());
+
+    return self;
+}
+
+
+GelRecord* gel_record_ref(GelRecord *self)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+
+    g_atomic_int_inc(&self->ref_count);
+    return self;
+}
+
+
+void gel_record_unref(GelRecord *self)
+{
+    g_return_if_fail(self != NULL);
+
+    if(g_atomic_int_dec_and_test(&self->ref_count))
+    {
+        for(guint i = 0; i < self->n_fields; i++)
+            if(GEL_IS_VALUE(self->slots + i))
+                g_value_unset(self->slots + i);
+        g_free(self->slots);
+
+        if(self->shape != NULL)
+            gel_shape_unref(self->shape);
+        else
+        {
+            g_hash_table_unref(self->index);
+            for(guint i = 0; i < self->n_fields; i++)
+                g_free(self->names[i]);
+            g_free(self->names);
+        }
+
+        g_slice_free(GelRecord, self);
+    }
+}
+
+
+guint gel_record_get_n_fields(const GelRecord *self)
+{
+    g_return_val_if_fail(self != NULL, 0);
+
+    return self->n_fields;
+}
+
+
+const gchar* gel_record_get_field_name(const GelRecord *self, guint index)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+    g_return_val_if_fail(index < self->n_fields, NULL);
+
+    if(self->shape == NULL)
+        return self->names[index];
+
+    return gel_shape_get_name(self->shape, index);
+}
+
+
+GValue* gel_record_get_field_value(const GelRecord *self, guint index)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+    g_return_val_if_fail(index < self->n_fields, NULL);
+
+    return self->slots + index;
+}
+
+
+GValue* gel_record_lookup(const GelRecord *self, const gchar *name)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+    g_return_val_if_fail(name != NULL, NULL);
+
+    gint slot = self->shape != NULL
+        ? gel_shape_lookup(self->shape, name)
+        : GPOINTER_TO_INT(g_hash_table_lookup(self->index, name)) - 1;
+
+    return slot >= 0 ? self->slots + slot : NULL;
+}
+
+
+static
+void gel_record_cache_entry_clear(GelRecordCacheEntry *entry)
+{
+    if(entry->shape != NULL)
+    {
+        gel_shape_unref(entry->shape);
+        gel_string_unref(entry->name);
+        entry->shape = NULL;
+        entry->name = NULL;
+    }
+}
+
+
+static
+void gel_record_cache_free(GelRecordCacheEntry *cache)
+{
+    for(guint i = 0; i < GEL_RECORD_CACHE_SIZE; i++)
+        gel_record_cache_entry_clear(cache + i);
+    g_free(cache);
+}
+
+
+static
+GelRecordCacheEntry* gel_record_cache_entry(gconstpointer site)
+{
+    GelRecordCacheEntry *cache = g_private_get(&record_CACHE);
+    if(cache == NULL)
+    {
+        cache = g_new0(GelRecordCacheEntry, GEL_RECORD_CACHE_SIZE);
+        g_private_set(&record_CACHE, cache);
+    }
+
+    return cache + (GPOINTER_TO_SIZE(site) >> 4) % GEL_RECORD_CACHE_SIZE;
+}
+
+
+/*
+ * Like gel_record_lookup(), but remembers the slot of the field for the
+ * shape of the record, keyed on @site (the #GValue holding the name in
+ * the code doing the lookup). Later lookups from the same site of the
+ * same #GelString on records of the same shape go straight to the slot.
+ */
+GValue* gel_record_lookup_cached(const GelRecord *self,
+                                 const GValue *site, const GValue *name)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+    g_return_val_if_fail(name != NULL, NULL);
+
+    GelShape *shape = self->shape;
+    gchar *string = gel_value_get_string(name);
+    if(shape == NULL || GEL_VALUE_TYPE(name) != GEL_TYPE_STRING)
+        return gel_record_lookup(self, string);
+
+    GelRecordCacheEntry *entry = gel_record_cache_entry(site);
+
+    if(entry->site == site && entry->shape == shape && entry->name == string)
+        return self->slots + entry->slot;
+
+    gint slot = gel_shape_lookup(shape, string);
+    if(slot < 0)
+        return NULL;
+
+    gel_record_cache_entry_clear(entry);
+    entry->site = site;
+    entry->shape = gel_shape_ref(shape);
+    entry->name = gel_string_ref(string);
+    entry->slot = slot;
+
+    return self->slots + slot;
+}
+
+
+/*
+ * Stores a copy of @value in the field @name. A record that does not have
+ * such field moves to the shape that results from appending @name,
+ * or leaves its shape if it would have too many fields.
+ */
+void gel_record_insert(GelRecord *self, const gchar *name,
+                       const GValue *value)
+{
+    g_return_if_fail(self != NULL);
+    g_return_if_fail(name != NULL);
+    g_return_if_fail(value != NULL);
+
+    GValue *slot_value = gel_record_lookup(self, name);
+    if(slot_value == NULL)
+    {
+        guint n_fields = self->n_fields;
+        if(n_fields == self->n_prealloced)
+        {
+            self->n_prealloced = MAX(4, self->n_prealloced * 2);
+            self->slots = g_renew(GValue, self->slots, self->n_prealloced);
+            memset(self->slots + n_fields, 0,
+                sizeof(GValue) * (self->n_prealloced - n_fields));
+            if(self->shape == NULL)
+                self->names = g_renew(gchar*, self->names, self->n_prealloced);
+        }
+
+        if(self->shape != NULL && n_fields == GEL_RECORD_MAX_SHAPE_FIELDS)
+            gel_record_leave_shape(self);
+
+        if(self->shape != NULL)
+        {
+            GelShape *shape = gel_shape_transition(self->shape, name);
+            gel_shape_unref(self->shape);
+            self->shape = shape;
+        }
+        else
+        {
+            self->names[n_fields] = g_strdup(name);
+            g_hash_table_insert(self->index,
+                self->names[n_fields], GUINT_TO_POINTER(n_fields + 1));
+        }
+
+        self->n_fields++;
+        slot_value = self->slots + n_fields;
+    }
+    else
+    if(GEL_IS_VALUE(slot_value))
+        g_value_unset(slot_value);
+
+    gel_value_copy(value, slot_value);
+}
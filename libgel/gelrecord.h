@@ -0,0 +1,23 @@
+#ifndef GEL_TYPE_RECORD
+#define GEL_TYPE_RECORD (gel_record_get_type())
+
+#include <glib-object.h>
+
+typedef struct _GelRecord GelRecord;
+GType gel_record_get_type(void) G_GNUC_CONST;
+
+GelRecord* gel_record_new(void);
+GelRecord* gel_record_ref(GelRecord *self);
+void gel_record_unref(GelRecord *self);
+
+guint gel_record_get_n_fields(const GelRecord *self);
+const gchar* gel_record_get_field_name(const GelRecord *self, guint index);
+GValue* gel_record_get_field_value(const GelRecord *self, guint index);
+
+GValue* gel_record_lookup(const GelRecord *self, const gchar *name);
+GValue* gel_record_lookup_cached(const GelRecord *self,
+                                 const GValue *site, const GValue *name);
+void gel_record_insert(GelRecord *self, const gchar *name,
+                       const GValue *value);
+
+#endif
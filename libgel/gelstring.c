@@ -0,0 +1,162 @@
+#include <string.h>
+
+#include <gelstring.h>
+#include <gelvalueprivate.h>
+
+
+/*
+ * Strings used by Gel values are immutable and reference counted.
+ * A string is a plain nul-terminated gchar* preceded by a header that
+ * keeps its reference count, its length and its hash once computed,
+ * so copying a string value only increases its reference count.
+ */
+
+typedef struct _GelStringHeader GelStringHeader;
+
+struct _GelStringHeader
+{
+    volatile gint ref_count;
+    guint hash;
+    gsize length;
+};
+
+#define gel_string_header(s) (((GelStringHeader*)(s)) - 1)
+
+
+static
+void gel_string_to_string_transform(const GValue *src_value,
+                                    GValue *dest_value)
+{
+    g_value_set_string(dest_value, gel_value_get_string(src_value));
+}
+
+
+static
+void gel_string_from_string_transform(const GValue *src_value,
+                                      GValue *dest_value)
+{
+    const gchar *str = gel_value_get_string(src_value);
+    gel_value_take_boxed(dest_value, str != NULL ? gel_string_new(str) : NULL);
+}
+
+
+GType gel_string_get_type(void)
+{
+    static volatile gsize once = 0;
+    static GType type = G_TYPE_INVALID;
+
+    if(g_once_init_enter(&once))
+    {
+        type = g_boxed_type_register_static("GelString",
+            (GBoxedCopyFunc)gel_string_ref, (GBoxedFreeFunc)gel_string_unref);
+        g_value_register_transform_func(type, G_TYPE_STRING,
+            gel_string_to_string_transform);
+        g_value_register_transform_func(G_TYPE_STRING, type,
+            gel_string_from_string_transform);
+        g_once_init_leave(&once, 1);
+    }
+
+    return type;
+}
+
+
+static
+gchar* gel_string_alloc(gsize length)
+{
+    GelStringHeader *header = g_malloc(sizeof(GelStringHeader) + length + 1);
+    header->ref_count = 1;
+    header->hash = 0;
+    header->length = length;
+
+    gchar *self = (gchar*)(header + 1);
+    self[length] = 0;
+
+    return self;
+}
+
+
+gchar* gel_string_new_len(const gchar *str, gsize length)
+{
+    gchar *self = gel_string_alloc(length);
+    memcpy(self, str, length);
+
+    return self;
+}
+
+
+gchar* gel_string_new(const gchar *str)
+{
+    g_return_val_if_fail(str != NULL, NULL);
+
+    return gel_string_new_len(str, strlen(str));
+}
+
+
+gchar* gel_string_concat(const gchar *s1, gsize l1,
+                         const gchar *s2, gsize l2)
+{
+    gchar *self = gel_string_alloc(l1 + l2);
+    memcpy(self, s1, l1);
+    memcpy(self + l1, s2, l2);
+
+    return self;
+}
+
+
+gchar* gel_string_ref(gchar *self)
+{
+    g_return_val_if_fail(self != NULL, NULL);
+
+    g_atomic_int_inc(&gel_string_header(self)->ref_count);
+    return self;
+}
+
+
+void gel_string_unref(gchar *self)
+{
+    g_return_if_fail(self != NULL);
+
+    GelStringHeader *header = gel_string_header(self);
+    if(g_atomic_int_dec_and_test(&header->ref_count))
+        g_free(header);
+}
+
+
+gsize gel_string_get_length(const gchar *self)
+{
+    return self != NULL ? gel_string_header(self)->length : 0;
+}
+
+
+guint gel_string_hash(const gchar *self)
+{
+    if(self == NULL)
+        return 0;
+
+    GelStringHeader *header = gel_string_header(self);
+    if(header->hash == 0)
+        header->hash = g_str_hash(self);
+
+    return header->hash;
+}
+
+
+gboolean gel_string_equal(const gchar *s1, const gchar *s2)
+{
+    if(s1 == s2)
+        return TRUE;
+
+    if(s1 == NULL || s2 == NULL)
+        return FALSE;
+
+    const GelStringHeader *h1 = gel_string_header(s1);
+    const GelStringHeader *h2 = gel_string_header(s2);
+
+    if(h1->length != h2->length)
+        return FALSE;
+
+    if(h1->hash != 0 && h2->hash != 0 && h1->hash != h2->hash)
+        return FALSE;
+
+    return memcmp(s1, s2, h1->length) == 0;
+}
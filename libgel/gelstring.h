@@ -0,0 +1,19 @@
+#ifndef GEL_TYPE_STRING
+#define GEL_TYPE_STRING (gel_string_get_type())
+
+#include <glib-object.h>
+
+GType gel_string_get_type(void) G_GNUC_CONST;
+
+gchar* gel_string_new(const gchar *str);
+gchar* gel_string_new_len(const gchar *str, gsize length);
+gchar* gel_string_concat(const gchar *s1, gsize l1,
+                         const gchar *s2, gsize l2);
+gchar* gel_string_ref(gchar *self);
+void gel_string_unref(gchar *self);
+
+gsize gel_string_get_length(const gchar *self);
+guint gel_string_hash(const gchar *self);
+gboolean gel_string_equal(const gchar *s1, const gchar *s2);
+
+#endif
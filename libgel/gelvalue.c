@@ -1,8 +1,13 @@
+#include <string.h>
+
 #include <glib-object.h>
 
 #include <gelvalue.h>
 #include <gelvalueprivate.h>
+#include <gelarrayprivate.h>
 #include <gelsymbol.h>
+#include <gelrecord.h>
+#include <gelndarray.h>
 #include <gelclosure.h>
 
 
@@ -113,6 +118,42 @@ void gel_value_list_free(GList *value_list)
 }
 
 
+/*
+ * Turns a #GelString held by @value into a plain gchararray,
+ * the string type the host expects from the values it gets.
+ */
+void gel_value_to_host(GValue *value)
+{
+    if(GEL_VALUE_TYPE(value) == GEL_TYPE_STRING)
+    {
+        GValue host_value = {0};
+        g_value_init(&host_value, G_TYPE_STRING);
+        g_value_set_string(&host_value, gel_value_get_string(value));
+        g_value_unset(value);
+        *value = host_value;
+    }
+}
+
+
+/*
+ * Turns a plain gchararray held by @value, as passed by the host,
+ * into a #GelString.
+ */
+void gel_value_from_host(GValue *value)
+{
+    if(GEL_VALUE_TYPE(value) == G_TYPE_STRING
+        && gel_value_get_string(value) != NULL)
+    {
+        GValue gel_value = {0};
+        g_value_init(&gel_value, GEL_TYPE_STRING);
+        gel_value_take_boxed(&gel_value,
+            gel_string_new(gel_value_get_string(value)));
+        g_value_unset(value);
+        *value = gel_value;
+    }
+}
+
+
 static
 gchar* gel_value_stringify(const GValue *value, gchar* (*str)(const GValue *))
 {
@@ -135,14 +176,17 @@ gchar* gel_value_stringify(const GValue *value, gchar* (*str)(const GValue *))
         if(n_values > 0)
         {
             guint last = n_values - 1;
-            const GValue *array_values = gel_value_array_get_values(array);
 
             for(guint i = 0; i <= last; i++)
             {
-                gchar *s = str(array_values + i);
+                GValue tmp_value = {0};
+                gel_value_array_get_value(array, i, &tmp_value);
+                gchar *s = str(&tmp_value);
                 g_string_append_printf(buffer,
                     "%s%s", s, i != last ? " " : ")");
                 g_free(s);
+                if(GEL_IS_VALUE(&tmp_value))
+                    g_value_unset(&tmp_value);
             }
         }
         else
@@ -184,6 +228,41 @@ gchar* gel_value_stringify(const GValue *value, gchar* (*str)(const GValue *))
         result =  g_string_free(buffer, FALSE);
     }
     else
+    if(GEL_VALUE_HOLDS(value, GEL_TYPE_RECORD))
+    {
+        const GelRecord *record = gel_value_get_boxed(value);
+        GString *buffer = g_string_new("{");
+        const guint n_fields = gel_record_get_n_fields(record);
+
+        if(n_fields > 0)
+        {
+            guint last = n_fields - 1;
+            GValue name_value = {0};
+            g_value_init(&name_value, G_TYPE_STRING);
+
+            for(guint i = 0; i <= last; i++)
+            {
+                g_value_set_static_string(&name_value,
+                    gel_record_get_field_name(record, i));
+                gchar *ks = str(&name_value);
+                gchar *vs = str(gel_record_get_field_value(record, i));
+                g_string_append_printf(buffer,
+                    "%s %s%s", ks, vs, i != last ? " " : "}");
+                g_free(ks);
+                g_free(vs);
+            }
+
+            g_value_unset(&name_value);
+        }
+        else
+            g_string_append_c(buffer, '}');
+
+        result =  g_string_free(buffer, FALSE);
+    }
+    else
+    if(GEL_VALUE_HOLDS(value, GEL_TYPE_NDARRAY))
+        result = gel_ndarray_to_string(gel_value_get_boxed(value));
+    else
     if(GEL_VALUE_HOLDS(value, GEL_TYPE_SYMBOL))
     {
         const GelSymbol *symbol = gel_value_get_boxed(value);
@@ -245,7 +324,7 @@ gchar* gel_value_repr(const GValue *value)
     g_return_val_if_fail(value != NULL, NULL);
     g_return_val_if_fail(GEL_IS_VALUE(value), NULL);
 
-    if(GEL_VALUE_HOLDS(value, G_TYPE_STRING))
+    if(GEL_VALUE_HOLDS_STRING(value))
         return g_strdup_printf("\"%s\"", gel_value_get_string(value));
 
     return gel_value_stringify(value, gel_value_repr);
@@ -268,7 +347,7 @@ gchar* gel_value_to_string(const GValue *value)
     if(!GEL_IS_VALUE(value))
         return g_strdup("VOID");
 
-    if(GEL_VALUE_HOLDS(value, G_TYPE_STRING))
+    if(GEL_VALUE_HOLDS_STRING(value))
         return g_strdup(gel_value_get_string(value));
 
     return gel_value_stringify(value, gel_value_to_string);
@@ -316,6 +395,13 @@ gboolean gel_value_to_boolean(const GValue *value)
             result = (gel_value_get_double(value) != 0.0);
             break;
         default:
+            if(type == GEL_TYPE_STRING)
+            {
+                result = (gel_string_get_length(
+                    gel_value_get_string(value)) != 0);
+                break;
+            }
+            else
             if(type == G_TYPE_ARRAY)
             {
                 GelValueArray *array = gel_value_get_boxed(value);
@@ -361,10 +447,12 @@ GType gel_value_simple_type(const GValue *value)
         case G_TYPE_DOUBLE:
             return G_TYPE_DOUBLE;
         case G_TYPE_STRING:
-            return G_TYPE_STRING;
+            return GEL_TYPE_STRING;
         case G_TYPE_BOOLEAN:
             return G_TYPE_BOOLEAN;
         default:
+            if(type == GEL_TYPE_STRING)
+                return GEL_TYPE_STRING;
             if(GEL_VALUE_HOLDS(value, G_TYPE_ENUM)
                || GEL_VALUE_HOLDS(value, G_TYPE_FLAGS))
                 return G_TYPE_INT64;
@@ -372,6 +460,10 @@ GType gel_value_simple_type(const GValue *value)
                 return GEL_TYPE_VALUE_ARRAY;
             if(GEL_VALUE_HOLDS(value, G_TYPE_HASH_TABLE))
                 return G_TYPE_HASH_TABLE;
+            if(GEL_VALUE_HOLDS(value, GEL_TYPE_NDARRAY))
+                return GEL_TYPE_NDARRAY;
+            if(GEL_VALUE_HOLDS(value, GEL_TYPE_RECORD))
+                return GEL_TYPE_RECORD;
             if(g_value_fits_pointer(value))
                 return G_TYPE_POINTER;
 
@@ -402,7 +494,6 @@ GType gel_values_simple_type(const GValue *v1, const GValue *v2)
 }
 
 
-static
 guint gel_value_hash(const GValue *value)
 {
     GType type = GEL_VALUE_TYPE(value);
@@ -411,6 +502,8 @@ guint gel_value_hash(const GValue *value)
         case G_TYPE_STRING:
             return g_str_hash(gel_value_get_string(value));
         default:
+            if(type == GEL_TYPE_STRING)
+                return gel_string_hash(gel_value_get_string(value));
             return value->data[0].v_uint;
     }
 }
@@ -481,6 +574,22 @@ GList* gel_args_from_array(const GelValueArray *vars, gchar **variadic,
 }
 
 
+/*
+ * Gets the length of the string held by @value, a #GelString
+ * or a plain gchararray coming from the host.
+ */
+static
+gsize gel_value_get_length(const GValue *value)
+{
+    const gchar *string = gel_value_get_string(value);
+
+    if(GEL_VALUE_TYPE(value) == GEL_TYPE_STRING)
+        return gel_string_get_length(string);
+
+    return string != NULL ? strlen(string) : 0;
+}
+
+
 static
 gboolean gel_values_simple_add(const GValue *v1, const GValue *v2, 
                                GValue *dest_value)
@@ -502,33 +611,22 @@ gboolean gel_values_simple_add(const GValue *v1, const GValue *v2,
                 gel_value_get_double(v1)
                 + gel_value_get_double(v2));
             return TRUE;
-        case G_TYPE_STRING:
-            g_value_take_string(dest_value,
-                g_strconcat(
-                    gel_value_get_string(v1),
-                    gel_value_get_string(v2),
-                NULL));
-            return TRUE;
         default:
+            if(type == GEL_TYPE_STRING)
+            {
+                gel_value_take_boxed(dest_value,
+                    gel_string_concat(
+                        gel_value_get_string(v1), gel_value_get_length(v1),
+                        gel_value_get_string(v2), gel_value_get_length(v2)));
+                return TRUE;
+            }
+            else
             if(type == GEL_TYPE_VALUE_ARRAY)
             {
-                GelValueArray *a1 = gel_value_get_boxed(v1);
-                GelValueArray *a2 = gel_value_get_boxed(v2);
-                guint n1_values = gel_value_array_get_n_values(a1);
-                guint n2_values = gel_value_array_get_n_values(a2);
-
-                GelValueArray *array =
-                    gel_value_array_new(n1_values + n2_values);
-
-                const GValue *a1_values = gel_value_array_get_values(a1);
-                for(guint i = 0; i < n1_values; i++)
-                    gel_value_array_append(array, a1_values + i);
-
-                const GValue *a2_values = gel_value_array_get_values(a2);
-                for(guint i = 0; i < n2_values; i++)
-                    gel_value_array_append(array, a2_values + i);
-
-                gel_value_take_boxed(dest_value, array);
+                gel_value_take_boxed(dest_value,
+                    gel_value_array_concat(
+                        gel_value_get_boxed(v1),
+                        gel_value_get_boxed(v2)));
                 return TRUE;
             }
             else
@@ -720,12 +818,12 @@ gboolean gel_values_can_cmp(const GValue *v1, const GValue *v2)
     {
         case G_TYPE_INT64:
         case G_TYPE_DOUBLE:
-        case G_TYPE_STRING:
         case G_TYPE_POINTER:
         case G_TYPE_BOOLEAN:
             return TRUE;
         default:
-            if(type == GEL_TYPE_VALUE_ARRAY)
+            if(type == GEL_TYPE_STRING || type == GEL_TYPE_VALUE_ARRAY
+               || type == GEL_TYPE_NDARRAY || type == GEL_TYPE_RECORD)
                 return TRUE;
             return FALSE;
     }
@@ -759,6 +857,11 @@ gboolean gel_values_simple_ge(const GValue *v1, const GValue *v2)
 static
 gboolean gel_values_simple_eq(const GValue *v1, const GValue *v2)
 {
+    if(GEL_VALUE_TYPE(v1) == GEL_TYPE_STRING
+        && GEL_VALUE_TYPE(v2) == GEL_TYPE_STRING)
+        return gel_string_equal(
+            gel_value_get_string(v1), gel_value_get_string(v2));
+
     if(gel_values_can_cmp(v1, v2))
         return gel_values_cmp(v1, v2) == 0;
     return FALSE;
@@ -795,6 +898,11 @@ gboolean gel_values_simple_ne(const GValue *v1, const GValue *v2)
     g_return_val_if_fail(v1 != NULL, FALSE);
     g_return_val_if_fail(v2 != NULL, FALSE);
 
+    if(GEL_VALUE_TYPE(v1) == GEL_TYPE_STRING
+        && GEL_VALUE_TYPE(v2) == GEL_TYPE_STRING)
+        return !gel_string_equal(
+            gel_value_get_string(v1), gel_value_get_string(v2));
+
     if(gel_values_can_cmp(v1, v2))
         return gel_values_cmp(v1, v2) != 0;
     return FALSE;
@@ -883,12 +991,6 @@ gint gel_values_cmp(const GValue *v1, const GValue *v2)
             result = b1 > b2 ? 1 : b1 < b2 ? -1 : 0;
             break;
         }
-        case G_TYPE_STRING:
-        {
-            result = g_strcmp0(
-                gel_value_get_string(vv1), gel_value_get_string(vv2));
-            break;
-        }
         case G_TYPE_POINTER:
         {
             
@@ -899,6 +1001,13 @@ gint gel_values_cmp(const GValue *v1, const GValue *v2)
             break;
         }
         default:
+            if(simple_type == GEL_TYPE_STRING)
+            {
+                const gchar *s1 = gel_value_get_string(vv1);
+                const gchar *s2 = gel_value_get_string(vv2);
+                result = s1 == s2 ? 0 : g_strcmp0(s1, s2);
+            }
+            else
             if(simple_type == GEL_TYPE_VALUE_ARRAY)
             {
                 GelValueArray *a1 = gel_value_get_boxed(vv1);
@@ -908,19 +1017,52 @@ gint gel_values_cmp(const GValue *v1, const GValue *v2)
                 guint a2_n = gel_value_array_get_n_values(a2);
                 guint n_values = MIN(a1_n, a2_n);
 
-                GValue *a1_values = gel_value_array_get_values(a1);
-                GValue *a2_values = gel_value_array_get_values(a2);
-
                 guint i;
-                for(i = 0; i < n_values; i++)
+                if(gel_value_array_get_storage(a1) == GEL_ARRAY_STORAGE_INT64
+                    && gel_value_array_get_storage(a2)
+                        == GEL_ARRAY_STORAGE_INT64)
+                {
+                    const gint64 *i1 = gel_value_array_peek_int64s(a1);
+                    const gint64 *i2 = gel_value_array_peek_int64s(a2);
+                    for(i = 0; i < n_values; i++)
+                        if(i1[i] != i2[i])
+                        {
+                            result = i1[i] > i2[i] ? 1 : -1;
+                            break;
+                        }
+                }
+                else
                 {
-                    result = gel_values_cmp(a1_values + i, a2_values + i);
-                    if(result != 0)
-                        break;
+                    for(i = 0; i < n_values; i++)
+                    {
+                        GValue e1 = {0};
+                        GValue e2 = {0};
+                        gel_value_array_get_value(a1, i, &e1);
+                        gel_value_array_get_value(a2, i, &e2);
+                        result = gel_values_cmp(&e1, &e2);
+                        if(GEL_IS_VALUE(&e1))
+                            g_value_unset(&e1);
+                        if(GEL_IS_VALUE(&e2))
+                            g_value_unset(&e2);
+                        if(result != 0)
+                            break;
+                    }
                 }
                 if(i == n_values)
                     result = a1_n > a2_n ? 1 : a1_n < a2_n ? -1 : 0;
             }
+            else
+            if(simple_type == GEL_TYPE_NDARRAY)
+                result = gel_ndarray_cmp(
+                    gel_value_get_boxed(vv1), gel_value_get_boxed(vv2));
+            else
+            if(simple_type == GEL_TYPE_RECORD)
+            {
+                /* Records are only equal to themselves */
+                const GelRecord *r1 = gel_value_get_boxed(vv1);
+                const GelRecord *r2 = gel_value_get_boxed(vv2);
+                result = r1 > r2 ? 1 : r1 < r2 ? -1 : 0;
+            }
     }
 
     if(GEL_IS_VALUE(&tmp1))
@@ -4,6 +4,7 @@
 #include <glib-object.h>
 
 #include <gelvariable.h>
+#include <gelstring.h>
 #include <gelarray.h>
 
 #ifndef GEL_VALUE_USE_MACRO
@@ -72,6 +73,9 @@
 
 #endif
 
+#define GEL_VALUE_HOLDS_STRING(v) \
+    (GEL_VALUE_TYPE(v) == GEL_TYPE_STRING || GEL_VALUE_HOLDS(v, G_TYPE_STRING))
+
 #define gel_value_new() (g_new0(GValue, 1))
 #define gel_value_new_of_type(t) (g_value_init(gel_value_new(), t))
 
@@ -86,10 +90,13 @@ GValue* gel_value_new_from_boxed(GType type, gpointer boxed);
 GValue* gel_value_dup(const GValue *value);
 void gel_value_free(GValue *value);
 void gel_value_list_free(GList *value_list);
+void gel_value_to_host(GValue *value);
+void gel_value_from_host(GValue *value);
 
 GList* gel_args_from_array(const GelValueArray *vars, gchar **variadic,
                            gchar **invalid);
 
+guint gel_value_hash(const GValue *value);
 GHashTable* gel_hash_table_new(void);
 
 GelVariable* gel_variable_lookup_predefined(const gchar *name);
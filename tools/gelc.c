@@ -0,0 +1,455 @@
+/*
+    gelc compiles a script to C source code for a shared object
+    that gel_context_load_module() can load into a GelContext.
+
+    Functions defined once at the top level of the script are
+    translated to instructions by gelnative.c, the way the JIT does
+    before compiling them to machine code, and these are written as C.
+    This covers int64 and boolean code using their arguments, names
+    they define at the top of their code, the predefined arithmetic,
+    comparisons, if, do, set and while, and calls to other predefined
+    closures, which the C code makes with gel_module_call(). Such
+    functions run natively when their arguments are int64, and are
+    interpreted otherwise.
+
+    Everything else is not compiled: the module keeps the text of the
+    script, which is parsed and evaluated as usual when it is loaded.
+    Forms outside of the subset can define names, take code instead of
+    values, capture contexts or be rewritten by macros and eval at run
+    time, so C code calling into the runtime for them would do the work
+    of the interpreter without saving any of it. The compiled functions
+    also need their code, to fall back to it when they are called with
+    other arguments or when what they call gives up.
+
+    Usage: gelc script.gel module.c
+    The module can be then built with the C compiler of the system:
+    cc -shared -fPIC `pkg-config --cflags gel-0.1` module.c -o module.so
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <gel.h>
+#include <gelvalueprivate.h>
+#include <gelsymbol.h>
+#include <gelnative.h>
+
+
+typedef struct _GelcCompiler
+{
+    const GelNative *native;
+    GString *code;
+    guint depth;
+
+    /* Values on the stack, and at most */
+    guint n_stack;
+    guint max_stack;
+
+    gboolean has_operand;
+    gboolean has_calls;
+} GelcCompiler;
+
+
+static
+void gelc_emit(GelcCompiler *c, const gchar *format, ...)
+    G_GNUC_PRINTF(2, 3);
+
+static
+void gelc_emit(GelcCompiler *c, const gchar *format, ...)
+{
+    for(guint i = 0; i < c->depth; i++)
+        g_string_append(c->code, "    ");
+
+    va_list args;
+    va_start(args, format);
+    g_string_append_vprintf(c->code, format, args);
+    va_end(args);
+
+    g_string_append_c(c->code, '\n');
+}
+
+
+/* Appends @text as a C string literal */
+static
+void gelc_quote(GString *code, const gchar *text)
+{
+    gchar *escaped = g_strescape(text, NULL);
+
+    g_string_append_c(code, '"');
+    for(const gchar *p = escaped; *p != 0; p++)
+        if(*p == '?')
+            g_string_append(code, "\\?");
+        else
+            g_string_append_c(code, *p);
+    g_string_append_c(code, '"');
+
+    g_free(escaped);
+}
+
+
+static
+const gchar* gelc_symbol_name(const GValue *value)
+{
+    if(!GEL_VALUE_HOLDS(value, GEL_TYPE_SYMBOL))
+        return NULL;
+
+    return gel_symbol_get_name(gel_value_get_boxed(value));
+}
+
+
+/* Makes the call of index @index, returning what it does unless done */
+static
+void gelc_call(GelcCompiler *c, guint index)
+{
+    const GelModuleCall *call = g_ptr_array_index(c->native->calls, index);
+
+    c->has_calls = TRUE;
+    gelc_emit(c, "status = gel_module_call(calls[%u], slots, context);",
+        index);
+    gelc_emit(c, "if(status != GEL_MODULE_DONE)");
+    gelc_emit(c, "    return status;");
+
+    if(call->result != 0)
+        gelc_emit(c, "a = slots[%u];", call->result - 1);
+}
+
+
+/* Divides a by b, making the call whose index + 1 is @division instead
+   of dividing by 0, if it is not 0 */
+static
+void gelc_division(GelcCompiler *c, GelNativeOpCode code, guint division)
+{
+    const gchar *op = (code == GEL_NATIVE_DIVIDE) ? "/" : "%";
+
+    if(division == 0)
+    {
+        gelc_emit(c, "a = a %s b;", op);
+        return;
+    }
+
+    const GelModuleCall *call =
+        g_ptr_array_index(c->native->calls, division - 1);
+
+    gelc_emit(c, "if(b == 0)");
+    gelc_emit(c, "{");
+    c->depth++;
+    gelc_emit(c, "slots[%u] = a;", call->slots[0] - 1);
+    gelc_emit(c, "slots[%u] = b;", call->slots[1] - 1);
+    gelc_call(c, division - 1);
+    c->depth--;
+    gelc_emit(c, "}");
+    gelc_emit(c, "else");
+    gelc_emit(c, "    a = a %s b;", op);
+}
+
+
+static
+void gelc_op(GelcCompiler *c, const GelNativeOp *op)
+{
+    /* Indexed by the operators, from GEL_NATIVE_ADD */
+    static const gchar *const operators[] =
+    {
+        "+", "-", "*", "/", "%", ">", ">=", "==", "<=", "<", "!="
+    };
+
+    switch(op->code)
+    {
+        case GEL_NATIVE_CONSTANT:
+            if(op->operand == G_MININT64)
+                gelc_emit(c, "a = G_MININT64;");
+            else
+                gelc_emit(c, "a = G_GINT64_CONSTANT(%" G_GINT64_FORMAT ");",
+                    op->operand);
+            break;
+        case GEL_NATIVE_LOAD:
+            gelc_emit(c, "a = slots[%u];", (guint)op->operand);
+            break;
+        case GEL_NATIVE_STORE:
+            gelc_emit(c, "slots[%u] = a;", (guint)op->operand);
+            break;
+        case GEL_NATIVE_PUSH:
+            gelc_emit(c, "s%u = a;", c->n_stack++);
+            c->max_stack = MAX(c->max_stack, c->n_stack);
+            break;
+        case GEL_NATIVE_OPERAND:
+            c->has_operand = TRUE;
+            gelc_emit(c, "b = a;");
+            gelc_emit(c, "a = s%u;", --c->n_stack);
+            break;
+        case GEL_NATIVE_ADD:
+        case GEL_NATIVE_SUBTRACT:
+        case GEL_NATIVE_MULTIPLY:
+            /* Wraps around as the interpreter does */
+            gelc_emit(c, "a = (gint64)((guint64)a %s (guint64)b);",
+                operators[op->code - GEL_NATIVE_ADD]);
+            break;
+        case GEL_NATIVE_DIVIDE:
+        case GEL_NATIVE_MODULO:
+            gelc_division(c, op->code, op->operand);
+            break;
+        case GEL_NATIVE_GREATER:
+        case GEL_NATIVE_GREATER_EQUAL:
+        case GEL_NATIVE_EQUAL:
+        case GEL_NATIVE_LESS_EQUAL:
+        case GEL_NATIVE_LESS:
+        case GEL_NATIVE_NOT_EQUAL:
+            gelc_emit(c, "a = (a %s b);",
+                operators[op->code - GEL_NATIVE_ADD]);
+            break;
+        case GEL_NATIVE_LABEL:
+            c->depth--;
+            gelc_emit(c, "l%u:;", (guint)op->operand);
+            c->depth++;
+            break;
+        case GEL_NATIVE_JUMP:
+            gelc_emit(c, "goto l%u;", (guint)op->operand);
+            break;
+        case GEL_NATIVE_JUMP_IF_FALSE:
+            gelc_emit(c, "if(a == 0)");
+            gelc_emit(c, "    goto l%u;", (guint)op->operand);
+            break;
+        case GEL_NATIVE_CALL:
+            gelc_call(c, op->operand);
+            break;
+    }
+}
+
+
+/*
+ * Translates the function defined by the top-level form @value to a
+ * GelModuleFunc called gel_module_function@index, appending it to
+ * @module, and its entry of the table of functions to @table.
+ * Names defined by the script are defined in @context, so they do not
+ * refer to their predefined values. Returns FALSE if the function can
+ * not be translated.
+ */
+static
+gboolean gelc_function(GelContext *context, guint form, const GValue *value,
+                       guint index, GString *module, GString *table)
+{
+    const GelValueArray *array = gel_value_get_boxed(value);
+    const GValue *values = gel_value_array_get_values(array);
+    guint n_values = gel_value_array_get_n_values(array);
+
+    if(n_values < 4 || !GEL_VALUE_HOLDS(values + 2, GEL_TYPE_VALUE_ARRAY))
+        return FALSE;
+
+    gchar *variadic = NULL;
+    gchar *invalid = NULL;
+    GList *args = gel_args_from_array(gel_value_get_boxed(values + 2),
+        &variadic, &invalid);
+
+    GelValueArray *code = gel_value_array_new(n_values - 3);
+    for(guint i = 3; i < n_values; i++)
+        gel_value_array_append(code, values + i);
+
+    GelNative *native = NULL;
+    if(variadic == NULL && invalid == NULL)
+        native = gel_native_new(args, code, context);
+
+    g_list_foreach(args, (GFunc)g_free, NULL);
+    g_list_free(args);
+    g_free(variadic);
+    g_free(invalid);
+    gel_value_array_free(code);
+
+    if(native == NULL)
+        return FALSE;
+
+    GelcCompiler c = {0};
+    c.native = native;
+    c.code = g_string_new(NULL);
+    c.depth = 1;
+
+    for(guint i = 0; i < native->ops->len; i++)
+        gelc_op(&c, &g_array_index(native->ops, GelNativeOp, i));
+
+    g_string_append_printf(module,
+        "static\n"
+        "GelModuleStatus gel_module_function%u(gint64 *slots,"
+        " gint64 *result,\n"
+        "    GelContext *context, GelModuleCall * const *calls)\n"
+        "{\n"
+        "    gint64 a = 0;\n", index);
+    if(c.has_operand)
+        g_string_append(module, "    gint64 b = 0;\n");
+    for(guint i = 0; i < c.max_stack; i++)
+        g_string_append_printf(module, "    gint64 s%u = 0;\n", i);
+    if(c.has_calls)
+        g_string_append(module, "    GelModuleStatus status;\n");
+
+    g_string_append_printf(module,
+        "\n"
+        "%s"
+        "\n"
+        "    *result = a;\n"
+        "    return GEL_MODULE_DONE;\n"
+        "}\n\n\n", c.code->str);
+
+    g_string_append_printf(table, "    {%u, ", form);
+    gelc_quote(table, gelc_symbol_name(values + 1));
+    g_string_append_printf(table, ", %uU, gel_module_function%u},\n",
+        gel_native_get_checksum(native), index);
+
+    g_string_free(c.code, TRUE);
+    gel_native_free(native);
+
+    return TRUE;
+}
+
+
+/*
+ * Gets the name defined by the top-level form @value, if it is a call
+ * to define or to function with a name, or NULL otherwise.
+ */
+static
+const gchar* gelc_form_defines(const GValue *value, gboolean *is_function)
+{
+    if(!GEL_VALUE_HOLDS(value, GEL_TYPE_VALUE_ARRAY))
+        return NULL;
+
+    const GelValueArray *array = gel_value_get_boxed(value);
+    const GValue *values = gel_value_array_get_values(array);
+    if(gel_value_array_get_n_values(array) < 2)
+        return NULL;
+
+    const gchar *name = gelc_symbol_name(values + 0);
+    if(g_strcmp0(name, "define") != 0 && g_strcmp0(name, "function") != 0)
+        return NULL;
+
+    *is_function = (strcmp(name, "function") == 0);
+    return gelc_symbol_name(values + 1);
+}
+
+
+/* Writes to @output the C source code of the module made from @file */
+static
+gboolean gelc_compile(const gchar *file, const gchar *output, GError **error)
+{
+    gchar *source = NULL;
+    if(!g_file_get_contents(file, &source, NULL, error))
+        return FALSE;
+
+    GelValueArray *array = gel_parse_file(file, error);
+    if(array == NULL)
+    {
+        g_free(source);
+        return FALSE;
+    }
+
+    const GValue *forms = gel_value_array_get_values(array);
+    guint n_forms = gel_value_array_get_n_values(array);
+
+    /* Only names defined once surely refer to the function defining them,
+       and names the script defines do not refer to predefined values */
+    GHashTable *definitions = g_hash_table_new(g_str_hash, g_str_equal);
+    GelContext *context = gel_context_new();
+    for(guint i = 0; i < n_forms; i++)
+    {
+        gboolean is_function = FALSE;
+        const gchar *name = gelc_form_defines(forms + i, &is_function);
+        if(name == NULL)
+            continue;
+
+        guint n_definitions =
+            GPOINTER_TO_UINT(g_hash_table_lookup(definitions, name));
+        g_hash_table_insert(definitions, (gpointer)name,
+            GUINT_TO_POINTER(n_definitions + 1));
+
+        if(n_definitions == 0)
+            gel_context_define(context, name,
+                gel_value_new_of_type(G_TYPE_BOOLEAN));
+    }
+
+    GString *module = g_string_new(
+        "/* Made by gelc, do not edit */\n\n"
+        "#include <gmodule.h>\n"
+        "#include <gel.h>\n\n\n");
+    GString *table = g_string_new(NULL);
+    guint n_functions = 0;
+
+    for(guint i = 0; i < n_forms; i++)
+    {
+        gboolean is_function = FALSE;
+        const gchar *name = gelc_form_defines(forms + i, &is_function);
+
+        if(name == NULL || !is_function || GPOINTER_TO_UINT(
+                g_hash_table_lookup(definitions, name)) != 1)
+            continue;
+
+        if(gelc_function(context, i, forms + i, n_functions, module, table))
+            n_functions++;
+        else
+            g_printerr("%s: %s is interpreted\n", file, name);
+    }
+
+    g_string_append(module, "static const gchar gel_module_source[] =\n");
+    gchar **lines = g_strsplit(source, "\n", -1);
+    for(guint i = 0; lines[i] != NULL; i++)
+    {
+        if(lines[i + 1] == NULL && lines[i][0] == 0)
+            break;
+
+        gchar *line = (lines[i + 1] != NULL) ?
+            g_strconcat(lines[i], "\n", NULL) : g_strdup(lines[i]);
+        g_string_append(module, "    ");
+        gelc_quote(module, line);
+        g_string_append(module, "\n");
+        g_free(line);
+    }
+    g_string_append(module, "    \"\";\n\n");
+    g_strfreev(lines);
+
+    if(n_functions > 0)
+        g_string_append_printf(module,
+            "static const GelModuleFunction gel_module_functions[] =\n"
+            "{\n%s};\n\n", table->str);
+
+    g_string_append(module,
+        "G_MODULE_EXPORT const GelModule gel_module =\n"
+        "{\n"
+        "    GEL_MODULE_VERSION,\n"
+        "    ");
+    gelc_quote(module, file);
+    g_string_append_printf(module,
+        ",\n"
+        "    gel_module_source,\n"
+        "    %u,\n"
+        "    %s\n"
+        "};\n\n", n_functions,
+        (n_functions > 0) ? "gel_module_functions" : "NULL");
+
+    gboolean result =
+        g_file_set_contents(output, module->str, module->len, error);
+
+    g_string_free(table, TRUE);
+    g_string_free(module, TRUE);
+    gel_context_free(context);
+    g_hash_table_unref(definitions);
+    gel_value_array_free(array);
+    g_free(source);
+
+    return result;
+}
+
+
+int main(int argc, char *argv[])
+{
+    g_type_init();
+
+    if(argc != 3)
+    {
+        g_printerr("usage: %s script.gel module.c\n", argv[0]);
+        return 1;
+    }
+
+    GError *error = NULL;
+    if(!gelc_compile(argv[1], argv[2], &error))
+    {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+
+    return 0;
+}